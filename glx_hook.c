@@ -15,10 +15,23 @@
 
 #ifdef GH_CONTEXT_TRACKING
 #include <time.h>	/* for clock_gettime */
+#include <sys/syscall.h> /* for SYS_gettid */
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>	/* for sched_getcpu */
+#include <sys/resource.h> /* for getrusage */
+#include <signal.h>	/* for the profiler */
+#include <execinfo.h>	/* for backtrace(3) */
+#include <sys/mman.h>
+#include <sys/prctl.h>	/* for the timer slack */
+#include <linux/perf_event.h>
 #include <GL/glext.h>
 #endif
 
 #include "dlsym_wrapper.h"
+#ifdef GH_CONTEXT_TRACKING
+#include "glx_hook_record.h"
+#endif
 
 #ifdef __GLIBC__
 #if (__GLIBC__ > 2) || ( (__GLIBC__ == 2 ) && (__GLIBC_MINOR__ >= 34))
@@ -105,6 +118,103 @@ get_envui(const char *name, unsigned int def)
 	return i;
 }
 
+static uint64_t
+get_time_ns(clockid_t clk)
+{
+	struct timespec ts;
+
+	clock_gettime(clk, &ts);
+	return (uint64_t)ts.tv_sec * (uint64_t)1000000000UL + (uint64_t)ts.tv_nsec;
+}
+
+/* comparison function for qsort(3) */
+static int
+compare_u64(const void *a, const void *b)
+{
+	uint64_t x=*(const uint64_t*)a;
+	uint64_t y=*(const uint64_t*)b;
+	return (x>y) - (x<y);
+}
+
+/* write /proc/self/maps, if it changed since the last time */
+static void
+write_maps(FILE *file, uint64_t *maps_hash)
+{
+	char buf[4096];
+	char *maps=NULL;
+	size_t len=0,n,i;
+	uint64_t hash=14695981039346656037ULL; /* FNV-1a */
+	FILE *f=fopen("/proc/self/maps", "rt");
+
+	if (!f) {
+		return;
+	}
+	while ( (n=fread(buf, 1, sizeof(buf), f)) > 0) {
+		char *m=realloc(maps, len + n + 1);
+		if (!m) {
+			break;
+		}
+		maps=m;
+		memcpy(maps + len, buf, n);
+		len += n;
+	}
+	fclose(f);
+	if (!maps) {
+		return;
+	}
+	maps[len]=0;
+	for (i=0; i<len; i++) {
+		hash=(hash ^ (uint64_t)(unsigned char)maps[i]) * 1099511628211ULL;
+	}
+	if (hash != *maps_hash) {
+		char *line=maps;
+		while (*line) {
+			char *end=strchr(line, '\n');
+			if (end) {
+				*end=0;
+			}
+			fprintf(file, "# map %s\n", line);
+			if (!end) {
+				break;
+			}
+			line=end+1;
+		}
+		*maps_hash=hash;
+	}
+	free(maps);
+}
+
+/* sleep until the absolute time t of clock clk */
+static void
+sleep_until_ns(clockid_t clk, uint64_t t)
+{
+	struct timespec ts;
+
+	ts.tv_sec=(time_t)(t / (uint64_t)1000000000UL);
+	ts.tv_nsec=(long)(t % (uint64_t)1000000000UL);
+	while (clock_nanosleep(clk, TIMER_ABSTIME, &ts, NULL) == EINTR);
+}
+
+/* sleep until the absolute time t of CLOCK_MONOTONIC with the minimal
+ * timer slack, and spin for the last spin ns */
+static void
+sleep_until_precise_ns(uint64_t t, uint64_t spin)
+{
+	uint64_t now=get_time_ns(CLOCK_MONOTONIC);
+
+	if (now < t && t - now > spin) {
+		int slack=prctl(PR_GET_TIMERSLACK, 0, 0, 0, 0);
+		if (slack > 1) {
+			prctl(PR_SET_TIMERSLACK, 1UL, 0, 0, 0);
+		}
+		sleep_until_ns(CLOCK_MONOTONIC, t - spin);
+		if (slack > 1) {
+			prctl(PR_SET_TIMERSLACK, (unsigned long)slack, 0, 0, 0);
+		}
+	}
+	while (get_time_ns(CLOCK_MONOTONIC) < t);
+}
+
 #endif
 
 static size_t
@@ -411,6 +521,7 @@ static void * (* volatile GH_dlvsym)(void *, const char*, const char *)=NULL;
 static GH_fptr (* volatile GH_glXGetProcAddress)(const char*)=NULL;
 static GH_fptr (* volatile GH_glXGetProcAddressARB)(const char *)=NULL;
 static void (* volatile GH_glXSwapBuffers)(Display *, GLXDrawable);
+static int64_t (* volatile GH_glXSwapBuffersMscOML)(Display *, GLXDrawable, int64_t, int64_t, int64_t);
 static void (* volatile GH_glXSwapIntervalEXT)(Display *, GLXDrawable, int);
 static int (* volatile GH_glXSwapIntervalSGI)(int);
 static int (* volatile GH_glXSwapIntervalMESA)(unsigned int);
@@ -430,6 +541,77 @@ static void (* volatile GH_glDebugMessageCallbackARB)(GLDEBUGPROC, const GLvoid*
 static void (* volatile GH_glDebugMessageCallbackKHR)(GLDEBUGPROC, const GLvoid*);
 static void (* volatile GH_glDebugMessageCallbackAMD)(GLDEBUGPROCAMD, GLvoid*);
 
+static void (* volatile GH_glPushDebugGroup)(GLenum, GLuint, GLsizei, const GLchar *);
+static void (* volatile GH_glPopDebugGroup)(void);
+static void (* volatile GH_glPushGroupMarkerEXT)(GLsizei, const GLchar *);
+static void (* volatile GH_glPopGroupMarkerEXT)(void);
+static void (* volatile GH_glInsertEventMarkerEXT)(GLsizei, const GLchar *);
+static void (* volatile GH_glDebugMessageInsert)(GLenum, GLenum, GLuint, GLenum, GLsizei, const GLchar *);
+static void (* volatile GH_glDebugMessageInsertARB)(GLenum, GLenum, GLuint, GLenum, GLsizei, const GLchar *);
+static void (* volatile GH_glStringMarkerGREMEDY)(GLsizei, const void *);
+
+static void (* volatile GH_glCompileShader)(GLuint);
+static void (* volatile GH_glCompileShaderARB)(GLhandleARB);
+static void (* volatile GH_glLinkProgram)(GLuint);
+static void (* volatile GH_glLinkProgramARB)(GLhandleARB);
+
+static void (* volatile GH_glTexImage1D)(GLenum, GLint, GLint, GLsizei, GLint, GLenum, GLenum, const GLvoid *);
+static void (* volatile GH_glTexImage2D)(GLenum, GLint, GLint, GLsizei, GLsizei, GLint, GLenum, GLenum, const GLvoid *);
+static void (* volatile GH_glTexImage3D)(GLenum, GLint, GLint, GLsizei, GLsizei, GLsizei, GLint, GLenum, GLenum, const GLvoid *);
+static void (* volatile GH_glTexSubImage1D)(GLenum, GLint, GLint, GLsizei, GLenum, GLenum, const GLvoid *);
+static void (* volatile GH_glTexSubImage2D)(GLenum, GLint, GLint, GLint, GLsizei, GLsizei, GLenum, GLenum, const GLvoid *);
+static void (* volatile GH_glTexSubImage3D)(GLenum, GLint, GLint, GLint, GLint, GLsizei, GLsizei, GLsizei, GLenum, GLenum, const GLvoid *);
+static void (* volatile GH_glCompressedTexImage1D)(GLenum, GLint, GLenum, GLsizei, GLint, GLsizei, const GLvoid *);
+static void (* volatile GH_glCompressedTexImage2D)(GLenum, GLint, GLenum, GLsizei, GLsizei, GLint, GLsizei, const GLvoid *);
+static void (* volatile GH_glCompressedTexImage3D)(GLenum, GLint, GLenum, GLsizei, GLsizei, GLsizei, GLint, GLsizei, const GLvoid *);
+static void (* volatile GH_glCompressedTexSubImage1D)(GLenum, GLint, GLint, GLsizei, GLenum, GLsizei, const GLvoid *);
+static void (* volatile GH_glCompressedTexSubImage2D)(GLenum, GLint, GLint, GLint, GLsizei, GLsizei, GLenum, GLsizei, const GLvoid *);
+static void (* volatile GH_glCompressedTexSubImage3D)(GLenum, GLint, GLint, GLint, GLint, GLsizei, GLsizei, GLsizei, GLenum, GLsizei, const GLvoid *);
+static void (* volatile GH_glBufferData)(GLenum, GLsizeiptr, const void *, GLenum);
+static void (* volatile GH_glBufferSubData)(GLenum, GLintptr, GLsizeiptr, const void *);
+static void * (* volatile GH_glMapBuffer)(GLenum, GLenum);
+static void * (* volatile GH_glMapBufferRange)(GLenum, GLintptr, GLsizeiptr, GLbitfield);
+static void (* volatile GH_glFlushMappedBufferRange)(GLenum, GLintptr, GLsizeiptr);
+static void (* volatile GH_glGetBufferParameteriv)(GLenum, GLenum, GLint *);
+static void (* volatile GH_glBufferDataARB)(GLenum, GLsizeiptrARB, const void *, GLenum);
+static void (* volatile GH_glBufferSubDataARB)(GLenum, GLintptrARB, GLsizeiptrARB, const void *);
+static void * (* volatile GH_glMapBufferARB)(GLenum, GLenum);
+static void (* volatile GH_glTextureSubImage1D)(GLuint, GLint, GLint, GLsizei, GLenum, GLenum, const void *);
+static void (* volatile GH_glTextureSubImage2D)(GLuint, GLint, GLint, GLint, GLsizei, GLsizei, GLenum, GLenum, const void *);
+static void (* volatile GH_glTextureSubImage3D)(GLuint, GLint, GLint, GLint, GLint, GLsizei, GLsizei, GLsizei, GLenum, GLenum, const void *);
+static void (* volatile GH_glCompressedTextureSubImage1D)(GLuint, GLint, GLint, GLsizei, GLenum, GLsizei, const void *);
+static void (* volatile GH_glCompressedTextureSubImage2D)(GLuint, GLint, GLint, GLint, GLsizei, GLsizei, GLenum, GLsizei, const void *);
+static void (* volatile GH_glCompressedTextureSubImage3D)(GLuint, GLint, GLint, GLint, GLint, GLsizei, GLsizei, GLsizei, GLenum, GLsizei, const void *);
+static void (* volatile GH_glNamedBufferData)(GLuint, GLsizeiptr, const void *, GLenum);
+static void (* volatile GH_glNamedBufferSubData)(GLuint, GLintptr, GLsizeiptr, const void *);
+static void * (* volatile GH_glMapNamedBuffer)(GLuint, GLenum);
+static void * (* volatile GH_glMapNamedBufferRange)(GLuint, GLintptr, GLsizeiptr, GLbitfield);
+static void (* volatile GH_glFlushMappedNamedBufferRange)(GLuint, GLintptr, GLsizeiptr);
+static void (* volatile GH_glGetNamedBufferParameteriv)(GLuint, GLenum, GLint *);
+static void (* volatile GH_glTexStorage1D)(GLenum, GLsizei, GLenum, GLsizei);
+static void (* volatile GH_glTexStorage2D)(GLenum, GLsizei, GLenum, GLsizei, GLsizei);
+static void (* volatile GH_glTexStorage3D)(GLenum, GLsizei, GLenum, GLsizei, GLsizei, GLsizei);
+static void (* volatile GH_glBufferStorage)(GLenum, GLsizeiptr, const void *, GLbitfield);
+static void (* volatile GH_glRenderbufferStorage)(GLenum, GLenum, GLsizei, GLsizei);
+static void (* volatile GH_glRenderbufferStorageMultisample)(GLenum, GLsizei, GLenum, GLsizei, GLsizei);
+static void (* volatile GH_glDeleteTextures)(GLsizei, const GLuint *);
+static void (* volatile GH_glDeleteBuffers)(GLsizei, const GLuint *);
+static void (* volatile GH_glDeleteRenderbuffers)(GLsizei, const GLuint *);
+static void (* volatile GH_glTexImage2DMultisample)(GLenum, GLsizei, GLenum, GLsizei, GLsizei, GLboolean);
+static void (* volatile GH_glTexImage3DMultisample)(GLenum, GLsizei, GLenum, GLsizei, GLsizei, GLsizei, GLboolean);
+static void (* volatile GH_glTexStorage2DMultisample)(GLenum, GLsizei, GLenum, GLsizei, GLsizei, GLboolean);
+static void (* volatile GH_glTexStorage3DMultisample)(GLenum, GLsizei, GLenum, GLsizei, GLsizei, GLsizei, GLboolean);
+static void (* volatile GH_glGenerateMipmap)(GLenum);
+static void (* volatile GH_glGenerateMipmapEXT)(GLenum);
+static void (* volatile GH_glGenerateTextureMipmap)(GLuint);
+static void (* volatile GH_glReadPixels)(GLint, GLint, GLsizei, GLsizei, GLenum, GLenum, GLvoid *);
+static void (* volatile GH_glGetTexImage)(GLenum, GLint, GLenum, GLenum, GLvoid *);
+static void (* volatile GH_glGetBufferSubData)(GLenum, GLintptr, GLsizeiptr, void *);
+static void (* volatile GH_glGetQueryObjectiv)(GLuint, GLenum, GLint *);
+static void (* volatile GH_glGetQueryObjectuiv)(GLuint, GLenum, GLuint *);
+static void (* volatile GH_glGetQueryObjecti64v)(GLuint, GLenum, GLint64 *);
+static void (* volatile GH_glClear)(GLbitfield);
+
 /* function pointers we just might qeury */
 static void (* volatile GH_glFlush)(void);
 static void (* volatile GH_glFinish)(void);
@@ -437,6 +619,7 @@ static void (* volatile GH_glFinish)(void);
 static GLXFBConfig* (* volatile GH_glXGetFBConfigs)(Display*, int, int*);
 static int (* volatile GH_glXGetFBConfigAttrib)(Display*, GLXFBConfig, int, int*);
 static int (* volatile GH_XFree)(void*);
+static Bool (* volatile GH_glXGetSyncValuesOML)(Display *, GLXDrawable, int64_t *, int64_t *, int64_t *);
 
 #ifdef GH_CONTEXT_TRACKING
 /* OpenGL extension functions we might query */
@@ -448,6 +631,31 @@ static PFNGLGETQUERYOBJECTUI64VPROC GH_glGetQueryObjectui64v=NULL;
 static PFNGLFENCESYNCPROC GH_glFenceSync=NULL;
 static PFNGLDELETESYNCPROC GH_glDeleteSync=NULL;
 static PFNGLCLIENTWAITSYNCPROC GH_glClientWaitSync=NULL;
+static PFNGLGETSTRINGIPROC GH_glGetStringi=NULL;
+static const GLubyte * (* volatile GH_glGetString)(GLenum);
+static void (* volatile GH_glGetIntegerv)(GLenum, GLint *);
+
+/* synchronous Xlib and GLX queries */
+static int (* volatile GH_XSync)(Display*, Bool);
+static Status (* volatile GH_XGetWindowAttributes)(Display*, Window, XWindowAttributes*);
+static Bool (* volatile GH_XQueryPointer)(Display*, Window, Window*, Window*, int*, int*, int*, int*, unsigned int*);
+static Status (* volatile GH_XGetGeometry)(Display*, Drawable, Window*, int*, int*, unsigned int*, unsigned int*, unsigned int*, unsigned int*);
+static Bool (* volatile GH_XTranslateCoordinates)(Display*, Window, Window, int, int, int*, int*, Window*);
+static int (* volatile GH_XGetInputFocus)(Display*, Window*, int*);
+static Status (* volatile GH_XQueryTree)(Display*, Window, Window*, Window*, Window**, unsigned int*);
+static Atom (* volatile GH_XInternAtom)(Display*, const char*, Bool);
+static void (* volatile GH_glXQueryDrawable)(Display*, GLXDrawable, int, unsigned int*);
+
+/* Xlib functions consuming events */
+static int (* volatile GH_XNextEvent)(Display*, XEvent*);
+static int (* volatile GH_XWindowEvent)(Display*, Window, long, XEvent*);
+static int (* volatile GH_XMaskEvent)(Display*, long, XEvent*);
+static int (* volatile GH_XIfEvent)(Display*, XEvent*, Bool (*)(Display*, XEvent*, XPointer), XPointer);
+static Bool (* volatile GH_XCheckWindowEvent)(Display*, Window, long, XEvent*);
+static Bool (* volatile GH_XCheckMaskEvent)(Display*, long, XEvent*);
+static Bool (* volatile GH_XCheckTypedEvent)(Display*, int, XEvent*);
+static Bool (* volatile GH_XCheckTypedWindowEvent)(Display*, Window, int, XEvent*);
+static Bool (* volatile GH_XCheckIfEvent)(Display*, XEvent*, Bool (*)(Display*, XEvent*, XPointer), XPointer);
 #endif /* GH_CONTEXT_TRACKING */
 
 /* Resolve an unintercepted symbol via the original dlsym() */
@@ -591,1983 +799,8982 @@ GH_get_gl_proc(const char *name)
 	(void)0
 
 /***************************************************************************
- * LATENCY LIMITER                                                         *
+ * TRACE EVENT OUTPUT                                                      *
  ***************************************************************************/
 
+/* Events in the Chrome trace event JSON format, which can be loaded
+ * into Perfetto or chrome://tracing. The events are formatted by the
+ * threads generating them into a buffer, and a background thread
+ * writes them to the file, so that the rendering threads never block on
+ * file I/O. If the buffer is full, events are dropped. */
 
-/* we support different modes for the frame time measurements */
-typedef enum {
-	GH_LATENCY_NOP=-2,		/* do nothing */
-	GH_LATENCY_FINISH_AFTER,	/* force a finish after buffer swaps */
-	GH_LATENCY_FINISH_BEFORE,	/* force a finish before buffer swaps */
-	/* values above 0 indicate use of GL_ARB_sync to limit to n frames */
-} GH_latency_mode;
+/* synthetic thread IDs for the per-context tracks */
+#define GH_TRACE_TID_CTX(num)	(0x1000000 + (int)(num))
+#define GH_TRACE_TID_GPU(num)	(0x2000000 + (int)(num))
+
+#define GH_TRACE_EVENT_MAX	1024
 
 typedef struct {
-	int latency;
-	GLsync *sync_object;
-	unsigned int cur_pos;
-	unsigned int flags;
-	GLuint64 gl_wait_timeout;
-	GLuint64 gl_wait_interval;
-	useconds_t self_wait_interval;
-} GH_latency;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	pthread_once_t once;
+	FILE *file;
+	char *buf[2];			/* double buffer: one is filled, one is written */
+	size_t size;			/* size of each buffer */
+	size_t fill;			/* fill level of the active buffer */
+	unsigned int active;		/* index of the active buffer */
+	unsigned long events;		/* number of events so far */
+	unsigned long dropped;		/* number of dropped events */
+	uint64_t base;			/* time base of the trace in ns */
+	pthread_t thread;
+	int stop;
+} GH_trace_t;
+
+static GH_trace_t trace = {
+	.mutex = PTHREAD_MUTEX_INITIALIZER,
+	.cond = PTHREAD_COND_INITIALIZER,
+	.once = PTHREAD_ONCE_INIT,
+	.file = NULL,
+};
 
-/* latency flags */
-#define GH_LATENCY_FLAG_MANUAL_WAIT	0x1
+static __thread int trace_thread_named = 0;
 
-static int
-latency_gl_init()
+static void *
+trace_thread(void *arg)
 {
-	GH_GET_GL_PROC_OR_FAIL(glFenceSync, GH_MSG_WARNING, -1);
-	GH_GET_GL_PROC_OR_FAIL(glDeleteSync, GH_MSG_WARNING, -1);
-	GH_GET_GL_PROC_OR_FAIL(glClientWaitSync, GH_MSG_WARNING, -1);
-	return 0;
+	(void)arg;
+	pthread_mutex_lock(&trace.mutex);
+	while (1) {
+		struct timespec deadline;
+		size_t fill;
+		char *buf;
+		int stop;
+
+		/* write out the data at least every 100ms */
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		deadline.tv_nsec += 100000000L;
+		if (deadline.tv_nsec >= 1000000000L) {
+			deadline.tv_nsec -= 1000000000L;
+			deadline.tv_sec++;
+		}
+		while (!trace.stop && trace.fill < trace.size/2) {
+			if (pthread_cond_timedwait(&trace.cond, &trace.mutex, &deadline)) {
+				break;
+			}
+		}
+		buf=trace.buf[trace.active];
+		fill=trace.fill;
+		stop=trace.stop;
+		trace.active ^= 1;
+		trace.fill=0;
+		pthread_mutex_unlock(&trace.mutex);
+		if (fill) {
+			fwrite(buf, fill, 1, trace.file);
+			fflush(trace.file);
+		}
+		if (stop) {
+			break;
+		}
+		pthread_mutex_lock(&trace.mutex);
+	}
+	return NULL;
 }
 
 static void
-latency_init(GH_latency *lat, int latency, int manual_wait, unsigned gl_wait_timeout_usecs, unsigned int gl_wait_interval_usecs, unsigned int self_wait_interval_usecs)
+trace_shutdown(void)
 {
-	lat->latency=latency;
-	lat->sync_object=NULL;
-	lat->cur_pos=0;
-	lat->flags=0;
-	lat->gl_wait_timeout=(GLuint64)gl_wait_timeout_usecs * (GLuint64)1000;
-	lat->gl_wait_interval=(GLuint64)gl_wait_interval_usecs * (GLuint64)1000;
-	lat->self_wait_interval=(useconds_t)self_wait_interval_usecs;
+	pthread_mutex_lock(&trace.mutex);
+	trace.stop=1;
+	pthread_cond_signal(&trace.cond);
+	pthread_mutex_unlock(&trace.mutex);
+	pthread_join(trace.thread, NULL);
+	/* the writer thread did write out the last buffer */
+	fputs("\n]\n", trace.file);
+	fclose(trace.file);
+	if (trace.dropped) {
+		GH_verbose(GH_MSG_WARNING, "trace: dropped %lu of %lu events, consider increasing GH_TRACE_BUFFER_KB\n",
+				trace.dropped, trace.events + trace.dropped);
+	}
+	trace.file=NULL;
+}
 
-	if (manual_wait > 0) {
-		lat->flags |= GH_LATENCY_FLAG_MANUAL_WAIT;
-	} else if (manual_wait < 0) {
-		if ((gl_wait_interval_usecs > 0) || (self_wait_interval_usecs > 0))  {
-			lat->flags |= GH_LATENCY_FLAG_MANUAL_WAIT;
-		}
+static void
+trace_init(void)
+{
+	const char *file=getenv("GH_TRACE_FILE");
+	FILE *f;
+	char buf[PATH_MAX];
+
+	if (!file || !file[0]) {
+		return;
+	}
+	parse_name(buf, sizeof(buf), file, 0);
+	f=fopen(buf, "wt");
+	if (!f) {
+		GH_verbose(GH_MSG_WARNING, "trace: failed to open '%s'\n", buf);
+		return;
+	}
+	trace.size=(size_t)get_envui("GH_TRACE_BUFFER_KB", 1024) * 1024;
+	if (trace.size < 2*GH_TRACE_EVENT_MAX) {
+		trace.size = 2*GH_TRACE_EVENT_MAX;
+	}
+	trace.buf[0]=malloc(trace.size);
+	trace.buf[1]=malloc(trace.size);
+	if (!trace.buf[0] || !trace.buf[1]) {
+		GH_verbose(GH_MSG_WARNING, "trace: out of memory\n");
+		free(trace.buf[0]);
+		free(trace.buf[1]);
+		fclose(f);
+		return;
+	}
+	fputs("[\n", f);
+	trace.file=f;
+	trace.fill=0;
+	trace.active=0;
+	trace.events=0;
+	trace.dropped=0;
+	trace.stop=0;
+	trace.base=get_time_ns(CLOCK_REALTIME);
+	if (pthread_create(&trace.thread, NULL, trace_thread, NULL)) {
+		GH_verbose(GH_MSG_WARNING, "trace: failed to create writer thread\n");
+		trace.file=NULL;
+		free(trace.buf[0]);
+		free(trace.buf[1]);
+		trace.buf[0]=NULL;
+		trace.buf[1]=NULL;
+		fclose(f);
+		return;
 	}
+	atexit(trace_shutdown);
+	GH_verbose(GH_MSG_INFO, "trace: writing trace events to '%s'\n", buf);
+}
 
-	if (latency != GH_LATENCY_NOP) {
-		GH_verbose(GH_MSG_INFO, "setting up latency limiter mode %d\n", latency);
+static int
+trace_enabled(void)
+{
+	pthread_once(&trace.once, trace_init);
+	return (trace.file != NULL);
+}
+
+static int
+trace_tid(void)
+{
+	return (int)syscall(SYS_gettid);
+}
+
+/* append a single JSON event */
+static void
+trace_emit(const char *fmt, ...)
+{
+	char ev[GH_TRACE_EVENT_MAX];
+	va_list args;
+	size_t len;
+	int r;
+
+	va_start(args, fmt);
+	r=vsnprintf(ev+2, sizeof(ev)-2, fmt, args);
+	va_end(args);
+	if (r < 0 || (size_t)r >= sizeof(ev)-2) {
+		/* do not write truncated events */
+		pthread_mutex_lock(&trace.mutex);
+		trace.dropped++;
+		pthread_mutex_unlock(&trace.mutex);
+		return;
 	}
+	len=(size_t)r;
 
-	if (latency > 0) {
-		if (latency_gl_init()) {
-			lat->latency=GH_LATENCY_FINISH_BEFORE;
-			GH_verbose(GH_MSG_WARNING, "GPU sync not available, using latency mode %d\n",
-					GH_LATENCY_FINISH_BEFORE);
+	pthread_mutex_lock(&trace.mutex);
+	if (trace.file && trace.fill + len + 2 <= trace.size) {
+		const char *data=ev;
+		if (trace.events++) {
+			ev[0]=',';
+			ev[1]='\n';
+			len += 2;
+		} else {
+			data += 2;
+		}
+		memcpy(trace.buf[trace.active] + trace.fill, data, len);
+		trace.fill += len;
+		if (trace.fill >= trace.size/2) {
+			pthread_cond_signal(&trace.cond);
 		}
+	} else {
+		trace.dropped++;
 	}
+	pthread_mutex_unlock(&trace.mutex);
+}
 
-	if (lat->latency > 0) {
-		unsigned int cnt=(unsigned)lat->latency;
-		lat->sync_object=malloc(sizeof(*lat->sync_object) * cnt);
-		if (!lat->sync_object) {
-			lat->latency=GH_LATENCY_FINISH_BEFORE;
-			GH_verbose(GH_MSG_WARNING, "out of memory for sync objects, using latency mode %d\n");
+static double
+trace_ts(uint64_t t)
+{
+	return (double)(int64_t)(t - trace.base) / 1000.0;
+}
+
+/* escape a string for use in a JSON string */
+static void
+trace_escape(char *buf, size_t size, const char *str)
+{
+	size_t pos=0;
+
+	for (; *str && pos + 3 < size; str++) {
+		if (*str == '"' || *str == '\\') {
+			buf[pos++]='\\';
+			buf[pos++]=*str;
+		} else if ((unsigned char)*str < 0x20) {
+			buf[pos++]=' ';
 		} else {
-			unsigned int i;
-			for (i=0; i<cnt; i++) {
-				lat->sync_object[i]=NULL;
-			}
-			GH_verbose(GH_MSG_DEBUG, "enabling latency limiter: %d\n",lat->latency);
-			if (lat->flags & GH_LATENCY_FLAG_MANUAL_WAIT) {
-				GH_verbose(GH_MSG_INFO, "latency limiter with manual waits GL: %u usecs + self: %u usecs\n",
-						gl_wait_interval_usecs, self_wait_interval_usecs);
-			} else {
-				GH_verbose(GH_MSG_INFO, "latency limiter with timeout: %u usecs\n",
-						gl_wait_timeout_usecs);
-			}
+			buf[pos++]=*str;
 		}
 	}
+	buf[pos]=0;
 }
 
 static void
-latency_destroy(GH_latency *lat)
+trace_name_track(int tid, const char *name)
 {
-	if (lat) {
-		if (lat->sync_object && lat->latency > 0) {
-			unsigned int i;
-			for (i=0; i<(unsigned)lat->latency; i++) {
-				if (lat->sync_object[i]) {
-					GH_glDeleteSync(lat->sync_object[i]);
-				}
-			}
+	char escaped[128];
+
+	/* thread names are chosen by the application */
+	trace_escape(escaped, sizeof(escaped), name);
+	trace_emit("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+			(int)getpid(), tid, escaped);
+}
+
+/* make sure the current thread has a name in the trace */
+static int
+trace_thread_tid(void)
+{
+	int tid=trace_tid();
+
+	if (!trace_thread_named) {
+		char name[32];
+		char track[64];
+		if (pthread_getname_np(pthread_self(), name, sizeof(name))) {
+			name[0]=0;
 		}
+		snprintf(track, sizeof(track), "thread %d %s", tid, name);
+		trace_name_track(tid, track);
+		trace_thread_named=1;
 	}
+	return tid;
 }
 
 static void
-latency_before_swap(GH_latency *lat)
+trace_name_ctx_tracks(unsigned int ctx_num)
 {
-	GLsync sync;
+	char name[64];
 
-	switch(lat->latency) {
-		case GH_LATENCY_NOP:
-		case GH_LATENCY_FINISH_AFTER:
-			(void)lat;
-			break;
-		case GH_LATENCY_FINISH_BEFORE:
-			GH_glFinish();
-			break;
-		default:
-			if ( (sync=lat->sync_object[lat->cur_pos]) ) {
-				if (lat->flags & GH_LATENCY_FLAG_MANUAL_WAIT) {
-					/* check for the fence in a loop */
-					while(GH_glClientWaitSync(sync, GL_SYNC_FLUSH_COMMANDS_BIT, lat->gl_wait_interval) == GL_TIMEOUT_EXPIRED) {
-						if (lat->self_wait_interval) {
-							usleep(lat->self_wait_interval);
-						}
-					}
-				} else {
-					/* just wait for the fence */
-					GH_glClientWaitSync(sync, GL_SYNC_FLUSH_COMMANDS_BIT, lat->gl_wait_timeout);
-					/* NOTE: we do not care about the result */
-				}
-			}
+	snprintf(name, sizeof(name), "GL context %u", ctx_num);
+	trace_name_track(GH_TRACE_TID_CTX(ctx_num), name);
+	snprintf(name, sizeof(name), "GPU context %u", ctx_num);
+	trace_name_track(GH_TRACE_TID_GPU(ctx_num), name);
+}
+
+/* a span on the track of the calling thread */
+static void
+trace_span(const char *name, uint64_t t0, uint64_t t1)
+{
+	if (trace.file) {
+		trace_emit("{\"name\":\"%s\",\"cat\":\"gh\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%d}",
+				name, trace_ts(t0), (double)(int64_t)(t1-t0)/1000.0, (int)getpid(), trace_thread_tid());
 	}
 }
 
+/* a span on an arbitrary track, with a numeric argument */
 static void
-latency_after_swap(GH_latency *lat)
+trace_span_track(const char *name, uint64_t t0, uint64_t t1, int tid, const char *arg_name, long long arg)
 {
-	switch(lat->latency) {
-		case GH_LATENCY_NOP:
-		case GH_LATENCY_FINISH_BEFORE:
-			(void)lat;
-			break;
-		case GH_LATENCY_FINISH_AFTER:
-			GH_glFinish();
-			break;
-		default:
-			if ( (lat->sync_object[lat->cur_pos]) ) {
-				GH_glDeleteSync(lat->sync_object[lat->cur_pos]);
-			}
-			lat->sync_object[lat->cur_pos]=GH_glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
-			if (++lat->cur_pos == (unsigned)lat->latency) {
-				lat->cur_pos=0;
-			}
+	if (trace.file) {
+		trace_emit("{\"name\":\"%s\",\"cat\":\"gh\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%d,\"args\":{\"%s\":%lld}}",
+				name, trace_ts(t0), (double)(int64_t)(t1-t0)/1000.0, (int)getpid(), tid, arg_name, arg);
+	}
+}
+
+/* an instant event on the track of a context */
+static void
+trace_instant_ctx(const char *name, unsigned int ctx_num, const void *ptr)
+{
+	if (trace.file) {
+		trace_emit("{\"name\":\"%s\",\"cat\":\"gh\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%.3f,\"pid\":%d,\"tid\":%d,\"args\":{\"ctx\":\"%p\",\"thread\":%d}}",
+				name, trace_ts(get_time_ns(CLOCK_REALTIME)), (int)getpid(), GH_TRACE_TID_CTX(ctx_num), ptr, trace_thread_tid());
 	}
 }
 
 /***************************************************************************
- * FRAME TIMING MEASUREMENTS                                               *
+ * FLIGHT RECORDER                                                         *
  ***************************************************************************/
 
-/* we support different modes for the frame time measurements */
+/* Each context records the events of its most recent frames into a
+ * fixed-size ring buffer. When a frame is considerably slower than
+ * usual, the events of the last few frames are dumped to a file, so
+ * that rare hitches can be analyzed without logging every frame.
+ * Spans are forwarded to the TRACE EVENT OUTPUT, too. The GL calls
+ * glx_hook intercepts are counted per class and recorded at the end of
+ * each frame. */
+
 typedef enum {
-	GH_FRAMETIME_NONE=0,	/* do not measure any frame times */
-	GH_FRAMETIME_CPU,	/* measure only on CPU */
-	GH_FRAMETIME_CPU_GPU,	/* measure both on CPU and GPU */
-} GH_frametime_mode;
+	GH_EVENT_SWAP=0,
+	GH_EVENT_SWAP_OML,
+	GH_EVENT_SWAP_OMITTED,
+	GH_EVENT_SWAP_SLEEP,
+	GH_EVENT_LATENCY_BEFORE_SWAP,
+	GH_EVENT_LATENCY_AFTER_SWAP,
+	GH_EVENT_MAKE_CURRENT,
+	GH_EVENT_UNBOUND,
+	GH_EVENT_DEBUG_MESSAGE,
+	GH_EVENT_MARKER,
+	GH_EVENT_FRAME,
+	GH_EVENT_STALL,
+	GH_EVENT_FPS_LIMIT,
+	GH_EVENT_JIT_DELAY,
+	GH_EVENT_CALLS_MARKER,		/* one per GH_gl_call, in the same order */
+	GH_EVENT_CALLS_SHADER,
+	GH_EVENT_CALLS_SYNC,
+	GH_EVENT_CALLS_UPLOAD,
+	GH_EVENT_CALLS_MEMORY,
+	GH_EVENT_COUNT
+} GH_event_type;
+
+static const char *event_name[GH_EVENT_COUNT]={
+	"glXSwapBuffers",
+	"glXSwapBuffersMscOML",
+	"swap omitted",
+	"swap sleep",
+	"latency_before_swap",
+	"latency_after_swap",
+	"MakeCurrent",
+	"unbound",
+	"debug message",
+	"marker",
+	"frame",
+	"stall",
+	"fps limit",
+	"jit delay",
+	"GL calls: markers",
+	"GL calls: shaders",
+	"GL calls: readback/sync",
+	"GL calls: uploads",
+	"GL calls: memory"
+};
 
-/* a single timestamp */
-typedef struct {
-	struct timespec timestamp_cpu;	/* CPU timestamp */
-	GLuint64 timestamp_gl;		/* OpenGL timestamp (client side) */
-	GLuint query_object;		/* the OpenGL timer query object */
-} GH_timestamp;
+/* the classes of the intercepted GL calls counted per frame */
+typedef enum {
+	GH_CALL_MARKER=0,		/* debug groups and markers */
+	GH_CALL_SHADER,			/* shader compiles and program links */
+	GH_CALL_SYNC,			/* calls the stall detector times */
+	GH_CALL_UPLOAD,			/* calls the upload accounting sees */
+	GH_CALL_MEMORY,			/* calls the GPU memory tracking sees */
+	GH_CALL_COUNT
+} GH_gl_call;
 
-/* the _result_ of the measurement */
 typedef struct {
-	uint64_t cpu;
-	uint64_t gl;
-	uint64_t gpu;
-} GH_frametime;
-
-/* the complete state needed for frametime measurements */
+	uint64_t t0;			/* start, CLOCK_REALTIME */
+	uint64_t t1;			/* end, CLOCK_REALTIME */
+	unsigned int frame;
+	unsigned int type;		/* GH_event_type */
+	long long arg;
+} GH_flight_event;
+
+/* frames used for the rolling median */
+#define GH_MEDIAN_WINDOW	64
+/* update the median every n frames */
+#define GH_MEDIAN_UPDATE	16
+
+/* rolling median of the frame times, used to detect slow frames */
 typedef struct {
-	GH_frametime_mode mode;		/* the mode we are in */
-	unsigned int delay;		/* number of frames for delay */
-	unsigned int num_timestamps;	/* number of timestamps per frame */
-	unsigned int num_results;	/* number of frames to store results */
-	GH_timestamp *timestamp;	/* the array of timestamps, used as ring buffer */
-	unsigned int cur_pos;		/* the current frame in the delay ring buffer */
-	GH_frametime *frametime;	/* the array of frametimes */
-	unsigned int cur_result;	/* the current result index */
-	unsigned int frame;		/* the current frame */
-	FILE *dump;			/* the stream to dump the results to */
-} GH_frametimes;
-
-/* the probes we take each frame */
-typedef enum {
-	GH_FRAMETIME_BEFORE_SWAPBUFFERS=0,
-	GH_FRAMETIME_AFTER_SWAPBUFFERS,
-	GH_FRAMETIME_COUNT
-} GH_frametime_probe;
+	uint64_t window[GH_MEDIAN_WINDOW];
+	unsigned int count;
+	uint64_t median;
+} GH_median;
 
 static void
-timestamp_init(GH_timestamp *ts)
+median_add(GH_median *m, uint64_t dt)
 {
-	ts->query_object=0;
-	ts->timestamp_gl=0;
-	ts->timestamp_cpu.tv_sec=0;
-	ts->timestamp_cpu.tv_nsec=0;
+	m->window[m->count++ % GH_MEDIAN_WINDOW]=dt;
+	if (m->count >= GH_MEDIAN_WINDOW && !(m->count % GH_MEDIAN_UPDATE)) {
+		uint64_t sorted[GH_MEDIAN_WINDOW];
+		memcpy(sorted, m->window, sizeof(sorted));
+		qsort(sorted, GH_MEDIAN_WINDOW, sizeof(sorted[0]), compare_u64);
+		m->median=sorted[GH_MEDIAN_WINDOW/2];
+	}
 }
 
-static void
-timestamp_cleanup(GH_timestamp *ts)
+/* true if dt exceeds percent of the median, false as long as there is no median yet */
+static int
+median_exceeded(const GH_median *m, uint64_t dt, unsigned int percent)
 {
-	if (ts->query_object && GH_glDeleteQueries) {
-		GH_glDeleteQueries(1, &ts->query_object);
-		ts->query_object=0;
-	}
+	return (percent && m->count >= GH_MEDIAN_WINDOW && dt * 100 > m->median * percent);
 }
 
+typedef struct {
+	GH_flight_event *event;
+	unsigned int size;		/* power of two, 0 if disabled */
+	unsigned long long count;	/* number of events recorded so far */
+	unsigned int frame;		/* current frame */
+	unsigned int dump_frames;	/* number of frames to dump */
+	unsigned int next_dump;		/* first frame allowed to trigger a dump */
+	unsigned int dumps_left;
+	unsigned int median_percent;	/* relative threshold, 0 if disabled */
+	uint64_t threshold;		/* absolute threshold in ns, 0 if disabled */
+	uint64_t last_end;		/* end of the previous frame */
+	unsigned int calls[GH_CALL_COUNT];	/* intercepted GL calls in the current frame */
+	GH_median median;
+	char *name;			/* file name, opened at the first dump */
+	FILE *file;
+} GH_flight_recorder;
+
 static void
-timestamp_set(GH_timestamp *ts, GH_frametime *rs, GH_frametime_mode mode)
+flight_init(GH_flight_recorder *fr, unsigned int ctx_num)
 {
-	/* CPU */
-	/* collect previous result */
-	rs->cpu=(uint64_t)ts->timestamp_cpu.tv_sec * (uint64_t)1000000000UL
-		+ (uint64_t)ts->timestamp_cpu.tv_nsec;
-	/* new query */
-	clock_gettime(CLOCK_REALTIME, &ts->timestamp_cpu);
+	unsigned int frames=get_envui("GH_FLIGHT_RECORDER", 0);
+	unsigned int events;
 
-	/* GPU */
-	if (mode >= GH_FRAMETIME_CPU_GPU) {
-		/* collect previous result */
-		if (ts->query_object) {
-			GLuint64 value;
-			GH_glGetQueryObjectui64v(ts->query_object, GL_QUERY_RESULT, &value);
-			rs->gpu=(uint64_t)value;
-		} else {
-			GH_glGenQueries(1, &ts->query_object);
-		}
-		rs->gl=(uint64_t)(ts->timestamp_gl);
-		/* new query */
-		GH_glQueryCounter(ts->query_object, GL_TIMESTAMP);
-		GH_glGetInteger64v(GL_TIMESTAMP, (GLint64*)&ts->timestamp_gl);
+	memset(fr, 0, sizeof(*fr));
+	if (!frames) {
+		return;
 	}
+	events=get_envui("GH_FLIGHT_RECORDER_EVENTS", 4096);
+	for (fr->size=16; fr->size < events && fr->size < 0x10000000; fr->size <<= 1);
+	fr->event=malloc(sizeof(*fr->event) * fr->size);
+	if (!fr->event) {
+		GH_verbose(GH_MSG_WARNING, "flight recorder: out of memory\n");
+		fr->size=0;
+		return;
+	}
+	fr->dump_frames=frames;
+	fr->dumps_left=get_envui("GH_FLIGHT_RECORDER_MAX_DUMPS", 100);
+	fr->threshold=(uint64_t)get_envui("GH_FLIGHT_RECORDER_THRESHOLD_USECS", 0) * 1000ULL;
+	fr->median_percent=get_envui("GH_FLIGHT_RECORDER_MEDIAN_PERCENT", 200);
+	fr->name=malloc(PATH_MAX);
+	if (fr->name) {
+		parse_name(fr->name, PATH_MAX, get_envs("GH_FLIGHT_RECORDER_FILE", "glx_hook_flight-ctx%c.txt"), ctx_num);
+	}
+	GH_verbose(GH_MSG_INFO, "flight recorder: %u events, dumping %u frames\n", fr->size, frames);
 }
 
 static void
-frametime_init(GH_frametime *rs)
+flight_destroy(GH_flight_recorder *fr)
 {
-	rs->cpu = 0;
-	rs->gl  = 0;
-	rs->gpu = 0;
+	if (fr->file && fr->file != stderr) {
+		fclose(fr->file);
+	}
+	free(fr->name);
+	free(fr->event);
+	fr->event=NULL;
+	fr->name=NULL;
+	fr->file=NULL;
+	fr->size=0;
 }
 
-static int
-frametimes_gl_init()
+/* record an event, this might be called from other threads (debug messages) */
+static void
+flight_record(GH_flight_recorder *fr, GH_event_type type, uint64_t t0, uint64_t t1, long long arg)
 {
-	GH_GET_GL_PROC_OR_FAIL(glGenQueries, GH_MSG_WARNING, -1);
-	GH_GET_GL_PROC_OR_FAIL(glDeleteQueries, GH_MSG_WARNING, -1);
-	GH_GET_GL_PROC_OR_FAIL(glGetInteger64v, GH_MSG_WARNING, -1);
-	GH_GET_GL_PROC_OR_FAIL(glQueryCounter, GH_MSG_WARNING, -1);
-	GH_GET_GL_PROC_OR_FAIL(glGetQueryObjectui64v, GH_MSG_WARNING, -1);
-	return 0;
+	if (fr && fr->size) {
+		unsigned long long pos=__atomic_fetch_add(&fr->count, 1, __ATOMIC_RELAXED);
+		GH_flight_event *ev=&fr->event[pos & (fr->size-1)];
+		ev->t0=t0;
+		ev->t1=t1;
+		ev->frame=fr->frame;
+		ev->type=(unsigned int)type;
+		ev->arg=arg;
+	}
 }
 
+/* true if spans should be generated at all */
+#define GH_EVENTS_ENABLED(fr) (trace.file || ((fr) && (fr)->size))
+
+/* a span on the track of the calling thread, also recorded in the flight recorder */
 static void
-frametimes_init(GH_frametimes *ft, GH_frametime_mode mode, unsigned int delay, unsigned int num_timestamps, unsigned int num_results, unsigned int ctx_num)
+event_span(GH_flight_recorder *fr, GH_event_type type, uint64_t t0, uint64_t t1, long long arg)
 {
-	ft->cur_pos=0;
-	ft->cur_result=0;
-	ft->frame=0;
-	ft->dump=NULL;
+	trace_span(event_name[type], t0, t1);
+	flight_record(fr, type, t0, t1, arg);
+}
 
-	if (mode >= GH_FRAMETIME_CPU_GPU) {
-		if (frametimes_gl_init()) {
-			GH_verbose(GH_MSG_WARNING, "GPU timer queries not available, using CPU only\n");
-			mode = GH_FRAMETIME_CPU;
-		}
-	}
+static void
+flight_dump(GH_flight_recorder *fr, uint64_t t0, uint64_t dt)
+{
+	unsigned long long count=fr->count;
+	unsigned long long pos=(count > fr->size)?(count - fr->size):0;
+	unsigned int first=(fr->frame >= fr->dump_frames)?(fr->frame - fr->dump_frames + 1):0;
 
-	if (mode && delay && num_timestamps && num_results) {
-		ft->mode=mode;
-		ft->delay=delay;
-		ft->num_timestamps=num_timestamps;
-		ft->num_results=num_results;
-		if ((ft->frametime=malloc(sizeof(*ft->frametime) * (num_results+1) * num_timestamps))) {
-			if ((ft->timestamp=malloc(sizeof(*ft->timestamp) * delay * num_timestamps))) {
-				unsigned int i;
-				GH_verbose(GH_MSG_DEBUG, "enabling frametime measurements mode %d,  %u x %u timestamps\n",
-						(int)mode, delay, num_timestamps);
-				for (i=0; i<delay * num_timestamps; i++) {
-					timestamp_init(&ft->timestamp[i]);
-				}
-			} else {
-				GH_verbose(GH_MSG_WARNING, "failed to allocate memory for %u x %u timestamps, "
-						"disbaling timestamps\n",
-						delay, num_timestamps);
-				mode=GH_FRAMETIME_NONE;
-			}
-		} else {
-			GH_verbose(GH_MSG_WARNING, "failed to allocate memory for %u x %u frametime results, "
-					"disbaling timestamps\n",
-					num_results, num_timestamps);
-			mode=GH_FRAMETIME_NONE;
+	if (!fr->file) {
+		if (fr->name) {
+			fr->file=fopen(fr->name, "wt");
 		}
-	}
-
-	if (!mode || !delay || !num_timestamps || !num_results) {
-		ft->mode=GH_FRAMETIME_NONE;
-		ft->delay=0;
-		ft->num_timestamps=0;
-		ft->num_results=0;
-		ft->timestamp=NULL;
-		ft->frametime=NULL;
-	}
-
-	if (ft->mode) {
-		const char *file=get_envs("GH_FRAMETIME_FILE","glx_hook_frametimes-ctx%c.csv");
-		if (file) {
-			char buf[PATH_MAX];
-			parse_name(buf, sizeof(buf), file, ctx_num);
-			ft->dump=fopen(buf,"wt");
+		if (!fr->file) {
+			fr->file=stderr;
 		}
-		if (!ft->dump) {
-			ft->dump=stderr;
+	}
+	GH_verbose(GH_MSG_INFO, "flight recorder: slow frame %u: %.3f ms\n", fr->frame, (double)dt * 1.0E-6);
+	fprintf(fr->file, "# slow frame %u: %.3f ms (median %.3f ms, threshold %.3f ms)\n",
+			fr->frame, (double)dt * 1.0E-6, (double)fr->median.median * 1.0E-6, (double)fr->threshold * 1.0E-6);
+	fprintf(fr->file, "# frame\tstart_ms\tduration_ms\tevent\targ\n");
+	for (; pos < count; pos++) {
+		const GH_flight_event *ev=&fr->event[pos & (fr->size-1)];
+		if (ev->frame < first || ev->frame > fr->frame) {
+			continue;
 		}
+		fprintf(fr->file, "%u\t%.3f\t%.3f\t%s\t%lld\n", ev->frame,
+				(double)(int64_t)(ev->t0 - t0) * 1.0E-6,
+				(double)(int64_t)(ev->t1 - ev->t0) * 1.0E-6,
+				(ev->type < GH_EVENT_COUNT)?event_name[ev->type]:"?", ev->arg);
 	}
+	fputc('\n', fr->file);
+	fflush(fr->file);
 }
 
+/* record the GL call counts of the current frame and start over */
 static void
-frametimes_init_base(GH_frametimes *ft)
+flight_calls(GH_flight_recorder *fr, uint64_t now)
 {
-	/* get the base timestamp */
-	if (ft->mode > GH_FRAMETIME_NONE) {
-		GH_timestamp base;
-		unsigned int i;
-		GH_frametime *last=&ft->frametime[ft->num_results * ft->num_timestamps];
+	unsigned int i;
 
-		timestamp_init(&base);
-		timestamp_set(&base, &last[0], ft->mode);
-		timestamp_set(&base, &last[0], ft->mode);
-		for (i=1; i<ft->num_timestamps; i++) {
-			last[i]=last[0];
+	for (i=0; i<GH_CALL_COUNT; i++) {
+		if (fr->calls[i]) {
+			flight_record(fr, (GH_event_type)(GH_EVENT_CALLS_MARKER + i), now, now, (long long)fr->calls[i]);
+			fr->calls[i]=0;
 		}
-		timestamp_cleanup(&base);
 	}
 }
 
+/* called at the end of each frame with the current CLOCK_REALTIME */
 static void
-frametimes_dump_diff(const GH_frametimes *ft, uint64_t val, uint64_t base)
+flight_frame_end(GH_flight_recorder *fr, uint64_t now)
 {
-	fprintf(ft->dump, "\t%llu", (unsigned long long) (val-base));
+	uint64_t dt;
+	int slow;
+
+	if (!fr->size) {
+		return;
+	}
+	flight_calls(fr, now);
+	if (!fr->last_end) {
+		fr->last_end=now;
+		fr->frame++;
+		return;
+	}
+	dt=now - fr->last_end;
+	flight_record(fr, GH_EVENT_FRAME, fr->last_end, now, (long long)fr->frame);
+
+	slow=(fr->threshold && dt > fr->threshold) || median_exceeded(&fr->median, dt, fr->median_percent);
+	if (slow && fr->dumps_left && fr->frame >= fr->next_dump) {
+		flight_dump(fr, fr->last_end, dt);
+		fr->next_dump=fr->frame + fr->dump_frames;
+		fr->dumps_left--;
+	}
+
+	median_add(&fr->median, dt);
+	fr->last_end=now;
+	fr->frame++;
 }
 
+/***************************************************************************
+ * CALL RECORDER                                                           *
+ ***************************************************************************/
+
+/* Record the intercepted glX calls with the times the application called
+ * in and got control back, the frametime results and the GH_* settings
+ * into a binary file (see glx_hook_record.h), so that glx_hook_replay can
+ * drive the same call sequence later on, e.g. against a stub GL. */
+
+typedef struct {
+	pthread_once_t once;
+	pthread_mutex_t mutex;
+	FILE *file;
+	uint64_t base;			/* CLOCK_MONOTONIC of the start */
+	unsigned long records;
+} GH_recorder;
+
+static GH_recorder recorder={.once=PTHREAD_ONCE_INIT, .mutex=PTHREAD_MUTEX_INITIALIZER};
+
 static void
-frametimes_dump_result(const GH_frametimes *ft, const GH_frametime *rs, const GH_frametime *base)
+recorder_write(const GH_record *rec, const void *payload)
 {
-	frametimes_dump_diff(ft, rs->cpu, base->cpu);
-	frametimes_dump_diff(ft, rs->gpu, base->gpu);
-	frametimes_dump_diff(ft, rs->gpu, rs->gl);
+	pthread_mutex_lock(&recorder.mutex);
+	if (recorder.file) {
+		fwrite(rec, sizeof(*rec), 1, recorder.file);
+		if (rec->size) {
+			static const char pad[8];
+			fwrite(payload, rec->size, 1, recorder.file);
+			fwrite(pad, GH_RECORD_PADDING(rec->size), 1, recorder.file);
+		}
+		recorder.records++;
+	}
+	pthread_mutex_unlock(&recorder.mutex);
 }
 
 static void
-frametimes_dump_results(const GH_frametimes *ft, const GH_frametime *rs, const GH_frametime *prev)
+recorder_shutdown(void)
 {
-	unsigned int i;
-	for (i=0; i<ft->num_timestamps; i++) {
-		frametimes_dump_result(ft, &rs[i], &prev[GH_FRAMETIME_AFTER_SWAPBUFFERS]);
+	pthread_mutex_lock(&recorder.mutex);
+	if (recorder.file) {
+		GH_verbose(GH_MSG_INFO, "recorder: %lu records written\n", recorder.records);
+		fclose(recorder.file);
+		recorder.file=NULL;
 	}
+	pthread_mutex_unlock(&recorder.mutex);
 }
 
 static void
-frametimes_flush(GH_frametimes *ft)
+recorder_init(void)
 {
-	unsigned int i;
-	GH_frametime *last;
-	const GH_frametime *cur,*prev=&ft->frametime[ft->num_results * ft->num_timestamps];
+	const char *file=get_envs("GH_RECORD_FILE", NULL);
+	GH_record_header hdr;
+	char buf[PATH_MAX];
+	char **env;
 
-	if (ft->cur_result == 0) {
+	if (!file || !file[0]) {
 		return;
 	}
-
-	GH_verbose(GH_MSG_DEBUG, "frametimes: dumping results of %u frames\n", ft->cur_result);
-	for (i=0; i<ft->cur_result; i++) {
-		unsigned int frame=ft->frame - ft->cur_result + i;
-		if (frame >= ft->delay) {
-			fprintf(ft->dump, "%u", frame - ft->delay);
-			cur=&ft->frametime[i * ft->num_timestamps];
-			frametimes_dump_results(ft, cur, prev);
-			prev=cur;
-			fputc('\n', ft->dump);
-		}
-	}
-	fflush(ft->dump);
-	/* copy the last result */
-	last=&ft->frametime[ft->num_results * ft->num_timestamps];
-	cur=&ft->frametime[(ft->cur_result-1) * ft->num_timestamps];
-	for (i=0; i<ft->num_timestamps; i++) {
-		last[i]=cur[i];
+	parse_name(buf, sizeof(buf), file, 0);
+	recorder.file=fopen(buf, "wb");
+	if (!recorder.file) {
+		GH_verbose(GH_MSG_WARNING, "recorder: failed to open '%s'\n", buf);
+		return;
 	}
-
-
-	ft->cur_result=0;
-}
-
-static void
-frametimes_destroy(GH_frametimes *ft)
-{
-	if (ft) {
-		unsigned int cnt=ft->delay * ft->num_timestamps;
-		unsigned int i;
-
-		frametimes_flush(ft);
-		if (ft->dump != NULL && ft->dump != stdout && ft->dump != stderr) {
-			fclose(ft->dump);
-		}
-		for (i=0; i<cnt; i++) {
-			timestamp_cleanup(&ft->timestamp[i]);
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, GH_RECORD_MAGIC, sizeof(hdr.magic));
+	hdr.version=GH_RECORD_VERSION;
+	hdr.pid=(uint32_t)getpid();
+	hdr.start=get_time_ns(CLOCK_REALTIME);
+	recorder.base=get_time_ns(CLOCK_MONOTONIC);
+	fwrite(&hdr, sizeof(hdr), 1, recorder.file);
+	/* the settings the recording was made with */
+	for (env=environ; env && *env; env++) {
+		if (!strncmp(*env, "GH_", 3)) {
+			GH_record rec;
+			memset(&rec, 0, sizeof(rec));
+			rec.type=GH_RECORD_CONFIG;
+			rec.ctx=GH_RECORD_NO_CONTEXT;
+			rec.size=(uint32_t)strlen(*env) + 1;
+			recorder_write(&rec, *env);
 		}
-		free(ft->timestamp);
-		free(ft->frametime);
 	}
+	atexit(recorder_shutdown);
+	GH_verbose(GH_MSG_INFO, "recorder: recording the glX calls to '%s'\n", buf);
 }
 
-static void
-frametimes_before_swap(GH_frametimes *ft)
+/* call at the start of a wrapper, returns 0 if not recording */
+static uint64_t
+recorder_begin(void)
 {
-	unsigned int ts_idx;
-	unsigned int rs_idx;
-
-	if (ft->mode == GH_FRAMETIME_NONE)
-		return;
-	ts_idx=ft->cur_pos * ft->num_timestamps + GH_FRAMETIME_BEFORE_SWAPBUFFERS;
-	rs_idx=ft->cur_result * ft->num_timestamps + GH_FRAMETIME_BEFORE_SWAPBUFFERS;
-	timestamp_set(&ft->timestamp[ts_idx], &ft->frametime[rs_idx], ft->mode);
+	pthread_once(&recorder.once, recorder_init);
+	return (recorder.file)?get_time_ns(CLOCK_MONOTONIC):0;
 }
 
+/* call at the end of a wrapper with the value recorder_begin() returned */
 static void
-frametimes_finish_frame(GH_frametimes *ft)
+recorder_call(GH_record_type type, unsigned int ctx_num, uint64_t t0, int64_t arg)
 {
-	if (++ft->cur_pos == ft->delay) {
-		ft->cur_pos=0;
-	}
-	++ft->frame;
-	if (++ft->cur_result >= ft->num_results) {
-		frametimes_flush(ft);
-	}
+	GH_record rec;
+
+	memset(&rec, 0, sizeof(rec));
+	rec.type=(uint32_t)type;
+	rec.ctx=ctx_num;
+	rec.thread=(uint32_t)trace_tid();
+	rec.t1=get_time_ns(CLOCK_MONOTONIC) - recorder.base;
+	rec.t0=t0 - recorder.base;
+	rec.arg[0]=arg;
+	recorder_write(&rec, NULL);
 }
 
+/* the frametime results of a frame are complete */
 static void
-frametimes_after_swap(GH_frametimes *ft)
+recorder_frame(unsigned int ctx_num, unsigned int frame, uint64_t cpu, uint64_t gpu, int64_t latency)
 {
-	unsigned int ts_idx;
-	unsigned int rs_idx;
-
-	if (ft->mode == GH_FRAMETIME_NONE)
-		return;
-	ts_idx=ft->cur_pos * ft->num_timestamps + GH_FRAMETIME_AFTER_SWAPBUFFERS;
-	rs_idx=ft->cur_result * ft->num_timestamps + GH_FRAMETIME_AFTER_SWAPBUFFERS;
-	timestamp_set(&ft->timestamp[ts_idx], &ft->frametime[rs_idx], ft->mode);
-	frametimes_finish_frame(ft);
+	GH_record rec;
+
+	memset(&rec, 0, sizeof(rec));
+	rec.type=GH_RECORD_FRAME;
+	rec.ctx=ctx_num;
+	rec.thread=(uint32_t)trace_tid();
+	rec.t0=cpu;
+	rec.t1=gpu;
+	rec.arg[0]=(int64_t)frame;
+	rec.arg[1]=latency;
+	recorder_write(&rec, NULL);
 }
 
 /***************************************************************************
- * SWAPBUFFER OMISSION (very experimental)                                 *
+ * LATENCY LIMITER                                                         *
  ***************************************************************************/
 
-#define GH_SWAP_OMISSION_FRAMES_MAX 16
 
+/* we support different modes for the frame time measurements */
+typedef enum {
+	GH_LATENCY_NOP=-2,		/* do nothing */
+	GH_LATENCY_FINISH_AFTER,	/* force a finish after buffer swaps */
+	GH_LATENCY_FINISH_BEFORE,	/* force a finish before buffer swaps */
+	/* values above 0 indicate use of GL_ARB_sync to limit to n frames */
+} GH_latency_mode;
+
+/* model of the fence completion times for the predictive wait,
+ * all times are CLOCK_MONOTONIC */
 typedef struct {
-	int swapbuffers;
-	int swapbuffer_cnt;
-	int latency_mode;
-	int flush_mode;
-	int measure_mode;
-	int limits[2];
-	uint64_t min_swap_time;
-	GH_timestamp prev_frame_ts[GH_SWAP_OMISSION_FRAMES_MAX][2];
-	GH_frametime prev_frames[GH_SWAP_OMISSION_FRAMES_MAX][2];
-	int prev_intervals[GH_SWAP_OMISSION_FRAMES_MAX];
+	uint64_t last_signal;		/* the previous fence was signaled (filtered), 0 if unknown */
+	int last_accurate;		/* last_signal was observed by polling */
+	uint64_t interval;		/* average time between two fences being signaled */
+	uint64_t deviation;		/* average absolute prediction error */
+	uint64_t oversleep;		/* average delay of the wake-up from the sleep */
+	unsigned int scale;		/* margin in units of deviation/16, tuned online */
+	uint64_t min_margin;
+	uint64_t poll_ns;		/* total time spent polling */
+	unsigned long long sleeps;	/* number of waits which did sleep */
+	unsigned long long late;	/* wake-ups after the fence was signaled */
+} GH_latency_predict;
+
+/* state of the adaptive queue depth */
+typedef struct {
+	unsigned int min;		/* bounds of the depth */
+	unsigned int max;
+	unsigned int window;		/* frames left in the current starvation window */
+	unsigned int starved;		/* starvation events in the current window */
+	unsigned int since_wait;	/* frames since we last had to wait */
+	unsigned int rate;		/* decaying starvation rate, GH_LATENCY_ADAPT_RATE_ONE is every frame */
+	unsigned int hold;		/* frames since the last change required to decrease the depth */
+	unsigned int since_change;	/* frames since the last change of the depth */
+	unsigned int since_decrease;	/* frames since the last decrease */
+	unsigned int pending;		/* newest fences not seen signaled yet */
+	unsigned int busy_fences;	/* fences signaled since busy_since */
+	uint64_t busy_since;		/* end of the last wait since which the GPU was busy, 0 if not */
+	uint64_t last_end;		/* end of the previous wait */
+	uint64_t cpu;			/* average CPU time per frame outside of the wait */
+	uint64_t gpu;			/* average time between fences while the GPU is busy */
+	unsigned long long depth_sum;
+	unsigned long long changes;
+} GH_latency_adapt;
+
+typedef struct {
+	int latency;
+	unsigned int depth;		/* the current number of frames, <= latency */
+	GLsync *sync_object;
 	unsigned int cur_pos;
-	unsigned int measure_frames_tot;
-	unsigned int measure_frames_avg;
-} GH_swapbuffer_omission_t;
+	unsigned int flags;
+	GLuint64 gl_wait_timeout;
+	GLuint64 gl_wait_interval;
+	useconds_t self_wait_interval;
+	uint64_t wait_ns;		/* total time spent waiting */
+	unsigned long long waits;	/* number of waits */
+	GH_latency_predict predict;
+	GH_latency_adapt adapt;
+} GH_latency;
 
-static void
-swapbuffer_omission_init(GH_swapbuffer_omission_t *swo)
-{
-	int i;
-	int min_swap_usecs = get_envi("GH_MIN_SWAP_USECS",0);
-	swo->swapbuffers=get_envi("GH_SWAPBUFFERS",0);
-	swo->min_swap_time = 0;
-	if (min_swap_usecs > 0) {
-		swo->swapbuffers = 1;
-		swo->min_swap_time = (uint64_t)min_swap_usecs * (uint64_t)1000UL;
-	}
-	swo->latency_mode = get_envi("GH_SWAP_OMISSION_LATENCY", 0);
-	swo->flush_mode = get_envi("GH_SWAP_OMISSION_FLUSH", 1);
-	swo->measure_mode = get_envi("GH_SWAP_OMISSION_MEASURE", 3);
-	swo->limits[0] = get_envi("GH_SWAP_OMISSION_MIN",1);
-	swo->limits[1] = get_envi("GH_SWAP_OMISSION_MAX",4);
-	if (swo->limits[0] < 1) {
-		swo->limits[0] = 1;
-	}
-	if (swo->limits[1] < swo->limits[0]) {
-		swo->limits[1] = swo->limits[0];
+/* latency flags */
+#define GH_LATENCY_FLAG_MANUAL_WAIT	0x1
+#define GH_LATENCY_FLAG_PREDICT		0x2
+
+/* margin scale in units of 1/16 of the deviation: initial value, minimum,
+ * increase after a late wake-up and decay per wait, which settles at a few
+ * percent of late wake-ups */
+#define GH_LATENCY_PREDICT_SCALE_INIT	32
+#define GH_LATENCY_PREDICT_SCALE_MIN	4
+#define GH_LATENCY_PREDICT_SCALE_LATE	8
+#define GH_LATENCY_PREDICT_SCALE_DECAY	64
+
+/* the minimum sleep per iteration once we polled for longer than expected,
+ * so that we do not busy-wait with GH_LATENCY_SPIN_USECS=0 */
+#define GH_LATENCY_PREDICT_POLL_SLEEP	20000ULL
+
+/* adaptive depth: starvation events within the window to increase the depth,
+ * and the range of frames after a change before decreasing it, which is
+ * doubled whenever a decrease had to be undone soon */
+#define GH_LATENCY_ADAPT_WINDOW		32
+#define GH_LATENCY_ADAPT_STARVED	2
+#define GH_LATENCY_ADAPT_HOLD_MIN	128
+#define GH_LATENCY_ADAPT_HOLD_MAX	2048
+
+/* the starvation rate decays by 1/GH_LATENCY_ADAPT_RATE_DECAY per frame,
+ * the depth is only decreased while it is below 1% */
+#define GH_LATENCY_ADAPT_RATE_ONE	65536U
+#define GH_LATENCY_ADAPT_RATE_DECAY	64U
+#define GH_LATENCY_ADAPT_RATE_LOW	(GH_LATENCY_ADAPT_RATE_ONE / 100U)
+
+static int
+latency_gl_init()
+{
+	GH_GET_GL_PROC_OR_FAIL(glFenceSync, GH_MSG_WARNING, -1);
+	GH_GET_GL_PROC_OR_FAIL(glDeleteSync, GH_MSG_WARNING, -1);
+	GH_GET_GL_PROC_OR_FAIL(glClientWaitSync, GH_MSG_WARNING, -1);
+	return 0;
+}
+
+static void
+latency_init(GH_latency *lat, int latency, unsigned int max_latency, int manual_wait, unsigned gl_wait_timeout_usecs, unsigned int gl_wait_interval_usecs, unsigned int self_wait_interval_usecs, unsigned int spin_usecs)
+{
+	lat->latency=latency;
+	lat->depth=(latency > 0)?(unsigned)latency:0;
+	lat->sync_object=NULL;
+	lat->cur_pos=0;
+	lat->flags=0;
+	lat->gl_wait_timeout=(GLuint64)gl_wait_timeout_usecs * (GLuint64)1000;
+	lat->gl_wait_interval=(GLuint64)gl_wait_interval_usecs * (GLuint64)1000;
+	lat->self_wait_interval=(useconds_t)self_wait_interval_usecs;
+	lat->wait_ns=0;
+	lat->waits=0;
+	memset(&lat->predict, 0, sizeof(lat->predict));
+	lat->predict.min_margin=(uint64_t)spin_usecs * (uint64_t)1000;
+	lat->predict.scale=GH_LATENCY_PREDICT_SCALE_INIT;
+	memset(&lat->adapt, 0, sizeof(lat->adapt));
+	lat->adapt.min=lat->depth;
+	lat->adapt.max=lat->depth;
+	if (latency > 0 && max_latency > (unsigned)latency) {
+		/* the ring holds the fences for the maximum depth */
+		lat->latency=(int)max_latency;
+		lat->adapt.max=max_latency;
+		lat->adapt.window=GH_LATENCY_ADAPT_WINDOW;
+		lat->adapt.hold=GH_LATENCY_ADAPT_HOLD_MIN;
+	}
+
+	if (manual_wait > 1) {
+		lat->flags |= GH_LATENCY_FLAG_PREDICT;
+	} else if (manual_wait > 0) {
+		lat->flags |= GH_LATENCY_FLAG_MANUAL_WAIT;
+	} else if (manual_wait < 0) {
+		if ((gl_wait_interval_usecs > 0) || (self_wait_interval_usecs > 0))  {
+			lat->flags |= GH_LATENCY_FLAG_MANUAL_WAIT;
+		}
 	}
-	swo->swapbuffer_cnt=0;
-	swo->cur_pos = 0;
-	swo->measure_frames_tot = get_envui("GH_SWAP_OMISSION_MEASURE_TOT", 6U);
-	swo->measure_frames_avg = get_envui("GH_SWAP_OMISSION_MEASURE_AVG", 4U);
-	if (swo->measure_frames_tot > GH_SWAP_OMISSION_FRAMES_MAX) {
-		swo->measure_frames_tot = GH_SWAP_OMISSION_FRAMES_MAX;
-	} else if (swo->measure_frames_tot < 2) {
-		swo->measure_frames_tot = 2;
+
+	if (latency != GH_LATENCY_NOP) {
+		GH_verbose(GH_MSG_INFO, "setting up latency limiter mode %d\n", latency);
 	}
-	if (swo->measure_frames_avg >= swo->measure_frames_tot) {
-		swo->measure_frames_avg = swo->measure_frames_tot - 1U;
+
+	if (latency > 0) {
+		if (latency_gl_init()) {
+			lat->latency=GH_LATENCY_FINISH_BEFORE;
+			GH_verbose(GH_MSG_WARNING, "GPU sync not available, using latency mode %d\n",
+					GH_LATENCY_FINISH_BEFORE);
+		}
 	}
-	if (swo->measure_frames_avg < 1) {
-		swo->measure_frames_avg = 1;
+
+	if (lat->latency > 0) {
+		unsigned int cnt=(unsigned)lat->latency;
+		lat->sync_object=malloc(sizeof(*lat->sync_object) * cnt);
+		if (!lat->sync_object) {
+			lat->latency=GH_LATENCY_FINISH_BEFORE;
+			GH_verbose(GH_MSG_WARNING, "out of memory for sync objects, using latency mode %d\n");
+		} else {
+			unsigned int i;
+			for (i=0; i<cnt; i++) {
+				lat->sync_object[i]=NULL;
+			}
+			GH_verbose(GH_MSG_DEBUG, "enabling latency limiter: %d\n",lat->latency);
+			if (lat->adapt.max > lat->adapt.min) {
+				GH_verbose(GH_MSG_INFO, "latency limiter with adaptive depth %u to %u\n",
+						lat->adapt.min, lat->adapt.max);
+			}
+			if (lat->flags & GH_LATENCY_FLAG_PREDICT) {
+				GH_verbose(GH_MSG_INFO, "latency limiter with predictive waits, min. spin: %u usecs\n",
+						spin_usecs);
+			} else if (lat->flags & GH_LATENCY_FLAG_MANUAL_WAIT) {
+				GH_verbose(GH_MSG_INFO, "latency limiter with manual waits GL: %u usecs + self: %u usecs\n",
+						gl_wait_interval_usecs, self_wait_interval_usecs);
+			} else {
+				GH_verbose(GH_MSG_INFO, "latency limiter with timeout: %u usecs\n",
+						gl_wait_timeout_usecs);
+			}
+		}
 	}
+}
 
-	for (i=0; i<GH_SWAP_OMISSION_FRAMES_MAX; i++) {
-		timestamp_init(&swo->prev_frame_ts[i][0]);
-		timestamp_init(&swo->prev_frame_ts[i][1]);
-		frametime_init(&swo->prev_frames[i][0]);
-		frametime_init(&swo->prev_frames[i][1]);
-		swo->prev_intervals[i] = 1;
+static void
+latency_destroy(GH_latency *lat)
+{
+	if (lat) {
+		const GH_latency_predict *p=&lat->predict;
+		if ((lat->flags & GH_LATENCY_FLAG_PREDICT) && lat->waits) {
+			GH_verbose(GH_MSG_INFO, "latency limiter: %llu waits, %llu slept, %llu woke up late, "
+					"avg polling %.3f ms, interval %.3f ms, deviation %.3f ms, margin scale %.2f\n",
+					lat->waits, p->sleeps, p->late,
+					(double)p->poll_ns * 1.0E-6 / (double)lat->waits,
+					(double)p->interval * 1.0E-6, (double)p->deviation * 1.0E-6,
+					(double)p->scale / 16.0);
+		}
+		if (lat->adapt.max > lat->adapt.min && lat->waits) {
+			GH_verbose(GH_MSG_INFO, "latency limiter: adaptive depth: final %u, avg %.2f, %llu changes, "
+					"CPU %.3f ms, GPU %.3f ms per frame\n",
+					lat->depth, (double)lat->adapt.depth_sum / (double)lat->waits,
+					lat->adapt.changes, (double)lat->adapt.cpu * 1.0E-6,
+					(double)lat->adapt.gpu * 1.0E-6);
+		}
+		if (lat->sync_object && lat->latency > 0) {
+			unsigned int i;
+			for (i=0; i<(unsigned)lat->latency; i++) {
+				if (lat->sync_object[i]) {
+					GH_glDeleteSync(lat->sync_object[i]);
+				}
+			}
+		}
 	}
 }
 
-static int
-swapbuffer_omission_init_gl_funcs(void)
+/* the totals are also read by the prom exporter from other threads */
+static void
+latency_account(GH_latency *lat, uint64_t t0, uint64_t t1)
 {
-	GH_GET_GL_PROC_OR_FAIL(glGenQueries, GH_MSG_WARNING, -1);
-	GH_GET_GL_PROC_OR_FAIL(glDeleteQueries, GH_MSG_WARNING, -1);
-	GH_GET_GL_PROC_OR_FAIL(glGetInteger64v, GH_MSG_WARNING, -1);
-	GH_GET_GL_PROC_OR_FAIL(glQueryCounter, GH_MSG_WARNING, -1);
-	GH_GET_GL_PROC_OR_FAIL(glGetQueryObjectui64v, GH_MSG_WARNING, -1);
-	return 0;
+	__atomic_store_n(&lat->wait_ns, lat->wait_ns + (t1 - t0), __ATOMIC_RELAXED);
+	__atomic_store_n(&lat->waits, lat->waits + 1, __ATOMIC_RELAXED);
+}
+
+/* update an average with weight 1/8 */
+static uint64_t
+latency_predict_avg(uint64_t avg, uint64_t value)
+{
+	return (avg)?(avg - avg/8 + value/8):value;
 }
 
+/* Wait for a fence by predicting the time it is signaled from the
+ * previous ones: sleep until shortly before that, and poll from then on.
+ * The margin covers the prediction error and the wake-up delay. It grows
+ * whenever we woke up too late, and shrinks slowly otherwise. */
 static void
-swapbuffer_omission_init_gl(GH_swapbuffer_omission_t *swo)
+latency_predict_wait(GH_latency_predict *p, GLsync sync)
 {
-	if (swo->min_swap_time > 0) {
-		if (swapbuffer_omission_init_gl_funcs()) {
-			GH_verbose(GH_MSG_WARNING,"adaptive swapbuffer omission not availabe without timer query, disabling it");
-			swo->min_swap_time = 0;
-			swo->swapbuffers = get_envi("GH_SWAPBUFFERS",0);;
+	uint64_t now=get_time_ns(CLOCK_MONOTONIC);
+	uint64_t margin=p->min_margin + p->deviation*p->scale/16 + p->oversleep;
+	uint64_t predicted=0;
+	uint64_t t_poll,t_signal;
+
+	if (GH_glClientWaitSync(sync, GL_SYNC_FLUSH_COMMANDS_BIT, 0) != GL_TIMEOUT_EXPIRED) {
+		/* the GPU is ahead, we only know it was signaled before now */
+		p->last_signal=now;
+		p->last_accurate=0;
+		return;
+	}
+	if (p->last_signal && p->interval) {
+		predicted=p->last_signal + p->interval;
+		if (predicted > now + margin) {
+			uint64_t target=predicted - margin;
+			sleep_until_ns(CLOCK_MONOTONIC, target);
+			now=get_time_ns(CLOCK_MONOTONIC);
+			p->oversleep=latency_predict_avg(p->oversleep, (now > target)?(now - target):0);
+			p->sleeps++;
+			if (GH_glClientWaitSync(sync, 0, 0) != GL_TIMEOUT_EXPIRED) {
+				/* woke up too late, the fence was signaled somewhen
+				 * between the target and now: keep the prediction */
+				p->late++;
+				p->scale += GH_LATENCY_PREDICT_SCALE_LATE;
+				p->last_signal=(now < predicted)?now:predicted;
+				p->last_accurate=1;
+				return;
+			}
+		}
+	}
+	/* poll, but not for longer than expected */
+	t_poll=now;
+	while (GH_glClientWaitSync(sync, 0, 0) == GL_TIMEOUT_EXPIRED) {
+		now=get_time_ns(CLOCK_MONOTONIC);
+		if (now > t_poll + 2*margin + p->interval/4) {
+			sleep_until_ns(CLOCK_MONOTONIC, now + ((p->min_margin > GH_LATENCY_PREDICT_POLL_SLEEP)?
+						p->min_margin:GH_LATENCY_PREDICT_POLL_SLEEP));
 		}
 	}
+	t_signal=get_time_ns(CLOCK_MONOTONIC);
+	p->poll_ns += t_signal - t_poll;
+	if (predicted && p->last_accurate) {
+		/* alpha-beta filter, so that the noise of a single frame
+		 * does not carry over to the next prediction */
+		int64_t err=(int64_t)(t_signal - predicted);
+		p->deviation=latency_predict_avg(p->deviation, (uint64_t)((err < 0)?-err:err));
+		p->interval=(uint64_t)((int64_t)p->interval + err/16);
+		t_signal=(uint64_t)((int64_t)predicted + err/4);
+	} else if (p->last_signal && p->last_accurate) {
+		p->interval=latency_predict_avg(p->interval, t_signal - p->last_signal);
+	}
+	if (p->scale > GH_LATENCY_PREDICT_SCALE_MIN) {
+		p->scale -= (p->scale + GH_LATENCY_PREDICT_SCALE_DECAY - 1)/GH_LATENCY_PREDICT_SCALE_DECAY;
+	}
+	p->last_signal=t_signal;
+	p->last_accurate=1;
 }
 
+/* Look at the fences not seen signaled so far, they are signaled in order.
+ * Only a wait tells when a fence was signaled, otherwise we just know it
+ * happened before the look. So we measure from the end of one wait to the
+ * end of the next one, divided by the fences signaled in between, as long
+ * as the GPU did not run out of work in between. Right after a wait, the
+ * GPU continues with the frame just submitted even if all fences are
+ * signaled. Returns if the GPU is done with all fenced frames. */
 static int
-swapbuffer_omission_do_swap(GH_swapbuffer_omission_t *swo)
+latency_adapt_observe(GH_latency *lat, uint64_t now, int after_wait)
 {
-	int do_swap;
-	if (swo->min_swap_time > 0) {
-		unsigned int i,idx;
-		uint64_t cpu = 0;
-		uint64_t gpu = 0;
-		uint64_t val;
-		timestamp_set(&swo->prev_frame_ts[swo->cur_pos][1],&swo->prev_frames[swo->cur_pos][1], GH_FRAMETIME_CPU_GPU);
-		if (++swo->cur_pos >= swo->measure_frames_tot) {
-			swo->cur_pos = 0;
-		}
-		idx = swo->cur_pos;
-
-		for (i=0; i<swo->measure_frames_avg; i++) {
-			cpu += (swo->prev_frames[idx][1].cpu - swo->prev_frames[idx][0].cpu);
-			gpu += (swo->prev_frames[idx][1].gpu - swo->prev_frames[idx][0].gpu);
-			if (++idx >= swo->measure_frames_tot) {
-				idx = 0;
-			}
-		}
-		cpu /= swo->measure_frames_avg;
-		gpu /= swo->measure_frames_avg;
-		switch (swo->measure_mode) {
-			case 1:
-				val=cpu;
-				break;
-			case 2:
-				val=gpu;
-				break;
-			default:
-				val = (cpu>gpu)?cpu:gpu;
+	GH_latency_adapt *ad=&lat->adapt;
+	unsigned int signaled=0;
+
+	while (ad->pending) {
+		GLsync sync=lat->sync_object[(lat->cur_pos + (unsigned)lat->latency - ad->pending) % (unsigned)lat->latency];
+		if (sync && GH_glClientWaitSync(sync, 0, 0) == GL_TIMEOUT_EXPIRED) {
+			break;
 		}
-		if (val < 1000) {
-			val = 1000;
+		ad->pending--;
+		signaled++;
+	}
+	if (after_wait && signaled) {
+		if (ad->busy_since) {
+			ad->gpu=latency_predict_avg(ad->gpu, (now - ad->busy_since)/(ad->busy_fences + signaled));
 		}
-		int interval  = (int)(swo->min_swap_time/val);
-		if (interval < swo->limits[0]) {
-			interval = swo->limits[0];
+		ad->busy_since=now;
+		ad->busy_fences=0;
+	} else if (!ad->pending) {
+		/* the GPU might have idled since the previous look */
+		ad->busy_since=0;
+		/* no frame was fenced yet at the start */
+		return (lat->sync_object[(lat->cur_pos + (unsigned)lat->latency - 1) % (unsigned)lat->latency] != NULL);
+	} else {
+		ad->busy_fences += signaled;
+	}
+	return 0;
+}
+
+/* Adapt the queue depth after the wait of a frame. The GPU starved if it
+ * already finished all previous frames when the application came to swap,
+ * while the limiter held the application back recently: then the queue was
+ * too short to cover the CPU time of the frame. That only counts if one
+ * more frame of GPU work would have covered it, a CPU spike longer than
+ * that starves any depth. The depth is increased after repeated
+ * starvation, and decreased again while the starvation rate is low, but
+ * not below the depth the average CPU and GPU frame times require. */
+static void
+latency_adapt(GH_latency *lat, int drained, uint64_t t_arrive, uint64_t t_end)
+{
+	GH_latency_adapt *ad=&lat->adapt;
+	int waited=(t_end - t_arrive > (uint64_t)50000);
+	unsigned int depth=lat->depth;
+	uint64_t cpu=0;
+
+	if (ad->last_end && t_arrive > ad->last_end) {
+		cpu=t_arrive - ad->last_end;
+		ad->cpu=latency_predict_avg(ad->cpu, cpu);
+	}
+	ad->last_end=t_end;
+	ad->rate -= ad->rate / GH_LATENCY_ADAPT_RATE_DECAY;
+	/* the queue held about depth frames at the end of the previous wait */
+	if (drained && ad->since_wait <= depth && ad->gpu && cpu <= (uint64_t)(depth + 1) * ad->gpu) {
+		ad->starved++;
+		ad->rate += GH_LATENCY_ADAPT_RATE_ONE / GH_LATENCY_ADAPT_RATE_DECAY;
+	}
+	ad->since_wait=(waited)?0:ad->since_wait + 1;
+	ad->since_change++;
+	ad->since_decrease++;
+
+	if (ad->starved >= GH_LATENCY_ADAPT_STARVED && depth < ad->max) {
+		depth++;
+		if (ad->since_decrease < 2*ad->hold) {
+			/* we just came from here, wait longer before the next try */
+			ad->hold=(2*ad->hold < GH_LATENCY_ADAPT_HOLD_MAX)?2*ad->hold:GH_LATENCY_ADAPT_HOLD_MAX;
 		}
-		if (interval > swo->limits[1]) {
-			interval = swo->limits[1];
+	} else if (ad->since_change >= ad->hold && ad->rate < GH_LATENCY_ADAPT_RATE_LOW && depth > ad->min) {
+		/* the minimum depth which keeps the GPU busy */
+		unsigned int need=(ad->gpu)?1U + (unsigned int)((ad->cpu + ad->gpu - 1)/ad->gpu):ad->min;
+		if (depth > need) {
+			depth--;
+			ad->since_decrease=0;
 		}
-		swo->prev_intervals[swo->cur_pos]=interval;
-		idx = swo->cur_pos + swo->measure_frames_tot - swo->measure_frames_avg + 1;
-		for (i=0; i<(swo->measure_frames_avg-1); i++) {
-			if (idx >= swo->measure_frames_tot) {
-				idx -= swo->measure_frames_tot;
-			}
-			interval += swo->prev_intervals[idx++];
+		ad->since_change=0;
+	}
+	if (--ad->window == 0) {
+		ad->window=GH_LATENCY_ADAPT_WINDOW;
+		ad->starved=0;
+		if (ad->since_decrease >= 2*ad->hold && ad->hold > GH_LATENCY_ADAPT_HOLD_MIN) {
+			ad->hold /= 2;
 		}
-		swo->swapbuffers = interval / swo->measure_frames_avg;
+	}
+	if (depth != lat->depth) {
+		GH_verbose(GH_MSG_DEBUG, "latency limiter: depth %u -> %u\n", lat->depth, depth);
+		lat->depth=depth;
+		ad->starved=0;
+		ad->since_change=0;
+		ad->window=GH_LATENCY_ADAPT_WINDOW;
+		ad->changes++;
+	}
+	ad->depth_sum += depth;
+}
+
+static void
+latency_before_swap(GH_latency *lat, GH_flight_recorder *fr)
+{
+	GLsync sync;
+	uint64_t t0,t1;
+	int drained=0;
 
-		/*printf("XXX %d %d cpu: %lu, gpu: %lu\n", swo->swapbuffers, interval, cpu, gpu);*/
+	switch(lat->latency) {
+		case GH_LATENCY_NOP:
+		case GH_LATENCY_FINISH_AFTER:
+			(void)lat;
+			(void)fr;
+			return;
+		default:
+			(void)0;
 	}
-	do_swap = (++swo->swapbuffer_cnt >= swo->swapbuffers);
-	return do_swap;
+
+	t0=get_time_ns(CLOCK_REALTIME);
+	switch(lat->latency) {
+		case GH_LATENCY_FINISH_BEFORE:
+			GH_glFinish();
+			break;
+		default:
+			if (lat->adapt.max > lat->adapt.min) {
+				/* is the GPU done with everything? */
+				drained=latency_adapt_observe(lat, t0, 0);
+			}
+			/* the fence of the frame depth frames ago */
+			if ( (sync=lat->sync_object[(lat->cur_pos + (unsigned)lat->latency - lat->depth) % (unsigned)lat->latency]) ) {
+				if (lat->flags & GH_LATENCY_FLAG_PREDICT) {
+					latency_predict_wait(&lat->predict, sync);
+				} else if (lat->flags & GH_LATENCY_FLAG_MANUAL_WAIT) {
+					/* check for the fence in a loop */
+					while(GH_glClientWaitSync(sync, GL_SYNC_FLUSH_COMMANDS_BIT, lat->gl_wait_interval) == GL_TIMEOUT_EXPIRED) {
+						if (lat->self_wait_interval) {
+							usleep(lat->self_wait_interval);
+						}
+					}
+				} else {
+					/* just wait for the fence */
+					GH_glClientWaitSync(sync, GL_SYNC_FLUSH_COMMANDS_BIT, lat->gl_wait_timeout);
+					/* NOTE: we do not care about the result */
+				}
+			}
+	}
+	t1=get_time_ns(CLOCK_REALTIME);
+	latency_account(lat, t0, t1);
+	if (lat->adapt.max > lat->adapt.min) {
+		/* the fence we waited for was just signaled */
+		latency_adapt_observe(lat, t1, 1);
+		latency_adapt(lat, drained, t0, t1);
+	}
+	event_span(fr, GH_EVENT_LATENCY_BEFORE_SWAP, t0, t1, (lat->latency > 0)?(int)lat->depth:lat->latency);
 }
 
 static void
-swapbuffer_omission_swap_skipped(GH_swapbuffer_omission_t *swo)
+latency_after_swap(GH_latency *lat, GH_flight_recorder *fr)
 {
-	switch (swo->flush_mode) {
-		case 1:
-			GH_glFlush();
+	switch(lat->latency) {
+		case GH_LATENCY_NOP:
+		case GH_LATENCY_FINISH_BEFORE:
+			(void)lat;
+			(void)fr;
 			break;
-		case 2:
-			GH_glFinish();
+		case GH_LATENCY_FINISH_AFTER:
+			{
+				uint64_t t0=get_time_ns(CLOCK_REALTIME);
+				uint64_t t1;
+				GH_glFinish();
+				t1=get_time_ns(CLOCK_REALTIME);
+				latency_account(lat, t0, t1);
+				event_span(fr, GH_EVENT_LATENCY_AFTER_SWAP, t0, t1, lat->latency);
+			}
 			break;
 		default:
-			(void)0; /* nop */
+			if ( (lat->sync_object[lat->cur_pos]) ) {
+				GH_glDeleteSync(lat->sync_object[lat->cur_pos]);
+			}
+			lat->sync_object[lat->cur_pos]=GH_glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+			if (lat->adapt.pending < (unsigned)lat->latency) {
+				lat->adapt.pending++;
+			}
+			if (++lat->cur_pos == (unsigned)lat->latency) {
+				lat->cur_pos=0;
+			}
 	}
 }
 
+/***************************************************************************
+ * FRAME RATE LIMITER                                                      *
+ ***************************************************************************/
+
+/* The buffer swaps are scheduled against absolute deadlines on a fixed
+ * grid of CLOCK_MONOTONIC, so that the frame rate does not depend on the
+ * time the application spends per frame. We sleep until shortly before
+ * the deadline with a minimal timer slack, and spin for the rest. */
+
+typedef struct {
+	uint64_t interval;		/* target frame interval in ns, 0 if disabled */
+	uint64_t spin;			/* time to spin before the deadline */
+	uint64_t catchup;		/* max. delay to catch up with, reset the schedule beyond */
+	int after_swap;			/* limit after instead of before the buffer swap */
+	uint64_t deadline;		/* deadline of the current frame, 0 if not started */
+	uint64_t last_release;		/* the previous frame was released */
+	uint64_t start;			/* release of the first frame */
+	/* statistics */
+	unsigned long long frames;
+	unsigned long long late;	/* frames which missed their deadline */
+	unsigned long long resets;	/* schedule resets after too long frames */
+	unsigned long long waits;	/* frames which had to wait */
+	unsigned long long intervals;	/* intervals between two released frames */
+	uint64_t interval_err_sum;	/* absolute deviation of the intervals from the target */
+	uint64_t interval_err_max;
+	uint64_t wake_err_sum;		/* release after the deadline, for frames which had to wait */
+	uint64_t wake_err_max;
+	uint64_t wait_ns;		/* total time spent waiting */
+} GH_fps_limit;
+
 static void
-swapbuffer_omission_swap_finished(GH_swapbuffer_omission_t *swo, int did_swap)
+fps_limit_init(GH_fps_limit *fl)
 {
-	if (did_swap) {
-		swo->swapbuffer_cnt = 0;
+	const char *s=get_envs("GH_FPS_LIMIT", NULL);
+	double hz=(s)?strtod(s, NULL):0.0;
+
+	memset(fl, 0, sizeof(*fl));
+	if (hz > 0.0) {
+		fl->interval=(uint64_t)(1.0E9 / hz + 0.5);
+		fl->spin=(uint64_t)get_envui("GH_FPS_LIMIT_SPIN_USECS", 200) * (uint64_t)1000UL;
+		fl->catchup=(uint64_t)get_envui("GH_FPS_LIMIT_CATCHUP_FRAMES", 1) * fl->interval;
+		fl->after_swap=get_envi("GH_FPS_LIMIT_AFTER_SWAP", 0);
+		GH_verbose(GH_MSG_INFO, "frame rate limiter: %.3f Hz %s the swap, spin: %u usecs\n",
+				hz, (fl->after_swap)?"after":"before", (unsigned)(fl->spin / 1000));
 	}
-	if (swo->min_swap_time > 0) {
-		timestamp_set(&swo->prev_frame_ts[swo->cur_pos][0],&swo->prev_frames[swo->cur_pos][0], GH_FRAMETIME_CPU_GPU);
+}
+
+static void
+fps_limit_destroy(GH_fps_limit *fl)
+{
+	if (fl->frames && fl->last_release > fl->start) {
+		GH_verbose(GH_MSG_INFO, "frame rate limiter: %llu frames at %.3f Hz (target %.3f Hz), "
+				"%llu late, %llu resets, interval jitter avg %.3f max %.3f ms, "
+				"wake-up error avg %.3f max %.3f ms, avg wait %.3f ms\n",
+				fl->frames, (double)(fl->frames - 1) * 1.0E9 / (double)(fl->last_release - fl->start),
+				1.0E9 / (double)fl->interval, fl->late, fl->resets,
+				(fl->intervals)?(double)fl->interval_err_sum * 1.0E-6 / (double)fl->intervals:0.0,
+				(double)fl->interval_err_max * 1.0E-6,
+				(fl->waits)?(double)fl->wake_err_sum * 1.0E-6 / (double)fl->waits:0.0,
+				(double)fl->wake_err_max * 1.0E-6,
+				(double)fl->wait_ns * 1.0E-6 / (double)fl->frames);
 	}
 }
 
+/* wait for the deadline of the current frame and schedule the next one */
 static void
-swapbuffer_omission_destroy(GH_swapbuffer_omission_t *swo)
+fps_limit_wait(GH_fps_limit *fl, GH_flight_recorder *fr)
 {
-	int i;
-	for (i=0; i<GH_SWAP_OMISSION_FRAMES_MAX; i++) {
-		timestamp_cleanup(&swo->prev_frame_ts[i][0]);
-		timestamp_cleanup(&swo->prev_frame_ts[i][1]);
+	uint64_t now=get_time_ns(CLOCK_MONOTONIC);
+	uint64_t t0=(GH_EVENTS_ENABLED(fr))?get_time_ns(CLOCK_REALTIME):0;
+	uint64_t start=now;
+
+	if (!fl->deadline) {
+		/* the first frame starts the schedule */
+		fl->deadline=now;
+		fl->start=now;
+	}
+	if (now < fl->deadline) {
+		sleep_until_precise_ns(fl->deadline, fl->spin);
+		now=get_time_ns(CLOCK_MONOTONIC);
+		fl->waits++;
+		fl->wake_err_sum += now - fl->deadline;
+		if (now - fl->deadline > fl->wake_err_max) {
+			fl->wake_err_max=now - fl->deadline;
+		}
+	} else if (fl->frames) {
+		fl->late++;
+		if (now - fl->deadline > fl->catchup) {
+			/* too far behind, do not rush the following frames */
+			fl->deadline=now;
+			fl->resets++;
+		}
+	}
+	if (fl->last_release) {
+		uint64_t dt=now - fl->last_release;
+		uint64_t err=(dt > fl->interval)?(dt - fl->interval):(fl->interval - dt);
+		fl->interval_err_sum += err;
+		if (err > fl->interval_err_max) {
+			fl->interval_err_max=err;
+		}
+		fl->intervals++;
+	}
+	fl->last_release=now;
+	fl->wait_ns += now - start;
+	fl->frames++;
+	fl->deadline += fl->interval;
+	if (t0) {
+		event_span(fr, GH_EVENT_FPS_LIMIT, t0, get_time_ns(CLOCK_REALTIME), (long long)(now - start));
 	}
 }
 
 /***************************************************************************
- * GL context tracking                                                     *
+ * JUST-IN-TIME FRAME START                                                *
  ***************************************************************************/
 
-typedef struct gl_context_ceation_opts_s {
-	pthread_mutex_t mutex;
-	unsigned int flags;
-	int force_version[2];
-	int force_version_min[2];
-	int force_version_max[2];
-	int force_flags_on;
-	int force_flags_off;
-	int force_profile_on;
-	int force_profile_off;
-	int force_no_error;
-} gl_context_creation_opts_t;
+/* When the frames are paced by the display or the frame rate limiter, the
+ * application samples its input right after the buffer swap returns, and
+ * the frame then waits for the pacing. We delay the return from the swap
+ * instead, so that the next frame arrives at its deadline just in time:
+ * the deadline of the frame rate limiter, or the vblank the frame can be
+ * presented at, minus the time the GPU lags behind at the swap, both
+ * predicted from the recent frames, minus a safety margin. */
 
-/* flag bits */
-#define GH_GLCTX_CREATE_INITIALIZED	0x1
-#define GH_GLCTX_COMPAT_IF_LEGACY	0x2
+/* The GPU lag at the swap includes the time the frame waited for the
+ * previous ones whenever a frame was late. The median of the recent
+ * frames follows changes of the GPU load, but not these outliers. */
+#define GH_JIT_GPU_WINDOW	8
 
-typedef struct gl_context_s {
-	GLXContext ctx;
-	GLXDrawable draw;
-	GLXDrawable read;
-	unsigned int flags;
-	int inject_swapinterval;
-	unsigned int num;
-	struct gl_context_s *next;
-	GH_frametimes frametimes;
-	GH_latency latency;
-	GH_swapbuffer_omission_t swapbuffer_omission;
-	useconds_t swap_sleep_usecs;
-	GLDEBUGPROC original_debug_callback;
-	GLDEBUGPROCAMD original_debug_callback_AMD;
-	const GLvoid* original_debug_callback_user_ptr;
-	GLvoid* original_debug_callback_AMD_user_ptr;
-} gl_context_t;
+/* sample the SBC when the application arrives at the swap for the first
+ * frames, and every that many frames from then on */
+#define GH_JIT_SBC_INTERVAL	16
 
-/* flag bits */
-#define GH_GL_CURRENT		0x1
-#define GH_GL_NEVER_CURRENT	0x2
-#define GH_GL_INTERCEPT_DEBUG	0x4
-#define GH_GL_INJECT_DEBUG	0x8
+typedef struct {
+	int enabled;
+	int oml;			/* predict the vblanks via GLX_OML_sync_control */
+	uint64_t margin;		/* safety margin */
+	uint64_t release;		/* we returned from the swap, CLOCK_MONOTONIC */
+	uint64_t deadline;		/* the current frame should arrive at the swap until then, 0 if none */
+	uint64_t cpu;			/* average CPU time per frame */
+	uint64_t cpu_dev;		/* average absolute deviation of it */
+	uint64_t gpu_tail[GH_JIT_GPU_WINDOW];	/* the recent GPU lags at the swap, including 0 */
+	unsigned int gpu_count;		/* the number of lags measured, 0 if none yet */
+	uint64_t gpu;			/* their median */
+	/* the display model, all in ns of CLOCK_MONOTONIC */
+	uint64_t base_ust;		/* UST of the vblank base_msc, 0 if unknown */
+	int64_t base_msc;
+	uint64_t refresh;		/* the refresh period, 0 if unknown */
+	int64_t swaps;			/* the buffer swaps we did */
+	int64_t sbc_offset;		/* the swaps of the drawable before our first one */
+	int sbc_known;			/* sbc_offset was observed */
+	/* statistics */
+	unsigned long long frames;
+	unsigned long long delayed;
+	unsigned long long late;	/* frames arriving after their deadline */
+	uint64_t delay_ns;
+} GH_jit_start;
+
+/* the most recent swap interval set by the app or us, assuming the usual
+ * default of 1 */
+static volatile int swap_interval_current=1;
 
-static gl_context_creation_opts_t ctx_creation_opts = {
-	.mutex = PTHREAD_MUTEX_INITIALIZER,
-	.flags = 0,
-	.force_version = {-1, -1},
-	.force_version_min = {-1, -1},
-	.force_version_max = {-1, -1},
-	.force_flags_on = 0,
-	.force_flags_off = 0,
-	.force_profile_on = 0,
-	.force_profile_off = 0,
-	.force_no_error = -1,
-};
-static gl_context_t * volatile ctx_list=NULL;
-static volatile int ctx_counter=0;
-static pthread_mutex_t ctx_mutex=PTHREAD_MUTEX_INITIALIZER;
-static pthread_key_t ctx_current;
+static void
+jit_start_init(GH_jit_start *jit)
+{
+	memset(jit, 0, sizeof(*jit));
+	if (get_envi("GH_JIT_START", 0)) {
+		jit->enabled=1;
+		jit->margin=(uint64_t)get_envui("GH_JIT_START_MARGIN_USECS", 1000) * (uint64_t)1000UL;
+		GH_GET_GL_PROC(glXGetSyncValuesOML);
+		jit->oml=(GH_glXGetSyncValuesOML != NULL);
+		GH_verbose(GH_MSG_INFO, "just-in-time frame start, margin: %u usecs%s\n",
+				(unsigned)(jit->margin / 1000),
+				(jit->oml)?"":", GLX_OML_sync_control not available, only with the frame rate limiter");
+	}
+}
 
-/* forward declarations */
-static void APIENTRY
-GH_debug_callback(GLenum source, GLenum type, GLuint id, GLenum severity,
-		  GLsizei length, const GLchar *message, const GLvoid* userParam);
-static void APIENTRY
-GH_debug_callback_AMD(GLuint id, GLenum category, GLenum severity,
-		  GLsizei length, const GLchar *message, GLvoid* userParam);
+static void
+jit_start_destroy(GH_jit_start *jit)
+{
+	if (jit->enabled && jit->frames) {
+		GH_verbose(GH_MSG_INFO, "just-in-time frame start: %llu frames, %llu delayed by %.3f ms avg, "
+				"%llu late, CPU %.3f +/- %.3f ms, GPU %.3f ms, refresh %.3f ms\n",
+				jit->frames, jit->delayed,
+				(jit->delayed)?(double)jit->delay_ns * 1.0E-6 / (double)jit->delayed:0.0,
+				jit->late, (double)jit->cpu * 1.0E-6, (double)jit->cpu_dev * 1.0E-6,
+				(double)jit->gpu * 1.0E-6,
+				(double)jit->refresh * 1.0E-6);
+	}
+}
 
+/* The SBC counts the completed swaps of the drawable, our own count might
+ * have started later. Before our swap, the SBC is at most the swaps done so
+ * far, and equal to them whenever none of our frames is queued anymore,
+ * so the largest difference seen there is the offset. */
 static void
-add_ctx(gl_context_t *glc)
+jit_start_sbc(GH_jit_start *jit, Display *dpy, GLXDrawable drawable)
 {
-	pthread_mutex_lock(&ctx_mutex);
-	glc->next=ctx_list;
-	ctx_list=glc;
-	pthread_mutex_unlock(&ctx_mutex);
+	int64_t ust, msc, sbc;
+
+	if (GH_glXGetSyncValuesOML(dpy, drawable, &ust, &msc, &sbc)) {
+		if (!jit->sbc_known || sbc - jit->swaps > jit->sbc_offset) {
+			jit->sbc_offset=sbc - jit->swaps;
+			jit->sbc_known=1;
+		}
+	}
 }
 
-static gl_context_t *
-create_ctx(GLXContext ctx, unsigned int num)
+/* the application arrived at the buffer swap */
+static void
+jit_start_arrive(GH_jit_start *jit, Display *dpy, GLXDrawable drawable)
 {
-	gl_context_t *glc;
+	uint64_t now=get_time_ns(CLOCK_MONOTONIC);
 
-	glc=malloc(sizeof(*glc));
-	if (glc) {
-		glc->ctx=ctx;
-		glc->draw=None;
-		glc->read=None;
-		glc->inject_swapinterval=GH_SWAP_DONT_SET;
-		glc->flags=GH_GL_NEVER_CURRENT;
-		glc->num=num;
-		glc->original_debug_callback=(GLDEBUGPROC)NULL;
-		glc->original_debug_callback_AMD=(GLDEBUGPROCAMD)NULL;
-		glc->original_debug_callback_user_ptr=NULL;
-		glc->original_debug_callback_AMD_user_ptr=NULL;
+	if (jit->oml && (jit->frames < GH_JIT_SBC_INTERVAL || !(jit->frames % GH_JIT_SBC_INTERVAL))) {
+		jit_start_sbc(jit, dpy, drawable);
+	}
 
-		glc->swap_sleep_usecs=0;
-		frametimes_init(&glc->frametimes, GH_FRAMETIME_NONE, 0, 0, 0, num);
-		latency_init(&glc->latency, GH_LATENCY_NOP, 0, 1000000, 0, 0);
-		swapbuffer_omission_init(&glc->swapbuffer_omission);
+	if (jit->release) {
+		uint64_t cpu=now - jit->release;
+		uint64_t dev=(cpu > jit->cpu)?(cpu - jit->cpu):(jit->cpu - cpu);
+		jit->cpu_dev=(jit->cpu)?latency_predict_avg(jit->cpu_dev, dev):0;
+		jit->cpu=latency_predict_avg(jit->cpu, cpu);
+		jit->frames++;
 	}
-	return glc;
+	if (jit->deadline && now > jit->deadline) {
+		jit->late++;
+	}
+}
+
+/* a conservative prediction from the average and its deviation */
+#define GH_JIT_PREDICT(avg, dev) ((avg) + 2*(dev))
+
+/* the deadline of the next frame from the vblanks, 0 if unknown */
+static uint64_t
+jit_start_vblank_deadline(GH_jit_start *jit, Display *dpy, GLXDrawable drawable,
+			  uint64_t now, uint64_t *cap)
+{
+	int64_t ust, msc, sbc, queued;
+	uint64_t t,earliest;
+	uint64_t gpu=jit->gpu;
+	unsigned int n;
+
+	if (!GH_glXGetSyncValuesOML(dpy, drawable, &ust, &msc, &sbc)) {
+		return 0;
+	}
+	t=(uint64_t)ust * (uint64_t)1000UL;
+	if (t > now + (uint64_t)1000000000UL || t + (uint64_t)1000000000UL < now) {
+		GH_verbose(GH_MSG_WARNING, "just-in-time frame start: UST is not CLOCK_MONOTONIC, not using the vblanks\n");
+		jit->oml=0;
+		return 0;
+	}
+	if (!jit->base_ust || msc <= jit->base_msc) {
+		jit->base_ust=t;
+		jit->base_msc=msc;
+		return 0;
+	}
+	/* the refresh period, measured over at least 16 vblanks */
+	if (msc - jit->base_msc >= 16) {
+		jit->refresh=(t - jit->base_ust) / (uint64_t)(msc - jit->base_msc);
+		if (msc - jit->base_msc >= 1024) {
+			jit->base_ust=t;
+			jit->base_msc=msc;
+		}
+	}
+	/* our frames not presented yet, the offset might still be too small,
+	 * assume the frame just swapped until it is known */
+	queued=(jit->sbc_known)?(jit->swaps + jit->sbc_offset - sbc):1;
+	n=(unsigned int)abs(swap_interval_current);
+	if (!jit->refresh || !n) {
+		/* unknown refresh or not synchronized to the vblank */
+		return 0;
+	}
+	/* the queued frames are presented every n vblanks from the next one
+	 * on, so the last one at msc + 1 + (queued - 1) * n, and this one n
+	 * vblanks later at the earliest, or whenever it can be finished */
+	if (queued > 0) {
+		t += (uint64_t)(1 + (queued - 1) * (int64_t)n) * jit->refresh;
+	}
+	t += (uint64_t)n * jit->refresh;
+	earliest=now + GH_JIT_PREDICT(jit->cpu, jit->cpu_dev) + gpu + jit->margin;
+	if (t < earliest) {
+		t += ((earliest - t + jit->refresh - 1) / jit->refresh) * jit->refresh;
+	}
+	*cap=(uint64_t)n * jit->refresh;
+	return t - gpu;
 }
 
+/* delay the return from the buffer swap until the next frame should start,
+ * swapped tells if the buffers were actually swapped, gpu_valid if gpu_tail
+ * was measured at this swap */
 static void
-destroy_ctx(gl_context_t *glc)
+jit_start_wait(GH_jit_start *jit, const GH_fps_limit *fl, int swapped, int gpu_valid, uint64_t gpu_tail,
+	       Display *dpy, GLXDrawable drawable, GH_flight_recorder *fr)
 {
-	if (glc) {
-		frametimes_destroy(&glc->frametimes);
-		latency_destroy(&glc->latency);
-		swapbuffer_omission_destroy(&glc->swapbuffer_omission);
-		free(glc);
+	uint64_t now=get_time_ns(CLOCK_MONOTONIC);
+	uint64_t deadline=0,cap=0;
+
+	if (swapped) {
+		jit->swaps++;
+	}
+	if (gpu_valid) {
+		uint64_t sorted[GH_JIT_GPU_WINDOW];
+		unsigned int n;
+		jit->gpu_tail[jit->gpu_count++ % GH_JIT_GPU_WINDOW]=gpu_tail;
+		n=(jit->gpu_count < GH_JIT_GPU_WINDOW)?jit->gpu_count:GH_JIT_GPU_WINDOW;
+		memcpy(sorted, jit->gpu_tail, sizeof(*sorted) * n);
+		qsort(sorted, n, sizeof(*sorted), compare_u64);
+		jit->gpu=sorted[n/2];
+	}
+	if (fl->interval) {
+		deadline=fl->deadline;
+		cap=fl->interval;
+	} else if (jit->oml) {
+		deadline=jit_start_vblank_deadline(jit, dpy, drawable, now, &cap);
+	}
+	jit->deadline=deadline;
+	if (deadline && jit->frames) {
+		uint64_t need=GH_JIT_PREDICT(jit->cpu, jit->cpu_dev) + jit->margin;
+		if (deadline > now + need) {
+			uint64_t target=deadline - need;
+			uint64_t t0=(GH_EVENTS_ENABLED(fr))?get_time_ns(CLOCK_REALTIME):0;
+			if (target - now > cap) {
+				target=now + cap;
+			}
+			sleep_until_precise_ns(target, 0);
+			jit->delayed++;
+			jit->delay_ns += target - now;
+			if (t0) {
+				event_span(fr, GH_EVENT_JIT_DELAY, t0, get_time_ns(CLOCK_REALTIME), (long long)(target - now));
+			}
+		}
 	}
+	jit->release=get_time_ns(CLOCK_MONOTONIC);
 }
 
-static gl_context_t *
-find_ctx(GLXContext ctx)
+/***************************************************************************
+ * CPU/GPU CLOCK CALIBRATION                                               *
+ ***************************************************************************/
+
+/* The GL_TIMESTAMP values live in their own clock domain. We periodically
+ * sample pairs of (CPU time, GL time) and fit a linear model
+ *     cpu = base_cpu + offset + drift * (gl - base_gl)
+ * so that any GPU timestamp can be mapped onto the CPU timeline. */
+
+#define GH_CLOCK_CALIBRATION_SAMPLES_MAX 32
+#define GH_CLOCK_CALIBRATION_TRIES	 3
+/* samples closer together than this give no usable drift */
+#define GH_CLOCK_CALIBRATION_MIN_SPAN_NS 100000000ULL
+
+typedef struct {
+	unsigned int interval;		/* sample every n frames, 0 disables calibration */
+	unsigned int counter;		/* frames until the next sample */
+	unsigned int max_samples;	/* number of samples used for the fit */
+	unsigned int num_samples;	/* number of valid samples */
+	unsigned int cur_sample;	/* next sample in the ring buffer */
+	uint64_t cpu[GH_CLOCK_CALIBRATION_SAMPLES_MAX];
+	uint64_t gl[GH_CLOCK_CALIBRATION_SAMPLES_MAX];
+	uint64_t base_cpu;		/* base values of the fit */
+	uint64_t base_gl;
+	double offset;			/* offset in ns, relative to the base */
+	double drift;			/* CPU ns per GL ns */
+} GH_clock_calibration;
+
+static void
+clock_calibration_init(GH_clock_calibration *cal, unsigned int interval, unsigned int max_samples)
 {
-	gl_context_t *glc;
+	if (max_samples > GH_CLOCK_CALIBRATION_SAMPLES_MAX) {
+		max_samples = GH_CLOCK_CALIBRATION_SAMPLES_MAX;
+	} else if (max_samples < 2) {
+		max_samples = 2;
+	}
+	cal->interval=interval;
+	cal->counter=interval;
+	cal->max_samples=max_samples;
+	cal->num_samples=0;
+	cal->cur_sample=0;
+	cal->base_cpu=0;
+	cal->base_gl=0;
+	cal->offset=0.0;
+	cal->drift=1.0;
+}
 
-	pthread_mutex_lock(&ctx_mutex);
-	for (glc=ctx_list; glc; glc=glc->next)
-		if (glc->ctx == ctx)
-			break;
-	pthread_mutex_unlock(&ctx_mutex);
-	return glc;
+/* least squares fit over all samples in the ring buffer */
+static void
+clock_calibration_fit(GH_clock_calibration *cal)
+{
+	unsigned int i,idx;
+	double sx=0.0, sy=0.0, sxx=0.0, sxy=0.0;
+	double n=(double)cal->num_samples;
+	double denom;
+	uint64_t span;
+
+	/* use the oldest sample as base, so that the values stay small */
+	idx=(cal->cur_sample + cal->max_samples - cal->num_samples) % cal->max_samples;
+	cal->base_cpu=cal->cpu[idx];
+	cal->base_gl=cal->gl[idx];
+
+	for (i=0; i<cal->num_samples; i++) {
+		double x,y;
+		idx=(cal->cur_sample + cal->max_samples - cal->num_samples + i) % cal->max_samples;
+		x=(double)(int64_t)(cal->gl[idx] - cal->base_gl);
+		y=(double)(int64_t)(cal->cpu[idx] - cal->base_cpu);
+		sx += x;
+		sy += y;
+		sxx += x*x;
+		sxy += x*y;
+	}
+
+	/* the newest sample is the one just before cur_sample */
+	idx=(cal->cur_sample + cal->max_samples - 1) % cal->max_samples;
+	span=cal->cpu[idx] - cal->base_cpu;
+	denom=n*sxx - sx*sx;
+	if (span >= GH_CLOCK_CALIBRATION_MIN_SPAN_NS && denom > 0.0) {
+		cal->drift=(n*sxy - sx*sy)/denom;
+		cal->offset=(sy - cal->drift * sx)/n;
+	} else {
+		/* the jitter of the samples dominates over such a short
+		 * time, only determine the offset */
+		cal->drift=1.0;
+		cal->offset=(sy - sx)/n;
+	}
 }
 
 static void
-remove_ctx(GLXContext ctx)
+clock_calibration_sample(GH_clock_calibration *cal)
 {
-	gl_context_t *glc,*prev=NULL;
+	uint64_t best_cpu=0;
+	uint64_t best_gl=0;
+	uint64_t best_dur=UINT64_MAX;
+	int i;
 
-	pthread_mutex_lock(&ctx_mutex);
-	for (glc=ctx_list; glc; glc=glc->next) {
-		if (glc->ctx == ctx)
-			break;
-		prev=glc;
+	/* bracket the GL query by two CPU timestamps, and keep the tightest
+	 * bracket of a few tries to reduce the influence of preemption */
+	for (i=0; i<GH_CLOCK_CALIBRATION_TRIES; i++) {
+		GLint64 gl;
+		uint64_t t0,t1;
+
+		t0=get_time_ns(CLOCK_REALTIME);
+		GH_glGetInteger64v(GL_TIMESTAMP, &gl);
+		t1=get_time_ns(CLOCK_REALTIME);
+		if (t1 - t0 < best_dur) {
+			best_dur=t1 - t0;
+			best_cpu=t0 + best_dur/2;
+			best_gl=(uint64_t)gl;
+		}
 	}
-	if (glc) {
-		if (prev) 
-			prev->next=glc->next;
-		else
-			ctx_list=glc->next;
+
+	cal->cpu[cal->cur_sample]=best_cpu;
+	cal->gl[cal->cur_sample]=best_gl;
+	if (++cal->cur_sample >= cal->max_samples) {
+		cal->cur_sample=0;
 	}
-	pthread_mutex_unlock(&ctx_mutex);
-	if (glc) {
-		destroy_ctx(glc);
+	if (cal->num_samples < cal->max_samples) {
+		cal->num_samples++;
 	}
+	clock_calibration_fit(cal);
+	GH_verbose(GH_MSG_DEBUG, "clock calibration: %u samples, drift %.9f, offset %.0f ns, bracket %llu ns\n",
+			cal->num_samples, cal->drift, cal->offset, (unsigned long long)best_dur);
 }
 
+/* call once per frame */
 static void
-read_config(gl_context_t *glc)
+clock_calibration_update(GH_clock_calibration *cal)
 {
-	glc->inject_swapinterval=get_envi("GH_INJECT_SWAPINTERVAL", GH_SWAP_DONT_SET);
-	if (get_envi("GH_GL_DEBUG_OUTPUT",0)) {
-		glc->flags |= GH_GL_INTERCEPT_DEBUG;
-	}
-	if (get_envi("GH_GL_INJECT_DEBUG_OUTPUT",0)) {
-		glc->flags |= GH_GL_INJECT_DEBUG;
+	if (cal->interval && --cal->counter == 0) {
+		cal->counter=cal->interval;
+		clock_calibration_sample(cal);
 	}
 }
 
-static void
-create_context(GLXContext ctx)
+/* map a GL timestamp to the CPU timeline */
+static uint64_t
+clock_calibration_map(const GH_clock_calibration *cal, uint64_t gl)
 {
-	gl_context_t *glc;
-	unsigned int ctx_num;
+	double x=(double)(int64_t)(gl - cal->base_gl);
 
-	GH_verbose(GH_MSG_DEBUG, "created ctx %p\n",ctx);
+	return cal->base_cpu + (uint64_t)(int64_t)(cal->offset + cal->drift * x);
+}
 
-	pthread_mutex_lock(&ctx_mutex);
-	ctx_num=ctx_counter++;
-	if (!ctx_num) {
-		pthread_key_create(&ctx_current, NULL);
-		pthread_setspecific(ctx_current, NULL);
-		/* query the function pointers for the standard functions
-		 * which might be often called ... */
-		GH_GET_PTR_GL(glXSwapBuffers);
-		GH_GET_PTR_GL(glXMakeCurrent);
-		GH_GET_PTR_GL(glXMakeContextCurrent);
-		GH_GET_PTR_GL(glXMakeCurrentReadSGI);
-		GH_GET_PTR_GL(glFlush);
-		GH_GET_PTR_GL(glFinish);
+/***************************************************************************
+ * HEAP ALLOCATION ACCOUNTING                                              *
+ ***************************************************************************/
+
+/* With GH_MALLOC_INTERCEPT, we interpose malloc(3) and friends and count
+ * the allocations of each thread in thread-local counters, which are
+ * consumed by the frame timing measurements at each buffer swap. The
+ * real functions are the __libc_* aliases of glibc, so we neither need
+ * dlsym() nor any memory of our own to resolve them. */
+
+#ifdef GH_MALLOC_INTERCEPT
+#ifndef __GLIBC__
+#error GH_MALLOC_INTERCEPT requires glibc
+#endif
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void *__libc_memalign(size_t alignment, size_t size);
+extern void *__libc_valloc(size_t size);
+extern void *__libc_pvalloc(size_t size);
+extern void __libc_free(void *ptr);
+
+#define GH_ALLOC_LOG_DEPTH 32
+
+typedef struct {
+	unsigned long allocs;		/* malloc, calloc, realloc and aligned allocations */
+	unsigned long frees;		/* free calls (for non-NULL pointers) */
+	unsigned long long bytes;	/* bytes requested */
+	int in_hook;			/* reentrancy guard */
+} GH_alloc_counters;
+
+/* initial-exec: the TLS must never be allocated lazily, as that would call malloc */
+static __thread GH_alloc_counters alloc_counters __attribute__((tls_model("initial-exec")));
+
+static struct {
+	volatile int enabled;
+	size_t log_threshold;		/* log allocations of at least that many bytes, 0 to disable */
+	int log_fd;
+} alloc_config = { 0, 0, -1 };
+
+/* log a large allocation with a backtrace, this does not use stdio */
+static void
+alloc_log(const char *func, size_t size)
+{
+	void *bt[GH_ALLOC_LOG_DEPTH];
+	char buf[128];
+	int len,n;
+
+	len=snprintf(buf, sizeof(buf), "%s(%lu) thread %d\n", func, (unsigned long)size, (int)syscall(SYS_gettid));
+	if (len > 0 && write(alloc_config.log_fd, buf, (size_t)len) < 0) {
+		return;
 	}
-	pthread_mutex_unlock(&ctx_mutex);
-	
-	glc=create_ctx(ctx, ctx_num);
-	if (glc) {
-		read_config(glc);
-		/* add to our list */
-		add_ctx(glc);
-	} else {
-		GH_verbose(GH_MSG_ERROR, "out of memory\n");
+	n=backtrace(bt, GH_ALLOC_LOG_DEPTH);
+	/* skip our own frames */
+	if (n > 2) {
+		backtrace_symbols_fd(bt + 2, n - 2, alloc_config.log_fd);
 	}
+}
+
+static inline void
+alloc_count(const char *func, size_t size)
+{
+	GH_alloc_counters *c=&alloc_counters;
 
+	if (!alloc_config.enabled || c->in_hook) {
+		return;
+	}
+	c->allocs++;
+	c->bytes += size;
+	if (alloc_config.log_threshold && size >= alloc_config.log_threshold) {
+		c->in_hook=1;
+		alloc_log(func, size);
+		c->in_hook=0;
+	}
 }
 
-static void
-destroy_context(GLXContext ctx)
+static inline void
+alloc_count_free(void)
 {
-	GH_verbose(GH_MSG_INFO, "destroyed ctx %p\n",ctx);
-	remove_ctx(ctx);
+	if (alloc_config.enabled) {
+		alloc_counters.frees++;
+	}
 }
 
 static void
-make_current(GLXContext ctx, Display *dpy, GLXDrawable draw, GLXDrawable read)
+alloc_init(void)
 {
-	gl_context_t *glc;
+	const char *file;
+	void *dummy[1];
 
-	glc=(gl_context_t*)pthread_getspecific(ctx_current);
-	if (glc) {
-		/* old context */
-		glc->flags &= ~GH_GL_CURRENT;
-		GH_verbose(GH_MSG_DEBUG, "unbound context %p\n",glc->ctx);
+	if (alloc_config.enabled) {
+		return;
 	}
-	
-	if (ctx) {
-		glc=find_ctx(ctx);
-
-		if (glc == NULL) {
-			GH_verbose(GH_MSG_WARNING, "app tried to make current non-existing context %p\n",ctx);
-		} else {
-			glc->draw=draw;
-			glc->read=read;
-			glc->flags |= GH_GL_CURRENT;
-			GH_verbose(GH_MSG_DEBUG, "made current context %p\n",ctx);
-			if (glc->flags & GH_GL_NEVER_CURRENT) {
-				unsigned int ft_delay=get_envui("GH_FRAMETIME_DELAY", 10);
-				unsigned int ft_frames=get_envui("GH_FRAMETIME_FRAMES", 1000);
-				GH_frametime_mode ft_mode=(GH_frametime_mode)get_envi("GH_FRAMETIME", (int)GH_FRAMETIME_NONE);
-				int latency=get_envi("GH_LATENCY", GH_LATENCY_NOP);
-				int latency_manual_wait=get_envi("GH_LATENCY_MANUAL_WAIT", -1);
-				unsigned int latency_gl_wait_timeout=get_envui("GH_LATENCY_GL_WAIT_TIMEOUT_USECS", 1000000);
-				unsigned int latency_gl_wait_interval=get_envui("GH_LATENCY_GL_WAIT_USECS", 0);
-				unsigned int latency_self_wait_interval=get_envui("GH_LATENCY_WAIT_USECS", 0);
-				/* made current for the first time */
-				glc->flags &= ~ GH_GL_NEVER_CURRENT;
-
-				glc->swap_sleep_usecs=(useconds_t)get_envui("GH_SWAP_SLEEP_USECS",0);
-				frametimes_init(&glc->frametimes, ft_mode, ft_delay, GH_FRAMETIME_COUNT, ft_frames, glc->num);
-				frametimes_init_base(&glc->frametimes);
-				latency_init(&glc->latency, latency, latency_manual_wait, latency_gl_wait_timeout, latency_gl_wait_interval, latency_self_wait_interval);
-				swapbuffer_omission_init_gl(&glc->swapbuffer_omission);
-				if (glc->inject_swapinterval != GH_SWAP_DONT_SET) {
-					GH_GET_PTR_GL(glXSwapIntervalEXT);
-					if (GH_glXSwapIntervalEXT) {
-						GH_verbose(GH_MSG_INFO, "injecting swap interval: %d\n",
-								glc->inject_swapinterval);
-						GH_glXSwapIntervalEXT(dpy, glc->draw, glc->inject_swapinterval);
-					} else {
-						GH_GET_PTR_GL(glXSwapIntervalSGI);
-						if (GH_glXSwapIntervalEXT) {
-							GH_verbose(GH_MSG_INFO, "injecting swap interval: %d\n",
-									glc->inject_swapinterval);
-							GH_glXSwapIntervalSGI(glc->inject_swapinterval);
-						}
-					}
-				}
-				if (glc->flags & GH_GL_INJECT_DEBUG) {
-					GH_GET_PTR_GL(glDebugMessageCallback);
-					if (GH_glDebugMessageCallback) {
-						GH_glDebugMessageCallback(GH_debug_callback, glc);
-						GH_verbose(GH_MSG_INFO, "injecting debug callback [core]\n");
-					} else {
-						GH_GET_PTR_GL(glDebugMessageCallbackARB);
-						if (GH_glDebugMessageCallbackARB) {
-							GH_glDebugMessageCallbackARB(GH_debug_callback, glc);
-							GH_verbose(GH_MSG_INFO, "injecting debug callback [ARB]\n");
-						} else {
-							GH_GET_PTR_GL(glDebugMessageCallbackKHR);
-							if (GH_glDebugMessageCallbackKHR) {
-								GH_glDebugMessageCallbackKHR(GH_debug_callback, glc);
-								GH_verbose(GH_MSG_INFO, "injecting debug callback [KHR]\n");
-							} else {
-								GH_GET_PTR_GL(glDebugMessageCallbackAMD);
-								if (GH_glDebugMessageCallbackAMD) {
-									GH_glDebugMessageCallbackAMD(GH_debug_callback_AMD, glc);
-									GH_verbose(GH_MSG_INFO, "injecting debug callback [AMD]\n");
-								} else {
-									GH_verbose(GH_MSG_WARNING, "failed ot iject debug message callback\n");
-								}
-							}
-						}
-					}
-				}
-			}
+	alloc_config.log_threshold=(size_t)get_envui("GH_FRAMETIME_ALLOC_LOG_BYTES", 0);
+	if (alloc_config.log_threshold) {
+		file=getenv("GH_FRAMETIME_ALLOC_LOG_FILE");
+		if (file && file[0]) {
+			char buf[PATH_MAX];
+			parse_name(buf, sizeof(buf), file, 0);
+			alloc_config.log_fd=open(buf, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
 		}
-	} else {
-		glc=NULL;
+		if (alloc_config.log_fd < 0) {
+			alloc_config.log_fd=2;
+		}
+		/* backtrace(3) might allocate at the first call */
+		backtrace(dummy, 1);
 	}
+	alloc_config.enabled=1;
+	GH_verbose(GH_MSG_INFO, "counting heap allocations\n");
+}
 
-	pthread_setspecific(ctx_current, glc);
+/* get the counters of the calling thread since the last call */
+static void
+alloc_take(unsigned long *allocs, unsigned long *frees, unsigned long long *bytes)
+{
+	GH_alloc_counters *c=&alloc_counters;
+
+	*allocs=c->allocs;
+	*frees=c->frees;
+	*bytes=c->bytes;
+	c->allocs=0;
+	c->frees=0;
+	c->bytes=0;
 }
+#endif /* GH_MALLOC_INTERCEPT */
 
-/****************************************************************************
- * GL DEBUG MESSAGES                                                        *
- ****************************************************************************/
+/***************************************************************************
+ * DEBUG MARKERS                                                           *
+ ***************************************************************************/
 
-/* Newer versions of the GL support the generation of human-readable messages
-   for GL errors, performance warnings and hints. These messages are
-   forwarded to a debug callback which has to be registered with the GL
-   context. Debug output may only be available in special debug context... */
+/* The debug groups and markers of the application are interned into a
+ * process-wide string table, so that the per-frame infos only need to
+ * store integer IDs. ID 0 means "no marker". Strings are never freed. */
 
-/* translate the debug message "source" enum to human-readable string */
-static const char *
-translateDebugSourceEnum(GLenum source)
+#define GH_MARKER_LENGTH_MAX	256
+#define GH_MARKER_COUNT_MAX	65536
+#define GH_MARKER_DEPTH_MAX	64
+
+typedef struct {
+	pthread_mutex_t mutex;
+	char **string;			/* indexed by ID */
+	unsigned int count;		/* number of IDs, including 0 */
+	unsigned int capacity;
+	unsigned int *hash;		/* open addressing, stores IDs, 0 if empty */
+	unsigned int hash_size;		/* power of two */
+} GH_marker_table;
+
+static GH_marker_table marker_table={PTHREAD_MUTEX_INITIALIZER, NULL, 1, 0, NULL, 0};
+
+/* per-context marker state */
+typedef struct {
+	int enabled;
+	unsigned int depth;		/* nesting depth of the groups */
+	unsigned int outer;		/* the outermost open group */
+	unsigned int group;		/* the first outermost group of the current frame */
+	unsigned int event;		/* the most recent event marker, kept across frames */
+	unsigned int written;		/* IDs already written to the output */
+} GH_markers;
+
+static uint32_t
+marker_hash(const char *str, size_t len)
 {
-	const char *s;
+	uint32_t hash=2166136261U; /* FNV-1a */
+	size_t i;
 
-	switch (source) {
-		case GL_DEBUG_SOURCE_API:
-			s="API";
-			break;
-		case GL_DEBUG_SOURCE_WINDOW_SYSTEM:
-			s="window system";
-			break;
-		case GL_DEBUG_SOURCE_SHADER_COMPILER:
-			s="shader compiler";
-			break;
-		case GL_DEBUG_SOURCE_THIRD_PARTY:
-			s="3rd party";
-			break;
-		case GL_DEBUG_SOURCE_APPLICATION:
-			s="application";
-			break;
-		case GL_DEBUG_SOURCE_OTHER:
-			s="other";
-			break;
-		default:
-			s="[UNKNOWN SOURCE]";
+	for (i=0; i<len; i++) {
+		hash=(hash ^ (uint32_t)(unsigned char)str[i]) * 16777619U;
 	}
-
-	return s;
+	return hash;
 }
 
-/* translate the debug message "category" enum to human-readable string */
-static const char *
-translateDebugCategoryEnum(GLenum cat)
+/* grow the table, must be called with the mutex locked */
+static int
+marker_table_grow(GH_marker_table *tbl)
 {
-	const char *s;
+	unsigned int new_size=(tbl->hash_size)?(tbl->hash_size * 2):256;
+	unsigned int *new_hash=calloc(new_size, sizeof(*new_hash));
+	char **new_string=realloc(tbl->string, sizeof(*new_string) * (new_size/2));
+	unsigned int i;
 
-	switch (cat) {
-		case GL_DEBUG_CATEGORY_API_ERROR_AMD:
-			s="API error";
-			break;
-		case GL_DEBUG_CATEGORY_WINDOW_SYSTEM_AMD:
-			s="window system";
-			break;
-		case GL_DEBUG_CATEGORY_DEPRECATION_AMD:
-			s="deprecation";
-			break;
-		case GL_DEBUG_CATEGORY_UNDEFINED_BEHAVIOR_AMD:
-			s="undefined behavior";
-			break;
-		case GL_DEBUG_CATEGORY_PERFORMANCE_AMD:
-			s="performance";
-			break;
-		case GL_DEBUG_CATEGORY_SHADER_COMPILER_AMD:
-			s="shader compiler";
-			break;
-		case GL_DEBUG_CATEGORY_APPLICATION_AMD:
-			s="application";
-			break;
-		case GL_DEBUG_CATEGORY_OTHER_AMD:
-			s="other";
-			break;
-		default:
-			s="[UNKNOWN CATEGORY]";
+	if (!new_hash || !new_string) {
+		free(new_hash);
+		if (new_string) {
+			tbl->string=new_string;
+		}
+		return -1;
+	}
+	tbl->string=new_string;
+	tbl->string[0]=NULL;
+	tbl->capacity=new_size/2;
+	for (i=1; i<tbl->count; i++) {
+		uint32_t h=marker_hash(tbl->string[i], strlen(tbl->string[i])) & (new_size - 1);
+		while (new_hash[h]) {
+			h=(h+1) & (new_size - 1);
+		}
+		new_hash[h]=i;
 	}
-
-	return s;
+	free(tbl->hash);
+	tbl->hash=new_hash;
+	tbl->hash_size=new_size;
+	return 0;
 }
 
-/* translate the debug message "type" enum to human-readable string */
-static const char *
-translateDebugTypeEnum(GLenum type)
+/* get the ID of a marker string, a negative length means NUL-terminated */
+static unsigned int
+marker_intern(const char *str, GLsizei length)
 {
-	const char *s;
+	static int warned=0;
+	GH_marker_table *tbl=&marker_table;
+	size_t len;
+	uint32_t h;
+	unsigned int id;
 
-	switch (type) {
-		case GL_DEBUG_TYPE_ERROR:
-			s="error";
-			break;
-		case GL_DEBUG_TYPE_DEPRECATED_BEHAVIOR:
-			s="deprecated";
-			break;
-		case GL_DEBUG_TYPE_UNDEFINED_BEHAVIOR:
-			s="undefined behavior";
-			break;
-		case GL_DEBUG_TYPE_PORTABILITY:
-			s="portability";
-			break;
-		case GL_DEBUG_TYPE_PERFORMANCE:
-			s="performance";
-			break;
-		case GL_DEBUG_TYPE_OTHER:
-			s="other";
-			break;
-		default:
-			s="[UNKNOWN TYPE]";
+	if (!str) {
+		return 0;
 	}
-	return s;
+	if (length < 0) {
+		len=strnlen(str, GH_MARKER_LENGTH_MAX);
+	} else {
+		len=((size_t)length < GH_MARKER_LENGTH_MAX)?(size_t)length:GH_MARKER_LENGTH_MAX;
+		len=strnlen(str, len);
+	}
+
+	pthread_mutex_lock(&tbl->mutex);
+	if (tbl->count >= tbl->capacity && tbl->count < GH_MARKER_COUNT_MAX) {
+		marker_table_grow(tbl);
+	}
+	if (!tbl->hash_size) {
+		pthread_mutex_unlock(&tbl->mutex);
+		return 0;
+	}
+	h=marker_hash(str, len) & (tbl->hash_size - 1);
+	while ( (id=tbl->hash[h]) ) {
+		const char *cur=tbl->string[id];
+		if (!strncmp(cur, str, len) && cur[len] == 0) {
+			pthread_mutex_unlock(&tbl->mutex);
+			return id;
+		}
+		h=(h+1) & (tbl->hash_size - 1);
+	}
+	if (tbl->count >= tbl->capacity) {
+		pthread_mutex_unlock(&tbl->mutex);
+		if (!warned) {
+			GH_verbose(GH_MSG_WARNING, "markers: too many different markers, ignoring new ones\n");
+			warned=1;
+		}
+		return 0;
+	}
+	id=tbl->count;
+	if (!(tbl->string[id]=strndup(str, len))) {
+		pthread_mutex_unlock(&tbl->mutex);
+		return 0;
+	}
+	tbl->hash[h]=id;
+	tbl->count++;
+	pthread_mutex_unlock(&tbl->mutex);
+	return id;
 }
 
-/* translate the debug message "xeverity" enum to human-readable string */
+/* get the string of a marker ID, the strings are never freed */
 static const char *
-translateDebugSeverityEnum(GLenum severity)
+marker_name(unsigned int id)
 {
-	const char *s;
+	const char *name="";
 
-	switch (severity) {
-		case GL_DEBUG_SEVERITY_HIGH:
-			s="high";
-			break;
-		case GL_DEBUG_SEVERITY_MEDIUM:
-			s="medium";
-			break;
-		case GL_DEBUG_SEVERITY_LOW:
-			s="low";
-			break;
-		case GL_DEBUG_SEVERITY_NOTIFICATION:
-			s="notification";
-			break;
-		default:
-			s="[UNKNOWN SEVERITY]";
+	pthread_mutex_lock(&marker_table.mutex);
+	if (id && id < marker_table.count) {
+		name=marker_table.string[id];
 	}
-
-	return s;
+	pthread_mutex_unlock(&marker_table.mutex);
+	return name;
 }
 
-/* our debug callback */
-static void APIENTRY
-GH_debug_callback(GLenum source, GLenum type, GLuint id, GLenum severity,
-		  GLsizei length, const GLchar *message, const GLvoid* userParam)
+/* write all markers not yet written as "# marker ID string" lines */
+static void
+marker_table_dump(FILE *f, unsigned int *written)
 {
-	const gl_context_t *glc=(const gl_context_t*)userParam;
-	if (glc) {
-		GH_verbose(GH_MSG_INFO, "GLDEBUG: %s %s %s [0x%x]: %s\n",
-					translateDebugSourceEnum(source),
-					translateDebugTypeEnum(type),
-					translateDebugSeverityEnum(severity),
-					id, message);
-		if (glc->original_debug_callback) {
-			glc->original_debug_callback(source, type, id, severity,
-						     length, message, glc->original_debug_callback_user_ptr);
+	GH_marker_table *tbl=&marker_table;
+	unsigned int id;
+
+	pthread_mutex_lock(&tbl->mutex);
+	for (id=*written+1; id<tbl->count; id++) {
+		const char *c;
+		fprintf(f, "# marker %u ", id);
+		for (c=tbl->string[id]; *c; c++) {
+			fputc((*c == '\n' || *c == '\r')?' ':*c, f);
 		}
+		fputc('\n', f);
 	}
+	if (tbl->count > 1) {
+		*written=tbl->count - 1;
+	}
+	pthread_mutex_unlock(&tbl->mutex);
 }
 
-/* our debug callback AMD */
-static void APIENTRY
-GH_debug_callback_AMD(GLuint id, GLenum category, GLenum severity,
-		  GLsizei length, const GLchar *message, GLvoid* userParam)
+static void
+markers_init(GH_markers *m, int enabled)
 {
-	const gl_context_t *glc=(const gl_context_t*)userParam;
+	memset(m, 0, sizeof(*m));
+	m->enabled=enabled;
+}
 
-	if (glc) {
-		GH_verbose(GH_MSG_INFO, "GLDEBUG[AMD]: %s %s %s [0x%x]: %s\n",
-					translateDebugCategoryEnum(category),
-					translateDebugSeverityEnum(severity),
-					id, message);
-		if (glc->original_debug_callback_AMD) {
-			glc->original_debug_callback_AMD(id, category, severity,
-							 length, message,
-							 glc->original_debug_callback_AMD_user_ptr);
+static void
+markers_push(GH_markers *m, unsigned int id)
+{
+	if (m->depth == 0) {
+		m->outer=id;
+		if (!m->group) {
+			m->group=id;
 		}
 	}
+	m->depth++;
+}
+
+static void
+markers_pop(GH_markers *m)
+{
+	if (m->depth > 0) {
+		m->depth--;
+	}
 }
 
 /***************************************************************************
- * GL context creation overrides                                           *
+ * GPU TIME PER DEBUG GROUP                                                *
  ***************************************************************************/
 
-static void context_creation_opts_init(gl_context_creation_opts_t *opts)
-{
-	opts->force_profile_on = 0;
-	opts->force_profile_off = 0;
-	opts->force_flags_on = 0;
-	opts->force_flags_off = 0;
-	opts->force_no_error = -1;
+/* Each debug group pushed by the application is bracketed by a pair of
+ * GL_TIMESTAMP queries from a pool allocated up front. Groups still open
+ * at the end of a frame are split, so every frame is self-contained. The
+ * results are read back when they are available, but not before the
+ * configured delay, and at the latest when the pool runs out of space. */
 
-	if (get_envi("GH_FORCE_GL_CONTEXT_PROFILE_CORE", 0)) {
-		opts->force_profile_on = GLX_CONTEXT_CORE_PROFILE_BIT_ARB;
-		opts->force_profile_off = GLX_CONTEXT_COMPATIBILITY_PROFILE_BIT_ARB;
-	}
+#define GH_GPU_GROUP_NONE	UINT_MAX
 
-	int value = get_envi("GH_FORCE_GL_CONTEXT_PROFILE_COMPAT", 0);
-	if (value == 1) {
-		opts->force_profile_on = GLX_CONTEXT_COMPATIBILITY_PROFILE_BIT_ARB;
-		opts->force_profile_off = GLX_CONTEXT_CORE_PROFILE_BIT_ARB;
-	} else if (value == 2) {
-		opts->flags |= GH_GLCTX_COMPAT_IF_LEGACY;
-	}
-	if (get_envi("GH_FORCE_GL_CONTEXT_FLAGS_NO_FORWARD_COMPAT", 0)) {
-		opts->force_flags_on &= ~GLX_CONTEXT_FORWARD_COMPATIBLE_BIT_ARB;
-		opts->force_flags_off |= GLX_CONTEXT_FORWARD_COMPATIBLE_BIT_ARB;
-	}
-	if (get_envi("GH_FORCE_GL_CONTEXT_FLAGS_NO_DEBUG", 0)) {
-		opts->force_flags_on &= ~GLX_CONTEXT_DEBUG_BIT_ARB;
-		opts->force_flags_off |= GLX_CONTEXT_DEBUG_BIT_ARB;
-	}
-	if (get_envi("GH_FORCE_GL_CONTEXT_FLAGS_FORWARD_COMPAT", 0)) {
-		opts->force_flags_on |= GLX_CONTEXT_FORWARD_COMPATIBLE_BIT_ARB;
-		opts->force_flags_off &= ~GLX_CONTEXT_FORWARD_COMPATIBLE_BIT_ARB;
-	}
-	if (get_envi("GH_FORCE_GL_CONTEXT_FLAGS_DEBUG", 0)) {
-		opts->force_flags_on |= GLX_CONTEXT_DEBUG_BIT_ARB;
-		opts->force_flags_off &= ~GLX_CONTEXT_DEBUG_BIT_ARB;
-	}
-	if (get_envi("GH_FORCE_GL_CONTEXT_FLAGS_NO_ERROR", 0)) {
-		opts->force_no_error = GL_TRUE;
-	}
-	if (get_envi("GH_FORCE_GL_CONTEXT_FLAGS_ERROR", 0)) {
-		opts->force_no_error = GL_FALSE;
-	}
+typedef struct {
+	unsigned int id;		/* marker ID of the group */
+	GLuint query[2];		/* begin and end timestamp */
+} GH_gpu_group;
 
-	opts->force_version[0] = get_envi("GH_FORCE_GL_VERSION_MAJOR", opts->force_version[0]);
-	opts->force_version[1] = get_envi("GH_FORCE_GL_VERSION_MINOR", opts->force_version[1]);
+typedef struct {
+	unsigned int frame;
+	unsigned int first;		/* position of the first group */
+	unsigned int count;
+	unsigned int dropped;		/* groups which did not fit into the pool */
+} GH_gpu_group_frame;
 
-	opts->force_version_min[0] = get_envi("GH_FORCE_MIN_GL_VERSION_MAJOR", opts->force_version_min[0]);
-	opts->force_version_min[1] = get_envi("GH_FORCE_MIN_GL_VERSION_MINOR", opts->force_version_min[1]);
+typedef struct {
+	unsigned int id;
+	unsigned int count;
+	uint64_t time;
+} GH_gpu_group_sum;
 
-	opts->force_version_max[0] = get_envi("GH_FORCE_MAX_GL_VERSION_MAJOR", opts->force_version_max[0]);
-	opts->force_version_max[1] = get_envi("GH_FORCE_MAX_GL_VERSION_MINOR", opts->force_version_max[1]);
-	
-	opts->force_flags_on = get_envi("GH_FORCE_GL_CONTEXT_FLAGS_ON", opts->force_flags_on);
-	opts->force_flags_off = get_envi("GH_FORCE_GL_CONTEXT_FLAGS_OFF", opts->force_flags_off);
+typedef struct {
+	int enabled;
+	unsigned int capacity;		/* number of groups in the pool, power of two */
+	unsigned int head;		/* next group to use, wraps around */
+	unsigned int tail;		/* oldest group not read back yet */
+	unsigned int frame_first;	/* first group of the current frame */
+	GH_gpu_group *group;
+	GLuint *queries;
+	unsigned int max_frames;	/* pending frames */
+	unsigned int frame_head;
+	unsigned int frame_tail;
+	GH_gpu_group_frame *frames;
+	unsigned int delay;
+	unsigned int depth;
+	unsigned int open[GH_MARKER_DEPTH_MAX];	/* positions of the open groups */
+	unsigned int open_id[GH_MARKER_DEPTH_MAX];	/* marker IDs of the open groups */
+	unsigned int frame_dropped;	/* groups dropped in the current frame */
+	unsigned long measured;
+	unsigned long dropped;
+	GH_gpu_group_sum *sum;		/* scratch space for one frame */
+	FILE *file;
+	unsigned int written;		/* marker IDs written to the file */
+	unsigned int ctx_num;
+} GH_gpu_groups;
 
-	opts->force_profile_on = get_envi("GH_FORCE_GL_CONTEXT_PROFILE_MASK_ON", opts->force_profile_on);
-	opts->force_profile_off = get_envi("GH_FORCE_GL_CONTEXT_PROFILE_MASK_OFF", opts->force_profile_off);
+static void
+gpu_groups_init(GH_gpu_groups *gg, unsigned int capacity, unsigned int delay, unsigned int ctx_num)
+{
+	char buf[PATH_MAX];
+	unsigned int size=64;
 
-	GH_verbose(GH_MSG_DEBUG, "got GL override options: force version %d.%d, min %d.%d, max %d.%d, flags +0x%x -0x%x, profile flags: +0x%x -0x%x, no error: %d\n",
-		opts->force_version[0],opts->force_version[1],
-		opts->force_version_min[0], opts->force_version_min[1],
-		opts->force_version_max[0], opts->force_version_max[1],
-		(unsigned)opts->force_flags_on, (unsigned)opts->force_flags_off,
-		(unsigned)opts->force_profile_on, (unsigned)opts->force_profile_off,
-		opts->force_no_error);
+	memset(gg, 0, sizeof(*gg));
+	gg->ctx_num=ctx_num;
+	if (!capacity) {
+		return;
+	}
+	while (size < capacity && size < 65536) {
+		size *= 2;
+	}
+	gg->capacity=size;
+	gg->delay=(delay)?delay:1;
+	gg->max_frames=2 * gg->delay + 1;
+	gg->group=calloc(gg->capacity, sizeof(*gg->group));
+	gg->queries=calloc(2 * gg->capacity, sizeof(*gg->queries));
+	gg->frames=calloc(gg->max_frames, sizeof(*gg->frames));
+	gg->sum=calloc(gg->capacity, sizeof(*gg->sum));
+	if (!gg->group || !gg->queries || !gg->frames || !gg->sum) {
+		GH_verbose(GH_MSG_WARNING, "failed to allocate memory for %u GPU debug groups\n", gg->capacity);
+		free(gg->group);
+		free(gg->queries);
+		free(gg->frames);
+		free(gg->sum);
+		memset(gg, 0, sizeof(*gg));
+		return;
+	}
+	parse_name(buf, sizeof(buf), get_envs("GH_FRAMETIME_GPU_GROUPS_FILE", "glx_hook_gpu_groups-ctx%c.txt"), ctx_num);
+	gg->file=fopen(buf, "wt");
+	if (!gg->file) {
+		GH_verbose(GH_MSG_WARNING, "failed to open '%s', GPU debug group times go to stderr\n", buf);
+		gg->file=stderr;
+	}
+	GH_glGenQueries((GLsizei)(2 * gg->capacity), gg->queries);
+	for (size=0; size<gg->capacity; size++) {
+		gg->group[size].query[0]=gg->queries[2*size];
+		gg->group[size].query[1]=gg->queries[2*size+1];
+	}
+	gg->enabled=1;
+	GH_verbose(GH_MSG_INFO, "GPU debug group timing ctx %u: %u groups\n", ctx_num, gg->capacity);
 }
 
-static int need_creation_override(const gl_context_creation_opts_t *opts)
+static void
+gpu_groups_destroy(GH_gpu_groups *gg)
 {
-	if (opts->force_version[0] >= 0 || opts->force_version[1] >= 0) {
-		return 1;
+	if (!gg->enabled) {
+		return;
 	}
-	if (opts->force_version_min[0] >= 0 || opts->force_version_min[1] >= 0) {
-		return 1;
+	GH_verbose((gg->dropped)?GH_MSG_WARNING:GH_MSG_INFO, "GPU debug group timing ctx %u: %lu groups measured, %lu dropped%s\n",
+			gg->ctx_num, gg->measured, gg->dropped,
+			(gg->dropped)?", increase GH_FRAMETIME_GPU_GROUPS":"");
+	if (GH_glDeleteQueries) {
+		GH_glDeleteQueries((GLsizei)(2 * gg->capacity), gg->queries);
 	}
-	if (opts->force_version_max[0] >= 0 || opts->force_version_max[1] >= 0) {
-		return 1;
+	if (gg->file && gg->file != stderr) {
+		fclose(gg->file);
+	}
+	free(gg->group);
+	free(gg->queries);
+	free(gg->frames);
+	free(gg->sum);
+	memset(gg, 0, sizeof(*gg));
+}
+
+/* start a group, returns its position or GH_GPU_GROUP_NONE */
+static unsigned int
+gpu_groups_begin(GH_gpu_groups *gg, unsigned int id)
+{
+	GH_gpu_group *g;
+	unsigned int pos=gg->head;
+
+	if (pos - gg->tail >= gg->capacity) {
+		gg->frame_dropped++;
+		gg->dropped++;
+		return GH_GPU_GROUP_NONE;
+	}
+	g=&gg->group[pos & (gg->capacity - 1)];
+	g->id=id;
+	GH_glQueryCounter(g->query[0], GL_TIMESTAMP);
+	gg->head++;
+	return pos;
+}
+
+static void
+gpu_groups_end(GH_gpu_groups *gg, unsigned int pos)
+{
+	if (pos != GH_GPU_GROUP_NONE) {
+		GH_glQueryCounter(gg->group[pos & (gg->capacity - 1)].query[1], GL_TIMESTAMP);
+	}
+}
+
+static void
+gpu_groups_push(GH_gpu_groups *gg, unsigned int id)
+{
+	if (gg->depth < GH_MARKER_DEPTH_MAX) {
+		gg->open[gg->depth]=gpu_groups_begin(gg, id);
+		gg->open_id[gg->depth]=id;
+	}
+	gg->depth++;
+}
+
+static void
+gpu_groups_pop(GH_gpu_groups *gg)
+{
+	if (gg->depth > 0) {
+		gg->depth--;
+		if (gg->depth < GH_MARKER_DEPTH_MAX) {
+			gpu_groups_end(gg, gg->open[gg->depth]);
+		}
+	}
+}
+
+/* read back the results of the oldest pending frame and write them */
+static void
+gpu_groups_read(GH_gpu_groups *gg, const GH_clock_calibration *cal)
+{
+	const GH_gpu_group_frame *fr=&gg->frames[gg->frame_tail % gg->max_frames];
+	int do_trace=(trace.file && cal->interval && cal->num_samples);
+	unsigned int num_sums=0;
+	unsigned int i,j;
+
+	for (i=0; i<fr->count; i++) {
+		const GH_gpu_group *g=&gg->group[(fr->first + i) & (gg->capacity - 1)];
+		GLuint64 t0=0,t1=0;
+		GH_glGetQueryObjectui64v(g->query[0], GL_QUERY_RESULT, &t0);
+		GH_glGetQueryObjectui64v(g->query[1], GL_QUERY_RESULT, &t1);
+		/* the number of distinct groups per frame is usually small */
+		for (j=0; j<num_sums; j++) {
+			if (gg->sum[j].id == g->id) {
+				break;
+			}
+		}
+		if (j == num_sums) {
+			gg->sum[j].id=g->id;
+			gg->sum[j].count=0;
+			gg->sum[j].time=0;
+			num_sums++;
+		}
+		gg->sum[j].count++;
+		gg->sum[j].time += (uint64_t)(t1 - t0);
+		if (do_trace) {
+			char name[2*GH_MARKER_LENGTH_MAX];
+			trace_escape(name, sizeof(name), marker_name(g->id));
+			trace_span_track(name, clock_calibration_map(cal, (uint64_t)t0),
+					clock_calibration_map(cal, (uint64_t)t1),
+					GH_TRACE_TID_GPU(gg->ctx_num), "frame", (long long)fr->frame);
+		}
+	}
+	if (num_sums) {
+		marker_table_dump(gg->file, &gg->written);
+	}
+	if (fr->dropped) {
+		fprintf(gg->file, "# frame %u: %u groups dropped\n", fr->frame, fr->dropped);
+	}
+	gg->measured += fr->count;
+	for (j=0; j<num_sums; j++) {
+		fprintf(gg->file, "%u\t%u\t%u\t%llu\n", fr->frame, gg->sum[j].id, gg->sum[j].count,
+				(unsigned long long)gg->sum[j].time);
+	}
+	gg->tail=fr->first + fr->count;
+	gg->frame_tail++;
+}
+
+/* check if the results of the oldest pending frame are available */
+static int
+gpu_groups_available(const GH_gpu_groups *gg)
+{
+	const GH_gpu_group_frame *fr=&gg->frames[gg->frame_tail % gg->max_frames];
+	GLuint64 available=1;
+
+	if (fr->count) {
+		const GH_gpu_group *g=&gg->group[(fr->first + fr->count - 1) & (gg->capacity - 1)];
+		GH_glGetQueryObjectui64v(g->query[1], GL_QUERY_RESULT_AVAILABLE, &available);
+	}
+	return (available != 0);
+}
+
+/* called at the end of each frame, with the frame number of the frametimes */
+static void
+gpu_groups_frame_end(GH_gpu_groups *gg, unsigned int frame, const GH_clock_calibration *cal)
+{
+	GH_gpu_group_frame *fr;
+	unsigned int depth=(gg->depth < GH_MARKER_DEPTH_MAX)?gg->depth:GH_MARKER_DEPTH_MAX;
+	unsigned int i;
+
+	/* split the groups which are still open */
+	for (i=0; i<depth; i++) {
+		gpu_groups_end(gg, gg->open[i]);
+	}
+	if (gg->frame_head - gg->frame_tail >= gg->max_frames) {
+		gpu_groups_read(gg, cal);
+	}
+	fr=&gg->frames[gg->frame_head % gg->max_frames];
+	fr->frame=frame;
+	fr->first=gg->frame_first;
+	fr->count=gg->head - gg->frame_first;
+	fr->dropped=gg->frame_dropped;
+	gg->frame_dropped=0;
+	gg->frame_head++;
+
+	/* read back what is ready, but keep the delay unless we are short of groups */
+	while (gg->frame_head != gg->frame_tail) {
+		fr=&gg->frames[gg->frame_tail % gg->max_frames];
+		if (frame - fr->frame < gg->delay && gg->head - gg->tail < gg->capacity/2) {
+			break;
+		}
+		if (frame - fr->frame < 2 * gg->delay && !gpu_groups_available(gg)) {
+			break;
+		}
+		gpu_groups_read(gg, cal);
+	}
+
+	/* continue the open groups in the next frame, this also retries
+	 * the groups which were dropped because the pool was full */
+	gg->frame_first=gg->head;
+	for (i=0; i<depth; i++) {
+		gg->open[i]=gpu_groups_begin(gg, gg->open_id[i]);
+	}
+}
+
+/***************************************************************************
+ * UPLOAD ACCOUNTING                                                       *
+ ***************************************************************************/
+
+/* Count the bytes the application transfers to textures and buffers per
+ * frame. Texture upload sizes are calculated from the format, type and
+ * dimensions, ignoring the GL_UNPACK_* pixel store state, so they are an
+ * estimate. Uploads with a NULL pointer only allocate storage and are not
+ * counted (this includes uploads from offset 0 of a pixel unpack buffer).
+ * Buffer ranges mapped for writing are counted when they are mapped, as
+ * persistent mappings might never be unmapped. For mappings with explicit
+ * flushes, the flushed ranges are counted instead. */
+
+typedef struct {
+	int enabled;
+	unsigned long calls;		/* the upload calls of the current frame */
+	unsigned long long texture;	/* the bytes of the current frame */
+	unsigned long long buffer;
+	unsigned long long mapped;
+	unsigned long long total_texture;	/* the totals of the context */
+	unsigned long long total_buffer;
+	unsigned long long total_mapped;
+} GH_uploads;
+
+static void
+uploads_init(GH_uploads *up, int enabled)
+{
+	memset(up, 0, sizeof(*up));
+	up->enabled=enabled;
+}
+
+/* bytes per pixel for a format and type of the client side data */
+static unsigned int
+upload_pixel_size(GLenum format, GLenum type)
+{
+	unsigned int components;
+	unsigned int size;
+
+	switch (type) {
+		case GL_UNSIGNED_BYTE_3_3_2:
+		case GL_UNSIGNED_BYTE_2_3_3_REV:
+			return 1;
+		case GL_UNSIGNED_SHORT_5_6_5:
+		case GL_UNSIGNED_SHORT_5_6_5_REV:
+		case GL_UNSIGNED_SHORT_4_4_4_4:
+		case GL_UNSIGNED_SHORT_4_4_4_4_REV:
+		case GL_UNSIGNED_SHORT_5_5_5_1:
+		case GL_UNSIGNED_SHORT_1_5_5_5_REV:
+			return 2;
+		case GL_UNSIGNED_INT_8_8_8_8:
+		case GL_UNSIGNED_INT_8_8_8_8_REV:
+		case GL_UNSIGNED_INT_10_10_10_2:
+		case GL_UNSIGNED_INT_2_10_10_10_REV:
+		case GL_UNSIGNED_INT_24_8:
+		case GL_UNSIGNED_INT_10F_11F_11F_REV:
+		case GL_UNSIGNED_INT_5_9_9_9_REV:
+			return 4;
+		case GL_FLOAT_32_UNSIGNED_INT_24_8_REV:
+			return 8;
+		case GL_UNSIGNED_BYTE:
+		case GL_BYTE:
+			size=1;
+			break;
+		case GL_UNSIGNED_SHORT:
+		case GL_SHORT:
+		case GL_HALF_FLOAT:
+			size=2;
+			break;
+		default:
+			size=4;
+	}
+
+	switch (format) {
+		case GL_RG:
+		case GL_RG_INTEGER:
+		case GL_LUMINANCE_ALPHA:
+		case GL_DEPTH_STENCIL:
+			components=2;
+			break;
+		case GL_RGB:
+		case GL_BGR:
+		case GL_RGB_INTEGER:
+		case GL_BGR_INTEGER:
+			components=3;
+			break;
+		case GL_RGBA:
+		case GL_BGRA:
+		case GL_RGBA_INTEGER:
+		case GL_BGRA_INTEGER:
+			components=4;
+			break;
+		default:
+			components=1;
+	}
+	return components * size;
+}
+
+static void
+upload_texture(GH_uploads *up, GLenum format, GLenum type, GLsizei width, GLsizei height, GLsizei depth, const void *pixels)
+{
+	up->calls++;
+	if (pixels && width > 0 && height > 0 && depth > 0) {
+		up->texture += (unsigned long long)width * (unsigned long long)height *
+			       (unsigned long long)depth * upload_pixel_size(format, type);
+	}
+}
+
+static void
+upload_compressed(GH_uploads *up, GLsizei size, const void *data)
+{
+	up->calls++;
+	if (data && size > 0) {
+		up->texture += (unsigned long long)size;
+	}
+}
+
+static void
+upload_buffer(GH_uploads *up, GLsizeiptr size, const void *data)
+{
+	up->calls++;
+	if (data && size > 0) {
+		up->buffer += (unsigned long long)size;
+	}
+}
+
+/* a buffer range mapped for writing, or flushed explicitly */
+static void
+upload_map(GH_uploads *up, long long size)
+{
+	up->calls++;
+	if (size > 0) {
+		up->mapped += (unsigned long long)size;
+	}
+}
+
+static void
+upload_map_range(GH_uploads *up, long long length, GLbitfield access)
+{
+	if ((access & GL_MAP_WRITE_BIT) && !(access & GL_MAP_FLUSH_EXPLICIT_BIT)) {
+		upload_map(up, length);
+	}
+}
+
+/* move the counters of the current frame to the frame info */
+static void
+uploads_take(GH_uploads *up, unsigned long *calls, unsigned long long *texture,
+	     unsigned long long *buffer, unsigned long long *mapped)
+{
+	*calls=up->calls;
+	*texture=up->texture;
+	*buffer=up->buffer;
+	*mapped=up->mapped;
+	up->total_texture += up->texture;
+	up->total_buffer += up->buffer;
+	up->total_mapped += up->mapped;
+	up->calls=0;
+	up->texture=0;
+	up->buffer=0;
+	up->mapped=0;
+}
+
+/***************************************************************************
+ * GPU MEMORY TRACKING                                                     *
+ ***************************************************************************/
+
+/* Estimate the GPU memory used by the textures, buffers and renderbuffers
+ * of a context by tracking their (re)specification and deletion. The
+ * object being specified is found by querying the current binding of the
+ * target. The sizes are estimates: drivers add padding, alignment and
+ * mipmap tails, and objects shared with other contexts are only accounted
+ * in the context which (re)specified them. The dimensions of each texture
+ * image are kept, so that glGenerateMipmap can add the levels it creates.
+ * Where GL_NVX_gpu_memory_info or GL_ATI_meminfo is available, the free
+ * video memory is sampled, too. */
+
+typedef enum {
+	GH_GPU_MEM_TEXTURE=0,
+	GH_GPU_MEM_BUFFER,
+	GH_GPU_MEM_RENDERBUFFER,
+	GH_GPU_MEM_TYPES
+} GH_gpu_mem_type;
+
+static const char *gpu_mem_type_name[GH_GPU_MEM_TYPES]={
+	"texture",
+	"buffer",
+	"renderbuffer",
+};
+
+typedef enum {
+	GH_GPU_MEM_INFO_NONE=0,
+	GH_GPU_MEM_INFO_NVX,
+	GH_GPU_MEM_INFO_ATI
+} GH_gpu_mem_info;
+
+/* the parts of a texture are identified by face * 32 + level,
+ * GH_GPU_MEM_ALL_PARTS replaces all of them (immutable storage) */
+#define GH_GPU_MEM_ALL_PARTS	UINT_MAX
+
+/* a single texture image, as specified by the application */
+typedef struct {
+	GLenum target;
+	GLsizei width;
+	GLsizei height;
+	GLsizei depth;
+	unsigned int bits;		/* per texel */
+} GH_gpu_mem_image;
+
+typedef struct {
+	unsigned int part;
+	uint64_t size;
+	GH_gpu_mem_image image;		/* all 0 if unknown */
+} GH_gpu_mem_part;
+
+typedef struct {
+	uint64_t key;			/* type << 32 | name, 0 if empty */
+	uint64_t size;			/* sum of all parts */
+	unsigned int num_parts;
+	GH_gpu_mem_part *parts;
+} GH_gpu_mem_object;
+
+typedef struct {
+	int enabled;
+	GH_gpu_mem_object *object;	/* open addressing, linear probing */
+	unsigned int size;		/* power of two */
+	unsigned int count;
+	uint64_t current[GH_GPU_MEM_TYPES];
+	uint64_t peak[GH_GPU_MEM_TYPES];
+	GH_gpu_mem_info info;
+	unsigned int interval;		/* sample the vendor info every n frames */
+	unsigned int counter;
+	long available_kb;		/* -1 if unknown */
+	long evicted_kb;
+	long total_kb;
+	long min_available_kb;
+} GH_gpu_memory;
+
+static uint32_t
+gpu_mem_hash(uint64_t key, unsigned int size)
+{
+	return (uint32_t)((key * 0x9E3779B97F4A7C15ULL) >> 32) & (size - 1);
+}
+
+/* find the slot of an object, or the empty slot where it belongs */
+static GH_gpu_mem_object *
+gpu_mem_find(GH_gpu_memory *gm, uint64_t key)
+{
+	uint32_t h=gpu_mem_hash(key, gm->size);
+
+	while (gm->object[h].key && gm->object[h].key != key) {
+		h=(h+1) & (gm->size - 1);
+	}
+	return &gm->object[h];
+}
+
+static int
+gpu_mem_grow(GH_gpu_memory *gm)
+{
+	unsigned int new_size=(gm->size)?(gm->size * 2):1024;
+	GH_gpu_mem_object *old=gm->object;
+	unsigned int old_size=gm->size;
+	unsigned int i;
+
+	gm->object=calloc(new_size, sizeof(*gm->object));
+	if (!gm->object) {
+		gm->object=old;
+		return -1;
+	}
+	gm->size=new_size;
+	for (i=0; i<old_size; i++) {
+		if (old[i].key) {
+			*gpu_mem_find(gm, old[i].key)=old[i];
+		}
+	}
+	free(old);
+	return 0;
+}
+
+/* remove an object, using backward shift deletion */
+static void
+gpu_mem_remove(GH_gpu_memory *gm, GH_gpu_mem_object *obj)
+{
+	unsigned int i=(unsigned int)(obj - gm->object);
+	unsigned int j=i;
+
+	free(obj->parts);
+	gm->count--;
+	for (;;) {
+		uint32_t h;
+		j=(j+1) & (gm->size - 1);
+		if (!gm->object[j].key) {
+			break;
+		}
+		h=gpu_mem_hash(gm->object[j].key, gm->size);
+		/* move entry j to the hole at i unless its home slot lies cyclically in (i, j] */
+		if ((j > i && (h <= i || h > j)) || (j < i && (h <= i && h > j))) {
+			gm->object[i]=gm->object[j];
+			i=j;
+		}
+	}
+	memset(&gm->object[i], 0, sizeof(gm->object[i]));
+}
+
+/* the values are also read by the prom exporter from other threads */
+static void
+gpu_mem_account(GH_gpu_memory *gm, GH_gpu_mem_type type, int64_t delta)
+{
+	__atomic_store_n(&gm->current[type], gm->current[type] + (uint64_t)delta, __ATOMIC_RELAXED);
+	if (gm->current[type] > gm->peak[type]) {
+		__atomic_store_n(&gm->peak[type], gm->current[type], __ATOMIC_RELAXED);
+	}
+}
+
+/* (re)specify a part of an object, image is NULL except for single texture images */
+static void
+gpu_mem_specify(GH_gpu_memory *gm, GH_gpu_mem_type type, GLuint name, unsigned int part, uint64_t size,
+		const GH_gpu_mem_image *image)
+{
+	uint64_t key=((uint64_t)(type+1) << 32) | (uint64_t)name;
+	GH_gpu_mem_object *obj;
+	unsigned int i;
+
+	if (!name) {
+		return;
+	}
+	if ((gm->count + 1) * 2 > gm->size && gpu_mem_grow(gm)) {
+		return;
+	}
+	obj=gpu_mem_find(gm, key);
+	if (!obj->key) {
+		obj->key=key;
+		gm->count++;
+	}
+	if (part == GH_GPU_MEM_ALL_PARTS || type != GH_GPU_MEM_TEXTURE) {
+		gpu_mem_account(gm, type, (int64_t)size - (int64_t)obj->size);
+		free(obj->parts);
+		obj->parts=NULL;
+		obj->num_parts=0;
+		obj->size=size;
+		return;
+	}
+	for (i=0; i<obj->num_parts; i++) {
+		if (obj->parts[i].part == part || obj->parts[i].part == GH_GPU_MEM_ALL_PARTS) {
+			break;
+		}
+	}
+	if (i == obj->num_parts) {
+		GH_gpu_mem_part *parts=realloc(obj->parts, sizeof(*parts) * (obj->num_parts + 1));
+		if (!parts) {
+			return;
+		}
+		obj->parts=parts;
+		obj->parts[i].part=part;
+		obj->parts[i].size=0;
+		obj->num_parts++;
+	}
+	gpu_mem_account(gm, type, (int64_t)size - (int64_t)obj->parts[i].size);
+	obj->size += size - obj->parts[i].size;
+	obj->parts[i].part=part;
+	obj->parts[i].size=size;
+	if (image) {
+		obj->parts[i].image=*image;
+	} else {
+		memset(&obj->parts[i].image, 0, sizeof(obj->parts[i].image));
+	}
+}
+
+static void
+gpu_mem_delete(GH_gpu_memory *gm, GH_gpu_mem_type type, GLsizei n, const GLuint *names)
+{
+	GLsizei i;
+
+	if (!gm->size || !names) {
+		return;
+	}
+	for (i=0; i<n; i++) {
+		uint64_t key=((uint64_t)(type+1) << 32) | (uint64_t)names[i];
+		GH_gpu_mem_object *obj=gpu_mem_find(gm, key);
+		if (obj->key) {
+			gpu_mem_account(gm, type, -(int64_t)obj->size);
+			gpu_mem_remove(gm, obj);
+		}
+	}
+}
+
+/* estimated bits per texel of an internal format */
+static unsigned int
+gpu_mem_texel_bits(GLenum internalformat)
+{
+	switch (internalformat) {
+		case 1:
+		case GL_R8:
+		case GL_R8_SNORM:
+		case GL_R8I:
+		case GL_R8UI:
+		case GL_ALPHA8:
+		case GL_LUMINANCE8:
+		case GL_INTENSITY8:
+		case GL_STENCIL_INDEX8:
+			return 8;
+		case 2:
+		case GL_RG8:
+		case GL_RG8_SNORM:
+		case GL_RG8I:
+		case GL_RG8UI:
+		case GL_R16:
+		case GL_R16_SNORM:
+		case GL_R16F:
+		case GL_R16I:
+		case GL_R16UI:
+		case GL_LUMINANCE8_ALPHA8:
+		case GL_RGB565:
+		case GL_RGB5_A1:
+		case GL_RGBA4:
+		case GL_DEPTH_COMPONENT16:
+			return 16;
+		case GL_RG16:
+		case GL_RG16_SNORM:
+		case GL_RG16F:
+		case GL_RG16I:
+		case GL_RG16UI:
+		case GL_R32F:
+		case GL_R32I:
+		case GL_R32UI:
+		case GL_RGB10_A2:
+		case GL_RGB10_A2UI:
+		case GL_R11F_G11F_B10F:
+		case GL_RGB9_E5:
+		case GL_DEPTH_COMPONENT24:
+		case GL_DEPTH_COMPONENT32:
+		case GL_DEPTH_COMPONENT32F:
+		case GL_DEPTH24_STENCIL8:
+		case GL_DEPTH_COMPONENT:
+		case GL_DEPTH_STENCIL:
+			return 32;
+		case GL_RGBA16:
+		case GL_RGBA16_SNORM:
+		case GL_RGBA16F:
+		case GL_RGBA16I:
+		case GL_RGBA16UI:
+		case GL_RGB16:
+		case GL_RGB16F:
+		case GL_RGB16I:
+		case GL_RGB16UI:
+		case GL_RG32F:
+		case GL_RG32I:
+		case GL_RG32UI:
+		case GL_DEPTH32F_STENCIL8:
+			return 64;
+		case GL_RGB32F:
+		case GL_RGB32I:
+		case GL_RGB32UI:
+			return 96;
+		case GL_RGBA32F:
+		case GL_RGBA32I:
+		case GL_RGBA32UI:
+			return 128;
+		case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+		case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT:
+		case GL_COMPRESSED_SRGB_S3TC_DXT1_EXT:
+		case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT:
+		case GL_COMPRESSED_RED_RGTC1:
+		case GL_COMPRESSED_SIGNED_RED_RGTC1:
+		case GL_COMPRESSED_RGB8_ETC2:
+		case GL_COMPRESSED_SRGB8_ETC2:
+		case GL_COMPRESSED_RGB8_PUNCHTHROUGH_ALPHA1_ETC2:
+		case GL_COMPRESSED_SRGB8_PUNCHTHROUGH_ALPHA1_ETC2:
+		case GL_COMPRESSED_R11_EAC:
+		case GL_COMPRESSED_SIGNED_R11_EAC:
+			return 4;
+		case GL_COMPRESSED_RGBA_S3TC_DXT3_EXT:
+		case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+		case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT3_EXT:
+		case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT:
+		case GL_COMPRESSED_RG_RGTC2:
+		case GL_COMPRESSED_SIGNED_RG_RGTC2:
+		case GL_COMPRESSED_RGBA_BPTC_UNORM:
+		case GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM:
+		case GL_COMPRESSED_RGB_BPTC_SIGNED_FLOAT:
+		case GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT:
+		case GL_COMPRESSED_RGBA8_ETC2_EAC:
+		case GL_COMPRESSED_SRGB8_ALPHA8_ETC2_EAC:
+		case GL_COMPRESSED_RG11_EAC:
+		case GL_COMPRESSED_SIGNED_RG11_EAC:
+			return 8;
+		default:
+			/* unsized and 8 bit per channel RGB(A) formats, RGB is usually padded */
+			return 32;
+	}
+}
+
+/* the binding to query for a texture target, and the face of cube maps */
+static GLenum
+gpu_mem_texture_binding(GLenum target, unsigned int *face)
+{
+	*face=0;
+	switch (target) {
+		case GL_TEXTURE_1D:
+			return GL_TEXTURE_BINDING_1D;
+		case GL_TEXTURE_2D:
+			return GL_TEXTURE_BINDING_2D;
+		case GL_TEXTURE_3D:
+			return GL_TEXTURE_BINDING_3D;
+		case GL_TEXTURE_1D_ARRAY:
+			return GL_TEXTURE_BINDING_1D_ARRAY;
+		case GL_TEXTURE_2D_ARRAY:
+			return GL_TEXTURE_BINDING_2D_ARRAY;
+		case GL_TEXTURE_RECTANGLE:
+			return GL_TEXTURE_BINDING_RECTANGLE;
+		case GL_TEXTURE_CUBE_MAP:
+			return GL_TEXTURE_BINDING_CUBE_MAP;
+		case GL_TEXTURE_CUBE_MAP_ARRAY:
+			return GL_TEXTURE_BINDING_CUBE_MAP_ARRAY;
+		case GL_TEXTURE_2D_MULTISAMPLE:
+			return GL_TEXTURE_BINDING_2D_MULTISAMPLE;
+		case GL_TEXTURE_2D_MULTISAMPLE_ARRAY:
+			return GL_TEXTURE_BINDING_2D_MULTISAMPLE_ARRAY;
+		case GL_TEXTURE_CUBE_MAP_POSITIVE_X:
+		case GL_TEXTURE_CUBE_MAP_NEGATIVE_X:
+		case GL_TEXTURE_CUBE_MAP_POSITIVE_Y:
+		case GL_TEXTURE_CUBE_MAP_NEGATIVE_Y:
+		case GL_TEXTURE_CUBE_MAP_POSITIVE_Z:
+		case GL_TEXTURE_CUBE_MAP_NEGATIVE_Z:
+			*face=target - GL_TEXTURE_CUBE_MAP_POSITIVE_X;
+			return GL_TEXTURE_BINDING_CUBE_MAP;
+		default:
+			/* proxy targets and whatever we do not know */
+			return 0;
+	}
+}
+
+static GLenum
+gpu_mem_buffer_binding(GLenum target)
+{
+	switch (target) {
+		case GL_ARRAY_BUFFER:
+			return GL_ARRAY_BUFFER_BINDING;
+		case GL_ELEMENT_ARRAY_BUFFER:
+			return GL_ELEMENT_ARRAY_BUFFER_BINDING;
+		case GL_PIXEL_PACK_BUFFER:
+			return GL_PIXEL_PACK_BUFFER_BINDING;
+		case GL_PIXEL_UNPACK_BUFFER:
+			return GL_PIXEL_UNPACK_BUFFER_BINDING;
+		case GL_UNIFORM_BUFFER:
+			return GL_UNIFORM_BUFFER_BINDING;
+		case GL_TRANSFORM_FEEDBACK_BUFFER:
+			return GL_TRANSFORM_FEEDBACK_BUFFER_BINDING;
+		case GL_COPY_READ_BUFFER:
+			return GL_COPY_READ_BUFFER_BINDING;
+		case GL_COPY_WRITE_BUFFER:
+			return GL_COPY_WRITE_BUFFER_BINDING;
+		case GL_SHADER_STORAGE_BUFFER:
+			return GL_SHADER_STORAGE_BUFFER_BINDING;
+		case GL_DRAW_INDIRECT_BUFFER:
+			return GL_DRAW_INDIRECT_BUFFER_BINDING;
+		case GL_DISPATCH_INDIRECT_BUFFER:
+			return GL_DISPATCH_INDIRECT_BUFFER_BINDING;
+		case GL_ATOMIC_COUNTER_BUFFER:
+			return GL_ATOMIC_COUNTER_BUFFER_BINDING;
+		case GL_QUERY_BUFFER:
+			return GL_QUERY_BUFFER_BINDING;
+		default:
+			return 0;
+	}
+}
+
+/* get the object currently bound to a binding point */
+static GLuint
+gpu_mem_bound(GLenum binding)
+{
+	GLint name=0;
+
+	if (!binding) {
+		return 0;
+	}
+	if (!GH_glGetIntegerv) {
+		GH_GET_GL_PROC_OR_FAIL(glGetIntegerv, GH_MSG_WARNING, 0);
+	}
+	GH_glGetIntegerv(binding, &name);
+	return (GLuint)name;
+}
+
+/* a texture image, size is 0 to calculate it from the internal format */
+static void
+gpu_mem_texture(GH_gpu_memory *gm, GLenum target, GLint level, GLenum internalformat,
+		GLsizei width, GLsizei height, GLsizei depth, uint64_t size)
+{
+	unsigned int face;
+	GLuint name=gpu_mem_bound(gpu_mem_texture_binding(target, &face));
+	GH_gpu_mem_image image;
+
+	image.target=target;
+	image.width=width;
+	image.height=height;
+	image.depth=depth;
+	image.bits=gpu_mem_texel_bits(internalformat);
+	if (width > 0 && height > 0 && depth > 0) {
+		uint64_t texels=(uint64_t)width * (uint64_t)height * (uint64_t)depth;
+		if (size) {
+			/* compressed: scale the mipmap levels by the given size */
+			image.bits=(unsigned int)((size * 8 + texels - 1) / texels);
+		} else {
+			size=texels * image.bits / 8;
+		}
+	}
+	if (target == GL_TEXTURE_CUBE_MAP) {
+		/* glTexImage2D does not accept it, but be safe */
+		face=0;
+	}
+	if (level < 0 || level >= 32) {
+		return;
+	}
+	gpu_mem_specify(gm, GH_GPU_MEM_TEXTURE, name, face * 32 + (unsigned int)level, size, &image);
+}
+
+/* glGenerateMipmap: derive the levels from the base level of each face,
+ * immutable storage already contains all levels */
+static void
+gpu_mem_generate_mipmap(GH_gpu_memory *gm, GLuint name)
+{
+	uint64_t key=((uint64_t)(GH_GPU_MEM_TEXTURE+1) << 32) | (uint64_t)name;
+	GH_gpu_mem_object *obj;
+	unsigned int i,num_parts;
+
+	if (!gm->size || !name) {
+		return;
+	}
+	obj=gpu_mem_find(gm, key);
+	num_parts=obj->num_parts;
+	for (i=0; i<num_parts; i++) {
+		GH_gpu_mem_image image;
+		unsigned int part,level;
+		int halve_height,halve_depth;
+
+		/* gpu_mem_specify() might move the object and its parts */
+		obj=gpu_mem_find(gm, key);
+		if (!obj->key || i >= obj->num_parts) {
+			break;
+		}
+		part=obj->parts[i].part;
+		image=obj->parts[i].image;
+		if (part == GH_GPU_MEM_ALL_PARTS) {
+			break;
+		}
+		if ((part % 32) || !image.bits) {
+			continue;
+		}
+		halve_height=(image.target != GL_TEXTURE_1D_ARRAY);
+		halve_depth=(image.target == GL_TEXTURE_3D);
+		for (level=1; level<32 && (image.width > 1 || (halve_height && image.height > 1) ||
+					   (halve_depth && image.depth > 1)); level++) {
+			image.width=(image.width > 1)?(image.width / 2):1;
+			if (halve_height) {
+				image.height=(image.height > 1)?(image.height / 2):1;
+			}
+			if (halve_depth) {
+				image.depth=(image.depth > 1)?(image.depth / 2):1;
+			}
+			gpu_mem_specify(gm, GH_GPU_MEM_TEXTURE, name, part + level,
+					(uint64_t)image.width * (uint64_t)image.height * (uint64_t)image.depth * image.bits / 8,
+					&image);
+		}
+	}
+}
+
+/* immutable texture storage for all levels */
+static void
+gpu_mem_texture_storage(GH_gpu_memory *gm, GLenum target, GLsizei levels, GLenum internalformat,
+		GLsizei width, GLsizei height, GLsizei depth)
+{
+	unsigned int face;
+	GLuint name=gpu_mem_bound(gpu_mem_texture_binding(target, &face));
+	uint64_t bits=gpu_mem_texel_bits(internalformat);
+	uint64_t size=0;
+	int halve_height=(target != GL_TEXTURE_1D_ARRAY);
+	int halve_depth=(target == GL_TEXTURE_3D);
+	GLsizei i;
+
+	for (i=0; i<levels; i++) {
+		uint64_t w=(uint64_t)width >> i;
+		uint64_t h=(halve_height)?((uint64_t)height >> i):(uint64_t)height;
+		uint64_t d=(halve_depth)?((uint64_t)depth >> i):(uint64_t)depth;
+		size += ((w)?w:1) * ((h)?h:1) * ((d)?d:1) * bits / 8;
+	}
+	if (target == GL_TEXTURE_CUBE_MAP) {
+		size *= 6;
+	}
+	gpu_mem_specify(gm, GH_GPU_MEM_TEXTURE, name, GH_GPU_MEM_ALL_PARTS, size, NULL);
+}
+
+/* multisampled textures have a single level */
+static void
+gpu_mem_texture_multisample(GH_gpu_memory *gm, GLenum target, GLsizei samples, GLenum internalformat,
+		GLsizei width, GLsizei height, GLsizei depth)
+{
+	unsigned int face;
+	GLuint name=gpu_mem_bound(gpu_mem_texture_binding(target, &face));
+	uint64_t size=0;
+
+	if (width > 0 && height > 0 && depth > 0) {
+		size=(uint64_t)width * (uint64_t)height * (uint64_t)depth * ((samples > 1)?(uint64_t)samples:1) *
+		     gpu_mem_texel_bits(internalformat) / 8;
+	}
+	gpu_mem_specify(gm, GH_GPU_MEM_TEXTURE, name, GH_GPU_MEM_ALL_PARTS, size, NULL);
+}
+
+static void
+gpu_mem_buffer(GH_gpu_memory *gm, GLenum target, GLsizeiptr size)
+{
+	GLuint name=gpu_mem_bound(gpu_mem_buffer_binding(target));
+
+	gpu_mem_specify(gm, GH_GPU_MEM_BUFFER, name, 0, (size > 0)?(uint64_t)size:0, NULL);
+}
+
+static void
+gpu_mem_renderbuffer(GH_gpu_memory *gm, GLsizei samples, GLenum internalformat, GLsizei width, GLsizei height)
+{
+	GLuint name=gpu_mem_bound(GL_RENDERBUFFER_BINDING);
+	uint64_t size=0;
+
+	if (width > 0 && height > 0) {
+		size=(uint64_t)width * (uint64_t)height * ((samples > 1)?(uint64_t)samples:1) *
+		     gpu_mem_texel_bits(internalformat) / 8;
+	}
+	gpu_mem_specify(gm, GH_GPU_MEM_RENDERBUFFER, name, 0, size, NULL);
+}
+
+/* check for an extension, the context must be current */
+static int
+gpu_mem_has_extension(const char *name)
+{
+	const char *version;
+	const char *exts;
+	size_t len=strlen(name);
+
+	GH_GET_GL_PROC(glGetString);
+	if (!GH_glGetString) {
+		return 0;
+	}
+	/* GL_NUM_EXTENSIONS and glGetStringi are GL 3.0, asking a legacy
+	 * context would leave a GL_INVALID_ENUM error for the application.
+	 * Core profiles on the other hand do not support GL_EXTENSIONS. */
+	version=(const char*)GH_glGetString(GL_VERSION);
+	if (version && atoi(version) >= 3) {
+		GLint i, num=0;
+		GH_GET_GL_PROC(glGetStringi);
+		GH_GET_GL_PROC(glGetIntegerv);
+		if (GH_glGetStringi && GH_glGetIntegerv) {
+			GH_glGetIntegerv(GL_NUM_EXTENSIONS, &num);
+			for (i=0; i<num; i++) {
+				const GLubyte *ext=GH_glGetStringi(GL_EXTENSIONS, (GLuint)i);
+				if (ext && !strcmp((const char*)ext, name)) {
+					return 1;
+				}
+			}
+		}
+		return 0;
+	}
+	exts=(const char*)GH_glGetString(GL_EXTENSIONS);
+	while (exts && (exts=strstr(exts, name))) {
+		if (exts[len] == 0 || exts[len] == ' ') {
+			return 1;
+		}
+		exts += len;
+	}
+	return 0;
+}
+
+/* sample the free video memory reported by the driver */
+static void
+gpu_mem_sample(GH_gpu_memory *gm)
+{
+	GLint v[4]={-1, -1, -1, -1};
+
+	switch (gm->info) {
+		case GH_GPU_MEM_INFO_NVX:
+			GH_glGetIntegerv(GL_GPU_MEMORY_INFO_CURRENT_AVAILABLE_VIDMEM_NVX, &v[0]);
+			GH_glGetIntegerv(GL_GPU_MEMORY_INFO_EVICTED_MEMORY_NVX, &v[1]);
+			__atomic_store_n(&gm->available_kb, (long)v[0], __ATOMIC_RELAXED);
+			gm->evicted_kb=v[1];
+			break;
+		case GH_GPU_MEM_INFO_ATI:
+			GH_glGetIntegerv(GL_TEXTURE_FREE_MEMORY_ATI, v);
+			__atomic_store_n(&gm->available_kb, (long)v[0], __ATOMIC_RELAXED);
+			break;
+		default:
+			return;
+	}
+	if (gm->available_kb >= 0 && (gm->min_available_kb < 0 || gm->available_kb < gm->min_available_kb)) {
+		gm->min_available_kb=gm->available_kb;
+	}
+}
+
+/* the context must be current */
+static void
+gpu_mem_init(GH_gpu_memory *gm, int enabled, unsigned int interval, unsigned int ctx_num)
+{
+	memset(gm, 0, sizeof(*gm));
+	gm->available_kb=-1;
+	gm->evicted_kb=-1;
+	gm->total_kb=-1;
+	gm->min_available_kb=-1;
+	if (!enabled) {
+		return;
+	}
+	GH_GET_GL_PROC(glGetIntegerv);
+	if (!GH_glGetIntegerv) {
+		GH_verbose(GH_MSG_WARNING, "GPU memory tracking: glGetIntegerv not available\n");
+		return;
+	}
+	gm->enabled=1;
+	gm->interval=interval;
+	if (interval) {
+		if (gpu_mem_has_extension("GL_NVX_gpu_memory_info")) {
+			GLint total=-1;
+			gm->info=GH_GPU_MEM_INFO_NVX;
+			GH_glGetIntegerv(GL_GPU_MEMORY_INFO_DEDICATED_VIDMEM_NVX, &total);
+			gm->total_kb=total;
+		} else if (gpu_mem_has_extension("GL_ATI_meminfo")) {
+			gm->info=GH_GPU_MEM_INFO_ATI;
+		}
+		gpu_mem_sample(gm);
+	}
+	GH_verbose(GH_MSG_INFO, "GPU memory tracking ctx %u: driver info: %s\n", ctx_num,
+			(gm->info == GH_GPU_MEM_INFO_NVX)?"GL_NVX_gpu_memory_info":
+			((gm->info == GH_GPU_MEM_INFO_ATI)?"GL_ATI_meminfo":"none"));
+}
+
+static void
+gpu_mem_destroy(GH_gpu_memory *gm)
+{
+	unsigned int i;
+
+	for (i=0; i<gm->size; i++) {
+		free(gm->object[i].parts);
+	}
+	free(gm->object);
+	gm->object=NULL;
+	gm->size=0;
+	gm->count=0;
+	gm->enabled=0;
+}
+
+/* called once per frame */
+static void
+gpu_mem_frame(GH_gpu_memory *gm)
+{
+	if (gm->info && ++gm->counter >= gm->interval) {
+		gm->counter=0;
+		gpu_mem_sample(gm);
+	}
+}
+
+/***************************************************************************
+ * PIPELINE STALL DETECTOR                                                 *
+ ***************************************************************************/
+
+/* Time the GL calls which may block until the GPU has caught up: readbacks
+ * into client memory, query results, synchronized buffer maps, glFinish and
+ * glClientWaitSync with a timeout. Calls taking longer than the threshold
+ * are recorded as stalls, together with the return address of the wrapper,
+ * which is the call site in the application, and written to the stall
+ * file at the end of the frame. */
+
+typedef enum {
+	GH_STALL_READ_PIXELS=0,
+	GH_STALL_GET_TEX_IMAGE,
+	GH_STALL_GET_BUFFER_SUB_DATA,
+	GH_STALL_GET_QUERY_OBJECTIV,
+	GH_STALL_GET_QUERY_OBJECTUIV,
+	GH_STALL_GET_QUERY_OBJECTI64V,
+	GH_STALL_GET_QUERY_OBJECTUI64V,
+	GH_STALL_MAP_BUFFER,
+	GH_STALL_MAP_BUFFER_RANGE,
+	GH_STALL_FINISH,
+	GH_STALL_CLIENT_WAIT_SYNC,
+	GH_STALL_FUNCS
+} GH_stall_func;
+
+static const char *stall_func_name[GH_STALL_FUNCS]={
+	"glReadPixels",
+	"glGetTexImage",
+	"glGetBufferSubData",
+	"glGetQueryObjectiv",
+	"glGetQueryObjectuiv",
+	"glGetQueryObjecti64v",
+	"glGetQueryObjectui64v",
+	"glMapBuffer",
+	"glMapBufferRange",
+	"glFinish",
+	"glClientWaitSync"
+};
+
+/* stalls recorded per frame, further ones are only counted */
+#define GH_STALL_RECORDS	64
+
+typedef struct {
+	GH_stall_func func;
+	uint64_t duration;		/* in ns */
+	const void *caller;		/* return address into the application */
+} GH_stall;
+
+typedef struct {
+	int enabled;
+	uint64_t threshold;		/* in ns */
+	unsigned int count;		/* the stalls of the current frame */
+	uint64_t time;
+	GH_stall record[GH_STALL_RECORDS];
+	unsigned long total_count[GH_STALL_FUNCS];	/* the totals of the context */
+	uint64_t total_time[GH_STALL_FUNCS];
+	FILE *file;
+	uint64_t maps_hash;		/* of the /proc/self/maps written to the file */
+	unsigned int ctx_num;
+} GH_stalls;
+
+static void
+stalls_init(GH_stalls *st, int enabled, unsigned int threshold_usecs, unsigned int ctx_num)
+{
+	char buf[PATH_MAX];
+
+	memset(st, 0, sizeof(*st));
+	st->ctx_num=ctx_num;
+	if (!enabled) {
+		return;
+	}
+	parse_name(buf, sizeof(buf), get_envs("GH_FRAMETIME_STALLS_FILE", "glx_hook_stalls-ctx%c.txt"), ctx_num);
+	st->file=fopen(buf, "wt");
+	if (!st->file) {
+		GH_verbose(GH_MSG_WARNING, "failed to open '%s', stalls go to stderr\n", buf);
+		st->file=stderr;
+	}
+	fprintf(st->file, "# frame\tfunction\ttime_ns\tcaller\n");
+	st->threshold=(uint64_t)threshold_usecs * (uint64_t)1000;
+	st->enabled=1;
+	GH_verbose(GH_MSG_INFO, "stall detector ctx %u: threshold %u usecs\n", ctx_num, threshold_usecs);
+}
+
+static void
+stalls_destroy(GH_stalls *st)
+{
+	unsigned int i;
+
+	if (!st->enabled) {
+		return;
+	}
+	for (i=0; i<GH_STALL_FUNCS; i++) {
+		if (st->total_count[i]) {
+			GH_verbose(GH_MSG_INFO, "stall detector ctx %u: %s: %lu stalls, %.3f ms total\n",
+					st->ctx_num, stall_func_name[i], st->total_count[i],
+					(double)st->total_time[i] * 1.0E-6);
+		}
+	}
+	if (st->file && st->file != stderr) {
+		fclose(st->file);
+	}
+	st->file=NULL;
+	st->enabled=0;
+}
+
+/* a timed call returned, returns non-zero if it was a stall */
+static int
+stall_record(GH_stalls *st, GH_stall_func func, uint64_t duration, const void *caller)
+{
+	if (duration < st->threshold) {
+		return 0;
+	}
+	if (st->count < GH_STALL_RECORDS) {
+		GH_stall *rec=&st->record[st->count];
+		rec->func=func;
+		rec->duration=duration;
+		rec->caller=caller;
+	}
+	st->count++;
+	st->time += duration;
+	st->total_count[func]++;
+	st->total_time[func] += duration;
+	return 1;
+}
+
+/* write the stalls of the frame and move the counters to the frame info */
+static void
+stalls_frame_end(GH_stalls *st, unsigned int frame, unsigned int *count, uint64_t *time)
+{
+	*count=st->count;
+	*time=st->time;
+	if (st->count) {
+		unsigned int n=(st->count < GH_STALL_RECORDS)?st->count:GH_STALL_RECORDS;
+		unsigned int i;
+
+		write_maps(st->file, &st->maps_hash);
+		for (i=0; i<n; i++) {
+			const GH_stall *rec=&st->record[i];
+			fprintf(st->file, "%u\t%s\t%llu\t%p\n", frame, stall_func_name[rec->func],
+					(unsigned long long)rec->duration, rec->caller);
+		}
+		if (st->count > n) {
+			fprintf(st->file, "# frame %u: %u more stalls not recorded\n", frame, st->count - n);
+		}
+	}
+	st->count=0;
+	st->time=0;
+}
+
+/***************************************************************************
+ * X11 ROUND TRIPS                                                         *
+ ***************************************************************************/
+
+/* Count and time the common Xlib and GLX calls which wait for a reply
+ * from the X server. Calls are attributed to the context current on the
+ * calling thread, this includes the calls libGL itself makes via the
+ * dynamic linker. Calls on threads without a current context are not
+ * counted. */
+
+typedef enum {
+	GH_X11_SYNC=0,
+	GH_X11_GET_WINDOW_ATTRIBUTES,
+	GH_X11_QUERY_POINTER,
+	GH_X11_GET_GEOMETRY,
+	GH_X11_TRANSLATE_COORDINATES,
+	GH_X11_GET_INPUT_FOCUS,
+	GH_X11_QUERY_TREE,
+	GH_X11_INTERN_ATOM,
+	GH_X11_GLX_QUERY_DRAWABLE,
+	GH_X11_FUNCS
+} GH_x11_func;
+
+static const char *x11_func_name[GH_X11_FUNCS]={
+	"XSync",
+	"XGetWindowAttributes",
+	"XQueryPointer",
+	"XGetGeometry",
+	"XTranslateCoordinates",
+	"XGetInputFocus",
+	"XQueryTree",
+	"XInternAtom",
+	"glXQueryDrawable"
+};
+
+typedef struct {
+	int enabled;
+	unsigned int count;		/* the calls of the current frame */
+	uint64_t time;
+	unsigned long total_count[GH_X11_FUNCS];	/* the totals of the context */
+	uint64_t total_time[GH_X11_FUNCS];
+	uint64_t max_time[GH_X11_FUNCS];
+	unsigned int ctx_num;
+} GH_x11_calls;
+
+/* set as soon as one context counts X11 calls, the wrappers
+ * do not look for the current context before */
+static volatile int x11_calls_active=0;
+
+static void
+x11_calls_init(GH_x11_calls *xc, int enabled, unsigned int ctx_num)
+{
+	memset(xc, 0, sizeof(*xc));
+	xc->ctx_num=ctx_num;
+	xc->enabled=enabled;
+	if (enabled) {
+		x11_calls_active=1;
+	}
+}
+
+static void
+x11_calls_destroy(GH_x11_calls *xc)
+{
+	unsigned int i;
+
+	if (!xc->enabled) {
+		return;
+	}
+	for (i=0; i<GH_X11_FUNCS; i++) {
+		if (xc->total_count[i]) {
+			GH_verbose(GH_MSG_INFO, "X11 round trips ctx %u: %s: %lu calls, %.3f ms total, %.3f ms avg, %.3f ms max\n",
+					xc->ctx_num, x11_func_name[i], xc->total_count[i],
+					(double)xc->total_time[i] * 1.0E-6,
+					(double)xc->total_time[i] * 1.0E-6 / (double)xc->total_count[i],
+					(double)xc->max_time[i] * 1.0E-6);
+		}
+	}
+	xc->enabled=0;
+}
+
+static void
+x11_call_record(GH_x11_calls *xc, GH_x11_func func, uint64_t duration)
+{
+	xc->count++;
+	xc->time += duration;
+	xc->total_count[func]++;
+	xc->total_time[func] += duration;
+	if (duration > xc->max_time[func]) {
+		xc->max_time[func]=duration;
+	}
+}
+
+/* move the counters of the current frame to the frame info */
+static void
+x11_calls_take(GH_x11_calls *xc, unsigned int *count, uint64_t *time)
+{
+	*count=xc->count;
+	*time=xc->time;
+	xc->count=0;
+	xc->time=0;
+}
+
+/***************************************************************************
+ * INPUT LATENCY                                                           *
+ ***************************************************************************/
+
+/* Timestamp the key, button and motion events when the application
+ * consumes them from the Xlib event queue, and tie them to the next buffer
+ * swap of any context. The latency is measured from the oldest event
+ * consumed since the previous swap to the swap itself, and to the point
+ * the GPU finished the frame. Events are a process-wide thing, so the
+ * state is global. */
+
+typedef struct {
+	pthread_mutex_t mutex;
+	volatile int active;
+	unsigned int count;		/* input events consumed since the last swap */
+	uint64_t first;			/* CLOCK_REALTIME of the oldest of them */
+} GH_input;
+
+static GH_input input={.mutex=PTHREAD_MUTEX_INITIALIZER};
+
+static void
+input_init(void)
+{
+	input.active=1;
+}
+
+/* an event was consumed by the application */
+static void
+input_event(const XEvent *ev)
+{
+	switch (ev->type) {
+		case KeyPress:
+		case KeyRelease:
+		case ButtonPress:
+		case ButtonRelease:
+		case MotionNotify:
+			break;
+		default:
+			return;
+	}
+	pthread_mutex_lock(&input.mutex);
+	if (!input.count++) {
+		input.first=get_time_ns(CLOCK_REALTIME);
+	}
+	pthread_mutex_unlock(&input.mutex);
+}
+
+/* move the events since the last swap to the frame info */
+static void
+input_take(unsigned int *count, uint64_t *first)
+{
+	pthread_mutex_lock(&input.mutex);
+	*count=input.count;
+	*first=input.first;
+	input.count=0;
+	pthread_mutex_unlock(&input.mutex);
+}
+
+/***************************************************************************
+ * FRAME TIMING MEASUREMENTS                                               *
+ ***************************************************************************/
+
+/* we support different modes for the frame time measurements */
+typedef enum {
+	GH_FRAMETIME_NONE=0,	/* do not measure any frame times */
+	GH_FRAMETIME_CPU,	/* measure only on CPU */
+	GH_FRAMETIME_CPU_GPU,	/* measure both on CPU and GPU */
+} GH_frametime_mode;
+
+/* a single timestamp */
+typedef struct {
+	struct timespec timestamp_cpu;	/* CPU timestamp */
+	GLuint64 timestamp_gl;		/* OpenGL timestamp (client side) */
+	GLuint query_object;		/* the OpenGL timer query object */
+} GH_timestamp;
+
+/* the _result_ of the measurement */
+typedef struct {
+	uint64_t cpu;
+	uint64_t gl;
+	uint64_t gpu;
+	uint64_t gpu_cpu;	/* gpu mapped to the CPU timeline */
+} GH_frametime;
+
+/* classification of a frame */
+typedef enum {
+	GH_FRAME_UNKNOWN=0,	/* not enough data */
+	GH_FRAME_CPU_BOUND,	/* the CPU work of the app limits the frame rate */
+	GH_FRAME_GPU_BOUND,	/* the GPU limits the frame rate */
+	GH_FRAME_PRESENT_BOUND,	/* blocked in the buffer swap, but not by the GPU */
+	GH_FRAME_CLASS_COUNT
+} GH_frame_class;
+
+/* additional information per frame: the values captured on the CPU
+ * are delayed by the same number of frames as the timer queries, and
+ * the derived values are calculated as soon as the results are complete */
+typedef struct {
+	/* captured */
+	int64_t present_ust;		/* UST of the most recent vblank (GLX_OML_sync_control) */
+	int64_t present_msc;		/* media stream counter */
+	int64_t present_sbc;		/* swap buffer counter */
+	uint64_t thread_cpu;		/* CPU time of the rendering thread in ns */
+	long nvcsw;			/* voluntary context switches */
+	long nivcsw;			/* involuntary context switches */
+	long minflt;			/* minor page faults */
+	long majflt;			/* major page faults */
+	long cpu_freq;			/* current CPU frequency in kHz, -1 if unknown */
+	long temperature;		/* in millidegrees Celsius, -1 if unknown */
+	unsigned long alloc_count;	/* heap allocations of the rendering thread */
+	unsigned long free_count;
+	unsigned long long alloc_bytes;
+	unsigned int marker_group;	/* outermost debug group of the frame */
+	unsigned int marker_event;	/* most recent event marker */
+	unsigned long upload_calls;	/* texture and buffer uploads */
+	unsigned long long upload_texture;
+	unsigned long long upload_buffer;
+	unsigned long long upload_mapped;
+	uint64_t gpu_mem[GH_GPU_MEM_TYPES];	/* tracked GPU memory per type */
+	long gpu_mem_available;		/* free video memory reported by the driver in kB */
+	long gpu_mem_evicted;
+	unsigned int stall_count;	/* GL calls which stalled */
+	uint64_t stall_time;
+	unsigned int x11_calls;		/* synchronous X11 calls */
+	uint64_t x11_time;
+	unsigned int input_count;	/* input events consumed during the frame */
+	uint64_t input_first;		/* CLOCK_REALTIME of the oldest one */
+	unsigned int latency_depth;	/* depth of the adaptive latency limiter */
+	int captured;			/* frame is inside a benchmark capture window */
+	/* derived */
+	GH_frame_class frame_class;
+	unsigned int gpu_span;		/* GPU span in percent of the frame time over the window */
+} GH_frameinfo;
+
+/* sliding window for the GPU span of the frames */
+typedef struct {
+	unsigned int size;		/* window size in frames, 0 if disabled */
+	unsigned int pos;
+	uint64_t *span;			/* GPU time between frame start and end */
+	uint64_t *period;		/* CPU frame time */
+	uint64_t span_sum;
+	uint64_t period_sum;
+} GH_frame_window;
+
+/* per-frame telemetry of the rendering thread */
+typedef struct {
+	int enabled;
+	unsigned int sysfs_interval;	/* read sysfs every n frames, 0 to disable */
+	unsigned int counter;		/* frames until the next sysfs reading */
+	char thermal_path[64];
+	long cpu_freq;			/* the most recent sysfs readings */
+	long temperature;
+} GH_telemetry;
+
+/* GPU timestamp at the start of a frame, issued at the first glClear */
+typedef struct {
+	GLuint query;
+	int issued;			/* the query is pending for the frame in this slot */
+} GH_frame_start;
+
+/* benchmark mode: warmup and capture windows */
+typedef struct {
+	int enabled;
+	unsigned int warmup;		/* frames to skip */
+	unsigned int frames;		/* frames to capture, 0 for unlimited */
+	unsigned int frame;		/* frames seen so far */
+	unsigned int captured;		/* frames captured so far */
+	int triggered;			/* capture only while triggered */
+	int capturing;
+	int done;			/* all frames captured */
+	unsigned int countdown;		/* frames until the results are complete */
+	int finished;			/* summary written */
+	int exit;			/* exit the process when done */
+	const char *trigger_file;
+	uint64_t *frametime;		/* the frame times of the captured frames */
+	uint64_t *latency;		/* the GPU latencies of the captured frames */
+	unsigned int count;
+	unsigned int capacity;
+	unsigned int ctx_num;
+} GH_benchmark;
+
+/* the complete state needed for frametime measurements */
+typedef struct {
+	GH_frametime_mode mode;		/* the mode we are in */
+	unsigned int delay;		/* number of frames for delay */
+	unsigned int num_timestamps;	/* number of timestamps per frame */
+	unsigned int num_results;	/* number of frames to store results */
+	GH_timestamp *timestamp;	/* the array of timestamps, used as ring buffer */
+	unsigned int cur_pos;		/* the current frame in the delay ring buffer */
+	GH_frametime *frametime;	/* the array of frametimes */
+	unsigned int cur_result;	/* the current result index */
+	unsigned int frame;		/* the current frame */
+	FILE *dump;			/* the stream to dump the results to */
+	GH_clock_calibration calibration; /* CPU/GPU clock calibration */
+	GH_frameinfo *info;		/* the array of per-frame infos */
+	GH_frameinfo *pending;		/* the captured infos in the delay ring buffer */
+	GH_frameinfo current;		/* the infos captured for the current frame */
+	GH_frameinfo last_info;		/* the most recent complete per-frame info */
+	int present;			/* query the presentation via GLX_OML_sync_control */
+	GH_frame_window window;		/* sliding window for the classification */
+	GH_telemetry telemetry;		/* thread CPU time, context switches, page faults */
+	int alloc;			/* count heap allocations */
+	int input;			/* measure the input latency */
+	int latency_depth;		/* report the adaptive latency limiter depth */
+	uint64_t gpu_tail;		/* GPU latency at the swap of the most recent complete frame */
+	int gpu_tail_valid;		/* gpu_tail was measured at the last swap */
+	GH_markers markers;		/* debug groups and markers of the app */
+	GH_gpu_groups groups;		/* GPU time per debug group */
+	GH_uploads uploads;		/* texture and buffer uploads */
+	GH_gpu_memory gpumem;		/* tracked GPU memory */
+	GH_stalls stalls;		/* pipeline stall detector */
+	GH_x11_calls x11;		/* X11 round trips */
+	GH_benchmark benchmark;		/* benchmark mode */
+	GH_frame_start *start;		/* GPU frame starts in the delay ring buffer, only when recording */
+	int started;			/* the current frame has its GPU frame start */
+	uint64_t start_gpu;		/* GPU frame start of the frame whose results complete next, 0 if unknown */
+	unsigned int ctx_num;		/* number of the context we belong to */
+} GH_frametimes;
+
+/* the probes we take each frame */
+typedef enum {
+	GH_FRAMETIME_BEFORE_SWAPBUFFERS=0,
+	GH_FRAMETIME_AFTER_SWAPBUFFERS,
+	GH_FRAMETIME_COUNT
+} GH_frametime_probe;
+
+static void
+timestamp_init(GH_timestamp *ts)
+{
+	ts->query_object=0;
+	ts->timestamp_gl=0;
+	ts->timestamp_cpu.tv_sec=0;
+	ts->timestamp_cpu.tv_nsec=0;
+}
+
+static void
+timestamp_cleanup(GH_timestamp *ts)
+{
+	if (ts->query_object && GH_glDeleteQueries) {
+		GH_glDeleteQueries(1, &ts->query_object);
+		ts->query_object=0;
+	}
+}
+
+static void
+timestamp_set(GH_timestamp *ts, GH_frametime *rs, GH_frametime_mode mode)
+{
+	/* CPU */
+	/* collect previous result */
+	rs->cpu=(uint64_t)ts->timestamp_cpu.tv_sec * (uint64_t)1000000000UL
+		+ (uint64_t)ts->timestamp_cpu.tv_nsec;
+	/* new query */
+	clock_gettime(CLOCK_REALTIME, &ts->timestamp_cpu);
+
+	/* GPU */
+	if (mode >= GH_FRAMETIME_CPU_GPU) {
+		/* collect previous result */
+		if (ts->query_object) {
+			GLuint64 value;
+			GH_glGetQueryObjectui64v(ts->query_object, GL_QUERY_RESULT, &value);
+			rs->gpu=(uint64_t)value;
+		} else {
+			GH_glGenQueries(1, &ts->query_object);
+		}
+		rs->gl=(uint64_t)(ts->timestamp_gl);
+		/* new query */
+		GH_glQueryCounter(ts->query_object, GL_TIMESTAMP);
+		GH_glGetInteger64v(GL_TIMESTAMP, (GLint64*)&ts->timestamp_gl);
+	}
+}
+
+static void
+frame_window_init(GH_frame_window *win, unsigned int size)
+{
+	win->size=0;
+	win->pos=0;
+	win->span_sum=0;
+	win->period_sum=0;
+	win->span=NULL;
+	win->period=NULL;
+	if (size) {
+		win->span=calloc(size, sizeof(*win->span));
+		win->period=calloc(size, sizeof(*win->period));
+		if (win->span && win->period) {
+			win->size=size;
+		} else {
+			GH_verbose(GH_MSG_WARNING, "failed to allocate memory for frame window of %u frames, "
+					"disabling frame classification\n", size);
+			free(win->span);
+			free(win->period);
+			win->span=NULL;
+			win->period=NULL;
+		}
+	}
+}
+
+static void
+frame_window_destroy(GH_frame_window *win)
+{
+	free(win->span);
+	free(win->period);
+	win->span=NULL;
+	win->period=NULL;
+	win->size=0;
+}
+
+/* add a frame to the window, return the GPU span in percent of the frame time */
+static unsigned int
+frame_window_add(GH_frame_window *win, uint64_t span, uint64_t period)
+{
+	uint64_t pct;
+
+	win->span_sum -= win->span[win->pos];
+	win->period_sum -= win->period[win->pos];
+	win->span[win->pos]=span;
+	win->period[win->pos]=period;
+	win->span_sum += span;
+	win->period_sum += period;
+	if (++win->pos >= win->size) {
+		win->pos=0;
+	}
+	if (!win->period_sum) {
+		return 0;
+	}
+	pct=(win->span_sum * 100U) / win->period_sum;
+	return (pct > 100U)?100U:(unsigned int)pct;
+}
+
+static void
+frameinfo_init(GH_frameinfo *info)
+{
+	unsigned int i;
+
+	info->present_ust=0;
+	info->present_msc=0;
+	info->present_sbc=0;
+	info->thread_cpu=0;
+	info->nvcsw=0;
+	info->nivcsw=0;
+	info->minflt=0;
+	info->majflt=0;
+	info->cpu_freq=-1;
+	info->temperature=-1;
+	info->alloc_count=0;
+	info->free_count=0;
+	info->alloc_bytes=0;
+	info->marker_group=0;
+	info->marker_event=0;
+	info->upload_calls=0;
+	info->upload_texture=0;
+	info->upload_buffer=0;
+	info->upload_mapped=0;
+	for (i=0; i<GH_GPU_MEM_TYPES; i++) {
+		info->gpu_mem[i]=0;
+	}
+	info->gpu_mem_available=-1;
+	info->gpu_mem_evicted=-1;
+	info->stall_count=0;
+	info->stall_time=0;
+	info->x11_calls=0;
+	info->x11_time=0;
+	info->input_count=0;
+	info->input_first=0;
+	info->latency_depth=0;
+	info->captured=1;
+	info->frame_class=GH_FRAME_UNKNOWN;
+	info->gpu_span=0;
+}
+
+static void
+telemetry_init(GH_telemetry *tm, int enabled, unsigned int sysfs_interval, unsigned int thermal_zone)
+{
+	tm->enabled=enabled;
+	tm->sysfs_interval=sysfs_interval;
+	tm->counter=0;
+	tm->cpu_freq=-1;
+	tm->temperature=-1;
+	snprintf(tm->thermal_path, sizeof(tm->thermal_path), "/sys/class/thermal/thermal_zone%u/temp", thermal_zone);
+}
+
+/* read a single integer from a sysfs file, -1 on failure */
+static long
+read_sysfs_long(const char *path)
+{
+	char buf[32];
+	ssize_t len;
+	int fd=open(path, O_RDONLY | O_CLOEXEC);
+
+	if (fd < 0) {
+		return -1;
+	}
+	len=read(fd, buf, sizeof(buf)-1);
+	close(fd);
+	if (len <= 0) {
+		return -1;
+	}
+	buf[len]=0;
+	return strtol(buf, NULL, 10);
+}
+
+/* sample the telemetry of the calling thread */
+static void
+telemetry_sample(GH_telemetry *tm, GH_frameinfo *info)
+{
+	struct rusage ru;
+
+	info->thread_cpu=get_time_ns(CLOCK_THREAD_CPUTIME_ID);
+	if (!getrusage(RUSAGE_THREAD, &ru)) {
+		info->nvcsw=ru.ru_nvcsw;
+		info->nivcsw=ru.ru_nivcsw;
+		info->minflt=ru.ru_minflt;
+		info->majflt=ru.ru_majflt;
+	}
+	if (tm->sysfs_interval) {
+		if (!tm->counter) {
+			char path[96];
+			int cpu=sched_getcpu();
+			if (cpu >= 0) {
+				snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/cpufreq/scaling_cur_freq", cpu);
+				tm->cpu_freq=read_sysfs_long(path);
+			}
+			tm->temperature=read_sysfs_long(tm->thermal_path);
+			tm->counter=tm->sysfs_interval;
+		}
+		tm->counter--;
+	}
+	info->cpu_freq=tm->cpu_freq;
+	info->temperature=tm->temperature;
+}
+
+/* triggers for the benchmark capture windows: -1 if not triggered yet,
+ * 1 after SIGUSR1, 0 after SIGUSR2 */
+static volatile sig_atomic_t benchmark_signal=-1;
+
+static void
+benchmark_signal_handler(int sig)
+{
+	benchmark_signal=(sig == SIGUSR1)?1:0;
+}
+
+static void
+benchmark_init(GH_benchmark *bm, unsigned int ctx_num)
+{
+	const char *cfg=getenv("GH_BENCHMARK");
+	char *next;
+
+	memset(bm, 0, sizeof(*bm));
+	bm->ctx_num=ctx_num;
+	if (!cfg || !cfg[0]) {
+		return;
+	}
+	bm->warmup=(unsigned int)strtoul(cfg, &next, 0);
+	if (*next == ',') {
+		bm->frames=(unsigned int)strtoul(next+1, NULL, 0);
+	}
+	bm->exit=get_envi("GH_BENCHMARK_EXIT", 0);
+	bm->trigger_file=getenv("GH_BENCHMARK_TRIGGER_FILE");
+	if (bm->trigger_file && !bm->trigger_file[0]) {
+		bm->trigger_file=NULL;
+	}
+	if (get_envi("GH_BENCHMARK_SIGNALS", 0)) {
+		static pthread_mutex_t mutex=PTHREAD_MUTEX_INITIALIZER;
+		static int installed=0;
+		pthread_mutex_lock(&mutex);
+		if (!installed) {
+			struct sigaction sa;
+			memset(&sa, 0, sizeof(sa));
+			sa.sa_handler=benchmark_signal_handler;
+			sa.sa_flags=SA_RESTART;
+			sigemptyset(&sa.sa_mask);
+			sigaction(SIGUSR1, &sa, NULL);
+			sigaction(SIGUSR2, &sa, NULL);
+			installed=1;
+		}
+		pthread_mutex_unlock(&mutex);
+		bm->triggered=1;
+	}
+	if (bm->trigger_file) {
+		bm->triggered=1;
+	}
+	bm->enabled=1;
+	GH_verbose(GH_MSG_INFO, "benchmark ctx %u: warmup %u frames, capturing %u frames%s\n",
+			ctx_num, bm->warmup, bm->frames, (bm->triggered)?" when triggered":"");
+}
+
+static void
+benchmark_destroy(GH_benchmark *bm)
+{
+	free(bm->frametime);
+	free(bm->latency);
+	bm->frametime=NULL;
+	bm->latency=NULL;
+	bm->enabled=0;
+}
+
+/* check if the current frame is to be captured */
+static int
+benchmark_frame(GH_benchmark *bm)
+{
+	int active;
+
+	if (++bm->frame <= bm->warmup || bm->done) {
+		return 0;
+	}
+	if (bm->triggered) {
+		active=(benchmark_signal > 0) ||
+		       (bm->trigger_file && !access(bm->trigger_file, F_OK));
+	} else {
+		active=1;
+	}
+	if (active != bm->capturing) {
+		GH_verbose(GH_MSG_INFO, "benchmark ctx %u: capture %s at frame %u\n", bm->ctx_num,
+				(active)?"started":"stopped", bm->frame - 1);
+		bm->capturing=active;
+	}
+	if (active && bm->frames && ++bm->captured >= bm->frames) {
+		bm->done=1;
+		bm->capturing=0;
+	}
+	return active;
+}
+
+/* add the results of a captured frame */
+static void
+benchmark_add(GH_benchmark *bm, uint64_t frametime, uint64_t latency)
+{
+	if (bm->count >= bm->capacity) {
+		unsigned int capacity=(bm->capacity)?(bm->capacity * 2):1024;
+		uint64_t *ft=realloc(bm->frametime, sizeof(*ft) * capacity);
+		uint64_t *lat;
+		if (ft) {
+			bm->frametime=ft;
+		}
+		lat=realloc(bm->latency, sizeof(*lat) * capacity);
+		if (lat) {
+			bm->latency=lat;
+		}
+		if (!ft || !lat) {
+			return;
+		}
+		bm->capacity=capacity;
+	}
+	bm->frametime[bm->count]=frametime;
+	bm->latency[bm->count]=latency;
+	bm->count++;
+}
+
+static uint64_t
+benchmark_percentile(const uint64_t *sorted, unsigned int count, double p)
+{
+	return sorted[(unsigned int)(p * (double)(count - 1) + 0.5)];
+}
+
+/* write the summary of the captured frames */
+static void
+benchmark_summary(GH_benchmark *bm, int with_latency)
+{
+	static const double p[]={0.5, 0.9, 0.95, 0.99, 0.999};
+	char buf[PATH_MAX];
+	uint64_t sum=0, lat_sum=0;
+	unsigned int i;
+	FILE *f;
+
+	if (!bm->enabled || bm->finished) {
+		return;
+	}
+	bm->finished=1;
+	if (!bm->count) {
+		GH_verbose(GH_MSG_WARNING, "benchmark ctx %u: no frames captured\n", bm->ctx_num);
+		return;
+	}
+	parse_name(buf, sizeof(buf), get_envs("GH_BENCHMARK_FILE", "glx_hook_benchmark-ctx%c.txt"), bm->ctx_num);
+	f=fopen(buf, "wt");
+	if (!f) {
+		GH_verbose(GH_MSG_WARNING, "benchmark ctx %u: failed to open '%s'\n", bm->ctx_num, buf);
+		f=stderr;
+	}
+	for (i=0; i<bm->count; i++) {
+		sum += bm->frametime[i];
+		lat_sum += bm->latency[i];
+	}
+	qsort(bm->frametime, bm->count, sizeof(*bm->frametime), compare_u64);
+	fprintf(f, "frames %u\n", bm->count);
+	fprintf(f, "duration_ms %.3f\n", (double)sum * 1.0E-6);
+	fprintf(f, "fps_avg %.3f\n", (sum)?((double)bm->count * 1.0E9 / (double)sum):0.0);
+	fprintf(f, "fps_1pct_low %.3f\n", 1.0E9 / (double)benchmark_percentile(bm->frametime, bm->count, 0.99));
+	fprintf(f, "frametime_avg_ms %.3f\n", (double)sum * 1.0E-6 / (double)bm->count);
+	fprintf(f, "frametime_min_ms %.3f\n", (double)bm->frametime[0] * 1.0E-6);
+	fprintf(f, "frametime_max_ms %.3f\n", (double)bm->frametime[bm->count-1] * 1.0E-6);
+	for (i=0; i<sizeof(p)/sizeof(p[0]); i++) {
+		fprintf(f, "frametime_p%g_ms %.3f\n", p[i] * 100.0,
+			(double)benchmark_percentile(bm->frametime, bm->count, p[i]) * 1.0E-6);
+	}
+	if (with_latency) {
+		qsort(bm->latency, bm->count, sizeof(*bm->latency), compare_u64);
+		fprintf(f, "latency_avg_ms %.3f\n", (double)lat_sum * 1.0E-6 / (double)bm->count);
+		for (i=0; i<sizeof(p)/sizeof(p[0]); i++) {
+			fprintf(f, "latency_p%g_ms %.3f\n", p[i] * 100.0,
+				(double)benchmark_percentile(bm->latency, bm->count, p[i]) * 1.0E-6);
+		}
+	}
+	GH_verbose(GH_MSG_INFO, "benchmark ctx %u: %u frames, %.3f fps average, %.3f ms 99th percentile\n",
+			bm->ctx_num, bm->count, (sum)?((double)bm->count * 1.0E9 / (double)sum):0.0,
+			(double)benchmark_percentile(bm->frametime, bm->count, 0.99) * 1.0E-6);
+	if (f != stderr) {
+		fclose(f);
+	}
+}
+
+/* Classify a completed frame based on the probes before and after the swap
+ * of the frame itself (cur), and the probe after the swap of the previous
+ * frame (prev).
+ * The GPU span is the GPU time between the start and the end of the
+ * frame. Since the GPU might idle in between when the app submits its
+ * work slowly, it is only an upper bound of the time the GPU was busy.
+ * We therefore use the latency at the end of the frame as the primary
+ * signal for GPU-bound frames: if the GPU still lags more than half a
+ * frame behind after the app has submitted all work of the frame, the GPU
+ * is the bottleneck. Otherwise,
+ * if more than half of the frame is spent in the buffer swap (including the
+ * latency limiter), we are waiting for the presentation (vsync, compositor,
+ * driver throttling), and the app is CPU-bound in all other cases. */
+static void
+frametimes_classify(GH_frametimes *ft, const GH_frametime *cur, const GH_frametime *prev, GH_frameinfo *info)
+{
+	uint64_t period=cur[GH_FRAMETIME_AFTER_SWAPBUFFERS].cpu - prev[GH_FRAMETIME_AFTER_SWAPBUFFERS].cpu;
+	uint64_t swap=cur[GH_FRAMETIME_AFTER_SWAPBUFFERS].cpu - cur[GH_FRAMETIME_BEFORE_SWAPBUFFERS].cpu;
+	int64_t latency=0;
+
+	if (ft->mode >= GH_FRAMETIME_CPU_GPU) {
+		uint64_t span=cur[GH_FRAMETIME_BEFORE_SWAPBUFFERS].gpu - prev[GH_FRAMETIME_AFTER_SWAPBUFFERS].gpu;
+		latency=(int64_t)(cur[GH_FRAMETIME_BEFORE_SWAPBUFFERS].gpu - cur[GH_FRAMETIME_BEFORE_SWAPBUFFERS].gl);
+		info->gpu_span=frame_window_add(&ft->window, span, period);
+	} else {
+		info->gpu_span=0;
+	}
+
+	if (latency > 0 && (uint64_t)latency > period/2) {
+		info->frame_class=GH_FRAME_GPU_BOUND;
+	} else if (swap > period/2) {
+		info->frame_class=GH_FRAME_PRESENT_BOUND;
+	} else {
+		info->frame_class=GH_FRAME_CPU_BOUND;
+	}
+	ft->last_info=*info;
+}
+
+static int
+frametimes_gl_init()
+{
+	GH_GET_GL_PROC_OR_FAIL(glGenQueries, GH_MSG_WARNING, -1);
+	GH_GET_GL_PROC_OR_FAIL(glDeleteQueries, GH_MSG_WARNING, -1);
+	GH_GET_GL_PROC_OR_FAIL(glGetInteger64v, GH_MSG_WARNING, -1);
+	GH_GET_GL_PROC_OR_FAIL(glQueryCounter, GH_MSG_WARNING, -1);
+	GH_GET_GL_PROC_OR_FAIL(glGetQueryObjectui64v, GH_MSG_WARNING, -1);
+	return 0;
+}
+
+static void
+frametimes_init(GH_frametimes *ft, GH_frametime_mode mode, unsigned int delay, unsigned int num_timestamps, unsigned int num_results, unsigned int ctx_num)
+{
+	ft->cur_pos=0;
+	ft->cur_result=0;
+	ft->frame=0;
+	ft->dump=NULL;
+	ft->info=NULL;
+	ft->pending=NULL;
+	ft->present=0;
+	ft->start=NULL;
+	ft->started=0;
+	ft->start_gpu=0;
+	ft->ctx_num=ctx_num;
+	frameinfo_init(&ft->current);
+	frameinfo_init(&ft->last_info);
+	clock_calibration_init(&ft->calibration, 0, 0);
+	frame_window_init(&ft->window, 0);
+	telemetry_init(&ft->telemetry, 0, 0, 0);
+	ft->alloc=0;
+	ft->input=0;
+	ft->latency_depth=0;
+	ft->gpu_tail=0;
+	ft->gpu_tail_valid=0;
+	markers_init(&ft->markers, 0);
+	gpu_groups_init(&ft->groups, 0, 0, ctx_num);
+	uploads_init(&ft->uploads, 0);
+	gpu_mem_init(&ft->gpumem, 0, 0, ctx_num);
+	stalls_init(&ft->stalls, 0, 0, ctx_num);
+	x11_calls_init(&ft->x11, 0, ctx_num);
+	benchmark_init(&ft->benchmark, ctx_num);
+	if (ft->benchmark.enabled && mode == GH_FRAMETIME_NONE) {
+		/* the benchmark needs at least the CPU frame times */
+		mode=GH_FRAMETIME_CPU;
+	}
+
+	if (mode >= GH_FRAMETIME_CPU_GPU) {
+		if (frametimes_gl_init()) {
+			GH_verbose(GH_MSG_WARNING, "GPU timer queries not available, using CPU only\n");
+			mode = GH_FRAMETIME_CPU;
+		} else {
+			clock_calibration_init(&ft->calibration,
+				get_envui("GH_FRAMETIME_CALIBRATION", 0),
+				get_envui("GH_FRAMETIME_CALIBRATION_SAMPLES", 16));
+			if (ft->calibration.interval) {
+				GH_verbose(GH_MSG_INFO, "CPU/GPU clock calibration every %u frames over %u samples\n",
+						ft->calibration.interval, ft->calibration.max_samples);
+			}
+		}
+	}
+
+	if (mode && delay && num_timestamps && num_results) {
+		ft->mode=mode;
+		ft->delay=delay;
+		ft->num_timestamps=num_timestamps;
+		ft->num_results=num_results;
+		if ((ft->frametime=malloc(sizeof(*ft->frametime) * (num_results+1) * num_timestamps))) {
+			if ((ft->timestamp=malloc(sizeof(*ft->timestamp) * delay * num_timestamps)) &&
+			    (ft->info=malloc(sizeof(*ft->info) * (num_results+1))) &&
+			    (ft->pending=malloc(sizeof(*ft->pending) * delay))) {
+				unsigned int i;
+				GH_verbose(GH_MSG_DEBUG, "enabling frametime measurements mode %d,  %u x %u timestamps\n",
+						(int)mode, delay, num_timestamps);
+				for (i=0; i<delay * num_timestamps; i++) {
+					timestamp_init(&ft->timestamp[i]);
+				}
+				for (i=0; i<num_results+1; i++) {
+					frameinfo_init(&ft->info[i]);
+				}
+				for (i=0; i<delay; i++) {
+					frameinfo_init(&ft->pending[i]);
+				}
+				frame_window_init(&ft->window, get_envui("GH_FRAMETIME_CLASSIFY", 0));
+				if (recorder.file && mode >= GH_FRAMETIME_CPU_GPU) {
+					/* the recorded GPU time starts at the first glClear */
+					ft->start=calloc(delay, sizeof(*ft->start));
+				}
+				if (get_envi("GH_FRAMETIME_PRESENT", 0)) {
+					GH_GET_GL_PROC(glXGetSyncValuesOML);
+					if (GH_glXGetSyncValuesOML) {
+						GH_verbose(GH_MSG_INFO, "measuring presentation via GLX_OML_sync_control\n");
+						ft->present=1;
+					} else {
+						GH_verbose(GH_MSG_WARNING, "GLX_OML_sync_control not available, not measuring presentation\n");
+					}
+				}
+				telemetry_init(&ft->telemetry, get_envi("GH_FRAMETIME_TELEMETRY", 0),
+						get_envui("GH_FRAMETIME_SYSFS_INTERVAL", 60),
+						get_envui("GH_FRAMETIME_THERMAL_ZONE", 0));
+				if (get_envi("GH_FRAMETIME_ALLOC", 0)) {
+#ifdef GH_MALLOC_INTERCEPT
+					alloc_init();
+					ft->alloc=1;
+#else
+					GH_verbose(GH_MSG_WARNING, "heap allocation accounting not available, rebuild with MALLOC=1\n");
+#endif
+				}
+				markers_init(&ft->markers, get_envi("GH_FRAMETIME_MARKERS", 0));
+				uploads_init(&ft->uploads, get_envi("GH_FRAMETIME_UPLOADS", 0));
+				gpu_mem_init(&ft->gpumem, get_envi("GH_FRAMETIME_GPU_MEMORY", 0),
+						get_envui("GH_FRAMETIME_GPU_MEMORY_INTERVAL", 60), ctx_num);
+				stalls_init(&ft->stalls, get_envi("GH_FRAMETIME_STALLS", 0),
+						get_envui("GH_FRAMETIME_STALLS_THRESHOLD_USECS", 500), ctx_num);
+				x11_calls_init(&ft->x11, get_envi("GH_FRAMETIME_X11", 0), ctx_num);
+				if (get_envi("GH_FRAMETIME_INPUT", 0)) {
+					input_init();
+					ft->input=1;
+				}
+				if (get_envui("GH_FRAMETIME_GPU_GROUPS", 0)) {
+					if (mode >= GH_FRAMETIME_CPU_GPU) {
+						gpu_groups_init(&ft->groups, get_envui("GH_FRAMETIME_GPU_GROUPS", 0), delay, ctx_num);
+					} else {
+						GH_verbose(GH_MSG_WARNING, "GPU debug group timing requires GH_FRAMETIME=2\n");
+					}
+				}
+			} else {
+				free(ft->timestamp);
+				free(ft->info);
+				ft->timestamp=NULL;
+				ft->info=NULL;
+				GH_verbose(GH_MSG_WARNING, "failed to allocate memory for %u x %u timestamps, "
+						"disbaling timestamps\n",
+						delay, num_timestamps);
+				mode=GH_FRAMETIME_NONE;
+			}
+		} else {
+			GH_verbose(GH_MSG_WARNING, "failed to allocate memory for %u x %u frametime results, "
+					"disbaling timestamps\n",
+					num_results, num_timestamps);
+			mode=GH_FRAMETIME_NONE;
+		}
+	}
+
+	if (!mode || !delay || !num_timestamps || !num_results) {
+		ft->mode=GH_FRAMETIME_NONE;
+		ft->delay=0;
+		ft->num_timestamps=0;
+		ft->num_results=0;
+		ft->timestamp=NULL;
+		ft->frametime=NULL;
+		ft->info=NULL;
+		ft->pending=NULL;
+		ft->present=0;
+	}
+
+	if (ft->mode) {
+		const char *file=get_envs("GH_FRAMETIME_FILE","glx_hook_frametimes-ctx%c.csv");
+		if (file) {
+			char buf[PATH_MAX];
+			parse_name(buf, sizeof(buf), file, ctx_num);
+			ft->dump=fopen(buf,"wt");
+		}
+		if (!ft->dump) {
+			ft->dump=stderr;
+		}
+	}
+}
+
+static void
+frametimes_map_result(const GH_frametimes *ft, GH_frametime *rs)
+{
+	if (ft->calibration.interval) {
+		rs->gpu_cpu=clock_calibration_map(&ft->calibration, rs->gpu);
+	}
+}
+
+static void
+frametimes_init_base(GH_frametimes *ft)
+{
+	/* get the base timestamp */
+	if (ft->mode > GH_FRAMETIME_NONE) {
+		GH_timestamp base;
+		unsigned int i;
+		GH_frametime *last=&ft->frametime[ft->num_results * ft->num_timestamps];
+
+		timestamp_init(&base);
+		if (ft->calibration.interval) {
+			/* the offset only, the drift needs samples spread
+			 * over some time, so the periodic ones will refine it */
+			clock_calibration_sample(&ft->calibration);
+		}
+		timestamp_set(&base, &last[0], ft->mode);
+		timestamp_set(&base, &last[0], ft->mode);
+		frametimes_map_result(ft, &last[0]);
+		for (i=1; i<ft->num_timestamps; i++) {
+			last[i]=last[0];
+		}
+		timestamp_cleanup(&base);
+	}
+}
+
+static void
+frametimes_dump_diff(const GH_frametimes *ft, uint64_t val, uint64_t base)
+{
+	fprintf(ft->dump, "\t%llu", (unsigned long long) (val-base));
+}
+
+static void
+frametimes_dump_sdiff(const GH_frametimes *ft, uint64_t val, uint64_t base)
+{
+	fprintf(ft->dump, "\t%lld", (long long)(int64_t)(val-base));
+}
+
+static void
+frametimes_dump_result(const GH_frametimes *ft, const GH_frametime *rs, const GH_frametime *base)
+{
+	frametimes_dump_diff(ft, rs->cpu, base->cpu);
+	frametimes_dump_diff(ft, rs->gpu, base->gpu);
+	frametimes_dump_diff(ft, rs->gpu, rs->gl);
+}
+
+static void
+frametimes_dump_info(const GH_frametimes *ft, const GH_frameinfo *info)
+{
+	fprintf(ft->dump, "\t%d\t%u", (int)info->frame_class, info->gpu_span);
+}
+
+/* A frame which was on screen for more than one vblank is a missed vblank
+ * (the previous frame is repeated), more completed swaps than vblanks
+ * means that frames were dropped (or torn without vsync). A UST of 0 means
+ * that there is no query result for that frame (or no previous frame at
+ * all), then all values are 0. */
+static void
+frametimes_dump_present(const GH_frametimes *ft, const GH_frameinfo *info, const GH_frameinfo *prev,
+		        int64_t *missed, int64_t *dropped)
+{
+	int64_t msc=0,sbc=0,ust=0;
+
+	if (info->present_ust && prev->present_ust) {
+		msc=info->present_msc - prev->present_msc;
+		sbc=info->present_sbc - prev->present_sbc;
+		ust=info->present_ust - prev->present_ust;
+	}
+	*missed=(sbc > 0 && msc > sbc)?(msc - sbc):0;
+	*dropped=(sbc > msc)?(sbc - msc):0;
+	fprintf(ft->dump, "\t%lld\t%lld\t%lld\t%lld\t%lld",
+			(long long)ust, (long long)msc, (long long)sbc,
+			(long long)*missed, (long long)*dropped);
+}
+
+static void
+frametimes_dump_telemetry(const GH_frametimes *ft, const GH_frameinfo *info, const GH_frameinfo *prev)
+{
+	if (!info->thread_cpu || !prev->thread_cpu) {
+		/* no sample of the previous frame, the first frame */
+		fprintf(ft->dump, "\t0\t0\t0\t0\t0\t%ld\t%ld", info->cpu_freq, info->temperature);
+		return;
+	}
+	fprintf(ft->dump, "\t%llu\t%ld\t%ld\t%ld\t%ld\t%ld\t%ld",
+			(unsigned long long)(info->thread_cpu - prev->thread_cpu),
+			info->nvcsw - prev->nvcsw, info->nivcsw - prev->nivcsw,
+			info->minflt - prev->minflt, info->majflt - prev->majflt,
+			info->cpu_freq, info->temperature);
+}
+
+static void
+frametimes_dump_alloc(const GH_frametimes *ft, const GH_frameinfo *info)
+{
+	fprintf(ft->dump, "\t%lu\t%llu\t%lu", info->alloc_count, info->alloc_bytes, info->free_count);
+}
+
+static void
+frametimes_dump_markers(const GH_frametimes *ft, const GH_frameinfo *info)
+{
+	fprintf(ft->dump, "\t%u\t%u", info->marker_group, info->marker_event);
+}
+
+static void
+frametimes_dump_uploads(const GH_frametimes *ft, const GH_frameinfo *info)
+{
+	fprintf(ft->dump, "\t%lu\t%llu\t%llu\t%llu", info->upload_calls,
+			info->upload_texture, info->upload_buffer, info->upload_mapped);
+}
+
+static void
+frametimes_dump_gpu_memory(const GH_frametimes *ft, const GH_frameinfo *info)
+{
+	fprintf(ft->dump, "\t%llu\t%llu\t%llu\t%ld\t%ld",
+			(unsigned long long)info->gpu_mem[GH_GPU_MEM_TEXTURE],
+			(unsigned long long)info->gpu_mem[GH_GPU_MEM_BUFFER],
+			(unsigned long long)info->gpu_mem[GH_GPU_MEM_RENDERBUFFER],
+			info->gpu_mem_available, info->gpu_mem_evicted);
+}
+
+static void
+frametimes_dump_stalls(const GH_frametimes *ft, const GH_frameinfo *info)
+{
+	fprintf(ft->dump, "\t%u\t%llu", info->stall_count, (unsigned long long)info->stall_time);
+}
+
+static void
+frametimes_dump_x11(const GH_frametimes *ft, const GH_frameinfo *info)
+{
+	fprintf(ft->dump, "\t%u\t%llu", info->x11_calls, (unsigned long long)info->x11_time);
+}
+
+/* the latencies from the oldest input event to the buffer swap and to
+ * the end of the GPU work of the frame, -1 if there was no input (or
+ * no GPU timestamp) */
+static void
+frametimes_dump_input(const GH_frametimes *ft, const GH_frameinfo *info, const GH_frametime *rs,
+		      int64_t *to_swap, int64_t *to_gpu)
+{
+	const GH_frametime *swap=&rs[GH_FRAMETIME_BEFORE_SWAPBUFFERS];
+
+	*to_swap=-1;
+	*to_gpu=-1;
+	if (info->input_count) {
+		*to_swap=(int64_t)(swap->cpu - info->input_first);
+		if (ft->calibration.interval) {
+			*to_gpu=(int64_t)(swap->gpu_cpu - info->input_first);
+		} else if (ft->mode >= GH_FRAMETIME_CPU_GPU) {
+			/* the GPU latency relative to the GL timestamp of the swap */
+			*to_gpu=*to_swap + (int64_t)(swap->gpu - swap->gl);
+		}
+	}
+	fprintf(ft->dump, "\t%u\t%lld\t%lld", info->input_count, (long long)*to_swap, (long long)*to_gpu);
+}
+
+static void
+frametimes_dump_results(const GH_frametimes *ft, const GH_frametime *rs, const GH_frametime *prev)
+{
+	unsigned int i;
+	for (i=0; i<ft->num_timestamps; i++) {
+		frametimes_dump_result(ft, &rs[i], &prev[GH_FRAMETIME_AFTER_SWAPBUFFERS]);
+	}
+	if (ft->calibration.interval) {
+		/* GPU timestamps on the CPU timeline, and the latency in the CPU domain */
+		for (i=0; i<ft->num_timestamps; i++) {
+			frametimes_dump_sdiff(ft, rs[i].gpu_cpu, prev[GH_FRAMETIME_AFTER_SWAPBUFFERS].cpu);
+			frametimes_dump_sdiff(ft, rs[i].gpu_cpu, rs[i].cpu);
+		}
+	}
+}
+
+static void
+frametimes_flush(GH_frametimes *ft)
+{
+	unsigned int i;
+	unsigned int class_count[GH_FRAME_CLASS_COUNT];
+	uint64_t span_sum=0;
+	int64_t missed_total=0, dropped_total=0;
+	unsigned int input_frames=0, input_gpu_frames=0;
+	int64_t input_swap_sum=0, input_swap_max=0, input_gpu_sum=0, input_gpu_max=0;
+	GH_frametime *last;
+	const GH_frametime *cur,*prev=&ft->frametime[ft->num_results * ft->num_timestamps];
+	const GH_frameinfo *prev_info=&ft->info[ft->num_results];
+
+	uint64_t t0;
+
+	if (ft->cur_result == 0) {
+		return;
+	}
+
+	t0=(trace.file)?get_time_ns(CLOCK_REALTIME):0;
+	GH_verbose(GH_MSG_DEBUG, "frametimes: dumping results of %u frames\n", ft->cur_result);
+	if (ft->markers.enabled) {
+		marker_table_dump(ft->dump, &ft->markers.written);
+	}
+	for (i=0; i<GH_FRAME_CLASS_COUNT; i++) {
+		class_count[i]=0;
+	}
+	for (i=0; i<ft->cur_result; i++) {
+		unsigned int frame=ft->frame - ft->cur_result + i;
+		cur=&ft->frametime[i * ft->num_timestamps];
+		if (frame >= ft->delay && !ft->info[i].captured) {
+			/* outside of the benchmark capture windows */
+			prev=cur;
+			prev_info=&ft->info[i];
+		} else if (frame >= ft->delay) {
+			if (ft->benchmark.enabled && frame > ft->delay) {
+				/* the GPU timestamp may be before the GL one if there was nothing queued */
+				int64_t latency=(int64_t)(cur[GH_FRAMETIME_BEFORE_SWAPBUFFERS].gpu - cur[GH_FRAMETIME_BEFORE_SWAPBUFFERS].gl);
+				benchmark_add(&ft->benchmark,
+					cur[GH_FRAMETIME_AFTER_SWAPBUFFERS].cpu - prev[GH_FRAMETIME_AFTER_SWAPBUFFERS].cpu,
+					(latency > 0)?(uint64_t)latency:0);
+			}
+			fprintf(ft->dump, "%u", frame - ft->delay);
+			frametimes_dump_results(ft, cur, prev);
+			if (ft->window.size) {
+				frametimes_dump_info(ft, &ft->info[i]);
+				class_count[ft->info[i].frame_class]++;
+				span_sum += ft->info[i].gpu_span;
+			}
+			if (ft->present) {
+				int64_t missed, dropped;
+				frametimes_dump_present(ft, &ft->info[i], prev_info, &missed, &dropped);
+				missed_total += missed;
+				dropped_total += dropped;
+			}
+			if (ft->telemetry.enabled) {
+				frametimes_dump_telemetry(ft, &ft->info[i], prev_info);
+			}
+			if (ft->alloc) {
+				frametimes_dump_alloc(ft, &ft->info[i]);
+			}
+			if (ft->markers.enabled) {
+				frametimes_dump_markers(ft, &ft->info[i]);
+			}
+			if (ft->uploads.enabled) {
+				frametimes_dump_uploads(ft, &ft->info[i]);
+			}
+			if (ft->gpumem.enabled) {
+				frametimes_dump_gpu_memory(ft, &ft->info[i]);
+			}
+			if (ft->stalls.enabled) {
+				frametimes_dump_stalls(ft, &ft->info[i]);
+			}
+			if (ft->x11.enabled) {
+				frametimes_dump_x11(ft, &ft->info[i]);
+			}
+			if (ft->input) {
+				int64_t to_swap, to_gpu;
+				frametimes_dump_input(ft, &ft->info[i], cur, &to_swap, &to_gpu);
+				if (to_swap >= 0) {
+					input_frames++;
+					input_swap_sum += to_swap;
+					input_swap_max=(to_swap > input_swap_max)?to_swap:input_swap_max;
+				}
+				if (to_gpu >= 0) {
+					input_gpu_frames++;
+					input_gpu_sum += to_gpu;
+					input_gpu_max=(to_gpu > input_gpu_max)?to_gpu:input_gpu_max;
+				}
+			}
+			if (ft->latency_depth) {
+				fprintf(ft->dump, "\t%u", ft->info[i].latency_depth);
+			}
+			prev=cur;
+			prev_info=&ft->info[i];
+			fputc('\n', ft->dump);
+		}
+	}
+	fflush(ft->dump);
+	if (ft->window.size) {
+		unsigned int frames=0;
+		for (i=0; i<GH_FRAME_CLASS_COUNT; i++) {
+			frames += class_count[i];
+		}
+		GH_verbose(GH_MSG_INFO, "frametimes ctx %u: %u frames: CPU-bound: %u, GPU-bound: %u, present-bound: %u, unknown: %u, avg GPU span: %u%%\n",
+				ft->ctx_num, frames,
+				class_count[GH_FRAME_CPU_BOUND],
+				class_count[GH_FRAME_GPU_BOUND],
+				class_count[GH_FRAME_PRESENT_BOUND],
+				class_count[GH_FRAME_UNKNOWN],
+				(frames)?(unsigned int)(span_sum/frames):0U);
+	}
+	if (ft->telemetry.enabled) {
+		/* skip the frames without a sample, these were delayed from before the start */
+		unsigned int first_idx=0;
+		while (first_idx < ft->cur_result && !ft->info[first_idx].thread_cpu) {
+			first_idx++;
+		}
+		if (first_idx + 1 < ft->cur_result) {
+			const GH_frameinfo *first=&ft->info[first_idx];
+			const GH_frameinfo *last_info=&ft->info[ft->cur_result-1];
+			GH_verbose(GH_MSG_INFO, "frametimes ctx %u: %u frames: thread CPU time: %.3f ms, context switches: %ld voluntary, %ld involuntary, page faults: %ld minor, %ld major\n",
+					ft->ctx_num, ft->cur_result - 1 - first_idx,
+					(double)(last_info->thread_cpu - first->thread_cpu) * 1.0E-6,
+					last_info->nvcsw - first->nvcsw, last_info->nivcsw - first->nivcsw,
+					last_info->minflt - first->minflt, last_info->majflt - first->majflt);
+		}
+	}
+	if (ft->uploads.enabled) {
+		GH_verbose(GH_MSG_INFO, "frametimes ctx %u: uploads so far: textures: %.3f MiB, buffers: %.3f MiB, mapped: %.3f MiB\n",
+				ft->ctx_num, (double)ft->uploads.total_texture / 1048576.0,
+				(double)ft->uploads.total_buffer / 1048576.0,
+				(double)ft->uploads.total_mapped / 1048576.0);
+	}
+	if (ft->gpumem.enabled) {
+		const GH_gpu_memory *gm=&ft->gpumem;
+		GH_verbose(GH_MSG_INFO, "frametimes ctx %u: GPU memory (current/peak): textures: %.1f/%.1f MiB, buffers: %.1f/%.1f MiB, renderbuffers: %.1f/%.1f MiB\n",
+				ft->ctx_num,
+				(double)gm->current[GH_GPU_MEM_TEXTURE] / 1048576.0, (double)gm->peak[GH_GPU_MEM_TEXTURE] / 1048576.0,
+				(double)gm->current[GH_GPU_MEM_BUFFER] / 1048576.0, (double)gm->peak[GH_GPU_MEM_BUFFER] / 1048576.0,
+				(double)gm->current[GH_GPU_MEM_RENDERBUFFER] / 1048576.0, (double)gm->peak[GH_GPU_MEM_RENDERBUFFER] / 1048576.0);
+		if (gm->min_available_kb >= 0) {
+			GH_verbose(GH_MSG_INFO, "frametimes ctx %u: free video memory: %.1f MiB, minimum: %.1f MiB, total: %.1f MiB\n",
+				ft->ctx_num, (double)gm->available_kb / 1024.0, (double)gm->min_available_kb / 1024.0,
+				(gm->total_kb >= 0)?((double)gm->total_kb / 1024.0):-1.0);
+		}
+	}
+	if (input_frames) {
+		GH_verbose(GH_MSG_INFO, "frametimes ctx %u: %u frames with input: input to swap: %.3f ms avg, %.3f ms max\n",
+				ft->ctx_num, input_frames, (double)input_swap_sum * 1.0E-6 / (double)input_frames,
+				(double)input_swap_max * 1.0E-6);
+	}
+	if (input_gpu_frames) {
+		GH_verbose(GH_MSG_INFO, "frametimes ctx %u: %u frames with input: input to GPU done: %.3f ms avg, %.3f ms max\n",
+				ft->ctx_num, input_gpu_frames, (double)input_gpu_sum * 1.0E-6 / (double)input_gpu_frames,
+				(double)input_gpu_max * 1.0E-6);
+	}
+	if (ft->present && (missed_total || dropped_total)) {
+		GH_verbose(GH_MSG_INFO, "frametimes ctx %u: %u frames: missed vblanks: %lld, dropped frames: %lld\n",
+				ft->ctx_num, ft->cur_result, (long long)missed_total, (long long)dropped_total);
+	}
+	/* copy the last result */
+	last=&ft->frametime[ft->num_results * ft->num_timestamps];
+	cur=&ft->frametime[(ft->cur_result-1) * ft->num_timestamps];
+	for (i=0; i<ft->num_timestamps; i++) {
+		last[i]=cur[i];
+	}
+	ft->info[ft->num_results]=ft->info[ft->cur_result-1];
+
+
+	ft->cur_result=0;
+	if (t0) {
+		trace_span("frametimes flush", t0, get_time_ns(CLOCK_REALTIME));
+	}
+}
+
+static void
+frametimes_destroy(GH_frametimes *ft)
+{
+	if (ft) {
+		unsigned int cnt=ft->delay * ft->num_timestamps;
+		unsigned int i;
+
+		frametimes_flush(ft);
+		benchmark_summary(&ft->benchmark, ft->mode >= GH_FRAMETIME_CPU_GPU);
+		benchmark_destroy(&ft->benchmark);
+		gpu_groups_destroy(&ft->groups);
+		gpu_mem_destroy(&ft->gpumem);
+		stalls_destroy(&ft->stalls);
+		x11_calls_destroy(&ft->x11);
+		if (ft->dump != NULL && ft->dump != stdout && ft->dump != stderr) {
+			fclose(ft->dump);
+		}
+		for (i=0; i<cnt; i++) {
+			timestamp_cleanup(&ft->timestamp[i]);
+		}
+		if (ft->start && GH_glDeleteQueries) {
+			for (i=0; i<ft->delay; i++) {
+				if (ft->start[i].query) {
+					GH_glDeleteQueries(1, &ft->start[i].query);
+				}
+			}
+		}
+		free(ft->start);
+		free(ft->timestamp);
+		free(ft->frametime);
+		free(ft->info);
+		free(ft->pending);
+		frame_window_destroy(&ft->window);
+	}
+}
+
+/* collect the GPU frame start of the frame in the current delay slot,
+ * it belongs to the frame whose results complete at the next swap */
+static void
+frametimes_start_collect(GH_frametimes *ft)
+{
+	GH_frame_start *fs=&ft->start[ft->cur_pos];
+
+	ft->start_gpu=0;
+	if (fs->issued) {
+		GLuint64 value;
+		GH_glGetQueryObjectui64v(fs->query, GL_QUERY_RESULT, &value);
+		ft->start_gpu=(uint64_t)value;
+		fs->issued=0;
+	}
+}
+
+/* the application starts to render the current frame */
+static void
+frametimes_frame_start(GH_frametimes *ft)
+{
+	GH_frame_start *fs;
+
+	if (!ft->start || ft->started) {
+		return;
+	}
+	frametimes_start_collect(ft);
+	fs=&ft->start[ft->cur_pos];
+	if (!fs->query) {
+		GH_glGenQueries(1, &fs->query);
+	}
+	GH_glQueryCounter(fs->query, GL_TIMESTAMP);
+	fs->issued=1;
+	ft->started=1;
+}
+
+static void
+frametimes_before_swap(GH_frametimes *ft)
+{
+	unsigned int ts_idx;
+	unsigned int rs_idx;
+
+	if (ft->mode == GH_FRAMETIME_NONE)
+		return;
+	if (ft->input) {
+		input_take(&ft->current.input_count, &ft->current.input_first);
+	}
+	if (ft->start && !ft->started) {
+		/* no glClear in this frame */
+		frametimes_start_collect(ft);
+	}
+	ts_idx=ft->cur_pos * ft->num_timestamps + GH_FRAMETIME_BEFORE_SWAPBUFFERS;
+	rs_idx=ft->cur_result * ft->num_timestamps + GH_FRAMETIME_BEFORE_SWAPBUFFERS;
+	timestamp_set(&ft->timestamp[ts_idx], &ft->frametime[rs_idx], ft->mode);
+	frametimes_map_result(ft, &ft->frametime[rs_idx]);
+}
+
+static void
+frametimes_finish_frame(GH_frametimes *ft)
+{
+	if (++ft->cur_pos == ft->delay) {
+		ft->cur_pos=0;
+	}
+	++ft->frame;
+	if (++ft->cur_result >= ft->num_results) {
+		frametimes_flush(ft);
+	}
+}
+
+/* query the presentation state right after the buffer swap */
+static void
+frametimes_present(GH_frametimes *ft, Display *dpy, GLXDrawable drawable)
+{
+	int64_t ust, msc, sbc;
+
+	if (!ft->present) {
+		return;
+	}
+	if (GH_glXGetSyncValuesOML(dpy, drawable, &ust, &msc, &sbc)) {
+		ft->current.present_ust=ust;
+		ft->current.present_msc=msc;
+		ft->current.present_sbc=sbc;
+	} else {
+		/* do not keep the values of an earlier frame */
+		ft->current.present_ust=0;
+		ft->current.present_msc=0;
+		ft->current.present_sbc=0;
+	}
+}
+
+static void
+frametimes_after_swap(GH_frametimes *ft)
+{
+	unsigned int ts_idx;
+	unsigned int rs_idx;
+
+	if (ft->mode == GH_FRAMETIME_NONE)
+		return;
+	ts_idx=ft->cur_pos * ft->num_timestamps + GH_FRAMETIME_AFTER_SWAPBUFFERS;
+	rs_idx=ft->cur_result * ft->num_timestamps + GH_FRAMETIME_AFTER_SWAPBUFFERS;
+	timestamp_set(&ft->timestamp[ts_idx], &ft->frametime[rs_idx], ft->mode);
+	frametimes_map_result(ft, &ft->frametime[rs_idx]);
+	if (ft->telemetry.enabled) {
+		telemetry_sample(&ft->telemetry, &ft->current);
+	}
+#ifdef GH_MALLOC_INTERCEPT
+	if (ft->alloc) {
+		alloc_take(&ft->current.alloc_count, &ft->current.free_count, &ft->current.alloc_bytes);
+	}
+#endif
+	if (ft->benchmark.enabled) {
+		ft->current.captured=benchmark_frame(&ft->benchmark);
+		if (ft->benchmark.done && !ft->benchmark.countdown) {
+			/* wait until the results of the last frame are complete */
+			ft->benchmark.countdown=ft->delay + 1;
+		}
+	}
+	if (ft->uploads.enabled) {
+		uploads_take(&ft->uploads, &ft->current.upload_calls, &ft->current.upload_texture,
+				&ft->current.upload_buffer, &ft->current.upload_mapped);
+	}
+	if (ft->gpumem.enabled) {
+		unsigned int i;
+		gpu_mem_frame(&ft->gpumem);
+		for (i=0; i<GH_GPU_MEM_TYPES; i++) {
+			ft->current.gpu_mem[i]=ft->gpumem.current[i];
+		}
+		ft->current.gpu_mem_available=ft->gpumem.available_kb;
+		ft->current.gpu_mem_evicted=ft->gpumem.evicted_kb;
+	}
+	if (ft->stalls.enabled) {
+		stalls_frame_end(&ft->stalls, ft->frame, &ft->current.stall_count, &ft->current.stall_time);
+	}
+	if (ft->x11.enabled) {
+		x11_calls_take(&ft->x11, &ft->current.x11_calls, &ft->current.x11_time);
+	}
+	if (ft->markers.enabled) {
+		ft->current.marker_group=ft->markers.group;
+		ft->current.marker_event=ft->markers.event;
+		ft->markers.group=(ft->markers.depth)?ft->markers.outer:0;
+	}
+	/* the CPU side infos are delayed just like the timer queries */
+	ft->info[ft->cur_result]=ft->pending[ft->cur_pos];
+	ft->pending[ft->cur_pos]=ft->current;
+	ft->gpu_tail_valid=0;
+	/* the results of the frame are complete now */
+	if (ft->frame > ft->delay) {
+		const GH_frametime *cur=&ft->frametime[ft->cur_result * ft->num_timestamps];
+		const GH_frametime *prev=(ft->cur_result)?
+			&ft->frametime[(ft->cur_result-1) * ft->num_timestamps]:
+			&ft->frametime[ft->num_results * ft->num_timestamps];
+		if (ft->window.size) {
+			frametimes_classify(ft, cur, prev, &ft->info[ft->cur_result]);
+		}
+		if (ft->mode >= GH_FRAMETIME_CPU_GPU) {
+			ft->gpu_tail=(cur[GH_FRAMETIME_BEFORE_SWAPBUFFERS].gpu > cur[GH_FRAMETIME_BEFORE_SWAPBUFFERS].gl)?
+				(cur[GH_FRAMETIME_BEFORE_SWAPBUFFERS].gpu - cur[GH_FRAMETIME_BEFORE_SWAPBUFFERS].gl):0;
+			ft->gpu_tail_valid=1;
+		}
+		if (recorder.file) {
+			uint64_t gpu=0;
+			if (ft->mode >= GH_FRAMETIME_CPU_GPU) {
+				/* the GPU is busy from the frame start on, the span
+				 * from the previous swap also contains the time the
+				 * GPU waited for the application */
+				uint64_t start=(ft->start_gpu)?ft->start_gpu:prev[GH_FRAMETIME_AFTER_SWAPBUFFERS].gpu;
+				uint64_t end=cur[GH_FRAMETIME_BEFORE_SWAPBUFFERS].gpu;
+				gpu=(end > start)?(end - start):0;
+			}
+			recorder_frame(ft->ctx_num, ft->frame - ft->delay,
+				cur[GH_FRAMETIME_AFTER_SWAPBUFFERS].cpu - prev[GH_FRAMETIME_AFTER_SWAPBUFFERS].cpu,
+				gpu,
+				(ft->mode >= GH_FRAMETIME_CPU_GPU)?
+					(int64_t)(cur[GH_FRAMETIME_BEFORE_SWAPBUFFERS].gpu - cur[GH_FRAMETIME_BEFORE_SWAPBUFFERS].gl):0);
+		}
+		if (trace.file && ft->calibration.interval) {
+			long long frame=(long long)(ft->frame - ft->delay);
+			trace_span_track("GPU frame", prev[GH_FRAMETIME_AFTER_SWAPBUFFERS].gpu_cpu,
+					cur[GH_FRAMETIME_BEFORE_SWAPBUFFERS].gpu_cpu,
+					GH_TRACE_TID_GPU(ft->ctx_num), "frame", frame);
+			trace_span_track("GPU swap", cur[GH_FRAMETIME_BEFORE_SWAPBUFFERS].gpu_cpu,
+					cur[GH_FRAMETIME_AFTER_SWAPBUFFERS].gpu_cpu,
+					GH_TRACE_TID_GPU(ft->ctx_num), "frame", frame);
+		}
+	} else if (ft->window.size) {
+		frameinfo_init(&ft->info[ft->cur_result]);
+	}
+	if (ft->groups.enabled) {
+		gpu_groups_frame_end(&ft->groups, ft->frame, &ft->calibration);
+	}
+	ft->started=0;
+	ft->start_gpu=0;
+	clock_calibration_update(&ft->calibration);
+	frametimes_finish_frame(ft);
+	if (ft->benchmark.countdown && !--ft->benchmark.countdown) {
+		frametimes_flush(ft);
+		benchmark_summary(&ft->benchmark, ft->mode >= GH_FRAMETIME_CPU_GPU);
+		if (ft->benchmark.exit) {
+			GH_verbose(GH_MSG_INFO, "benchmark ctx %u: done, exiting\n", ft->ctx_num);
+			exit(0);
+		}
+	}
+}
+
+/***************************************************************************
+ * SWAPBUFFER OMISSION (very experimental)                                 *
+ ***************************************************************************/
+
+/* In the adaptive mode, the CPU and GPU cost of each frame (from the end
+ * of a swap to the next swap, excluding the swap itself) are measured and
+ * filtered by an exponentially weighted moving average. The omission
+ * interval n is chosen so that n frames take about min_swap_time, and
+ * only changes by one step at a time, if the target leaves the band
+ * around n by more than the hysteresis, and not within hold frames of the
+ * previous change. The GPU times are read back without waiting: if the
+ * results of the oldest frame are still not available when its queries
+ * are needed again, that frame is dropped. */
+
+/* upper bound of the number of frames measured in flight */
+#define GH_SWAP_OMISSION_FRAMES_MAX 256
+
+typedef struct {
+	GLuint query[2];		/* GL_TIMESTAMP at the start and end of the frame */
+} GH_swapbuffer_omission_slot;
+
+typedef struct {
+	int swapbuffers;
+	int swapbuffer_cnt;
+	int latency_mode;
+	int flush_mode;
+	int measure_mode;
+	int limits[2];
+	uint64_t min_swap_time;
+	GH_swapbuffer_omission_slot *slot;
+	unsigned int head;		/* frames measured so far */
+	unsigned int tail;		/* frames read back (or dropped) so far */
+	int started;			/* the start of the current frame is measured */
+	uint64_t cpu_start;		/* CLOCK_MONOTONIC */
+	unsigned int measure_frames_tot;	/* number of slots */
+	unsigned int measure_frames_avg;	/* time constant of the averages in frames */
+	unsigned int hysteresis;	/* in percent of an interval step */
+	unsigned int hold;		/* min. frames between two changes */
+	unsigned int since_change;
+	uint64_t cpu;			/* averaged costs per frame, 0 if unknown */
+	uint64_t gpu;
+	/* statistics */
+	unsigned long long frames;
+	unsigned long long interval_sum;
+	unsigned long long changes;
+	unsigned long long gpu_samples;
+	unsigned long long gpu_dropped;	/* frames not measured on the GPU */
+} GH_swapbuffer_omission_t;
+
+static void
+swapbuffer_omission_init(GH_swapbuffer_omission_t *swo)
+{
+	int min_swap_usecs = get_envi("GH_MIN_SWAP_USECS",0);
+	swo->swapbuffers=get_envi("GH_SWAPBUFFERS",0);
+	swo->min_swap_time = 0;
+	if (min_swap_usecs > 0) {
+		swo->min_swap_time = (uint64_t)min_swap_usecs * (uint64_t)1000UL;
+	}
+	swo->latency_mode = get_envi("GH_SWAP_OMISSION_LATENCY", 0);
+	swo->flush_mode = get_envi("GH_SWAP_OMISSION_FLUSH", 1);
+	swo->measure_mode = get_envi("GH_SWAP_OMISSION_MEASURE", 3);
+	swo->limits[0] = get_envi("GH_SWAP_OMISSION_MIN",1);
+	swo->limits[1] = get_envi("GH_SWAP_OMISSION_MAX",4);
+	if (swo->limits[0] < 1) {
+		swo->limits[0] = 1;
+	}
+	if (swo->limits[1] < swo->limits[0]) {
+		swo->limits[1] = swo->limits[0];
+	}
+	if (min_swap_usecs > 0) {
+		swo->swapbuffers = swo->limits[0];
+	}
+	swo->swapbuffer_cnt=0;
+	swo->slot = NULL;
+	swo->head = 0;
+	swo->tail = 0;
+	swo->started = 0;
+	swo->cpu_start = 0;
+	swo->measure_frames_tot = get_envui("GH_SWAP_OMISSION_MEASURE_TOT", 6U);
+	swo->measure_frames_avg = get_envui("GH_SWAP_OMISSION_MEASURE_AVG", 16U);
+	if (swo->measure_frames_tot > GH_SWAP_OMISSION_FRAMES_MAX) {
+		swo->measure_frames_tot = GH_SWAP_OMISSION_FRAMES_MAX;
+	} else if (swo->measure_frames_tot < 2) {
+		swo->measure_frames_tot = 2;
+	}
+	if (swo->measure_frames_avg < 1) {
+		swo->measure_frames_avg = 1;
+	}
+	swo->hysteresis = get_envui("GH_SWAP_OMISSION_HYSTERESIS", 35U);
+	swo->hold = get_envui("GH_SWAP_OMISSION_HOLD", 30U);
+	swo->since_change = 0;
+	swo->cpu = 0;
+	swo->gpu = 0;
+	swo->frames = 0;
+	swo->interval_sum = 0;
+	swo->changes = 0;
+	swo->gpu_samples = 0;
+	swo->gpu_dropped = 0;
+}
+
+static int
+swapbuffer_omission_init_gl_funcs(void)
+{
+	GH_GET_GL_PROC_OR_FAIL(glGenQueries, GH_MSG_WARNING, -1);
+	GH_GET_GL_PROC_OR_FAIL(glDeleteQueries, GH_MSG_WARNING, -1);
+	GH_GET_GL_PROC_OR_FAIL(glGetInteger64v, GH_MSG_WARNING, -1);
+	GH_GET_GL_PROC_OR_FAIL(glQueryCounter, GH_MSG_WARNING, -1);
+	GH_GET_GL_PROC_OR_FAIL(glGetQueryObjectui64v, GH_MSG_WARNING, -1);
+	return 0;
+}
+
+static void
+swapbuffer_omission_init_gl(GH_swapbuffer_omission_t *swo)
+{
+	if (swo->min_swap_time > 0) {
+		if (swapbuffer_omission_init_gl_funcs() ||
+		    !(swo->slot=calloc(swo->measure_frames_tot, sizeof(*swo->slot)))) {
+			GH_verbose(GH_MSG_WARNING,"adaptive swapbuffer omission not availabe without timer query, disabling it");
+			swo->min_swap_time = 0;
+			swo->swapbuffers = get_envi("GH_SWAPBUFFERS",0);;
+		} else {
+			unsigned int i;
+			for (i=0; i<swo->measure_frames_tot; i++) {
+				GH_glGenQueries(2, swo->slot[i].query);
+			}
+			GH_verbose(GH_MSG_INFO, "adaptive swapbuffer omission: %u usecs, interval %d to %d, "
+					"%u frames average, hysteresis %u%%, hold %u frames\n",
+					(unsigned)(swo->min_swap_time / 1000), swo->limits[0], swo->limits[1],
+					swo->measure_frames_avg, swo->hysteresis, swo->hold);
+		}
+	}
+}
+
+/* update an exponentially weighted moving average over n frames */
+static uint64_t
+swapbuffer_omission_avg(uint64_t avg, uint64_t value, unsigned int n)
+{
+	if (!avg) {
+		return value;
+	}
+	return (value > avg)?(avg + (value - avg)/n):(avg - (avg - value)/n);
+}
+
+/* collect the GPU times of the frames which are finished, in order */
+static void
+swapbuffer_omission_read(GH_swapbuffer_omission_t *swo)
+{
+	while (swo->tail != swo->head) {
+		const GH_swapbuffer_omission_slot *s=&swo->slot[swo->tail % swo->measure_frames_tot];
+		GLuint64 available=0,t0=0,t1=0;
+		GH_glGetQueryObjectui64v(s->query[1], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available) {
+			break;
+		}
+		GH_glGetQueryObjectui64v(s->query[0], GL_QUERY_RESULT, &t0);
+		GH_glGetQueryObjectui64v(s->query[1], GL_QUERY_RESULT, &t1);
+		if (t1 > t0) {
+			swo->gpu=swapbuffer_omission_avg(swo->gpu, (uint64_t)(t1 - t0), swo->measure_frames_avg);
+			swo->gpu_samples++;
+		}
+		swo->tail++;
+	}
+}
+
+/* choose the omission interval from the averaged costs */
+static void
+swapbuffer_omission_control(GH_swapbuffer_omission_t *swo)
+{
+	uint64_t val;
+	uint64_t target;
+	int interval=swo->swapbuffers;
+
+	switch (swo->measure_mode) {
+		case 1:
+			val=swo->cpu;
+			break;
+		case 2:
+			val=swo->gpu;
+			break;
+		default:
+			val = (swo->cpu>swo->gpu)?swo->cpu:swo->gpu;
+	}
+	swo->since_change++;
+	if (!val) {
+		return;
+	}
+	if (val < 1000) {
+		val = 1000;
+	}
+	/* the number of frames fitting into min_swap_time, in percent */
+	target = (swo->min_swap_time * 100U) / val;
+	if (target >= (uint64_t)(interval + 1) * 100U + swo->hysteresis && interval < swo->limits[1]) {
+		interval++;
+	} else if (target + swo->hysteresis < (uint64_t)interval * 100U && interval > swo->limits[0]) {
+		interval--;
+	}
+	if (interval != swo->swapbuffers && swo->since_change >= swo->hold) {
+		GH_verbose(GH_MSG_DEBUG, "swapbuffer omission: interval %d -> %d, CPU %.3f ms, GPU %.3f ms, target %.2f\n",
+				swo->swapbuffers, interval, (double)swo->cpu * 1.0E-6, (double)swo->gpu * 1.0E-6,
+				(double)target / 100.0);
+		swo->swapbuffers = interval;
+		swo->since_change = 0;
+		swo->changes++;
+	}
+}
+
+static int
+swapbuffer_omission_do_swap(GH_swapbuffer_omission_t *swo)
+{
+	int do_swap;
+	if (swo->min_swap_time > 0) {
+		if (swo->started) {
+			uint64_t now=get_time_ns(CLOCK_MONOTONIC);
+			swo->cpu=swapbuffer_omission_avg(swo->cpu, now - swo->cpu_start, swo->measure_frames_avg);
+			GH_glQueryCounter(swo->slot[swo->head % swo->measure_frames_tot].query[1], GL_TIMESTAMP);
+			swo->head++;
+			swo->started = 0;
+		}
+		swapbuffer_omission_read(swo);
+		swapbuffer_omission_control(swo);
+		swo->frames++;
+		swo->interval_sum += (unsigned)swo->swapbuffers;
+	}
+	do_swap = (++swo->swapbuffer_cnt >= swo->swapbuffers);
+	return do_swap;
+}
+
+static void
+swapbuffer_omission_swap_skipped(GH_swapbuffer_omission_t *swo)
+{
+	switch (swo->flush_mode) {
+		case 1:
+			GH_glFlush();
+			break;
+		case 2:
+			GH_glFinish();
+			break;
+		default:
+			(void)0; /* nop */
+	}
+}
+
+static void
+swapbuffer_omission_swap_finished(GH_swapbuffer_omission_t *swo, int did_swap)
+{
+	if (did_swap) {
+		swo->swapbuffer_cnt = 0;
+	}
+	if (swo->min_swap_time > 0) {
+		if (swo->head - swo->tail >= swo->measure_frames_tot) {
+			/* the oldest frame is still in flight, drop it instead of waiting */
+			swo->tail++;
+			swo->gpu_dropped++;
+		}
+		swo->cpu_start=get_time_ns(CLOCK_MONOTONIC);
+		GH_glQueryCounter(swo->slot[swo->head % swo->measure_frames_tot].query[0], GL_TIMESTAMP);
+		swo->started = 1;
+	}
+}
+
+static void
+swapbuffer_omission_destroy(GH_swapbuffer_omission_t *swo)
+{
+	if (swo->slot) {
+		unsigned int i;
+		if (swo->frames) {
+			GH_verbose(GH_MSG_INFO, "swapbuffer omission: final interval %d, avg %.2f, %llu changes, "
+					"CPU %.3f ms, GPU %.3f ms per frame, %llu of %llu frames not measured on the GPU\n",
+					swo->swapbuffers, (double)swo->interval_sum / (double)swo->frames, swo->changes,
+					(double)swo->cpu * 1.0E-6, (double)swo->gpu * 1.0E-6,
+					swo->gpu_dropped, swo->frames);
+		}
+		for (i=0; i<swo->measure_frames_tot; i++) {
+			GH_glDeleteQueries(2, swo->slot[i].query);
+		}
+		free(swo->slot);
+		swo->slot = NULL;
+	}
+}
+
+/***************************************************************************
+ * FRAME STATISTICS                                                        *
+ ***************************************************************************/
+
+/* Lightweight statistics which are always collected, independent of the
+ * frametime measurements. They are exported by the PROMETHEUS EXPORT. */
+
+#define GH_STATS_FRAMETIMES 512
+
+typedef struct {
+	unsigned long long frames_presented;	/* swaps carried out */
+	unsigned long long frames_omitted;	/* swaps omitted */
+	unsigned long long debug_messages;	/* GL debug messages seen */
+	uint64_t last_swap;			/* CPU time of the previous swap request */
+	uint64_t frametime_sum;			/* sum of all frame times in ns */
+	unsigned long long frametime_count;	/* number of frame times */
+	unsigned int cur_frametime;		/* position in the ring buffer */
+	uint64_t frametime[GH_STATS_FRAMETIMES]; /* the most recent frame times in ns */
+} GH_stats;
+
+/* process-wide statistics, also counting already destroyed contexts */
+typedef struct {
+	unsigned long long frames_presented;
+	unsigned long long frames_omitted;
+	unsigned long long debug_messages;
+	unsigned long long swap_interval_overrides;
+	unsigned long long contexts_created;
+} GH_process_stats;
+
+static GH_process_stats process_stats;
+
+#define GH_STATS_INC(var) __atomic_fetch_add(&(var), 1, __ATOMIC_RELAXED)
+/* the per-context values have a single writer, but are read by the exporter */
+#define GH_STATS_SET(var, val) __atomic_store_n(&(var), (val), __ATOMIC_RELAXED)
+#define GH_STATS_GET(var) __atomic_load_n(&(var), __ATOMIC_RELAXED)
+
+static void
+stats_init(GH_stats *st)
+{
+	memset(st, 0, sizeof(*st));
+}
+
+/* called for each swap request with the current CLOCK_MONOTONIC time */
+static void
+stats_frame(GH_stats *st, uint64_t now, int did_swap)
+{
+	if (st->last_swap) {
+		uint64_t dt=now - st->last_swap;
+		GH_STATS_SET(st->frametime[st->cur_frametime], dt);
+		if (++st->cur_frametime >= GH_STATS_FRAMETIMES) {
+			st->cur_frametime=0;
+		}
+		GH_STATS_SET(st->frametime_sum, st->frametime_sum + dt);
+		GH_STATS_SET(st->frametime_count, st->frametime_count + 1);
+	}
+	st->last_swap=now;
+	if (did_swap) {
+		GH_STATS_SET(st->frames_presented, st->frames_presented + 1);
+		GH_STATS_INC(process_stats.frames_presented);
+	} else {
+		GH_STATS_SET(st->frames_omitted, st->frames_omitted + 1);
+		GH_STATS_INC(process_stats.frames_omitted);
+	}
+}
+
+/* get the quantiles q[0..n-1] of the recent frame times, return number of samples */
+static unsigned int
+stats_frametime_quantiles(const GH_stats *st, const double *q, uint64_t *res, unsigned int n)
+{
+	uint64_t sorted[GH_STATS_FRAMETIMES];
+	unsigned long long count=GH_STATS_GET(st->frametime_count);
+	unsigned int cnt=(count < GH_STATS_FRAMETIMES)?(unsigned int)count:GH_STATS_FRAMETIMES;
+	unsigned int i;
+
+	for (i=0; i<cnt; i++) {
+		sorted[i]=GH_STATS_GET(st->frametime[i]);
+	}
+	qsort(sorted, cnt, sizeof(sorted[0]), compare_u64);
+	for (i=0; i<n; i++) {
+		res[i]=(cnt)?sorted[(unsigned int)(q[i] * (double)(cnt-1) + 0.5)]:0;
+	}
+	return cnt;
+}
+
+/***************************************************************************
+ * CPU SAMPLING PROFILER                                                   *
+ ***************************************************************************/
+
+/* Sample the call stacks of the thread which made a context current for
+ * the first time. We prefer a perf_event_open(2) software clock event,
+ * where the kernel collects the call chains into a ring buffer. As a
+ * fallback, a per-thread CPU time timer delivers SIGPROF and the signal
+ * handler uses backtrace(3). The samples of each frame are collected and
+ * written out only if the frame was slower than a threshold. The file
+ * contains the raw addresses plus the /proc/self/maps, so the symbols can
+ * be resolved offline (e.g. with addr2line). */
+
+typedef enum {
+	GH_PROFILE_NONE=0,
+	GH_PROFILE_PERF,	/* perf_event_open software clock */
+	GH_PROFILE_TIMER,	/* timer_create and SIGPROF */
+} GH_profile_method;
+
+#define GH_PROFILE_PERF_PAGES	16	/* size of the perf ring buffer, must be a power of two */
+#define GH_PROFILE_SKIP_TIMER	2	/* frames of the signal handler itself */
+
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+
+typedef struct {
+	GH_profile_method method;
+	unsigned int depth;		/* maximum stack depth */
+	unsigned int max_samples;	/* samples per frame */
+	volatile unsigned int num_samples;
+	volatile unsigned long dropped;
+	uint64_t *sample_time;		/* CLOCK_MONOTONIC */
+	unsigned int *sample_depth;
+	void **sample_ip;		/* max_samples * depth */
+	uint64_t threshold;		/* absolute threshold in ns, 0 if disabled */
+	unsigned int median_percent;	/* relative threshold, 0 if disabled */
+	GH_median median;
+	uint64_t frame_start;		/* CLOCK_MONOTONIC */
+	unsigned int frame;		/* frame counter, if not given by GH_frametimes */
+	uint64_t maps_hash;		/* hash of the last maps written */
+	char *name;
+	FILE *file;
+	int perf_fd;
+	struct perf_event_mmap_page *perf_page;
+	size_t perf_size;		/* size of the perf data area */
+	timer_t timer;
+} GH_profiler;
+
+static struct sigaction profiler_old_action;
+
+/* pass a signal which was not sent by our timers to the previous handler */
+static void
+profiler_forward(int sig, siginfo_t *si, void *uc)
+{
+	if ((profiler_old_action.sa_flags & SA_SIGINFO) && profiler_old_action.sa_sigaction) {
+		profiler_old_action.sa_sigaction(sig, si, uc);
+	} else if (profiler_old_action.sa_handler != SIG_IGN && profiler_old_action.sa_handler != SIG_DFL) {
+		profiler_old_action.sa_handler(sig);
+	}
+}
+
+static void
+profiler_signal(int sig, siginfo_t *si, void *uc)
+{
+	GH_profiler *prof;
+	unsigned int n;
+	int saved_errno;
+
+	if (!si || si->si_code != SI_TIMER) {
+		profiler_forward(sig, si, uc);
+		return;
+	}
+	prof=(GH_profiler*)si->si_value.sival_ptr;
+	if (!prof || prof->method != GH_PROFILE_TIMER) {
+		return;
+	}
+	n=prof->num_samples;
+	if (n >= prof->max_samples) {
+		prof->dropped++;
+		return;
+	}
+	saved_errno=errno;
+	prof->sample_depth[n]=(unsigned int)backtrace(&prof->sample_ip[n * prof->depth], (int)prof->depth);
+	prof->sample_time[n]=get_time_ns(CLOCK_MONOTONIC);
+	__atomic_signal_fence(__ATOMIC_RELEASE);
+	prof->num_samples=n+1;
+	errno=saved_errno;
+}
+
+static int
+profiler_init_perf(GH_profiler *prof, unsigned int hz)
+{
+	struct perf_event_attr attr;
+	size_t page_size=(size_t)sysconf(_SC_PAGESIZE);
+	void *ptr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.size=sizeof(attr);
+	attr.type=PERF_TYPE_SOFTWARE;
+	attr.config=PERF_COUNT_SW_CPU_CLOCK;
+	attr.freq=1;
+	attr.sample_freq=hz;
+	attr.sample_type=PERF_SAMPLE_TIME | PERF_SAMPLE_CALLCHAIN;
+	attr.exclude_kernel=1;
+	attr.exclude_hv=1;
+	attr.exclude_callchain_kernel=1;
+	attr.use_clockid=1;
+	attr.clockid=CLOCK_MONOTONIC;
+
+	/* pid 0, cpu -1: the calling thread on any CPU */
+	prof->perf_fd=(int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC);
+	if (prof->perf_fd < 0) {
+		GH_verbose(GH_MSG_INFO, "profiler: perf_event_open failed: %s\n", strerror(errno));
+		return -1;
+	}
+	prof->perf_size=page_size * GH_PROFILE_PERF_PAGES;
+	ptr=mmap(NULL, page_size + prof->perf_size, PROT_READ | PROT_WRITE, MAP_SHARED, prof->perf_fd, 0);
+	if (ptr == MAP_FAILED) {
+		GH_verbose(GH_MSG_INFO, "profiler: failed to map the perf buffer: %s\n", strerror(errno));
+		close(prof->perf_fd);
+		prof->perf_fd=-1;
+		return -1;
+	}
+	prof->perf_page=(struct perf_event_mmap_page*)ptr;
+	prof->method=GH_PROFILE_PERF;
+	return 0;
+}
+
+static int
+profiler_init_timer(GH_profiler *prof, unsigned int hz)
+{
+	static pthread_mutex_t mutex=PTHREAD_MUTEX_INITIALIZER;
+	static int handler_installed=0;
+	struct sigevent sev;
+	struct itimerspec its;
+	void *dummy[1];
+
+	/* backtrace(3) might allocate memory at the first call, so
+	 * do that outside of the signal handler */
+	backtrace(dummy, 1);
+
+	pthread_mutex_lock(&mutex);
+	if (!handler_installed) {
+		struct sigaction sa;
+		memset(&sa, 0, sizeof(sa));
+		sa.sa_sigaction=profiler_signal;
+		sa.sa_flags=SA_SIGINFO | SA_RESTART;
+		sigemptyset(&sa.sa_mask);
+		if (sigaction(SIGPROF, &sa, &profiler_old_action)) {
+			pthread_mutex_unlock(&mutex);
+			GH_verbose(GH_MSG_WARNING, "profiler: failed to install SIGPROF handler\n");
+			return -1;
+		}
+		handler_installed=1;
+	}
+	pthread_mutex_unlock(&mutex);
+
+	memset(&sev, 0, sizeof(sev));
+	sev.sigev_notify=SIGEV_THREAD_ID;
+	sev.sigev_signo=SIGPROF;
+	sev.sigev_value.sival_ptr=prof;
+	sev.sigev_notify_thread_id=(pid_t)syscall(SYS_gettid);
+	prof->method=GH_PROFILE_TIMER;
+	if (timer_create(CLOCK_THREAD_CPUTIME_ID, &sev, &prof->timer)) {
+		GH_verbose(GH_MSG_WARNING, "profiler: timer_create failed: %s\n", strerror(errno));
+		prof->method=GH_PROFILE_NONE;
+		return -1;
+	}
+	its.it_interval.tv_sec=0;
+	its.it_interval.tv_nsec=(hz > 1)?(1000000000L / (long)hz):999999999L;
+	its.it_value=its.it_interval;
+	timer_settime(prof->timer, 0, &its, NULL);
+	return 0;
+}
+
+static void
+profiler_init(GH_profiler *prof, unsigned int ctx_num)
+{
+	unsigned int hz=get_envui("GH_PROFILE_HZ", 0);
+	int method=get_envi("GH_PROFILE_METHOD", 0);
+
+	memset(prof, 0, sizeof(*prof));
+	prof->perf_fd=-1;
+	if (!hz) {
+		return;
+	}
+	prof->depth=get_envui("GH_PROFILE_DEPTH", 32);
+	if (prof->depth < 1) {
+		prof->depth=1;
+	} else if (prof->depth > 256) {
+		prof->depth=256;
+	}
+	prof->max_samples=get_envui("GH_PROFILE_SAMPLES", 1024);
+	if (prof->max_samples < 1) {
+		prof->max_samples=1;
+	}
+	prof->threshold=(uint64_t)get_envui("GH_PROFILE_THRESHOLD_USECS", 0) * 1000ULL;
+	prof->median_percent=get_envui("GH_PROFILE_MEDIAN_PERCENT", 200);
+	prof->sample_time=malloc(sizeof(*prof->sample_time) * prof->max_samples);
+	prof->sample_depth=malloc(sizeof(*prof->sample_depth) * prof->max_samples);
+	prof->sample_ip=malloc(sizeof(*prof->sample_ip) * prof->max_samples * prof->depth);
+	prof->name=malloc(PATH_MAX);
+	if (!prof->sample_time || !prof->sample_depth || !prof->sample_ip || !prof->name) {
+		GH_verbose(GH_MSG_WARNING, "profiler: out of memory\n");
+		return;
+	}
+	parse_name(prof->name, PATH_MAX, get_envs("GH_PROFILE_FILE", "glx_hook_profile-ctx%c.txt"), ctx_num);
+
+	if (method == 0 || method == GH_PROFILE_PERF) {
+		profiler_init_perf(prof, hz);
+	}
+	if (prof->method == GH_PROFILE_NONE && (method == 0 || method == GH_PROFILE_TIMER)) {
+		profiler_init_timer(prof, hz);
+	}
+	if (prof->method != GH_PROFILE_NONE) {
+		GH_verbose(GH_MSG_INFO, "profiler: sampling thread %d at %u Hz via %s\n",
+				(int)syscall(SYS_gettid), hz,
+				(prof->method == GH_PROFILE_PERF)?"perf_event_open":"SIGPROF");
+	}
+}
+
+static void
+profiler_destroy(GH_profiler *prof)
+{
+	sigset_t set,old_set;
+	int blocked=0;
+
+	switch (prof->method) {
+		case GH_PROFILE_PERF:
+			munmap(prof->perf_page, (size_t)sysconf(_SC_PAGESIZE) + prof->perf_size);
+			close(prof->perf_fd);
+			break;
+		case GH_PROFILE_TIMER:
+			{
+				struct itimerspec its;
+				struct timespec ts={0, 0};
+				siginfo_t si;
+
+				/* The signal handler writes to our buffers: block SIGPROF,
+				 * so it cannot interrupt us, and stop the timer. A signal
+				 * which is already pending would still carry the pointer
+				 * to prof, so consume it while it is blocked. */
+				sigemptyset(&set);
+				sigaddset(&set, SIGPROF);
+				blocked=!pthread_sigmask(SIG_BLOCK, &set, &old_set);
+				memset(&its, 0, sizeof(its));
+				timer_settime(prof->timer, 0, &its, NULL);
+				timer_delete(prof->timer);
+				if (blocked && sigtimedwait(&set, &si, &ts) == SIGPROF && si.si_code != SI_TIMER) {
+					profiler_forward(SIGPROF, &si, NULL);
+				}
+			}
+			break;
+		default:
+			(void)0;
+	}
+	prof->method=GH_PROFILE_NONE;
+	if (prof->file) {
+		fclose(prof->file);
+	}
+	free(prof->sample_time);
+	free(prof->sample_depth);
+	free(prof->sample_ip);
+	free(prof->name);
+	memset(prof, 0, sizeof(*prof));
+	prof->perf_fd=-1;
+	if (blocked) {
+		pthread_sigmask(SIG_SETMASK, &old_set, NULL);
+	}
+}
+
+/* copy data out of the perf ring buffer, handling the wrap-around */
+static void
+profiler_perf_copy(const GH_profiler *prof, void *dst, uint64_t pos, size_t len)
+{
+	const char *data=(const char*)prof->perf_page + sysconf(_SC_PAGESIZE);
+	size_t offset=(size_t)(pos & (prof->perf_size - 1));
+	size_t first=prof->perf_size - offset;
+
+	if (first >= len) {
+		memcpy(dst, data + offset, len);
+	} else {
+		memcpy(dst, data + offset, first);
+		memcpy((char*)dst + first, data, len - first);
+	}
+}
+
+/* move the samples from the perf ring buffer to our sample buffer */
+static void
+profiler_perf_drain(GH_profiler *prof)
+{
+	struct perf_event_mmap_page *page=prof->perf_page;
+	uint64_t head=__atomic_load_n(&page->data_head, __ATOMIC_ACQUIRE);
+	uint64_t tail=page->data_tail;
+
+	while (tail < head) {
+		struct perf_event_header hdr;
+
+		profiler_perf_copy(prof, &hdr, tail, sizeof(hdr));
+		if (hdr.size < sizeof(hdr)) {
+			/* should never happen, skip everything */
+			tail=head;
+			break;
+		}
+		if (hdr.type == PERF_RECORD_SAMPLE) {
+			unsigned int n=prof->num_samples;
+			uint64_t pos=tail + sizeof(hdr);
+			uint64_t nr,i;
+			unsigned int depth=0;
+
+			if (n >= prof->max_samples) {
+				prof->dropped++;
+			} else {
+				profiler_perf_copy(prof, &prof->sample_time[n], pos, sizeof(uint64_t));
+				profiler_perf_copy(prof, &nr, pos + 8, sizeof(nr));
+				pos += 16;
+				for (i=0; i<nr && depth < prof->depth; i++, pos += 8) {
+					uint64_t ip;
+					profiler_perf_copy(prof, &ip, pos, sizeof(ip));
+					if (ip >= PERF_CONTEXT_MAX) {
+						/* context marker, not an address */
+						continue;
+					}
+					prof->sample_ip[n * prof->depth + depth++]=(void*)(uintptr_t)ip;
+				}
+				prof->sample_depth[n]=depth;
+				prof->num_samples=n+1;
+			}
+		} else if (hdr.type == PERF_RECORD_LOST) {
+			uint64_t lost;
+			profiler_perf_copy(prof, &lost, tail + sizeof(hdr) + 8, sizeof(lost));
+			prof->dropped += (unsigned long)lost;
+		}
+		tail += hdr.size;
+	}
+	__atomic_store_n(&page->data_tail, tail, __ATOMIC_RELEASE);
+}
+
+/* called after each buffer swap, tag the samples with the frame number */
+static void
+profiler_frame_end(GH_profiler *prof, unsigned int frame)
+{
+	uint64_t now;
+	uint64_t dt;
+	unsigned int n,i,j;
+
+	if (prof->method == GH_PROFILE_NONE) {
+		return;
+	}
+	if (prof->method == GH_PROFILE_PERF) {
+		profiler_perf_drain(prof);
+	}
+	now=get_time_ns(CLOCK_MONOTONIC);
+	dt=now - prof->frame_start;
+	n=prof->num_samples;
+	__atomic_signal_fence(__ATOMIC_ACQUIRE);
+
+	if (prof->frame_start && n && ((prof->threshold && dt >= prof->threshold) ||
+	    median_exceeded(&prof->median, dt, prof->median_percent))) {
+		unsigned int skip=(prof->method == GH_PROFILE_TIMER)?GH_PROFILE_SKIP_TIMER:0;
+		if (!prof->file) {
+			prof->file=fopen(prof->name, "wt");
+			if (!prof->file) {
+				GH_verbose(GH_MSG_WARNING, "profiler: failed to open '%s'\n", prof->name);
+				profiler_destroy(prof);
+				return;
+			}
+			fprintf(prof->file, "# frame\ttime_ms\taddresses (innermost first)\n");
+		}
+		write_maps(prof->file, &prof->maps_hash);
+		fprintf(prof->file, "# frame %u: %.3f ms, %u samples, %lu dropped\n",
+				frame, (double)dt * 1.0E-6, n, prof->dropped);
+		for (i=0; i<n; i++) {
+			void * const *ip=&prof->sample_ip[i * prof->depth];
+			fprintf(prof->file, "%u\t%.3f\t", frame,
+					(double)(int64_t)(prof->sample_time[i] - prof->frame_start) * 1.0E-6);
+			for (j=skip; j<prof->sample_depth[i]; j++) {
+				fprintf(prof->file, " %p", ip[j]);
+			}
+			fputc('\n', prof->file);
+		}
+		fflush(prof->file);
+	}
+	if (prof->frame_start) {
+		median_add(&prof->median, dt);
+	}
+	prof->dropped=0;
+	prof->num_samples=0;
+	prof->frame_start=now;
+	prof->frame=frame+1;
+}
+
+/***************************************************************************
+ * STARTUP TIMELINE                                                        *
+ ***************************************************************************/
+
+/* Record where the time between the process start and the first frames in
+ * steady state is spent: the first GL symbol lookup, the context creations,
+ * the first MakeCurrent, shader compilation and program linking, and the
+ * first swaps. Steady state is reached as soon as the last
+ * GH_STARTUP_STEADY_FRAMES frame intervals are within
+ * GH_STARTUP_STEADY_PERCENT of each other. The report is written once at
+ * that point (or at exit, if it is never reached), and recording stops.
+ * All times are CLOCK_MONOTONIC. */
+
+#define GH_STARTUP_CONTEXTS_MAX 8
+
+typedef struct {
+	unsigned int ctx_num;
+	uint64_t start;			/* begin of the glXCreateContext* call */
+	uint64_t end;
+	uint64_t override;		/* time spent in the creation override */
+	uint64_t fbconfig;		/* time spent looking up the fbconfig */
+} GH_startup_context;
+
+typedef struct {
+	pthread_once_t once;
+	pthread_mutex_t mutex;
+	volatile int enabled;		/* recording until the report is written */
+	char name[PATH_MAX];
+	uint64_t process_start;
+	uint64_t init;			/* glx_hook initialization */
+	uint64_t first_lookup;		/* first GL symbol lookup */
+	const char *first_lookup_func;
+	char first_lookup_name[64];
+	GH_startup_context context[GH_STARTUP_CONTEXTS_MAX];
+	unsigned int num_contexts;
+	uint64_t first_make_current;
+	unsigned int first_make_current_ctx;
+	unsigned int shaders;
+	uint64_t shader_time;
+	uint64_t shader_first;
+	uint64_t shader_last;
+	unsigned int programs;
+	uint64_t program_time;
+	uint64_t program_first;
+	uint64_t program_last;
+	uint64_t *swap;			/* times of the first swaps */
+	unsigned int num_swaps;
+	unsigned int max_swaps;
+	unsigned int list_swaps;	/* number of swaps listed in the report */
+	unsigned int steady_frames;
+	unsigned int steady_percent;
+} GH_startup;
+
+static GH_startup startup={.once=PTHREAD_ONCE_INIT, .mutex=PTHREAD_MUTEX_INITIALIZER};
+
+/* the context creation currently in progress on this thread */
+typedef struct {
+	uint64_t start;
+	uint64_t override;
+	uint64_t fbconfig;
+} GH_startup_creation;
+
+static __thread GH_startup_creation startup_creation;
+
+/* get the process start time from /proc/self/stat, which is in clock ticks
+ * since boot, and map it to CLOCK_MONOTONIC */
+static uint64_t
+startup_process_start(uint64_t now)
+{
+	char buf[1024];
+	const char *p;
+	unsigned long long ticks;
+	long hz=sysconf(_SC_CLK_TCK);
+	uint64_t start, boot_now;
+	ssize_t len;
+	int field;
+	int fd;
+
+	fd=open("/proc/self/stat", O_RDONLY);
+	if (fd < 0) {
+		return now;
+	}
+	len=read(fd, buf, sizeof(buf)-1);
+	close(fd);
+	if (len <= 0 || hz <= 0) {
+		return now;
+	}
+	buf[len]=0;
+	/* the command name might contain spaces, field 2 ends at the last ')' */
+	p=strrchr(buf, ')');
+	for (field=2; p && field<22; field++) {
+		p=strchr(p+1, ' ');
+	}
+	if (!p || sscanf(p+1, "%llu", &ticks) != 1) {
+		return now;
+	}
+	start=(uint64_t)ticks * 1000000000ULL / (uint64_t)hz;
+	boot_now=get_time_ns(CLOCK_BOOTTIME);
+	if (boot_now < start || boot_now - start > now) {
+		return now;
+	}
+	return now - (boot_now - start);
+}
+
+static void
+startup_write(int steady);
+
+static void
+startup_shutdown(void)
+{
+	pthread_mutex_lock(&startup.mutex);
+	if (startup.enabled) {
+		startup_write(0);
+	}
+	pthread_mutex_unlock(&startup.mutex);
+}
+
+static void
+startup_init(void)
+{
+	if (!get_envi("GH_STARTUP_REPORT", 0)) {
+		return;
+	}
+	startup.init=get_time_ns(CLOCK_MONOTONIC);
+	startup.process_start=startup_process_start(startup.init);
+	parse_name(startup.name, sizeof(startup.name), get_envs("GH_STARTUP_FILE", "glx_hook_startup-%p.txt"), 0);
+	startup.max_swaps=get_envui("GH_STARTUP_MAX_FRAMES", 1000);
+	startup.list_swaps=get_envui("GH_STARTUP_SWAPS", 10);
+	startup.steady_frames=get_envui("GH_STARTUP_STEADY_FRAMES", 10);
+	startup.steady_percent=get_envui("GH_STARTUP_STEADY_PERCENT", 125);
+	if (startup.max_swaps < 2) {
+		startup.max_swaps=2;
+	}
+	if (startup.steady_frames < 1) {
+		startup.steady_frames=1;
+	}
+	if (startup.steady_frames >= startup.max_swaps) {
+		startup.steady_frames=startup.max_swaps - 1;
+	}
+	startup.swap=malloc(sizeof(*startup.swap) * startup.max_swaps);
+	if (!startup.swap) {
+		GH_verbose(GH_MSG_WARNING, "startup: out of memory\n");
+		return;
+	}
+	startup.enabled=1;
+	atexit(startup_shutdown);
+	GH_verbose(GH_MSG_INFO, "startup: writing the startup timeline to '%s'\n", startup.name);
+}
+
+static int
+startup_enabled(void)
+{
+	pthread_once(&startup.once, startup_init);
+	return startup.enabled;
+}
+
+static double
+startup_ms(uint64_t t)
+{
+	return (double)(int64_t)(t - startup.process_start) * 1.0E-6;
+}
+
+/* write the report, called with the mutex held */
+static void
+startup_write(int steady)
+{
+	unsigned int i;
+	FILE *f;
+
+	startup.enabled=0;
+	f=fopen(startup.name, "wt");
+	if (!f) {
+		GH_verbose(GH_MSG_WARNING, "startup: failed to open '%s'\n", startup.name);
+		f=stderr;
+	}
+	fprintf(f, "# startup timeline of process %d, times in ms since the process start\n", (int)getpid());
+	fprintf(f, "glx_hook_init %.3f\n", startup_ms(startup.init));
+	if (startup.first_lookup) {
+		fprintf(f, "first_gl_lookup %.3f %s %s\n", startup_ms(startup.first_lookup),
+				startup.first_lookup_func, startup.first_lookup_name);
+	}
+	for (i=0; i<startup.num_contexts && i<GH_STARTUP_CONTEXTS_MAX; i++) {
+		const GH_startup_context *c=&startup.context[i];
+		fprintf(f, "context %u created %.3f duration %.3f override %.3f fbconfig %.3f\n",
+				c->ctx_num, startup_ms(c->end), (double)(c->end - c->start) * 1.0E-6,
+				(double)c->override * 1.0E-6, (double)c->fbconfig * 1.0E-6);
+	}
+	if (startup.num_contexts > GH_STARTUP_CONTEXTS_MAX) {
+		fprintf(f, "contexts %u\n", startup.num_contexts);
+	}
+	if (startup.first_make_current) {
+		fprintf(f, "first_make_current %.3f ctx %u\n", startup_ms(startup.first_make_current),
+				startup.first_make_current_ctx);
+	}
+	if (startup.shaders) {
+		fprintf(f, "shaders %u compile %.3f first %.3f last %.3f\n", startup.shaders,
+				(double)startup.shader_time * 1.0E-6,
+				startup_ms(startup.shader_first), startup_ms(startup.shader_last));
+	}
+	if (startup.programs) {
+		fprintf(f, "programs %u link %.3f first %.3f last %.3f\n", startup.programs,
+				(double)startup.program_time * 1.0E-6,
+				startup_ms(startup.program_first), startup_ms(startup.program_last));
+	}
+	for (i=0; i<startup.num_swaps && i<startup.list_swaps; i++) {
+		uint64_t prev=(i)?startup.swap[i-1]:startup.first_make_current;
+		fprintf(f, "swap %u %.3f interval %.3f\n", i, startup_ms(startup.swap[i]),
+				(prev)?((double)(startup.swap[i] - prev) * 1.0E-6):0.0);
+	}
+	if (steady) {
+		i=startup.num_swaps - startup.steady_frames - 1;
+		fprintf(f, "steady_state %.3f frame %u\n", startup_ms(startup.swap[i]), i);
+		GH_verbose(GH_MSG_INFO, "startup: steady state at frame %u, %.3f ms after the process start\n",
+				i, startup_ms(startup.swap[i]));
+	} else {
+		fprintf(f, "steady_state none frames %u\n", startup.num_swaps);
+		GH_verbose(GH_MSG_INFO, "startup: no steady state reached within %u frames\n", startup.num_swaps);
+	}
+	if (f != stderr) {
+		fclose(f);
+	}
+	free(startup.swap);
+	startup.swap=NULL;
+}
+
+/* first GL symbol lookup via dlsym or glXGetProcAddress */
+static void
+startup_lookup(const char *func, const char *name)
+{
+	if (!startup_enabled() || startup.first_lookup || !name || strncmp(name, "gl", 2)) {
+		return;
+	}
+	pthread_mutex_lock(&startup.mutex);
+	if (!startup.first_lookup) {
+		startup.first_lookup=get_time_ns(CLOCK_MONOTONIC);
+		startup.first_lookup_func=func;
+		strncpy(startup.first_lookup_name, name, sizeof(startup.first_lookup_name)-1);
+	}
+	pthread_mutex_unlock(&startup.mutex);
+}
+
+/* called at the begin of each glXCreateContext* */
+static void
+startup_creation_begin(void)
+{
+	if (startup_enabled()) {
+		startup_creation.start=get_time_ns(CLOCK_MONOTONIC);
+		startup_creation.override=0;
+		startup_creation.fbconfig=0;
+	}
+}
+
+static void
+startup_context(unsigned int ctx_num)
+{
+	if (!startup.enabled || !startup_creation.start) {
+		return;
+	}
+	pthread_mutex_lock(&startup.mutex);
+	if (startup.num_contexts < GH_STARTUP_CONTEXTS_MAX) {
+		GH_startup_context *c=&startup.context[startup.num_contexts];
+		c->ctx_num=ctx_num;
+		c->start=startup_creation.start;
+		c->end=get_time_ns(CLOCK_MONOTONIC);
+		c->override=startup_creation.override;
+		c->fbconfig=startup_creation.fbconfig;
+	}
+	startup.num_contexts++;
+	pthread_mutex_unlock(&startup.mutex);
+	startup_creation.start=0;
+}
+
+static void
+startup_make_current(unsigned int ctx_num)
+{
+	if (!startup.enabled || startup.first_make_current) {
+		return;
+	}
+	pthread_mutex_lock(&startup.mutex);
+	if (!startup.first_make_current) {
+		startup.first_make_current=get_time_ns(CLOCK_MONOTONIC);
+		startup.first_make_current_ctx=ctx_num;
+	}
+	pthread_mutex_unlock(&startup.mutex);
+}
+
+/* shader compilation (link=0) and program linking (link=1) */
+static void
+startup_shader(uint64_t t0, uint64_t t1, int link)
+{
+	pthread_mutex_lock(&startup.mutex);
+	if (link) {
+		if (!startup.programs++) {
+			startup.program_first=t0;
+		}
+		startup.program_last=t1;
+		startup.program_time += t1 - t0;
+	} else {
+		if (!startup.shaders++) {
+			startup.shader_first=t0;
+		}
+		startup.shader_last=t1;
+		startup.shader_time += t1 - t0;
+	}
+	pthread_mutex_unlock(&startup.mutex);
+}
+
+/* called after each swap with the current CLOCK_MONOTONIC time */
+static void
+startup_swap(uint64_t now)
+{
+	pthread_mutex_lock(&startup.mutex);
+	if (startup.enabled && startup.num_swaps < startup.max_swaps) {
+		unsigned int n=++startup.num_swaps;
+		startup.swap[n-1]=now;
+		if (n > startup.steady_frames) {
+			uint64_t dt_min=UINT64_MAX, dt_max=0;
+			unsigned int i;
+			for (i=n - startup.steady_frames; i<n; i++) {
+				uint64_t dt=startup.swap[i] - startup.swap[i-1];
+				if (dt < dt_min) {
+					dt_min=dt;
+				}
+				if (dt > dt_max) {
+					dt_max=dt;
+				}
+			}
+			if (dt_max * 100 <= dt_min * startup.steady_percent) {
+				startup_write(1);
+			}
+		}
+		if (startup.enabled && n >= startup.max_swaps) {
+			startup_write(0);
+		}
+	}
+	pthread_mutex_unlock(&startup.mutex);
+}
+
+/***************************************************************************
+ * GL context tracking                                                     *
+ ***************************************************************************/
+
+typedef struct gl_context_ceation_opts_s {
+	pthread_mutex_t mutex;
+	unsigned int flags;
+	int force_version[2];
+	int force_version_min[2];
+	int force_version_max[2];
+	int force_flags_on;
+	int force_flags_off;
+	int force_profile_on;
+	int force_profile_off;
+	int force_no_error;
+} gl_context_creation_opts_t;
+
+/* flag bits */
+#define GH_GLCTX_CREATE_INITIALIZED	0x1
+#define GH_GLCTX_COMPAT_IF_LEGACY	0x2
+
+typedef struct gl_context_s {
+	GLXContext ctx;
+	GLXDrawable draw;
+	GLXDrawable read;
+	unsigned int flags;
+	int inject_swapinterval;
+	unsigned int num;
+	struct gl_context_s *next;
+	GH_frametimes frametimes;
+	GH_latency latency;
+	GH_swapbuffer_omission_t swapbuffer_omission;
+	GH_stats stats;
+	GH_flight_recorder flight;
+	GH_profiler profiler;
+	GH_fps_limit fps_limit;
+	GH_jit_start jit_start;
+	useconds_t swap_sleep_usecs;
+	GLDEBUGPROC original_debug_callback;
+	GLDEBUGPROCAMD original_debug_callback_AMD;
+	const GLvoid* original_debug_callback_user_ptr;
+	GLvoid* original_debug_callback_AMD_user_ptr;
+} gl_context_t;
+
+/* flag bits */
+#define GH_GL_CURRENT		0x1
+#define GH_GL_NEVER_CURRENT	0x2
+#define GH_GL_INTERCEPT_DEBUG	0x4
+#define GH_GL_INJECT_DEBUG	0x8
+
+static gl_context_creation_opts_t ctx_creation_opts = {
+	.mutex = PTHREAD_MUTEX_INITIALIZER,
+	.flags = 0,
+	.force_version = {-1, -1},
+	.force_version_min = {-1, -1},
+	.force_version_max = {-1, -1},
+	.force_flags_on = 0,
+	.force_flags_off = 0,
+	.force_profile_on = 0,
+	.force_profile_off = 0,
+	.force_no_error = -1,
+};
+static gl_context_t * volatile ctx_list=NULL;
+static volatile int ctx_counter=0;
+static pthread_mutex_t ctx_mutex=PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t ctx_current;
+
+/* forward declarations */
+static void APIENTRY
+GH_debug_callback(GLenum source, GLenum type, GLuint id, GLenum severity,
+		  GLsizei length, const GLchar *message, const GLvoid* userParam);
+static void APIENTRY
+GH_debug_callback_AMD(GLuint id, GLenum category, GLenum severity,
+		  GLsizei length, const GLchar *message, GLvoid* userParam);
+static int
+prom_enabled(void);
+
+static void
+add_ctx(gl_context_t *glc)
+{
+	pthread_mutex_lock(&ctx_mutex);
+	glc->next=ctx_list;
+	ctx_list=glc;
+	pthread_mutex_unlock(&ctx_mutex);
+}
+
+static gl_context_t *
+create_ctx(GLXContext ctx, unsigned int num)
+{
+	gl_context_t *glc;
+
+	glc=malloc(sizeof(*glc));
+	if (glc) {
+		glc->ctx=ctx;
+		glc->draw=None;
+		glc->read=None;
+		glc->inject_swapinterval=GH_SWAP_DONT_SET;
+		glc->flags=GH_GL_NEVER_CURRENT;
+		glc->num=num;
+		glc->original_debug_callback=(GLDEBUGPROC)NULL;
+		glc->original_debug_callback_AMD=(GLDEBUGPROCAMD)NULL;
+		glc->original_debug_callback_user_ptr=NULL;
+		glc->original_debug_callback_AMD_user_ptr=NULL;
+
+		glc->swap_sleep_usecs=0;
+		stats_init(&glc->stats);
+		memset(&glc->flight, 0, sizeof(glc->flight));
+		memset(&glc->profiler, 0, sizeof(glc->profiler));
+		memset(&glc->fps_limit, 0, sizeof(glc->fps_limit));
+		memset(&glc->jit_start, 0, sizeof(glc->jit_start));
+		frametimes_init(&glc->frametimes, GH_FRAMETIME_NONE, 0, 0, 0, num);
+		latency_init(&glc->latency, GH_LATENCY_NOP, 0, 0, 1000000, 0, 0, 0);
+		swapbuffer_omission_init(&glc->swapbuffer_omission);
+	}
+	return glc;
+}
+
+static void
+destroy_ctx(gl_context_t *glc)
+{
+	if (glc) {
+		frametimes_destroy(&glc->frametimes);
+		latency_destroy(&glc->latency);
+		swapbuffer_omission_destroy(&glc->swapbuffer_omission);
+		flight_destroy(&glc->flight);
+		profiler_destroy(&glc->profiler);
+		fps_limit_destroy(&glc->fps_limit);
+		jit_start_destroy(&glc->jit_start);
+		free(glc);
+	}
+}
+
+static gl_context_t *
+find_ctx(GLXContext ctx)
+{
+	gl_context_t *glc;
+
+	pthread_mutex_lock(&ctx_mutex);
+	for (glc=ctx_list; glc; glc=glc->next)
+		if (glc->ctx == ctx)
+			break;
+	pthread_mutex_unlock(&ctx_mutex);
+	return glc;
+}
+
+static void
+remove_ctx(GLXContext ctx)
+{
+	gl_context_t *glc,*prev=NULL;
+
+	pthread_mutex_lock(&ctx_mutex);
+	for (glc=ctx_list; glc; glc=glc->next) {
+		if (glc->ctx == ctx)
+			break;
+		prev=glc;
+	}
+	if (glc) {
+		if (prev) 
+			prev->next=glc->next;
+		else
+			ctx_list=glc->next;
+	}
+	pthread_mutex_unlock(&ctx_mutex);
+	if (glc) {
+		destroy_ctx(glc);
+	}
+}
+
+static void
+read_config(gl_context_t *glc)
+{
+	glc->inject_swapinterval=get_envi("GH_INJECT_SWAPINTERVAL", GH_SWAP_DONT_SET);
+	if (get_envi("GH_GL_DEBUG_OUTPUT",0)) {
+		glc->flags |= GH_GL_INTERCEPT_DEBUG;
+	}
+	if (get_envi("GH_GL_INJECT_DEBUG_OUTPUT",0)) {
+		glc->flags |= GH_GL_INJECT_DEBUG;
+	}
+}
+
+static void
+create_context(GLXContext ctx)
+{
+	gl_context_t *glc;
+	unsigned int ctx_num;
+
+	GH_verbose(GH_MSG_DEBUG, "created ctx %p\n",ctx);
+
+	trace_enabled();
+	prom_enabled();
+	pthread_mutex_lock(&ctx_mutex);
+	ctx_num=ctx_counter++;
+	process_stats.contexts_created++;
+	if (!ctx_num) {
+		pthread_key_create(&ctx_current, NULL);
+		pthread_setspecific(ctx_current, NULL);
+		/* query the function pointers for the standard functions
+		 * which might be often called ... */
+		GH_GET_PTR_GL(glXSwapBuffers);
+		GH_GET_PTR_GL(glXMakeCurrent);
+		GH_GET_PTR_GL(glXMakeContextCurrent);
+		GH_GET_PTR_GL(glXMakeCurrentReadSGI);
+		GH_GET_PTR_GL(glFlush);
+		GH_GET_PTR_GL(glFinish);
+	}
+	pthread_mutex_unlock(&ctx_mutex);
+	
+	if (trace.file) {
+		trace_name_ctx_tracks(ctx_num);
+		trace_instant_ctx("context created", ctx_num, ctx);
+	}
+	glc=create_ctx(ctx, ctx_num);
+	startup_context(ctx_num);
+	if (glc) {
+		read_config(glc);
+		/* add to our list */
+		add_ctx(glc);
+	} else {
+		GH_verbose(GH_MSG_ERROR, "out of memory\n");
+	}
+
+}
+
+static void
+destroy_context(GLXContext ctx)
+{
+	GH_verbose(GH_MSG_INFO, "destroyed ctx %p\n",ctx);
+	if (trace.file) {
+		gl_context_t *glc=find_ctx(ctx);
+		if (glc) {
+			trace_instant_ctx("context destroyed", glc->num, ctx);
+		}
+	}
+	remove_ctx(ctx);
+}
+
+static void
+make_current(GLXContext ctx, Display *dpy, GLXDrawable draw, GLXDrawable read)
+{
+	gl_context_t *glc;
+
+	glc=(gl_context_t*)pthread_getspecific(ctx_current);
+	if (glc) {
+		/* old context */
+		glc->flags &= ~GH_GL_CURRENT;
+		GH_verbose(GH_MSG_DEBUG, "unbound context %p\n",glc->ctx);
+		if (trace.file) {
+			trace_instant_ctx("unbound", glc->num, glc->ctx);
+		}
+		if (glc->flight.size) {
+			uint64_t now=get_time_ns(CLOCK_REALTIME);
+			flight_record(&glc->flight, GH_EVENT_UNBOUND, now, now, 0);
+		}
+	}
+	
+	if (ctx) {
+		glc=find_ctx(ctx);
+
+		if (glc == NULL) {
+			GH_verbose(GH_MSG_WARNING, "app tried to make current non-existing context %p\n",ctx);
+		} else {
+			glc->draw=draw;
+			glc->read=read;
+			glc->flags |= GH_GL_CURRENT;
+			GH_verbose(GH_MSG_DEBUG, "made current context %p\n",ctx);
+			startup_make_current(glc->num);
+			if (trace.file) {
+				trace_instant_ctx("MakeCurrent", glc->num, ctx);
+			}
+			if (glc->flight.size) {
+				uint64_t now=get_time_ns(CLOCK_REALTIME);
+				flight_record(&glc->flight, GH_EVENT_MAKE_CURRENT, now, now, (long long)draw);
+			}
+			if (glc->flags & GH_GL_NEVER_CURRENT) {
+				unsigned int ft_delay=get_envui("GH_FRAMETIME_DELAY", 10);
+				unsigned int ft_frames=get_envui("GH_FRAMETIME_FRAMES", 1000);
+				GH_frametime_mode ft_mode=(GH_frametime_mode)get_envi("GH_FRAMETIME", (int)GH_FRAMETIME_NONE);
+				int latency=get_envi("GH_LATENCY", GH_LATENCY_NOP);
+				unsigned int latency_max=get_envui("GH_LATENCY_MAX", 0);
+				int latency_manual_wait=get_envi("GH_LATENCY_MANUAL_WAIT", -1);
+				unsigned int latency_gl_wait_timeout=get_envui("GH_LATENCY_GL_WAIT_TIMEOUT_USECS", 1000000);
+				unsigned int latency_gl_wait_interval=get_envui("GH_LATENCY_GL_WAIT_USECS", 0);
+				unsigned int latency_self_wait_interval=get_envui("GH_LATENCY_WAIT_USECS", 0);
+				unsigned int latency_spin=get_envui("GH_LATENCY_SPIN_USECS", 100);
+				/* made current for the first time */
+				glc->flags &= ~ GH_GL_NEVER_CURRENT;
+
+				glc->swap_sleep_usecs=(useconds_t)get_envui("GH_SWAP_SLEEP_USECS",0);
+				fps_limit_init(&glc->fps_limit);
+				jit_start_init(&glc->jit_start);
+				frametimes_init(&glc->frametimes, ft_mode, ft_delay, GH_FRAMETIME_COUNT, ft_frames, glc->num);
+				frametimes_init_base(&glc->frametimes);
+				latency_init(&glc->latency, latency, latency_max, latency_manual_wait, latency_gl_wait_timeout, latency_gl_wait_interval, latency_self_wait_interval, latency_spin);
+				glc->frametimes.latency_depth=(glc->latency.adapt.max > glc->latency.adapt.min);
+				swapbuffer_omission_init_gl(&glc->swapbuffer_omission);
+				flight_init(&glc->flight, glc->num);
+				profiler_init(&glc->profiler, glc->num);
+				if (glc->inject_swapinterval != GH_SWAP_DONT_SET) {
+					GH_GET_PTR_GL(glXSwapIntervalEXT);
+					if (GH_glXSwapIntervalEXT) {
+						GH_verbose(GH_MSG_INFO, "injecting swap interval: %d\n",
+								glc->inject_swapinterval);
+						GH_STATS_INC(process_stats.swap_interval_overrides);
+						GH_glXSwapIntervalEXT(dpy, glc->draw, glc->inject_swapinterval);
+						swap_interval_current=glc->inject_swapinterval;
+					} else {
+						GH_GET_PTR_GL(glXSwapIntervalSGI);
+						if (GH_glXSwapIntervalEXT) {
+							GH_verbose(GH_MSG_INFO, "injecting swap interval: %d\n",
+									glc->inject_swapinterval);
+							GH_STATS_INC(process_stats.swap_interval_overrides);
+							GH_glXSwapIntervalSGI(glc->inject_swapinterval);
+							swap_interval_current=glc->inject_swapinterval;
+						}
+					}
+				}
+				if (glc->flags & GH_GL_INJECT_DEBUG) {
+					GH_GET_PTR_GL(glDebugMessageCallback);
+					if (GH_glDebugMessageCallback) {
+						GH_glDebugMessageCallback(GH_debug_callback, glc);
+						GH_verbose(GH_MSG_INFO, "injecting debug callback [core]\n");
+					} else {
+						GH_GET_PTR_GL(glDebugMessageCallbackARB);
+						if (GH_glDebugMessageCallbackARB) {
+							GH_glDebugMessageCallbackARB(GH_debug_callback, glc);
+							GH_verbose(GH_MSG_INFO, "injecting debug callback [ARB]\n");
+						} else {
+							GH_GET_PTR_GL(glDebugMessageCallbackKHR);
+							if (GH_glDebugMessageCallbackKHR) {
+								GH_glDebugMessageCallbackKHR(GH_debug_callback, glc);
+								GH_verbose(GH_MSG_INFO, "injecting debug callback [KHR]\n");
+							} else {
+								GH_GET_PTR_GL(glDebugMessageCallbackAMD);
+								if (GH_glDebugMessageCallbackAMD) {
+									GH_glDebugMessageCallbackAMD(GH_debug_callback_AMD, glc);
+									GH_verbose(GH_MSG_INFO, "injecting debug callback [AMD]\n");
+								} else {
+									GH_verbose(GH_MSG_WARNING, "failed ot iject debug message callback\n");
+								}
+							}
+						}
+					}
+				}
+			}
+		}
+	} else {
+		glc=NULL;
+	}
+
+	pthread_setspecific(ctx_current, glc);
+}
+
+/***************************************************************************
+ * PROMETHEUS EXPORT                                                       *
+ ***************************************************************************/
+
+/* Periodically write the FRAME STATISTICS in the Prometheus text exposition
+ * format, so that a node_exporter textfile collector (or anything else
+ * which can read such files) can pick them up. The file is written to
+ * a temporary file first and then renamed, so readers never see partial
+ * data. Writing is done from within SwapBuffers, at most every
+ * GH_PROM_INTERVAL_MSECS milliseconds, and once more at exit. */
+
+typedef struct {
+	pthread_once_t once;
+	pthread_mutex_t mutex;
+	uint64_t interval;		/* in ns, 0 if disabled */
+	uint64_t next;			/* next write, CLOCK_MONOTONIC */
+	char name[PATH_MAX];
+	char tmp_name[PATH_MAX+8];
+	char labels[256];		/* common labels: pid and process */
+	struct GH_prom_ctx_s *ctx;	/* snapshot of the contexts */
+	unsigned int ctx_max;
+} GH_prom_t;
+
+/* the values of a context at the time of the snapshot */
+typedef struct GH_prom_ctx_s {
+	unsigned int num;
+	unsigned long long frames_presented;
+	unsigned long long frames_omitted;
+	unsigned long long debug_messages;
+	uint64_t latency_wait_ns;
+	unsigned long long latency_waits;
+	uint64_t frametime_sum;
+	unsigned long long frametime_count;
+	unsigned int quantile_samples;
+	uint64_t quantile[3];
+	int gpumem;
+	uint64_t gpumem_current[GH_GPU_MEM_TYPES];
+	uint64_t gpumem_peak[GH_GPU_MEM_TYPES];
+	long gpumem_available_kb;
+} GH_prom_ctx;
+
+static GH_prom_t prom={PTHREAD_ONCE_INIT, PTHREAD_MUTEX_INITIALIZER, 0, 0, {0}, {0}, {0}, NULL, 0};
+
+/* copy a label value, escaping it as required by the format */
+static void
+prom_label_value(char *buf, size_t size, const char *value)
+{
+	size_t pos=0;
+
+	while (*value && pos + 3 < size) {
+		char c=*(value++);
+		if (c == '\\' || c == '"') {
+			buf[pos++]='\\';
+		} else if (c == '\n') {
+			buf[pos++]='\\';
+			c='n';
+		}
+		buf[pos++]=c;
+	}
+	buf[pos]=0;
+}
+
+static void
+prom_counter(FILE *f, const char *name, const char *help)
+{
+	fprintf(f, "# HELP %s %s\n# TYPE %s counter\n", name, help, name);
+}
+
+/* Copy the values of all contexts, so that the file is neither formatted
+ * nor written while holding the ctx_mutex. Returns the number of contexts. */
+static unsigned int
+prom_snapshot(const double *q)
+{
+	gl_context_t *glc;
+	unsigned int cnt=0,i;
+
+	pthread_mutex_lock(&ctx_mutex);
+	for (glc=ctx_list; glc; glc=glc->next) {
+		cnt++;
+	}
+	if (cnt > prom.ctx_max) {
+		GH_prom_ctx *ctx=realloc(prom.ctx, sizeof(*ctx) * cnt);
+		if (!ctx) {
+			pthread_mutex_unlock(&ctx_mutex);
+			return 0;
+		}
+		prom.ctx=ctx;
+		prom.ctx_max=cnt;
+	}
+	cnt=0;
+	for (glc=ctx_list; glc; glc=glc->next) {
+		GH_prom_ctx *c=&prom.ctx[cnt++];
+		c->num=glc->num;
+		c->frames_presented=GH_STATS_GET(glc->stats.frames_presented);
+		c->frames_omitted=GH_STATS_GET(glc->stats.frames_omitted);
+		c->debug_messages=GH_STATS_GET(glc->stats.debug_messages);
+		c->latency_wait_ns=GH_STATS_GET(glc->latency.wait_ns);
+		c->latency_waits=GH_STATS_GET(glc->latency.waits);
+		c->frametime_sum=GH_STATS_GET(glc->stats.frametime_sum);
+		c->frametime_count=GH_STATS_GET(glc->stats.frametime_count);
+		c->quantile_samples=stats_frametime_quantiles(&glc->stats, q, c->quantile, 3);
+		c->gpumem=glc->frametimes.gpumem.enabled;
+		for (i=0; i<GH_GPU_MEM_TYPES; i++) {
+			c->gpumem_current[i]=GH_STATS_GET(glc->frametimes.gpumem.current[i]);
+			c->gpumem_peak[i]=GH_STATS_GET(glc->frametimes.gpumem.peak[i]);
+		}
+		c->gpumem_available_kb=GH_STATS_GET(glc->frametimes.gpumem.available_kb);
+	}
+	pthread_mutex_unlock(&ctx_mutex);
+	return cnt;
+}
+
+static void
+prom_gauge(FILE *f, const char *name, const char *help)
+{
+	fprintf(f, "# HELP %s %s\n# TYPE %s gauge\n", name, help, name);
+}
+
+static void
+prom_write(void)
+{
+	static const double q[3]={0.5, 0.9, 0.99};
+	const GH_prom_ctx *c;
+	unsigned int cnt,i,j;
+	FILE *f;
+
+	cnt=prom_snapshot(q);
+	f=fopen(prom.tmp_name, "wt");
+	if (!f) {
+		GH_verbose(GH_MSG_WARNING, "prom: failed to open '%s'\n", prom.tmp_name);
+		return;
+	}
+
+	prom_counter(f, "glx_hook_process_contexts_created_total", "GL contexts created.");
+	fprintf(f, "glx_hook_process_contexts_created_total{%s} %llu\n", prom.labels,
+		__atomic_load_n(&process_stats.contexts_created, __ATOMIC_RELAXED));
+	prom_counter(f, "glx_hook_process_frames_presented_total", "Frames presented by all contexts.");
+	fprintf(f, "glx_hook_process_frames_presented_total{%s} %llu\n", prom.labels,
+		__atomic_load_n(&process_stats.frames_presented, __ATOMIC_RELAXED));
+	prom_counter(f, "glx_hook_process_frames_omitted_total", "Frames omitted by all contexts.");
+	fprintf(f, "glx_hook_process_frames_omitted_total{%s} %llu\n", prom.labels,
+		__atomic_load_n(&process_stats.frames_omitted, __ATOMIC_RELAXED));
+	prom_counter(f, "glx_hook_process_debug_messages_total", "GL debug messages received by all contexts.");
+	fprintf(f, "glx_hook_process_debug_messages_total{%s} %llu\n", prom.labels,
+		__atomic_load_n(&process_stats.debug_messages, __ATOMIC_RELAXED));
+	prom_counter(f, "glx_hook_process_swap_interval_overrides_total", "Swap intervals changed, ignored or injected.");
+	fprintf(f, "glx_hook_process_swap_interval_overrides_total{%s} %llu\n", prom.labels,
+		__atomic_load_n(&process_stats.swap_interval_overrides, __ATOMIC_RELAXED));
+
+	prom_counter(f, "glx_hook_context_frames_presented_total", "Frames presented.");
+	for (i=0, c=prom.ctx; i<cnt; i++, c++) {
+		fprintf(f, "glx_hook_context_frames_presented_total{%s,ctx=\"%u\"} %llu\n",
+			prom.labels, c->num, c->frames_presented);
+	}
+	prom_counter(f, "glx_hook_context_frames_omitted_total", "Frames omitted.");
+	for (i=0, c=prom.ctx; i<cnt; i++, c++) {
+		fprintf(f, "glx_hook_context_frames_omitted_total{%s,ctx=\"%u\"} %llu\n",
+			prom.labels, c->num, c->frames_omitted);
+	}
+	prom_counter(f, "glx_hook_context_debug_messages_total", "GL debug messages received.");
+	for (i=0, c=prom.ctx; i<cnt; i++, c++) {
+		fprintf(f, "glx_hook_context_debug_messages_total{%s,ctx=\"%u\"} %llu\n",
+			prom.labels, c->num, c->debug_messages);
+	}
+	prom_counter(f, "glx_hook_context_latency_wait_seconds_total", "Time spent in the latency limiter.");
+	for (i=0, c=prom.ctx; i<cnt; i++, c++) {
+		fprintf(f, "glx_hook_context_latency_wait_seconds_total{%s,ctx=\"%u\"} %.9f\n",
+			prom.labels, c->num, (double)c->latency_wait_ns * 1.0E-9);
+	}
+	prom_counter(f, "glx_hook_context_latency_waits_total", "Waits done by the latency limiter.");
+	for (i=0, c=prom.ctx; i<cnt; i++, c++) {
+		fprintf(f, "glx_hook_context_latency_waits_total{%s,ctx=\"%u\"} %llu\n",
+			prom.labels, c->num, c->latency_waits);
+	}
+	fputs("# HELP glx_hook_context_frame_time_seconds Time between SwapBuffers calls, quantiles over the most recent frames.\n"
+	      "# TYPE glx_hook_context_frame_time_seconds summary\n", f);
+	for (i=0, c=prom.ctx; i<cnt; i++, c++) {
+		if (c->quantile_samples) {
+			for (j=0; j<3; j++) {
+				fprintf(f, "glx_hook_context_frame_time_seconds{%s,ctx=\"%u\",quantile=\"%g\"} %.9f\n",
+					prom.labels, c->num, q[j], (double)c->quantile[j] * 1.0E-9);
+			}
+		}
+		fprintf(f, "glx_hook_context_frame_time_seconds_sum{%s,ctx=\"%u\"} %.9f\n",
+			prom.labels, c->num, (double)c->frametime_sum * 1.0E-9);
+		fprintf(f, "glx_hook_context_frame_time_seconds_count{%s,ctx=\"%u\"} %llu\n",
+			prom.labels, c->num, c->frametime_count);
+	}
+	prom_gauge(f, "glx_hook_context_gpu_memory_bytes", "Tracked GPU memory per object type.");
+	for (i=0, c=prom.ctx; i<cnt; i++, c++) {
+		for (j=0; c->gpumem && j<GH_GPU_MEM_TYPES; j++) {
+			fprintf(f, "glx_hook_context_gpu_memory_bytes{%s,ctx=\"%u\",type=\"%s\"} %llu\n",
+				prom.labels, c->num, gpu_mem_type_name[j],
+				(unsigned long long)c->gpumem_current[j]);
+		}
+	}
+	prom_gauge(f, "glx_hook_context_gpu_memory_peak_bytes", "Peak tracked GPU memory per object type.");
+	for (i=0, c=prom.ctx; i<cnt; i++, c++) {
+		for (j=0; c->gpumem && j<GH_GPU_MEM_TYPES; j++) {
+			fprintf(f, "glx_hook_context_gpu_memory_peak_bytes{%s,ctx=\"%u\",type=\"%s\"} %llu\n",
+				prom.labels, c->num, gpu_mem_type_name[j],
+				(unsigned long long)c->gpumem_peak[j]);
+		}
+	}
+	prom_gauge(f, "glx_hook_context_gpu_memory_available_bytes", "Free video memory reported by the driver.");
+	for (i=0, c=prom.ctx; i<cnt; i++, c++) {
+		if (c->gpumem && c->gpumem_available_kb >= 0) {
+			fprintf(f, "glx_hook_context_gpu_memory_available_bytes{%s,ctx=\"%u\"} %llu\n",
+				prom.labels, c->num, (unsigned long long)c->gpumem_available_kb * 1024ULL);
+		}
+	}
+
+	if (fclose(f) || rename(prom.tmp_name, prom.name)) {
+		GH_verbose(GH_MSG_WARNING, "prom: failed to write '%s'\n", prom.name);
+		unlink(prom.tmp_name);
+	}
+}
+
+static void
+prom_shutdown(void)
+{
+	pthread_mutex_lock(&prom.mutex);
+	prom_write();
+	pthread_mutex_unlock(&prom.mutex);
+}
+
+static void
+prom_init(void)
+{
+	const char *file=getenv("GH_PROM_FILE");
+	char comm[64];
+	char value[128];
+	FILE *f;
+
+	if (!file || !file[0]) {
+		return;
+	}
+	parse_name(prom.name, sizeof(prom.name), file, 0);
+	snprintf(prom.tmp_name, sizeof(prom.tmp_name), "%s.tmp", prom.name);
+
+	comm[0]=0;
+	f=fopen("/proc/self/comm", "rt");
+	if (f) {
+		if (fgets(comm, sizeof(comm), f)) {
+			comm[strcspn(comm, "\n")]=0;
+		}
+		fclose(f);
+	}
+	prom_label_value(value, sizeof(value), comm);
+	snprintf(prom.labels, sizeof(prom.labels), "pid=\"%d\",process=\"%s\"", (int)getpid(), value);
+
+	prom.interval=(uint64_t)get_envui("GH_PROM_INTERVAL_MSECS", 5000) * 1000000ULL;
+	if (!prom.interval) {
+		prom.interval=1;
+	}
+	prom.next=0;
+	atexit(prom_shutdown);
+	GH_verbose(GH_MSG_INFO, "prom: writing statistics to '%s'\n", prom.name);
+}
+
+static int
+prom_enabled(void)
+{
+	pthread_once(&prom.once, prom_init);
+	return (prom.interval != 0);
+}
+
+/* called after each SwapBuffers with the current CLOCK_MONOTONIC time */
+static void
+prom_update(uint64_t now)
+{
+	if (!prom.interval || now < prom.next) {
+		return;
+	}
+	/* if some other thread is already writing, we do not need to */
+	if (pthread_mutex_trylock(&prom.mutex)) {
+		return;
+	}
+	if (now >= prom.next) {
+		prom.next=now + prom.interval;
+		prom_write();
+	}
+	pthread_mutex_unlock(&prom.mutex);
+}
+
+/****************************************************************************
+ * GL DEBUG MESSAGES                                                        *
+ ****************************************************************************/
+
+/* Newer versions of the GL support the generation of human-readable messages
+   for GL errors, performance warnings and hints. These messages are
+   forwarded to a debug callback which has to be registered with the GL
+   context. Debug output may only be available in special debug context... */
+
+/* translate the debug message "source" enum to human-readable string */
+static const char *
+translateDebugSourceEnum(GLenum source)
+{
+	const char *s;
+
+	switch (source) {
+		case GL_DEBUG_SOURCE_API:
+			s="API";
+			break;
+		case GL_DEBUG_SOURCE_WINDOW_SYSTEM:
+			s="window system";
+			break;
+		case GL_DEBUG_SOURCE_SHADER_COMPILER:
+			s="shader compiler";
+			break;
+		case GL_DEBUG_SOURCE_THIRD_PARTY:
+			s="3rd party";
+			break;
+		case GL_DEBUG_SOURCE_APPLICATION:
+			s="application";
+			break;
+		case GL_DEBUG_SOURCE_OTHER:
+			s="other";
+			break;
+		default:
+			s="[UNKNOWN SOURCE]";
+	}
+
+	return s;
+}
+
+/* translate the debug message "category" enum to human-readable string */
+static const char *
+translateDebugCategoryEnum(GLenum cat)
+{
+	const char *s;
+
+	switch (cat) {
+		case GL_DEBUG_CATEGORY_API_ERROR_AMD:
+			s="API error";
+			break;
+		case GL_DEBUG_CATEGORY_WINDOW_SYSTEM_AMD:
+			s="window system";
+			break;
+		case GL_DEBUG_CATEGORY_DEPRECATION_AMD:
+			s="deprecation";
+			break;
+		case GL_DEBUG_CATEGORY_UNDEFINED_BEHAVIOR_AMD:
+			s="undefined behavior";
+			break;
+		case GL_DEBUG_CATEGORY_PERFORMANCE_AMD:
+			s="performance";
+			break;
+		case GL_DEBUG_CATEGORY_SHADER_COMPILER_AMD:
+			s="shader compiler";
+			break;
+		case GL_DEBUG_CATEGORY_APPLICATION_AMD:
+			s="application";
+			break;
+		case GL_DEBUG_CATEGORY_OTHER_AMD:
+			s="other";
+			break;
+		default:
+			s="[UNKNOWN CATEGORY]";
+	}
+
+	return s;
+}
+
+/* translate the debug message "type" enum to human-readable string */
+static const char *
+translateDebugTypeEnum(GLenum type)
+{
+	const char *s;
+
+	switch (type) {
+		case GL_DEBUG_TYPE_ERROR:
+			s="error";
+			break;
+		case GL_DEBUG_TYPE_DEPRECATED_BEHAVIOR:
+			s="deprecated";
+			break;
+		case GL_DEBUG_TYPE_UNDEFINED_BEHAVIOR:
+			s="undefined behavior";
+			break;
+		case GL_DEBUG_TYPE_PORTABILITY:
+			s="portability";
+			break;
+		case GL_DEBUG_TYPE_PERFORMANCE:
+			s="performance";
+			break;
+		case GL_DEBUG_TYPE_OTHER:
+			s="other";
+			break;
+		default:
+			s="[UNKNOWN TYPE]";
+	}
+	return s;
+}
+
+/* translate the debug message "xeverity" enum to human-readable string */
+static const char *
+translateDebugSeverityEnum(GLenum severity)
+{
+	const char *s;
+
+	switch (severity) {
+		case GL_DEBUG_SEVERITY_HIGH:
+			s="high";
+			break;
+		case GL_DEBUG_SEVERITY_MEDIUM:
+			s="medium";
+			break;
+		case GL_DEBUG_SEVERITY_LOW:
+			s="low";
+			break;
+		case GL_DEBUG_SEVERITY_NOTIFICATION:
+			s="notification";
+			break;
+		default:
+			s="[UNKNOWN SEVERITY]";
+	}
+
+	return s;
+}
+
+/* our debug callback */
+static void APIENTRY
+GH_debug_callback(GLenum source, GLenum type, GLuint id, GLenum severity,
+		  GLsizei length, const GLchar *message, const GLvoid* userParam)
+{
+	gl_context_t *glc=(gl_context_t*)userParam;
+	if (glc) {
+		GH_STATS_INC(glc->stats.debug_messages);
+		GH_STATS_INC(process_stats.debug_messages);
+		if (glc->flight.size) {
+			uint64_t now=get_time_ns(CLOCK_REALTIME);
+			flight_record(&glc->flight, GH_EVENT_DEBUG_MESSAGE, now, now, (long long)id);
+		}
+		GH_verbose(GH_MSG_INFO, "GLDEBUG: %s %s %s [0x%x]: %s\n",
+					translateDebugSourceEnum(source),
+					translateDebugTypeEnum(type),
+					translateDebugSeverityEnum(severity),
+					id, message);
+		if (glc->original_debug_callback) {
+			glc->original_debug_callback(source, type, id, severity,
+						     length, message, glc->original_debug_callback_user_ptr);
+		}
+	}
+}
+
+/* our debug callback AMD */
+static void APIENTRY
+GH_debug_callback_AMD(GLuint id, GLenum category, GLenum severity,
+		  GLsizei length, const GLchar *message, GLvoid* userParam)
+{
+	gl_context_t *glc=(gl_context_t*)userParam;
+
+	if (glc) {
+		GH_STATS_INC(glc->stats.debug_messages);
+		GH_STATS_INC(process_stats.debug_messages);
+		if (glc->flight.size) {
+			uint64_t now=get_time_ns(CLOCK_REALTIME);
+			flight_record(&glc->flight, GH_EVENT_DEBUG_MESSAGE, now, now, (long long)id);
+		}
+		GH_verbose(GH_MSG_INFO, "GLDEBUG[AMD]: %s %s %s [0x%x]: %s\n",
+					translateDebugCategoryEnum(category),
+					translateDebugSeverityEnum(severity),
+					id, message);
+		if (glc->original_debug_callback_AMD) {
+			glc->original_debug_callback_AMD(id, category, severity,
+							 length, message,
+							 glc->original_debug_callback_AMD_user_ptr);
+		}
+	}
+}
+
+/***************************************************************************
+ * GL context creation overrides                                           *
+ ***************************************************************************/
+
+static void context_creation_opts_init(gl_context_creation_opts_t *opts)
+{
+	opts->force_profile_on = 0;
+	opts->force_profile_off = 0;
+	opts->force_flags_on = 0;
+	opts->force_flags_off = 0;
+	opts->force_no_error = -1;
+
+	if (get_envi("GH_FORCE_GL_CONTEXT_PROFILE_CORE", 0)) {
+		opts->force_profile_on = GLX_CONTEXT_CORE_PROFILE_BIT_ARB;
+		opts->force_profile_off = GLX_CONTEXT_COMPATIBILITY_PROFILE_BIT_ARB;
+	}
+
+	int value = get_envi("GH_FORCE_GL_CONTEXT_PROFILE_COMPAT", 0);
+	if (value == 1) {
+		opts->force_profile_on = GLX_CONTEXT_COMPATIBILITY_PROFILE_BIT_ARB;
+		opts->force_profile_off = GLX_CONTEXT_CORE_PROFILE_BIT_ARB;
+	} else if (value == 2) {
+		opts->flags |= GH_GLCTX_COMPAT_IF_LEGACY;
+	}
+	if (get_envi("GH_FORCE_GL_CONTEXT_FLAGS_NO_FORWARD_COMPAT", 0)) {
+		opts->force_flags_on &= ~GLX_CONTEXT_FORWARD_COMPATIBLE_BIT_ARB;
+		opts->force_flags_off |= GLX_CONTEXT_FORWARD_COMPATIBLE_BIT_ARB;
+	}
+	if (get_envi("GH_FORCE_GL_CONTEXT_FLAGS_NO_DEBUG", 0)) {
+		opts->force_flags_on &= ~GLX_CONTEXT_DEBUG_BIT_ARB;
+		opts->force_flags_off |= GLX_CONTEXT_DEBUG_BIT_ARB;
+	}
+	if (get_envi("GH_FORCE_GL_CONTEXT_FLAGS_FORWARD_COMPAT", 0)) {
+		opts->force_flags_on |= GLX_CONTEXT_FORWARD_COMPATIBLE_BIT_ARB;
+		opts->force_flags_off &= ~GLX_CONTEXT_FORWARD_COMPATIBLE_BIT_ARB;
+	}
+	if (get_envi("GH_FORCE_GL_CONTEXT_FLAGS_DEBUG", 0)) {
+		opts->force_flags_on |= GLX_CONTEXT_DEBUG_BIT_ARB;
+		opts->force_flags_off &= ~GLX_CONTEXT_DEBUG_BIT_ARB;
+	}
+	if (get_envi("GH_FORCE_GL_CONTEXT_FLAGS_NO_ERROR", 0)) {
+		opts->force_no_error = GL_TRUE;
+	}
+	if (get_envi("GH_FORCE_GL_CONTEXT_FLAGS_ERROR", 0)) {
+		opts->force_no_error = GL_FALSE;
+	}
+
+	opts->force_version[0] = get_envi("GH_FORCE_GL_VERSION_MAJOR", opts->force_version[0]);
+	opts->force_version[1] = get_envi("GH_FORCE_GL_VERSION_MINOR", opts->force_version[1]);
+
+	opts->force_version_min[0] = get_envi("GH_FORCE_MIN_GL_VERSION_MAJOR", opts->force_version_min[0]);
+	opts->force_version_min[1] = get_envi("GH_FORCE_MIN_GL_VERSION_MINOR", opts->force_version_min[1]);
+
+	opts->force_version_max[0] = get_envi("GH_FORCE_MAX_GL_VERSION_MAJOR", opts->force_version_max[0]);
+	opts->force_version_max[1] = get_envi("GH_FORCE_MAX_GL_VERSION_MINOR", opts->force_version_max[1]);
+	
+	opts->force_flags_on = get_envi("GH_FORCE_GL_CONTEXT_FLAGS_ON", opts->force_flags_on);
+	opts->force_flags_off = get_envi("GH_FORCE_GL_CONTEXT_FLAGS_OFF", opts->force_flags_off);
+
+	opts->force_profile_on = get_envi("GH_FORCE_GL_CONTEXT_PROFILE_MASK_ON", opts->force_profile_on);
+	opts->force_profile_off = get_envi("GH_FORCE_GL_CONTEXT_PROFILE_MASK_OFF", opts->force_profile_off);
+
+	GH_verbose(GH_MSG_DEBUG, "got GL override options: force version %d.%d, min %d.%d, max %d.%d, flags +0x%x -0x%x, profile flags: +0x%x -0x%x, no error: %d\n",
+		opts->force_version[0],opts->force_version[1],
+		opts->force_version_min[0], opts->force_version_min[1],
+		opts->force_version_max[0], opts->force_version_max[1],
+		(unsigned)opts->force_flags_on, (unsigned)opts->force_flags_off,
+		(unsigned)opts->force_profile_on, (unsigned)opts->force_profile_off,
+		opts->force_no_error);
+}
+
+static int need_creation_override(const gl_context_creation_opts_t *opts)
+{
+	if (opts->force_version[0] >= 0 || opts->force_version[1] >= 0) {
+		return 1;
+	}
+	if (opts->force_version_min[0] >= 0 || opts->force_version_min[1] >= 0) {
+		return 1;
+	}
+	if (opts->force_version_max[0] >= 0 || opts->force_version_max[1] >= 0) {
+		return 1;
+	}
+	if (opts->force_flags_on || opts->force_flags_off) {
+		return 2;
+	}
+	if (opts->force_profile_on || opts->force_profile_off) {
+		return 3;
+	}
+	if (opts->force_no_error >= 0) {
+		return 4;
+	}
+
+	return 0;
+}
+
+static int* get_override_attributes(gl_context_creation_opts_t *opts, const int *attribs)
+{
+	const int our_count=5;
+	int count = 0;
+	int additional_count = 0;
+	int req_version[2] = {1,0};
+	int req_profile_mask = GLX_CONTEXT_CORE_PROFILE_BIT_ARB;
+	int req_no_error = -1;
+	int req_flags = 0;
+	int legacy = 0;
+	int *attr_override;
+	int pos=0;
+	int i;
+
+	GH_verbose(GH_MSG_INFO, "overriding context attributes for creation\n");
+	if (attribs) {
+		while (attribs[2*count] != None) {
+			unsigned int name = (unsigned)attribs[2*count];
+			int value = attribs[2*count + 1];
+			GH_verbose(GH_MSG_INFO, "originally requested attrib: 0x%x = %d\n", name, value);
+			switch(name) {
+				case GLX_CONTEXT_MAJOR_VERSION_ARB:
+					req_version[0] = value;
+					break;
+				case GLX_CONTEXT_MINOR_VERSION_ARB:
+					req_version[1] = value;
+					break;
+				case GLX_CONTEXT_PROFILE_MASK_ARB:
+					req_profile_mask = value;
+					break;
+				case GLX_CONTEXT_FLAGS_ARB:
+					req_flags = value;
+					break;
+				case GLX_CONTEXT_OPENGL_NO_ERROR_ARB:
+					req_no_error = value;
+					break;
+				default:
+					additional_count++;
+			}
+			count++;
+		}
+	}
+
+	legacy = ((req_version[0] < 3) || ( (req_version[0] == 3) && req_version[1] < 2) );
+	if (legacy && (opts->flags & GH_GLCTX_COMPAT_IF_LEGACY)) {
+		GH_verbose(GH_MSG_INFO, "overriding legacy context to compat profile\n");
+		req_profile_mask &= ~GLX_CONTEXT_CORE_PROFILE_BIT_ARB;
+		req_profile_mask |= GLX_CONTEXT_COMPATIBILITY_PROFILE_BIT_ARB;
+	}
+
+	if (opts->force_version_min[0] >= 0) {
+		if (req_version[0] < opts->force_version_min[0]) {
+			GH_verbose(GH_MSG_INFO, "overriding context major version from %d to %d [min]\n",
+				   req_version[0], opts->force_version_min[0]);
+			req_version[0] = opts->force_version_min[0];
+		}
+	}
+	if (opts->force_version_min[1] >= 0) {
+		int override=0;
+		if (opts->force_version_min[0] >= 0) {
+			if (req_version[0] <= opts->force_version_min[0]) {
+				if (req_version[1] < opts->force_version_min[1]) {
+					override = 1;
+				}
+			}
+		} else {
+			if (req_version[1] < opts->force_version_min[1]) {
+				override = 1;
+			}
+		}
+
+		if (override) {
+			GH_verbose(GH_MSG_INFO, "overriding context minor version from %d to %d [min]\n",
+				   req_version[1], opts->force_version_min[1]);
+			req_version[1] = opts->force_version_min[1];
+		}
+	}
+
+	if (opts->force_version_max[0] >= 0) {
+		if (req_version[0] > opts->force_version_max[0]) {
+			GH_verbose(GH_MSG_INFO, "overriding context major version from %d to %d [max]\n",
+				   req_version[0], opts->force_version_max[0]);
+			req_version[0] = opts->force_version_max[0];
+		}
+	}
+	if (opts->force_version_max[1] >= 0) {
+		int override=0;
+		if (opts->force_version_max[0] >= 0) {
+			if (req_version[0] >= opts->force_version_max[0]) {
+				if (req_version[1] > opts->force_version_max[1]) {
+					override = 1;
+				}
+			}
+		} else {
+			if (req_version[1] > opts->force_version_max[1]) {
+				override = 1;
+			}
+		}
+
+		if (override) {
+			GH_verbose(GH_MSG_INFO, "overriding context minor version from %d to %d [max]\n",
+				   req_version[1], opts->force_version_max[1]);
+			req_version[1] = opts->force_version_max[1];
+		}
+	}
+
+	if (opts->force_version[0] >= 0) {
+		GH_verbose(GH_MSG_INFO, "overriding context major version from %d to %d\n",
+			   req_version[0], opts->force_version[0]);
+		req_version[0] = opts->force_version[0];
+	}
+	if (opts->force_version[1] >= 0) {
+		GH_verbose(GH_MSG_INFO, "overriding context minor version from %d to %d\n",
+			   req_version[1], opts->force_version[1]);
+		req_version[1] = opts->force_version[1];
 	}
 	if (opts->force_flags_on || opts->force_flags_off) {
-		return 2;
+		int new_flags = (req_flags | opts->force_flags_on)&(~opts->force_flags_off);
+		GH_verbose(GH_MSG_INFO, "overriding context flags from 0x%x to 0x%x\n",
+			   (unsigned)req_flags, (unsigned)new_flags);
+		req_flags = new_flags;
+	}
+	if (opts->force_profile_on || opts->force_profile_off) {
+		int new_profile = (req_profile_mask | opts->force_profile_on)&(~opts->force_profile_off);
+		GH_verbose(GH_MSG_INFO, "overriding context profile mask from 0x%x to 0x%x\n",
+			   (unsigned)req_profile_mask, (unsigned)new_profile);
+		req_profile_mask = new_profile;
+	}
+	if (opts->force_no_error >= 0) {
+		GH_verbose(GH_MSG_INFO, "overriding context NO_ERROR behavior from %d to %d\n",
+			   req_no_error, opts->force_no_error);
+		req_no_error = opts->force_no_error;
+	}
+
+	attr_override = malloc(sizeof(*attr_override) * ((additional_count + our_count) * 2 + 2));
+	if (!attr_override) {
+		GH_verbose(GH_MSG_ERROR, "overriding context attributes not possible: out of memory\n");
+		return NULL;
+	}
+
+	GH_verbose(GH_MSG_INFO, "requesting GL %d.%d flags: 0x%x, profile: 0x%x\n",
+		   req_version[0], req_version[1], (unsigned)req_flags, (unsigned)req_profile_mask);
+	attr_override[pos++] = GLX_CONTEXT_MAJOR_VERSION_ARB;
+	attr_override[pos++] = req_version[0];
+	attr_override[pos++] = GLX_CONTEXT_MINOR_VERSION_ARB;
+	attr_override[pos++] = req_version[1];
+	attr_override[pos++] = GLX_CONTEXT_PROFILE_MASK_ARB;
+	attr_override[pos++] = req_profile_mask;
+	attr_override[pos++] = GLX_CONTEXT_FLAGS_ARB;
+	attr_override[pos++] = req_flags;
+	if (req_no_error >= 0) {
+		attr_override[pos++] = GLX_CONTEXT_OPENGL_NO_ERROR_ARB;
+		attr_override[pos++] = req_no_error;
+	}
+
+	for (i=0; i<count; i++) {
+		unsigned int name = (unsigned)attribs[2*i];
+		int value = attribs[2*i+1];
+		switch (name) {
+			case GLX_CONTEXT_MAJOR_VERSION_ARB:
+			case GLX_CONTEXT_MINOR_VERSION_ARB:
+			case GLX_CONTEXT_PROFILE_MASK_ARB:
+			case GLX_CONTEXT_FLAGS_ARB:
+			case GLX_CONTEXT_OPENGL_NO_ERROR_ARB:
+				(void)0;
+				break;
+			default:
+				attr_override[pos++] = (int)name;
+				attr_override[pos++] = value;
+		}
+	}
+	attr_override[pos++] = None;
+	attr_override[pos++] = None;
+
+	return attr_override;
+}
+
+static const GLXFBConfig* get_fbconfig_for_visual(Display *dpy, XVisualInfo *vis, GLXFBConfig *cfg)
+{
+	GLXFBConfig *cfgs;
+	const GLXFBConfig *new_cfg = NULL;
+	/* TODO: what about the screen number? */
+	int screen=0;
+	int count;
+
+	GH_GET_PTR_GL(glXGetFBConfigs);
+	GH_GET_PTR_GL(glXGetFBConfigAttrib);
+	GH_GET_PTR(XFree);
+
+	if (!GH_glXGetFBConfigs || !GH_glXGetFBConfigAttrib || !GH_XFree) {
+		GH_verbose(GH_MSG_ERROR, "glXGetFBConfigs or glXGetFBConfigAttrib or XFree not found!\n");
+		return NULL;
+	}
+
+	cfgs=GH_glXGetFBConfigs(dpy, screen, &count);
+
+	if (cfgs && count > 0) {
+		int i;
+		for (i=0; i<count; i++) {
+			int value = -1;
+			int res = GH_glXGetFBConfigAttrib(dpy, cfgs[i], GLX_VISUAL_ID, &value);
+			if (res == Success) {
+				GH_verbose(GH_MSG_DEBUG, "fbconfig %d for visual ID %d\n", i, value);
+				if (value == (int)vis->visualid) {
+					GH_verbose(GH_MSG_INFO, "found fbconfig %d for visual ID %d\n", i, value);
+					*cfg = cfgs[i];
+					new_cfg=cfg;
+					break;
+				}
+			} else {
+				GH_verbose(GH_MSG_WARNING, "glxGerFBConfigAttrib failed!\n");
+			}
+		}
+	}
+
+	if (cfgs) {
+		GH_XFree(cfgs);
+	}
+
+	return new_cfg;
+}
+
+static GLXContext override_create_context(Display *dpy, XVisualInfo *vis, const GLXFBConfig *fbconfig, GLXContext shareList, Bool direct, const int *attribs)
+{
+	GLXFBConfig internal_fbconfig;
+
+	pthread_mutex_lock(&ctx_creation_opts.mutex);
+	if (!(ctx_creation_opts.flags & GH_GLCTX_CREATE_INITIALIZED)) {
+		context_creation_opts_init(&ctx_creation_opts);
+		ctx_creation_opts.flags |= GH_GLCTX_CREATE_INITIALIZED;
+	}
+	pthread_mutex_unlock(&ctx_creation_opts.mutex);
+
+	if (need_creation_override(&ctx_creation_opts)) {
+		GLXContext ctx = NULL;
+		uint64_t t0=(startup.enabled)?get_time_ns(CLOCK_MONOTONIC):0;
+		int *attribs_override = get_override_attributes(&ctx_creation_opts, attribs);
+		if (!attribs_override) {
+			GH_verbose(GH_MSG_WARNING, "failed to generate context creation override attributes!\n");
+			return NULL;
+		}
+		if (!fbconfig) {
+			uint64_t t1;
+			if (!vis) {
+				GH_verbose(GH_MSG_WARNING, "create context attempt without Visual and FBConfig!\n");
+				free(attribs_override);
+				return NULL;	
+			}
+			/* find FBConfig vor Visual ... */
+			t1=(t0)?get_time_ns(CLOCK_MONOTONIC):0;
+			fbconfig=get_fbconfig_for_visual(dpy, vis, &internal_fbconfig);
+			if (t1) {
+				startup_creation.fbconfig=get_time_ns(CLOCK_MONOTONIC) - t1;
+			}
+			if (!fbconfig) {
+				GH_verbose(GH_MSG_WARNING, "create context: failed to get fbconfig for visual!\n");
+				free(attribs_override);
+				return NULL;	
+			}
+		}
+		GH_GET_GL_PROC(glXCreateContextAttribsARB);
+		if (GH_glXCreateContextAttribsARB) {
+			ctx=GH_glXCreateContextAttribsARB(dpy, *fbconfig, shareList, direct, attribs_override);
+		} else {
+			GH_verbose(GH_MSG_WARNING, "failed to get glXCreateContextAttribsARB\n");
+		}
+		if (ctx == NULL) {
+			GH_verbose(GH_MSG_WARNING, "overridden context creation failed!\n");
+		} else {
+			GH_verbose(GH_MSG_INFO, "created context %p with overriden attributes!\n", ctx);
+		}
+		free(attribs_override);
+		if (t0) {
+			startup_creation.override=get_time_ns(CLOCK_MONOTONIC) - t0;
+		}
+		return ctx;
+
+	}
+	return NULL;
+}
+
+#endif /* GH_CONTEXT_TRACKING */
+
+/***************************************************************************
+ * SWAP INTERVAL LOGIC                                                     *
+ ***************************************************************************/
+
+/* possible GH_SWAP_MODEs */
+typedef enum {
+	GH_SWAP_MODE_NOP=0,	/* do not change anything */
+	GH_SWAP_MODE_IGNORE,	/* ignore all attempts to set swap interval */
+	GH_SWAP_MODE_CLAMP,	/* clamp interval to (a,b) */
+	GH_SWAP_MODE_FORCE,	/* force interval to a */
+	GH_SWAP_MODE_DISABLE,	/* force interval to 0 */
+	GH_SWAP_MODE_ENABLE,	/* force interval to >= 1 */
+	GH_SWAP_MODE_MIN,	/* force interval to >= a */
+	GH_SWAP_MODE_MAX,	/* force interval to <= a */
+	/* always add new elements here */
+	GH_SWAP_MODES_COUNT
+} GH_swap_mode;
+
+/* possible GH_SWAP_TEAR modes */
+typedef enum {
+	GH_SWAP_TEAR_RAW,	/* handle interval as if normal */
+	GH_SWAP_TEAR_KEEP,	/* keep tearing control as requested */
+	GH_SWAP_TEAR_DISABLE,	/* always disbale adaptive vsync */
+	GH_SWAP_TEAR_ENABLE,	/* enable adaptive vsync */
+	GH_SWAP_TEAR_INVERT,	/* could one ever need this? */
+	/* always add new elements here */
+	GH_SWAP_TEAR_COUNT
+} GH_swap_tear;
+
+typedef struct {
+	GH_swap_mode swap_mode;
+	GH_swap_tear swap_tear;
+	int swap_param[2];
+} GH_config;
+
+static void GH_swap_mode_from_str(GH_config volatile *cfg, const char *str)
+{
+	static const char *mode_str[GH_SWAP_MODES_COUNT+1]={
+		"nop",
+		"ignore",
+		"clamp",
+		"force",
+		"disable",
+		"enable",
+		"min",
+		"max",
+		NULL
+	};
+
+	size_t l=0;
+	int idx;
+	char *nstr;
+
+	cfg->swap_mode=GH_SWAP_MODE_NOP;
+	
+	if (str == NULL)
+		return;
+
+	for (idx=0; mode_str[idx]; idx++) {
+		l=strlen(mode_str[idx]);
+		if (!strncmp(str, mode_str[idx], l)) {
+			break;
+		}
+	}
+
+	if (idx >= 0 && idx<(int)GH_SWAP_MODES_COUNT) {
+		cfg->swap_mode=(GH_swap_mode)idx;
+	}
+
+	str += l;
+
+	/* read up to 2 ints as arguments */
+	while(*str && !isdigit(*str))
+		str++;
+	cfg->swap_param[0]=(int)strtol(str, &nstr, 0);
+	str=nstr;
+	while(*str && !isdigit(*str))
+		str++;
+	cfg->swap_param[1]=(int)strtol(str, &nstr,0);
+	GH_verbose(GH_MSG_DEBUG, "SWAP_MODE: %d %d %d\n",
+				cfg->swap_mode,cfg->swap_param[0],cfg->swap_param[1]);
+}
+
+static void GH_swap_tear_from_str(GH_config volatile *cfg, const char *str)
+{
+	static const char *mode_str[GH_SWAP_TEAR_COUNT+1]={
+		"raw",
+		"keep",
+		"disable",
+		"enable",
+		"invert",
+
+		NULL
+	};
+
+	int idx;
+
+	cfg->swap_tear=GH_SWAP_TEAR_KEEP;
+	
+	if (str == NULL)
+		return;
+
+	for (idx=0; mode_str[idx]; idx++) {
+		if (!strcmp(str, mode_str[idx])) {
+			break;
+		}
+	}
+
+	if (idx >= 0 && idx<(int)GH_SWAP_MODES_COUNT) {
+		cfg->swap_tear=(GH_swap_mode)idx;
+	}
+}
+
+static int GH_swap_interval_absolute(const volatile GH_config *cfg, int interval)
+{
+	int new_interval;
+
+	switch(cfg->swap_mode) {
+		case GH_SWAP_MODE_IGNORE:
+			new_interval=GH_SWAP_DONT_SET;
+			break;
+		case GH_SWAP_MODE_CLAMP:
+			new_interval=interval;
+			if (new_interval < cfg->swap_param[0])
+				new_interval=cfg->swap_param[0];
+			if (new_interval > cfg->swap_param[1])
+				interval=cfg->swap_param[1];
+			break;
+		case GH_SWAP_MODE_FORCE:
+			new_interval=cfg->swap_param[0];
+			break;
+		case GH_SWAP_MODE_DISABLE:
+			new_interval=0;
+			break;
+		case GH_SWAP_MODE_ENABLE:
+			new_interval=interval;
+			if (new_interval < 1)
+				new_interval=1;
+			break;
+		case GH_SWAP_MODE_MIN:
+			new_interval=interval;
+			if (new_interval < cfg->swap_param[0])
+				new_interval=cfg->swap_param[0];
+			break;
+		case GH_SWAP_MODE_MAX:
+			new_interval=interval;
+			if (new_interval > cfg->swap_param[0])
+				new_interval=cfg->swap_param[0];
+			break;
+		default:
+			new_interval=interval;
+	}
+
+	GH_verbose(GH_MSG_DEBUG,"swap interval, absolute value %d -> %d\n", interval, new_interval);
+	return new_interval;
+}
+
+static int GH_swap_interval_base(const volatile GH_config *cfg, int interval)
+{
+	int sign_interval;
+	int abs_interval;
+	int new_interval;
+
+	if (cfg->swap_tear == GH_SWAP_TEAR_RAW) {
+		sign_interval=0;
+		abs_interval=interval; /* moght be negative */
+	} else 	if (interval < 0) {
+		sign_interval=-1;
+		abs_interval=-interval;
+	} else {
+		sign_interval=1;
+		abs_interval=interval;
+	}
+
+	abs_interval=GH_swap_interval_absolute(cfg, abs_interval);
+	if (abs_interval == GH_SWAP_DONT_SET) {
+		GH_verbose(GH_MSG_INFO,"swap interval %d setting ignored\n",
+					interval);
+		return GH_SWAP_DONT_SET;
+	}
+
+	/* set sign based on GH_SWAP_TEAR mode */
+	switch (cfg->swap_tear) {
+		case GH_SWAP_TEAR_KEEP:
+			new_interval=abs_interval * sign_interval;
+			break;
+		case GH_SWAP_TEAR_DISABLE:
+			new_interval=abs_interval;
+			break;
+		case GH_SWAP_TEAR_ENABLE:
+			new_interval=-abs_interval;
+			break;
+		case GH_SWAP_TEAR_INVERT:
+			new_interval=abs_interval * (-sign_interval);
+			break;
+		default:
+			new_interval=abs_interval;	
+	}
+
+	GH_verbose(GH_MSG_INFO,"swap interval %d -> %d\n", interval, new_interval);
+	return new_interval;
+}
+
+static int GH_swap_interval(int interval)
+{
+	static pthread_mutex_t mutex=PTHREAD_MUTEX_INITIALIZER;
+	static volatile GH_config cfg={GH_SWAP_MODES_COUNT, GH_SWAP_TEAR_KEEP, {0,1}};
+	int new_interval;
+
+	pthread_mutex_lock(&mutex);
+	if (cfg.swap_mode >= GH_SWAP_MODES_COUNT) {
+		GH_swap_mode_from_str(&cfg, getenv("GH_SWAP_MODE"));
+		GH_swap_tear_from_str(&cfg, getenv("GH_SWAP_TEAR"));
+	}
+	pthread_mutex_unlock(&mutex);
+	new_interval=GH_swap_interval_base(&cfg, interval);
+#ifdef GH_CONTEXT_TRACKING
+	if (new_interval != interval) {
+		GH_STATS_INC(process_stats.swap_interval_overrides);
+	}
+	if (new_interval != GH_SWAP_DONT_SET) {
+		swap_interval_current=new_interval;
+	}
+#endif
+	return new_interval;
+}
+
+
+/***************************************************************************
+ * INTERCEPTED FUNCTIONS: libdl/libc                                       *
+ ***************************************************************************/
+
+/* intercept dlsym() itself */
+extern void *
+dlsym(void *handle, const char *name)
+{
+	void *interceptor;
+	void *ptr;
+	/* special case: we cannot use GH_GET_PTR as it relies on
+	 * GH_dlsym() which we have to query using GH_dlsym_internal */
+	pthread_mutex_lock(&GH_fptr_mutex);
+	GH_dlsym_internal_dlsym();
+	pthread_mutex_unlock(&GH_fptr_mutex);
+	interceptor=GH_get_interceptor(name, GH_dlsym_next, "dlsym");
+	ptr=(interceptor)?interceptor:GH_dlsym(handle,name);
+	GH_verbose(GH_MSG_DEBUG_INTERCEPTION,"dlsym(%p, %s) = %p%s\n",handle,name,ptr,
+		interceptor?" [intercepted]":"");
+	return ptr;
+}
+
+#if (GH_DLSYM_METHOD != 2)
+/* Also intercept GNU specific dlvsym().
+ * We can do this only if we are not using dlvsym to query dlsym... */
+extern void *
+dlvsym(void *handle, const char *name, const char *version)
+{
+	void *interceptor;
+	void *ptr;
+	pthread_mutex_lock(&GH_fptr_mutex);
+	GH_dlsym_internal_dlsym();
+	pthread_mutex_unlock(&GH_fptr_mutex);
+	GH_GET_PTR(dlvsym);
+	interceptor=GH_get_interceptor(name, GH_dlsym_next, "dlvsym");
+	ptr=(interceptor)?interceptor:GH_dlvsym(handle,name,version);
+	GH_verbose(GH_MSG_DEBUG_INTERCEPTION,"dlvsym(%p, %s, %s) = %p%s\n",handle,name,version,ptr,
+		interceptor?" [intercepted]":"");
+	return ptr;
+}
+#endif
+
+#ifdef GH_MALLOC_INTERCEPT
+/* heap allocations, see HEAP ALLOCATION ACCOUNTING */
+extern void *
+malloc(size_t size)
+{
+	alloc_count("malloc", size);
+	return __libc_malloc(size);
+}
+
+extern void *
+calloc(size_t nmemb, size_t size)
+{
+	size_t bytes;
+
+	if (__builtin_mul_overflow(nmemb, size, &bytes)) {
+		/* this fails anyway, and there is nothing to count */
+		return __libc_calloc(nmemb, size);
 	}
-	if (opts->force_profile_on || opts->force_profile_off) {
-		return 3;
+	alloc_count("calloc", bytes);
+	return __libc_calloc(nmemb, size);
+}
+
+extern void *
+realloc(void *ptr, size_t size)
+{
+	if (ptr && !size) {
+		/* glibc releases the block and returns NULL */
+		alloc_count_free();
+	} else {
+		alloc_count("realloc", size);
 	}
-	if (opts->force_no_error >= 0) {
-		return 4;
+	return __libc_realloc(ptr, size);
+}
+
+/* the reallocarray() of glibc calls its internal realloc, so our
+ * realloc() is never reached and we have to interpose it as well */
+extern void *
+reallocarray(void *ptr, size_t nmemb, size_t size)
+{
+	size_t bytes;
+
+	if (__builtin_mul_overflow(nmemb, size, &bytes)) {
+		errno=ENOMEM;
+		return NULL;
+	}
+	return realloc(ptr, bytes);
+}
+
+/* the blocks of the aligned variants are released by free() too, so they
+ * must be counted to keep the allocs and frees balanced */
+extern void *
+memalign(size_t alignment, size_t size)
+{
+	alloc_count("memalign", size);
+	return __libc_memalign(alignment, size);
+}
+
+extern void *
+aligned_alloc(size_t alignment, size_t size)
+{
+	alloc_count("aligned_alloc", size);
+	return __libc_memalign(alignment, size);
+}
+
+extern int
+posix_memalign(void **memptr, size_t alignment, size_t size)
+{
+	void *ptr;
+	int err=errno;
+
+	/* the same checks as glibc does, __libc_memalign() is more lenient */
+	if (!alignment || (alignment % sizeof(void*)) ||
+	    ((alignment / sizeof(void*)) & (alignment / sizeof(void*) - 1))) {
+		return EINVAL;
+	}
+	alloc_count("posix_memalign", size);
+	ptr=__libc_memalign(alignment, size);
+	if (!ptr) {
+		errno=err;
+		return ENOMEM;
+	}
+	*memptr=ptr;
+	return 0;
+}
+
+extern void *
+valloc(size_t size)
+{
+	alloc_count("valloc", size);
+	return __libc_valloc(size);
+}
+
+extern void *
+pvalloc(size_t size)
+{
+	alloc_count("pvalloc", size);
+	return __libc_pvalloc(size);
+}
+
+extern void
+free(void *ptr)
+{
+	if (ptr) {
+		alloc_count_free();
+	}
+	__libc_free(ptr);
+}
+#endif /* GH_MALLOC_INTERCEPT */
+
+/***************************************************************************
+ * INTERCEPTED FUNCTIONS: glX                                              *
+ ***************************************************************************/
+
+/* Actually, our goal is to intercept glXSwapInterval[EXT|SGI]() etc. But
+ * these are extension functions not required to be provided as external
+ * symbols. However, some applications just likn them anyways, so we have
+ * to handle the case were dlsym() or glXGetProcAddress[ARB]() is used to
+ * query the function pointers, and have to intercept these as well.
+ */
+
+/* helper macro to handle both glxGetProcAddress and glXGetProcAddressARB */
+#define GH_GLXGETPROCADDRESS_GENERIC(procname) \
+extern GH_fptr procname(const GLubyte *name) \
+{ \
+	void *interceptor; \
+	GH_fptr ptr; \
+	GH_GET_PTR(procname); \
+	interceptor=GH_get_interceptor((const char *)name, \
+					(GH_resolve_func)GH_ ##procname, \
+					 #procname); \
+	ptr=(interceptor)?(GH_fptr)interceptor:GH_ ##procname((const char*)name); \
+	GH_verbose(GH_MSG_DEBUG_INTERCEPTION,#procname "(%s) = %p%s\n",(const char *)name, ptr, \
+		interceptor?" [intercepted]":""); \
+	return ptr; \
+}
+
+GH_GLXGETPROCADDRESS_GENERIC(glXGetProcAddress)
+GH_GLXGETPROCADDRESS_GENERIC(glXGetProcAddressARB)
+
+#ifdef GH_CONTEXT_TRACKING
+
+/* the number of a context for the call recorder */
+static unsigned int
+recorder_ctx_num(GLXContext ctx)
+{
+	gl_context_t *glc=(ctx)?find_ctx(ctx):NULL;
+	return (glc)?glc->num:GH_RECORD_NO_CONTEXT;
+}
+
+/* the number of the current context for the call recorder */
+static unsigned int
+recorder_current_ctx_num(void)
+{
+	gl_context_t *glc=(ctx_counter)?(gl_context_t*)pthread_getspecific(ctx_current):NULL;
+	return (glc)?glc->num:GH_RECORD_NO_CONTEXT;
+}
+
+/* the first glClear after a swap starts the GPU work of a frame */
+extern void glClear(GLbitfield mask)
+{
+	gl_context_t *glc=(recorder.file && ctx_counter)?(gl_context_t*)pthread_getspecific(ctx_current):NULL;
+	if (glc) {
+		frametimes_frame_start(&glc->frametimes);
+	}
+	if (!GH_glClear) {
+		GH_GET_GL_PROC_OR_FAIL(glClear, GH_MSG_WARNING, );
+	}
+	GH_glClear(mask);
+}
+
+/* ---------- Context Creation ---------- */
+
+extern GLXContext glXCreateContext(Display *dpy, XVisualInfo *vis, GLXContext shareList, Bool direct )
+{
+	GLXContext ctx;
+	uint64_t t0=recorder_begin();
+
+	startup_creation_begin();
+	ctx = override_create_context(dpy, vis, NULL, shareList, direct, NULL);
+	if (ctx == NULL) {
+		GH_GET_PTR_GL(glXCreateContext);
+		ctx=GH_glXCreateContext(dpy, vis, shareList, direct);
+	}
+	create_context(ctx);
+	if (t0) {
+		recorder_call(GH_RECORD_CREATE_CONTEXT, recorder_ctx_num(ctx), t0, 0);
+	}
+	return ctx;
+}
+
+extern GLXContext glXCreateNewContext( Display *dpy, GLXFBConfig config, int renderType, GLXContext shareList, Bool direct )
+{
+	GLXContext ctx;
+	uint64_t t0=recorder_begin();
+
+	startup_creation_begin();
+	ctx = override_create_context(dpy, NULL, &config, shareList, direct, NULL);
+	if (ctx == NULL) {
+		GH_GET_PTR_GL(glXCreateNewContext);
+		ctx=GH_glXCreateNewContext(dpy, config, renderType, shareList, direct);
+	}
+	create_context(ctx);
+	if (t0) {
+		recorder_call(GH_RECORD_CREATE_CONTEXT, recorder_ctx_num(ctx), t0, 0);
+	}
+	return ctx;
+}
+
+extern GLXContext glXCreateContextAttribsARB (Display * dpy, GLXFBConfig config, GLXContext shareList, Bool direct, const int *attr)
+{
+	GLXContext ctx;
+	uint64_t t0=recorder_begin();
+
+	startup_creation_begin();
+	ctx = override_create_context(dpy, NULL, &config, shareList, direct, attr);
+	if (ctx == NULL) {
+		GH_GET_PTR_GL(glXCreateContextAttribsARB);
+		ctx=GH_glXCreateContextAttribsARB(dpy, config, shareList, direct, attr);
+	}
+	create_context(ctx);
+	if (t0) {
+		recorder_call(GH_RECORD_CREATE_CONTEXT, recorder_ctx_num(ctx), t0, 0);
+	}
+	return ctx;
+}
+
+extern GLXContext glXImportContextEXT (Display *dpy, GLXContextID id)
+{
+	GLXContext ctx;
+	uint64_t t0=recorder_begin();
+
+	startup_creation_begin();
+	GH_GET_PTR_GL(glXImportContextEXT);
+	ctx=GH_glXImportContextEXT(dpy, id);
+	create_context(ctx);
+	if (t0) {
+		recorder_call(GH_RECORD_CREATE_CONTEXT, recorder_ctx_num(ctx), t0, 0);
+	}
+	return ctx;
+}
+
+extern GLXContext glXCreateContextWithConfigSGIX (Display *dpy, GLXFBConfigSGIX config, int renderType, GLXContext shareList, Bool direct)
+{
+	GLXContext ctx;
+	uint64_t t0=recorder_begin();
+
+	startup_creation_begin();
+	/* TODO: override_create_context for this case */
+	GH_GET_PTR_GL(glXCreateContextWithConfigSGIX);
+	ctx=GH_glXCreateContextWithConfigSGIX(dpy, config, renderType, shareList, direct);
+	create_context(ctx);
+	if (t0) {
+		recorder_call(GH_RECORD_CREATE_CONTEXT, recorder_ctx_num(ctx), t0, 0);
+	}
+	return ctx;
+}
+
+/* ---------- Context Destruction ---------- */
+
+extern void glXDestroyContext(Display *dpy, GLXContext ctx)
+{
+	uint64_t t0=recorder_begin();
+	unsigned int ctx_num=(t0)?recorder_ctx_num(ctx):GH_RECORD_NO_CONTEXT;
+	GH_GET_PTR_GL(glXDestroyContext);
+	GH_glXDestroyContext(dpy, ctx);
+	destroy_context(ctx);
+	if (t0) {
+		recorder_call(GH_RECORD_DESTROY_CONTEXT, ctx_num, t0, 0);
+	}
+}
+
+extern void glXFreeContextEXT(Display *dpy, GLXContext ctx)
+{
+	uint64_t t0=recorder_begin();
+	unsigned int ctx_num=(t0)?recorder_ctx_num(ctx):GH_RECORD_NO_CONTEXT;
+	GH_GET_PTR_GL(glXFreeContextEXT);
+	GH_glXFreeContextEXT(dpy, ctx);
+	destroy_context(ctx);
+	if (t0) {
+		recorder_call(GH_RECORD_DESTROY_CONTEXT, ctx_num, t0, 0);
+	}
+}
+
+/* ---------- Current Context Tracking ---------- */
+
+extern Bool glXMakeCurrent(Display *dpy, GLXDrawable drawable, GLXContext ctx)
+{
+	Bool result;
+	uint64_t t0=recorder_begin();
+
+	result=GH_glXMakeCurrent(dpy, drawable, ctx);
+	make_current(ctx, dpy, drawable, drawable);
+	if (t0) {
+		recorder_call(GH_RECORD_MAKE_CURRENT, recorder_ctx_num(ctx), t0, 0);
+	}
+	return result;
+}
+
+extern Bool glXMakeContextCurrent(Display *dpy, GLXDrawable draw, GLXDrawable read, GLXContext ctx)
+{
+	Bool result;
+	uint64_t t0=recorder_begin();
+
+	result=GH_glXMakeContextCurrent(dpy, draw, read, ctx);
+	make_current(ctx, dpy, draw, read);
+	if (t0) {
+		recorder_call(GH_RECORD_MAKE_CURRENT, recorder_ctx_num(ctx), t0, 0);
+	}
+	return result;
+}
+
+extern Bool glXMakeCurrentReadSGI(Display *dpy, GLXDrawable draw, GLXDrawable read, GLXContext ctx)
+{
+	Bool result;
+	uint64_t t0=recorder_begin();
+
+	result=GH_glXMakeCurrentReadSGI(dpy, draw, read, ctx);
+	make_current(ctx, dpy, draw, read);
+	if (t0) {
+		recorder_call(GH_RECORD_MAKE_CURRENT, recorder_ctx_num(ctx), t0, 0);
+	}
+	return result;
+}
+
+/* ---------- GL Debug Output ---------- */
+
+extern void glDebugMessageCallback(GLDEBUGPROC proc, const GLvoid *user_ptr)
+{
+	GH_GET_PTR_GL(glDebugMessageCallback);
+	if (GH_glDebugMessageCallback) {
+		gl_context_t *glc=(gl_context_t*)pthread_getspecific(ctx_current);
+		if (glc) {
+			glc->original_debug_callback = proc;
+			glc->original_debug_callback_user_ptr = user_ptr;
+
+			if (glc->flags & GH_GL_INTERCEPT_DEBUG) {
+				GH_verbose(GH_MSG_INFO, "injecting debug output [core]!\n");
+				proc = GH_debug_callback;
+				user_ptr = glc;
+			}
+		} else {
+			GH_verbose(GH_MSG_WARNING, "debug message callback without current context!\n");
+		}
+		GH_glDebugMessageCallback(proc, user_ptr);
+	}
+}
+
+extern void glDebugMessageCallbackARB(GLDEBUGPROC proc, const GLvoid *user_ptr)
+{
+	GH_GET_PTR_GL(glDebugMessageCallbackARB);
+	if (GH_glDebugMessageCallbackARB) {
+		gl_context_t *glc=(gl_context_t*)pthread_getspecific(ctx_current);
+		if (glc) {
+			glc->original_debug_callback = proc;
+			glc->original_debug_callback_user_ptr = user_ptr;
+
+			if (glc->flags & GH_GL_INTERCEPT_DEBUG) {
+				GH_verbose(GH_MSG_INFO, "injecting debug output [ARB]!\n");
+				proc = GH_debug_callback;
+				user_ptr = glc;
+			}
+		} else {
+			GH_verbose(GH_MSG_WARNING, "debug message callback without current context!\n");
+		}
+		GH_glDebugMessageCallbackARB(proc, user_ptr);
 	}
-
-	return 0;
 }
 
-static int* get_override_attributes(gl_context_creation_opts_t *opts, const int *attribs)
+extern void glDebugMessageCallbackKHR(GLDEBUGPROC proc, const GLvoid *user_ptr)
 {
-	const int our_count=5;
-	int count = 0;
-	int additional_count = 0;
-	int req_version[2] = {1,0};
-	int req_profile_mask = GLX_CONTEXT_CORE_PROFILE_BIT_ARB;
-	int req_no_error = -1;
-	int req_flags = 0;
-	int legacy = 0;
-	int *attr_override;
-	int pos=0;
-	int i;
+	GH_GET_PTR_GL(glDebugMessageCallbackKHR);
+	if (GH_glDebugMessageCallbackKHR) {
+		gl_context_t *glc=(gl_context_t*)pthread_getspecific(ctx_current);
+		if (glc) {
+			glc->original_debug_callback = proc;
+			glc->original_debug_callback_user_ptr = user_ptr;
 
-	GH_verbose(GH_MSG_INFO, "overriding context attributes for creation\n");
-	if (attribs) {
-		while (attribs[2*count] != None) {
-			unsigned int name = (unsigned)attribs[2*count];
-			int value = attribs[2*count + 1];
-			GH_verbose(GH_MSG_INFO, "originally requested attrib: 0x%x = %d\n", name, value);
-			switch(name) {
-				case GLX_CONTEXT_MAJOR_VERSION_ARB:
-					req_version[0] = value;
-					break;
-				case GLX_CONTEXT_MINOR_VERSION_ARB:
-					req_version[1] = value;
-					break;
-				case GLX_CONTEXT_PROFILE_MASK_ARB:
-					req_profile_mask = value;
-					break;
-				case GLX_CONTEXT_FLAGS_ARB:
-					req_flags = value;
-					break;
-				case GLX_CONTEXT_OPENGL_NO_ERROR_ARB:
-					req_no_error = value;
-					break;
-				default:
-					additional_count++;
+			if (glc->flags & GH_GL_INTERCEPT_DEBUG) {
+				GH_verbose(GH_MSG_INFO, "injecting debug output [KHR]!\n");
+				proc = GH_debug_callback;
+				user_ptr = glc;
 			}
-			count++;
+		} else {
+			GH_verbose(GH_MSG_WARNING, "debug message callback without current context!\n");
 		}
+		GH_glDebugMessageCallbackKHR(proc, user_ptr);
 	}
+}
 
-	legacy = ((req_version[0] < 3) || ( (req_version[0] == 3) && req_version[1] < 2) );
-	if (legacy && (opts->flags & GH_GLCTX_COMPAT_IF_LEGACY)) {
-		GH_verbose(GH_MSG_INFO, "overriding legacy context to compat profile\n");
-		req_profile_mask &= ~GLX_CONTEXT_CORE_PROFILE_BIT_ARB;
-		req_profile_mask |= GLX_CONTEXT_COMPATIBILITY_PROFILE_BIT_ARB;
-	}
+extern void glDebugMessageCallbackAMD(GLDEBUGPROCAMD proc, GLvoid *user_ptr)
+{
+	GH_GET_PTR_GL(glDebugMessageCallbackAMD);
+	if (GH_glDebugMessageCallbackAMD) {
+		gl_context_t *glc=(gl_context_t*)pthread_getspecific(ctx_current);
+		if (glc) {
+			glc->original_debug_callback_AMD = proc;
+			glc->original_debug_callback_AMD_user_ptr = user_ptr;
 
-	if (opts->force_version_min[0] >= 0) {
-		if (req_version[0] < opts->force_version_min[0]) {
-			GH_verbose(GH_MSG_INFO, "overriding context major version from %d to %d [min]\n",
-				   req_version[0], opts->force_version_min[0]);
-			req_version[0] = opts->force_version_min[0];
-		}
-	}
-	if (opts->force_version_min[1] >= 0) {
-		int override=0;
-		if (opts->force_version_min[0] >= 0) {
-			if (req_version[0] <= opts->force_version_min[0]) {
-				if (req_version[1] < opts->force_version_min[1]) {
-					override = 1;
-				}
+			if (glc->flags & GH_GL_INTERCEPT_DEBUG) {
+				GH_verbose(GH_MSG_INFO, "injecting debug output [AMD]!\n");
+				proc = GH_debug_callback_AMD;
+				user_ptr = glc;
 			}
 		} else {
-			if (req_version[1] < opts->force_version_min[1]) {
-				override = 1;
-			}
+			GH_verbose(GH_MSG_WARNING, "debug message callback without current context!\n");
 		}
+		GH_glDebugMessageCallbackAMD(proc, user_ptr);
+	}
+}
 
-		if (override) {
-			GH_verbose(GH_MSG_INFO, "overriding context minor version from %d to %d [min]\n",
-				   req_version[1], opts->force_version_min[1]);
-			req_version[1] = opts->force_version_min[1];
-		}
+/* ---------- GL Call Counts ---------- */
+
+/* the current context, counting an intercepted GL call for the flight recorder */
+static gl_context_t *
+calls_current(GH_gl_call call)
+{
+	gl_context_t *glc=(ctx_counter)?(gl_context_t*)pthread_getspecific(ctx_current):NULL;
+	if (glc && glc->flight.size) {
+		glc->flight.calls[call]++;
 	}
+	return glc;
+}
 
-	if (opts->force_version_max[0] >= 0) {
-		if (req_version[0] > opts->force_version_max[0]) {
-			GH_verbose(GH_MSG_INFO, "overriding context major version from %d to %d [max]\n",
-				   req_version[0], opts->force_version_max[0]);
-			req_version[0] = opts->force_version_max[0];
-		}
+/* ---------- Debug Markers ---------- */
+
+/* the current context, if it tracks the debug markers */
+static gl_context_t *
+markers_current(void)
+{
+	gl_context_t *glc=calls_current(GH_CALL_MARKER);
+	return (glc && (glc->frametimes.markers.enabled || glc->frametimes.groups.enabled))?glc:NULL;
+}
+
+static void
+markers_record(gl_context_t *glc, unsigned int id)
+{
+	if (glc->flight.size) {
+		uint64_t now=get_time_ns(CLOCK_REALTIME);
+		flight_record(&glc->flight, GH_EVENT_MARKER, now, now, (long long)id);
 	}
-	if (opts->force_version_max[1] >= 0) {
-		int override=0;
-		if (opts->force_version_max[0] >= 0) {
-			if (req_version[0] >= opts->force_version_max[0]) {
-				if (req_version[1] > opts->force_version_max[1]) {
-					override = 1;
-				}
-			}
-		} else {
-			if (req_version[1] > opts->force_version_max[1]) {
-				override = 1;
-			}
+}
+
+static void
+markers_group(const GLchar *message, GLsizei length)
+{
+	gl_context_t *glc=markers_current();
+	if (glc) {
+		unsigned int id=marker_intern(message, length);
+		markers_push(&glc->frametimes.markers, id);
+		markers_record(glc, id);
+		if (glc->frametimes.groups.enabled) {
+			gpu_groups_push(&glc->frametimes.groups, id);
 		}
+	}
+}
 
-		if (override) {
-			GH_verbose(GH_MSG_INFO, "overriding context minor version from %d to %d [max]\n",
-				   req_version[1], opts->force_version_max[1]);
-			req_version[1] = opts->force_version_max[1];
+static void
+markers_group_end(void)
+{
+	gl_context_t *glc=markers_current();
+	if (glc) {
+		markers_pop(&glc->frametimes.markers);
+		if (glc->frametimes.groups.enabled) {
+			gpu_groups_pop(&glc->frametimes.groups);
 		}
 	}
+}
 
-	if (opts->force_version[0] >= 0) {
-		GH_verbose(GH_MSG_INFO, "overriding context major version from %d to %d\n",
-			   req_version[0], opts->force_version[0]);
-		req_version[0] = opts->force_version[0];
+static void
+markers_event(const GLchar *message, GLsizei length)
+{
+	gl_context_t *glc=markers_current();
+	if (glc) {
+		unsigned int id=marker_intern(message, length);
+		glc->frametimes.markers.event=id;
+		markers_record(glc, id);
 	}
-	if (opts->force_version[1] >= 0) {
-		GH_verbose(GH_MSG_INFO, "overriding context minor version from %d to %d\n",
-			   req_version[1], opts->force_version[1]);
-		req_version[1] = opts->force_version[1];
+}
+
+extern void glPushDebugGroup(GLenum source, GLuint id, GLsizei length, const GLchar *message)
+{
+	markers_group(message, length);
+	if (!GH_glPushDebugGroup) {
+		GH_GET_GL_PROC_OR_FAIL(glPushDebugGroup, GH_MSG_WARNING, );
 	}
-	if (opts->force_flags_on || opts->force_flags_off) {
-		int new_flags = (req_flags | opts->force_flags_on)&(~opts->force_flags_off);
-		GH_verbose(GH_MSG_INFO, "overriding context flags from 0x%x to 0x%x\n",
-			   (unsigned)req_flags, (unsigned)new_flags);
-		req_flags = new_flags;
+	GH_glPushDebugGroup(source, id, length, message);
+}
+
+extern void glPopDebugGroup(void)
+{
+	markers_group_end();
+	if (!GH_glPopDebugGroup) {
+		GH_GET_GL_PROC_OR_FAIL(glPopDebugGroup, GH_MSG_WARNING, );
 	}
-	if (opts->force_profile_on || opts->force_profile_off) {
-		int new_profile = (req_profile_mask | opts->force_profile_on)&(~opts->force_profile_off);
-		GH_verbose(GH_MSG_INFO, "overriding context profile mask from 0x%x to 0x%x\n",
-			   (unsigned)req_profile_mask, (unsigned)new_profile);
-		req_profile_mask = new_profile;
+	GH_glPopDebugGroup();
+}
+
+/* for GL_EXT_debug_marker, a length of 0 means NUL-terminated */
+extern void glPushGroupMarkerEXT(GLsizei length, const GLchar *marker)
+{
+	markers_group(marker, (length)?length:-1);
+	if (!GH_glPushGroupMarkerEXT) {
+		GH_GET_GL_PROC_OR_FAIL(glPushGroupMarkerEXT, GH_MSG_WARNING, );
 	}
-	if (opts->force_no_error >= 0) {
-		GH_verbose(GH_MSG_INFO, "overriding context NO_ERROR behavior from %d to %d\n",
-			   req_no_error, opts->force_no_error);
-		req_no_error = opts->force_no_error;
+	GH_glPushGroupMarkerEXT(length, marker);
+}
+
+extern void glPopGroupMarkerEXT(void)
+{
+	markers_group_end();
+	if (!GH_glPopGroupMarkerEXT) {
+		GH_GET_GL_PROC_OR_FAIL(glPopGroupMarkerEXT, GH_MSG_WARNING, );
 	}
+	GH_glPopGroupMarkerEXT();
+}
 
-	attr_override = malloc(sizeof(*attr_override) * ((additional_count + our_count) * 2 + 2));
-	if (!attr_override) {
-		GH_verbose(GH_MSG_ERROR, "overriding context attributes not possible: out of memory\n");
-		return NULL;
+extern void glInsertEventMarkerEXT(GLsizei length, const GLchar *marker)
+{
+	markers_event(marker, (length)?length:-1);
+	if (!GH_glInsertEventMarkerEXT) {
+		GH_GET_GL_PROC_OR_FAIL(glInsertEventMarkerEXT, GH_MSG_WARNING, );
 	}
+	GH_glInsertEventMarkerEXT(length, marker);
+}
 
-	GH_verbose(GH_MSG_INFO, "requesting GL %d.%d flags: 0x%x, profile: 0x%x\n",
-		   req_version[0], req_version[1], (unsigned)req_flags, (unsigned)req_profile_mask);
-	attr_override[pos++] = GLX_CONTEXT_MAJOR_VERSION_ARB;
-	attr_override[pos++] = req_version[0];
-	attr_override[pos++] = GLX_CONTEXT_MINOR_VERSION_ARB;
-	attr_override[pos++] = req_version[1];
-	attr_override[pos++] = GLX_CONTEXT_PROFILE_MASK_ARB;
-	attr_override[pos++] = req_profile_mask;
-	attr_override[pos++] = GLX_CONTEXT_FLAGS_ARB;
-	attr_override[pos++] = req_flags;
-	if (req_no_error >= 0) {
-		attr_override[pos++] = GLX_CONTEXT_OPENGL_NO_ERROR_ARB;
-		attr_override[pos++] = req_no_error;
+extern void glDebugMessageInsert(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length, const GLchar *buf)
+{
+	markers_event(buf, length);
+	if (!GH_glDebugMessageInsert) {
+		GH_GET_GL_PROC_OR_FAIL(glDebugMessageInsert, GH_MSG_WARNING, );
 	}
+	GH_glDebugMessageInsert(source, type, id, severity, length, buf);
+}
 
-	for (i=0; i<count; i++) {
-		unsigned int name = (unsigned)attribs[2*i];
-		int value = attribs[2*i+1];
-		switch (name) {
-			case GLX_CONTEXT_MAJOR_VERSION_ARB:
-			case GLX_CONTEXT_MINOR_VERSION_ARB:
-			case GLX_CONTEXT_PROFILE_MASK_ARB:
-			case GLX_CONTEXT_FLAGS_ARB:
-			case GLX_CONTEXT_OPENGL_NO_ERROR_ARB:
-				(void)0;
-				break;
-			default:
-				attr_override[pos++] = (int)name;
-				attr_override[pos++] = value;
-		}
+extern void glDebugMessageInsertARB(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length, const GLchar *buf)
+{
+	markers_event(buf, length);
+	if (!GH_glDebugMessageInsertARB) {
+		GH_GET_GL_PROC_OR_FAIL(glDebugMessageInsertARB, GH_MSG_WARNING, );
+	}
+	GH_glDebugMessageInsertARB(source, type, id, severity, length, buf);
+}
+
+/* for GL_GREMEDY_string_marker, a length of 0 means NUL-terminated */
+extern void glStringMarkerGREMEDY(GLsizei len, const void *string)
+{
+	markers_event((const GLchar*)string, (len)?len:-1);
+	if (!GH_glStringMarkerGREMEDY) {
+		GH_GET_GL_PROC_OR_FAIL(glStringMarkerGREMEDY, GH_MSG_WARNING, );
+	}
+	GH_glStringMarkerGREMEDY(len, string);
+}
+
+/* ---------- Startup Timeline ---------- */
+
+extern void glCompileShader(GLuint shader)
+{
+	uint64_t t0=(startup.enabled)?get_time_ns(CLOCK_MONOTONIC):0;
+	calls_current(GH_CALL_SHADER);
+	if (!GH_glCompileShader) {
+		GH_GET_GL_PROC_OR_FAIL(glCompileShader, GH_MSG_WARNING, );
+	}
+	GH_glCompileShader(shader);
+	if (t0) {
+		startup_shader(t0, get_time_ns(CLOCK_MONOTONIC), 0);
+	}
+}
+
+extern void glCompileShaderARB(GLhandleARB shader)
+{
+	uint64_t t0=(startup.enabled)?get_time_ns(CLOCK_MONOTONIC):0;
+	calls_current(GH_CALL_SHADER);
+	if (!GH_glCompileShaderARB) {
+		GH_GET_GL_PROC_OR_FAIL(glCompileShaderARB, GH_MSG_WARNING, );
+	}
+	GH_glCompileShaderARB(shader);
+	if (t0) {
+		startup_shader(t0, get_time_ns(CLOCK_MONOTONIC), 0);
+	}
+}
+
+extern void glLinkProgram(GLuint program)
+{
+	uint64_t t0=(startup.enabled)?get_time_ns(CLOCK_MONOTONIC):0;
+	calls_current(GH_CALL_SHADER);
+	if (!GH_glLinkProgram) {
+		GH_GET_GL_PROC_OR_FAIL(glLinkProgram, GH_MSG_WARNING, );
+	}
+	GH_glLinkProgram(program);
+	if (t0) {
+		startup_shader(t0, get_time_ns(CLOCK_MONOTONIC), 1);
+	}
+}
+
+extern void glLinkProgramARB(GLhandleARB program)
+{
+	uint64_t t0=(startup.enabled)?get_time_ns(CLOCK_MONOTONIC):0;
+	calls_current(GH_CALL_SHADER);
+	if (!GH_glLinkProgramARB) {
+		GH_GET_GL_PROC_OR_FAIL(glLinkProgramARB, GH_MSG_WARNING, );
+	}
+	GH_glLinkProgramARB(program);
+	if (t0) {
+		startup_shader(t0, get_time_ns(CLOCK_MONOTONIC), 1);
+	}
+}
+
+/* ---------- Stall Detector ---------- */
+
+/* the current context, if the stall detector is enabled */
+static gl_context_t *
+stalls_current(void)
+{
+	gl_context_t *glc=calls_current(GH_CALL_SYNC);
+	return (glc && glc->frametimes.stalls.enabled)?glc:NULL;
+}
+
+/* a timed call started at t0 (CLOCK_MONOTONIC) returned */
+static void
+stalls_end(gl_context_t *glc, GH_stall_func func, uint64_t t0, const void *caller)
+{
+	uint64_t dt=get_time_ns(CLOCK_MONOTONIC) - t0;
+
+	if (stall_record(&glc->frametimes.stalls, func, dt, caller) && (trace.file || glc->flight.size)) {
+		uint64_t t1=get_time_ns(CLOCK_REALTIME);
+		trace_span(stall_func_name[func], t1 - dt, t1);
+		flight_record(&glc->flight, GH_EVENT_STALL, t1 - dt, t1, (long long)(uintptr_t)caller);
 	}
-	attr_override[pos++] = None;
-	attr_override[pos++] = None;
+}
 
-	return attr_override;
+/* readbacks into a pixel pack buffer do not block */
+static int
+stalls_client_readback(void)
+{
+	return !gpu_mem_bound(GL_PIXEL_PACK_BUFFER_BINDING);
 }
 
-static const GLXFBConfig* get_fbconfig_for_visual(Display *dpy, XVisualInfo *vis, GLXFBConfig *cfg)
+extern void glReadPixels(GLint x, GLint y, GLsizei width, GLsizei height, GLenum format, GLenum type, GLvoid *pixels)
 {
-	GLXFBConfig *cfgs;
-	const GLXFBConfig *new_cfg = NULL;
-	/* TODO: what about the screen number? */
-	int screen=0;
-	int count;
+	gl_context_t *glc=stalls_current();
+	uint64_t t0=0;
+	if (!GH_glReadPixels) {
+		GH_GET_GL_PROC_OR_FAIL(glReadPixels, GH_MSG_WARNING, );
+	}
+	if (glc && stalls_client_readback()) {
+		t0=get_time_ns(CLOCK_MONOTONIC);
+	}
+	GH_glReadPixels(x, y, width, height, format, type, pixels);
+	if (t0) {
+		stalls_end(glc, GH_STALL_READ_PIXELS, t0, __builtin_return_address(0));
+	}
+}
 
-	GH_GET_PTR_GL(glXGetFBConfigs);
-	GH_GET_PTR_GL(glXGetFBConfigAttrib);
-	GH_GET_PTR(XFree);
+extern void glGetTexImage(GLenum target, GLint level, GLenum format, GLenum type, GLvoid *pixels)
+{
+	gl_context_t *glc=stalls_current();
+	uint64_t t0=0;
+	if (!GH_glGetTexImage) {
+		GH_GET_GL_PROC_OR_FAIL(glGetTexImage, GH_MSG_WARNING, );
+	}
+	if (glc && stalls_client_readback()) {
+		t0=get_time_ns(CLOCK_MONOTONIC);
+	}
+	GH_glGetTexImage(target, level, format, type, pixels);
+	if (t0) {
+		stalls_end(glc, GH_STALL_GET_TEX_IMAGE, t0, __builtin_return_address(0));
+	}
+}
 
-	if (!GH_glXGetFBConfigs || !GH_glXGetFBConfigAttrib || !GH_XFree) {
-		GH_verbose(GH_MSG_ERROR, "glXGetFBConfigs or glXGetFBConfigAttrib or XFree not found!\n");
-		return NULL;
+extern void glGetBufferSubData(GLenum target, GLintptr offset, GLsizeiptr size, void *data)
+{
+	gl_context_t *glc=stalls_current();
+	uint64_t t0=(glc)?get_time_ns(CLOCK_MONOTONIC):0;
+	if (!GH_glGetBufferSubData) {
+		GH_GET_GL_PROC_OR_FAIL(glGetBufferSubData, GH_MSG_WARNING, );
+	}
+	GH_glGetBufferSubData(target, offset, size, data);
+	if (t0) {
+		stalls_end(glc, GH_STALL_GET_BUFFER_SUB_DATA, t0, __builtin_return_address(0));
 	}
+}
 
-	cfgs=GH_glXGetFBConfigs(dpy, screen, &count);
+/* only GL_QUERY_RESULT waits for the result, GL_QUERY_RESULT_AVAILABLE
+ * and GL_QUERY_RESULT_NO_WAIT do not */
+#define GH_STALL_QUERY(pname, glc) \
+	(((pname) == GL_QUERY_RESULT && (glc))?get_time_ns(CLOCK_MONOTONIC):0)
 
-	if (cfgs && count > 0) {
-		int i;
-		for (i=0; i<count; i++) {
-			int value = -1;
-			int res = GH_glXGetFBConfigAttrib(dpy, cfgs[i], GLX_VISUAL_ID, &value);
-			if (res == Success) {
-				GH_verbose(GH_MSG_DEBUG, "fbconfig %d for visual ID %d\n", i, value);
-				if (value == (int)vis->visualid) {
-					GH_verbose(GH_MSG_INFO, "found fbconfig %d for visual ID %d\n", i, value);
-					*cfg = cfgs[i];
-					new_cfg=cfg;
-					break;
-				}
-			} else {
-				GH_verbose(GH_MSG_WARNING, "glxGerFBConfigAttrib failed!\n");
-			}
-		}
+extern void glGetQueryObjectiv(GLuint id, GLenum pname, GLint *params)
+{
+	gl_context_t *glc=stalls_current();
+	uint64_t t0=GH_STALL_QUERY(pname, glc);
+	if (!GH_glGetQueryObjectiv) {
+		GH_GET_GL_PROC_OR_FAIL(glGetQueryObjectiv, GH_MSG_WARNING, );
 	}
-
-	if (cfgs) {
-		GH_XFree(cfgs);
+	GH_glGetQueryObjectiv(id, pname, params);
+	if (t0) {
+		stalls_end(glc, GH_STALL_GET_QUERY_OBJECTIV, t0, __builtin_return_address(0));
 	}
+}
 
-	return new_cfg;
+extern void glGetQueryObjectuiv(GLuint id, GLenum pname, GLuint *params)
+{
+	gl_context_t *glc=stalls_current();
+	uint64_t t0=GH_STALL_QUERY(pname, glc);
+	if (!GH_glGetQueryObjectuiv) {
+		GH_GET_GL_PROC_OR_FAIL(glGetQueryObjectuiv, GH_MSG_WARNING, );
+	}
+	GH_glGetQueryObjectuiv(id, pname, params);
+	if (t0) {
+		stalls_end(glc, GH_STALL_GET_QUERY_OBJECTUIV, t0, __builtin_return_address(0));
+	}
 }
 
-static GLXContext override_create_context(Display *dpy, XVisualInfo *vis, const GLXFBConfig *fbconfig, GLXContext shareList, Bool direct, const int *attribs)
+extern void glGetQueryObjecti64v(GLuint id, GLenum pname, GLint64 *params)
 {
-	GLXFBConfig internal_fbconfig;
+	gl_context_t *glc=stalls_current();
+	uint64_t t0=GH_STALL_QUERY(pname, glc);
+	if (!GH_glGetQueryObjecti64v) {
+		GH_GET_GL_PROC_OR_FAIL(glGetQueryObjecti64v, GH_MSG_WARNING, );
+	}
+	GH_glGetQueryObjecti64v(id, pname, params);
+	if (t0) {
+		stalls_end(glc, GH_STALL_GET_QUERY_OBJECTI64V, t0, __builtin_return_address(0));
+	}
+}
 
-	pthread_mutex_lock(&ctx_creation_opts.mutex);
-	if (!(ctx_creation_opts.flags & GH_GLCTX_CREATE_INITIALIZED)) {
-		context_creation_opts_init(&ctx_creation_opts);
-		ctx_creation_opts.flags |= GH_GLCTX_CREATE_INITIALIZED;
+extern void glGetQueryObjectui64v(GLuint id, GLenum pname, GLuint64 *params)
+{
+	gl_context_t *glc=stalls_current();
+	uint64_t t0=GH_STALL_QUERY(pname, glc);
+	if (!GH_glGetQueryObjectui64v) {
+		GH_GET_GL_PROC_OR_FAIL(glGetQueryObjectui64v, GH_MSG_WARNING, );
 	}
-	pthread_mutex_unlock(&ctx_creation_opts.mutex);
+	GH_glGetQueryObjectui64v(id, pname, params);
+	if (t0) {
+		stalls_end(glc, GH_STALL_GET_QUERY_OBJECTUI64V, t0, __builtin_return_address(0));
+	}
+}
 
-	if (need_creation_override(&ctx_creation_opts)) {
-		GLXContext ctx = NULL;
-		int *attribs_override = get_override_attributes(&ctx_creation_opts, attribs);
-		if (!attribs_override) {
-			GH_verbose(GH_MSG_WARNING, "failed to generate context creation override attributes!\n");
-			return NULL;
-		}
-		if (!fbconfig) {
-			if (!vis) {
-				GH_verbose(GH_MSG_WARNING, "create context attempt without Visual and FBConfig!\n");
-				free(attribs_override);
-				return NULL;	
-			}
-			/* find FBConfig vor Visual ... */
-			fbconfig=get_fbconfig_for_visual(dpy, vis, &internal_fbconfig);
-			if (!fbconfig) {
-				GH_verbose(GH_MSG_WARNING, "create context: failed to get fbconfig for visual!\n");
-				free(attribs_override);
-				return NULL;	
-			}
-		}
-		GH_GET_GL_PROC(glXCreateContextAttribsARB);
-		if (GH_glXCreateContextAttribsARB) {
-			ctx=GH_glXCreateContextAttribsARB(dpy, *fbconfig, shareList, direct, attribs_override);
-		} else {
-			GH_verbose(GH_MSG_WARNING, "failed to get glXCreateContextAttribsARB\n");
-		}
-		if (ctx == NULL) {
-			GH_verbose(GH_MSG_WARNING, "overridden context creation failed!\n");
-		} else {
-			GH_verbose(GH_MSG_INFO, "created context %p with overriden attributes!\n", ctx);
-		}
-		free(attribs_override);
-		return ctx;
+extern void glFinish(void)
+{
+	gl_context_t *glc=stalls_current();
+	uint64_t t0=(glc)?get_time_ns(CLOCK_MONOTONIC):0;
+	if (!GH_glFinish) {
+		GH_GET_GL_PROC_OR_FAIL(glFinish, GH_MSG_WARNING, );
+	}
+	GH_glFinish();
+	if (t0) {
+		stalls_end(glc, GH_STALL_FINISH, t0, __builtin_return_address(0));
+	}
+}
 
+extern GLenum glClientWaitSync(GLsync sync, GLbitfield flags, GLuint64 timeout)
+{
+	gl_context_t *glc=stalls_current();
+	/* a timeout of 0 just polls the state */
+	uint64_t t0=(glc && timeout)?get_time_ns(CLOCK_MONOTONIC):0;
+	GLenum result;
+	if (!GH_glClientWaitSync) {
+		GH_GET_GL_PROC_OR_FAIL(glClientWaitSync, GH_MSG_WARNING, GL_WAIT_FAILED);
 	}
-	return NULL;
+	result=GH_glClientWaitSync(sync, flags, timeout);
+	if (t0) {
+		stalls_end(glc, GH_STALL_CLIENT_WAIT_SYNC, t0, __builtin_return_address(0));
+	}
+	return result;
 }
 
-#endif /* GH_CONTEXT_TRACKING */
+/* ---------- Upload Accounting ---------- */
 
-/***************************************************************************
- * SWAP INTERVAL LOGIC                                                     *
- ***************************************************************************/
+/* the upload counters of the current context, if enabled */
+static GH_uploads *
+uploads_current(void)
+{
+	gl_context_t *glc=calls_current(GH_CALL_UPLOAD);
+	return (glc && glc->frametimes.uploads.enabled)?&glc->frametimes.uploads:NULL;
+}
 
-/* possible GH_SWAP_MODEs */
-typedef enum {
-	GH_SWAP_MODE_NOP=0,	/* do not change anything */
-	GH_SWAP_MODE_IGNORE,	/* ignore all attempts to set swap interval */
-	GH_SWAP_MODE_CLAMP,	/* clamp interval to (a,b) */
-	GH_SWAP_MODE_FORCE,	/* force interval to a */
-	GH_SWAP_MODE_DISABLE,	/* force interval to 0 */
-	GH_SWAP_MODE_ENABLE,	/* force interval to >= 1 */
-	GH_SWAP_MODE_MIN,	/* force interval to >= a */
-	GH_SWAP_MODE_MAX,	/* force interval to <= a */
-	/* always add new elements here */
-	GH_SWAP_MODES_COUNT
-} GH_swap_mode;
+/* the tracked GPU memory of the current context, if enabled */
+static GH_gpu_memory *
+gpu_mem_current(void)
+{
+	gl_context_t *glc=calls_current(GH_CALL_MEMORY);
+	return (glc && glc->frametimes.gpumem.enabled)?&glc->frametimes.gpumem:NULL;
+}
 
-/* possible GH_SWAP_TEAR modes */
-typedef enum {
-	GH_SWAP_TEAR_RAW,	/* handle interval as if normal */
-	GH_SWAP_TEAR_KEEP,	/* keep tearing control as requested */
-	GH_SWAP_TEAR_DISABLE,	/* always disbale adaptive vsync */
-	GH_SWAP_TEAR_ENABLE,	/* enable adaptive vsync */
-	GH_SWAP_TEAR_INVERT,	/* could one ever need this? */
-	/* always add new elements here */
-	GH_SWAP_TEAR_COUNT
-} GH_swap_tear;
+extern void glTexImage1D(GLenum target, GLint level, GLint internalFormat, GLsizei width, GLint border, GLenum format, GLenum type, const GLvoid *pixels)
+{
+	GH_uploads *up=uploads_current();
+	GH_gpu_memory *gm=gpu_mem_current();
+	if (up) {
+		upload_texture(up, format, type, width, 1, 1, pixels);
+	}
+	if (gm) {
+		gpu_mem_texture(gm, target, level, (GLenum)internalFormat, width, 1, 1, 0);
+	}
+	if (!GH_glTexImage1D) {
+		GH_GET_GL_PROC_OR_FAIL(glTexImage1D, GH_MSG_WARNING, );
+	}
+	GH_glTexImage1D(target, level, internalFormat, width, border, format, type, pixels);
+}
 
-typedef struct {
-	GH_swap_mode swap_mode;
-	GH_swap_tear swap_tear;
-	int swap_param[2];
-} GH_config;
+extern void glTexImage2D(GLenum target, GLint level, GLint internalFormat, GLsizei width, GLsizei height, GLint border, GLenum format, GLenum type, const GLvoid *pixels)
+{
+	GH_uploads *up=uploads_current();
+	GH_gpu_memory *gm=gpu_mem_current();
+	if (up) {
+		upload_texture(up, format, type, width, height, 1, pixels);
+	}
+	if (gm) {
+		gpu_mem_texture(gm, target, level, (GLenum)internalFormat, width, height, 1, 0);
+	}
+	if (!GH_glTexImage2D) {
+		GH_GET_GL_PROC_OR_FAIL(glTexImage2D, GH_MSG_WARNING, );
+	}
+	GH_glTexImage2D(target, level, internalFormat, width, height, border, format, type, pixels);
+}
 
-static void GH_swap_mode_from_str(GH_config volatile *cfg, const char *str)
+extern void glTexImage3D(GLenum target, GLint level, GLint internalFormat, GLsizei width, GLsizei height, GLsizei depth, GLint border, GLenum format, GLenum type, const GLvoid *pixels)
 {
-	static const char *mode_str[GH_SWAP_MODES_COUNT+1]={
-		"nop",
-		"ignore",
-		"clamp",
-		"force",
-		"disable",
-		"enable",
-		"min",
-		"max",
-		NULL
-	};
+	GH_uploads *up=uploads_current();
+	GH_gpu_memory *gm=gpu_mem_current();
+	if (up) {
+		upload_texture(up, format, type, width, height, depth, pixels);
+	}
+	if (gm) {
+		gpu_mem_texture(gm, target, level, (GLenum)internalFormat, width, height, depth, 0);
+	}
+	if (!GH_glTexImage3D) {
+		GH_GET_GL_PROC_OR_FAIL(glTexImage3D, GH_MSG_WARNING, );
+	}
+	GH_glTexImage3D(target, level, internalFormat, width, height, depth, border, format, type, pixels);
+}
 
-	size_t l=0;
-	int idx;
-	char *nstr;
+extern void glTexSubImage1D(GLenum target, GLint level, GLint xoffset, GLsizei width, GLenum format, GLenum type, const GLvoid *pixels)
+{
+	GH_uploads *up=uploads_current();
+	if (up) {
+		upload_texture(up, format, type, width, 1, 1, pixels);
+	}
+	if (!GH_glTexSubImage1D) {
+		GH_GET_GL_PROC_OR_FAIL(glTexSubImage1D, GH_MSG_WARNING, );
+	}
+	GH_glTexSubImage1D(target, level, xoffset, width, format, type, pixels);
+}
 
-	cfg->swap_mode=GH_SWAP_MODE_NOP;
-	
-	if (str == NULL)
-		return;
+extern void glTexSubImage2D(GLenum target, GLint level, GLint xoffset, GLint yoffset, GLsizei width, GLsizei height, GLenum format, GLenum type, const GLvoid *pixels)
+{
+	GH_uploads *up=uploads_current();
+	if (up) {
+		upload_texture(up, format, type, width, height, 1, pixels);
+	}
+	if (!GH_glTexSubImage2D) {
+		GH_GET_GL_PROC_OR_FAIL(glTexSubImage2D, GH_MSG_WARNING, );
+	}
+	GH_glTexSubImage2D(target, level, xoffset, yoffset, width, height, format, type, pixels);
+}
 
-	for (idx=0; mode_str[idx]; idx++) {
-		l=strlen(mode_str[idx]);
-		if (!strncmp(str, mode_str[idx], l)) {
-			break;
-		}
+extern void glTexSubImage3D(GLenum target, GLint level, GLint xoffset, GLint yoffset, GLint zoffset, GLsizei width, GLsizei height, GLsizei depth, GLenum format, GLenum type, const GLvoid *pixels)
+{
+	GH_uploads *up=uploads_current();
+	if (up) {
+		upload_texture(up, format, type, width, height, depth, pixels);
 	}
+	if (!GH_glTexSubImage3D) {
+		GH_GET_GL_PROC_OR_FAIL(glTexSubImage3D, GH_MSG_WARNING, );
+	}
+	GH_glTexSubImage3D(target, level, xoffset, yoffset, zoffset, width, height, depth, format, type, pixels);
+}
 
-	if (idx >= 0 && idx<(int)GH_SWAP_MODES_COUNT) {
-		cfg->swap_mode=(GH_swap_mode)idx;
+extern void glCompressedTexImage1D(GLenum target, GLint level, GLenum internalformat, GLsizei width, GLint border, GLsizei imageSize, const GLvoid *data)
+{
+	GH_uploads *up=uploads_current();
+	GH_gpu_memory *gm=gpu_mem_current();
+	if (up) {
+		upload_compressed(up, imageSize, data);
+	}
+	if (gm) {
+		gpu_mem_texture(gm, target, level, internalformat, width, 1, 1, (imageSize > 0)?(uint64_t)imageSize:0);
 	}
+	if (!GH_glCompressedTexImage1D) {
+		GH_GET_GL_PROC_OR_FAIL(glCompressedTexImage1D, GH_MSG_WARNING, );
+	}
+	GH_glCompressedTexImage1D(target, level, internalformat, width, border, imageSize, data);
+}
 
-	str += l;
+extern void glCompressedTexImage2D(GLenum target, GLint level, GLenum internalformat, GLsizei width, GLsizei height, GLint border, GLsizei imageSize, const GLvoid *data)
+{
+	GH_uploads *up=uploads_current();
+	GH_gpu_memory *gm=gpu_mem_current();
+	if (up) {
+		upload_compressed(up, imageSize, data);
+	}
+	if (gm) {
+		gpu_mem_texture(gm, target, level, internalformat, width, height, 1, (imageSize > 0)?(uint64_t)imageSize:0);
+	}
+	if (!GH_glCompressedTexImage2D) {
+		GH_GET_GL_PROC_OR_FAIL(glCompressedTexImage2D, GH_MSG_WARNING, );
+	}
+	GH_glCompressedTexImage2D(target, level, internalformat, width, height, border, imageSize, data);
+}
 
-	/* read up to 2 ints as arguments */
-	while(*str && !isdigit(*str))
-		str++;
-	cfg->swap_param[0]=(int)strtol(str, &nstr, 0);
-	str=nstr;
-	while(*str && !isdigit(*str))
-		str++;
-	cfg->swap_param[1]=(int)strtol(str, &nstr,0);
-	GH_verbose(GH_MSG_DEBUG, "SWAP_MODE: %d %d %d\n",
-				cfg->swap_mode,cfg->swap_param[0],cfg->swap_param[1]);
+extern void glCompressedTexImage3D(GLenum target, GLint level, GLenum internalformat, GLsizei width, GLsizei height, GLsizei depth, GLint border, GLsizei imageSize, const GLvoid *data)
+{
+	GH_uploads *up=uploads_current();
+	GH_gpu_memory *gm=gpu_mem_current();
+	if (up) {
+		upload_compressed(up, imageSize, data);
+	}
+	if (gm) {
+		gpu_mem_texture(gm, target, level, internalformat, width, height, depth, (imageSize > 0)?(uint64_t)imageSize:0);
+	}
+	if (!GH_glCompressedTexImage3D) {
+		GH_GET_GL_PROC_OR_FAIL(glCompressedTexImage3D, GH_MSG_WARNING, );
+	}
+	GH_glCompressedTexImage3D(target, level, internalformat, width, height, depth, border, imageSize, data);
 }
 
-static void GH_swap_tear_from_str(GH_config volatile *cfg, const char *str)
+extern void glCompressedTexSubImage1D(GLenum target, GLint level, GLint xoffset, GLsizei width, GLenum format, GLsizei imageSize, const GLvoid *data)
 {
-	static const char *mode_str[GH_SWAP_TEAR_COUNT+1]={
-		"raw",
-		"keep",
-		"disable",
-		"enable",
-		"invert",
+	GH_uploads *up=uploads_current();
+	if (up) {
+		upload_compressed(up, imageSize, data);
+	}
+	if (!GH_glCompressedTexSubImage1D) {
+		GH_GET_GL_PROC_OR_FAIL(glCompressedTexSubImage1D, GH_MSG_WARNING, );
+	}
+	GH_glCompressedTexSubImage1D(target, level, xoffset, width, format, imageSize, data);
+}
 
-		NULL
-	};
+extern void glCompressedTexSubImage2D(GLenum target, GLint level, GLint xoffset, GLint yoffset, GLsizei width, GLsizei height, GLenum format, GLsizei imageSize, const GLvoid *data)
+{
+	GH_uploads *up=uploads_current();
+	if (up) {
+		upload_compressed(up, imageSize, data);
+	}
+	if (!GH_glCompressedTexSubImage2D) {
+		GH_GET_GL_PROC_OR_FAIL(glCompressedTexSubImage2D, GH_MSG_WARNING, );
+	}
+	GH_glCompressedTexSubImage2D(target, level, xoffset, yoffset, width, height, format, imageSize, data);
+}
 
-	int idx;
+extern void glCompressedTexSubImage3D(GLenum target, GLint level, GLint xoffset, GLint yoffset, GLint zoffset, GLsizei width, GLsizei height, GLsizei depth, GLenum format, GLsizei imageSize, const GLvoid *data)
+{
+	GH_uploads *up=uploads_current();
+	if (up) {
+		upload_compressed(up, imageSize, data);
+	}
+	if (!GH_glCompressedTexSubImage3D) {
+		GH_GET_GL_PROC_OR_FAIL(glCompressedTexSubImage3D, GH_MSG_WARNING, );
+	}
+	GH_glCompressedTexSubImage3D(target, level, xoffset, yoffset, zoffset, width, height, depth, format, imageSize, data);
+}
 
-	cfg->swap_tear=GH_SWAP_TEAR_KEEP;
-	
-	if (str == NULL)
-		return;
+extern void glBufferData(GLenum target, GLsizeiptr size, const void *data, GLenum usage)
+{
+	GH_uploads *up=uploads_current();
+	GH_gpu_memory *gm=gpu_mem_current();
+	if (up) {
+		upload_buffer(up, size, data);
+	}
+	if (gm) {
+		gpu_mem_buffer(gm, target, size);
+	}
+	if (!GH_glBufferData) {
+		GH_GET_GL_PROC_OR_FAIL(glBufferData, GH_MSG_WARNING, );
+	}
+	GH_glBufferData(target, size, data, usage);
+}
+
+extern void glBufferSubData(GLenum target, GLintptr offset, GLsizeiptr size, const void *data)
+{
+	GH_uploads *up=uploads_current();
+	if (up) {
+		upload_buffer(up, size, data);
+	}
+	if (!GH_glBufferSubData) {
+		GH_GET_GL_PROC_OR_FAIL(glBufferSubData, GH_MSG_WARNING, );
+	}
+	GH_glBufferSubData(target, offset, size, data);
+}
 
-	for (idx=0; mode_str[idx]; idx++) {
-		if (!strcmp(str, mode_str[idx])) {
-			break;
+extern void *glMapBuffer(GLenum target, GLenum access)
+{
+	GH_uploads *up=uploads_current();
+	gl_context_t *glc=stalls_current();
+	uint64_t t0=(glc)?get_time_ns(CLOCK_MONOTONIC):0;
+	void *ptr;
+	if (!GH_glMapBuffer) {
+		GH_GET_GL_PROC_OR_FAIL(glMapBuffer, GH_MSG_WARNING, NULL);
+	}
+	ptr=GH_glMapBuffer(target, access);
+	if (t0) {
+		stalls_end(glc, GH_STALL_MAP_BUFFER, t0, __builtin_return_address(0));
+	}
+	if (up && ptr && access != GL_READ_ONLY) {
+		GLint size=0;
+		if (!GH_glGetBufferParameteriv) {
+			GH_GET_GL_PROC(glGetBufferParameteriv);
 		}
+		if (GH_glGetBufferParameteriv) {
+			GH_glGetBufferParameteriv(target, GL_BUFFER_SIZE, &size);
+		}
+		upload_map(up, (long long)size);
 	}
+	return ptr;
+}
 
-	if (idx >= 0 && idx<(int)GH_SWAP_MODES_COUNT) {
-		cfg->swap_tear=(GH_swap_mode)idx;
+extern void *glMapBufferRange(GLenum target, GLintptr offset, GLsizeiptr length, GLbitfield access)
+{
+	GH_uploads *up=uploads_current();
+	gl_context_t *glc=stalls_current();
+	/* unsynchronized maps do not wait for the GPU */
+	uint64_t t0=(glc && !(access & GL_MAP_UNSYNCHRONIZED_BIT))?get_time_ns(CLOCK_MONOTONIC):0;
+	void *ptr;
+	if (!GH_glMapBufferRange) {
+		GH_GET_GL_PROC_OR_FAIL(glMapBufferRange, GH_MSG_WARNING, NULL);
+	}
+	ptr=GH_glMapBufferRange(target, offset, length, access);
+	if (t0) {
+		stalls_end(glc, GH_STALL_MAP_BUFFER_RANGE, t0, __builtin_return_address(0));
 	}
+	if (up && ptr) {
+		upload_map_range(up, (long long)length, access);
+	}
+	return ptr;
 }
 
-static int GH_swap_interval_absolute(const volatile GH_config *cfg, int interval)
+extern void glFlushMappedBufferRange(GLenum target, GLintptr offset, GLsizeiptr length)
 {
-	int new_interval;
+	GH_uploads *up=uploads_current();
+	if (up) {
+		upload_map(up, (long long)length);
+	}
+	if (!GH_glFlushMappedBufferRange) {
+		GH_GET_GL_PROC_OR_FAIL(glFlushMappedBufferRange, GH_MSG_WARNING, );
+	}
+	GH_glFlushMappedBufferRange(target, offset, length);
+}
 
-	switch(cfg->swap_mode) {
-		case GH_SWAP_MODE_IGNORE:
-			new_interval=GH_SWAP_DONT_SET;
-			break;
-		case GH_SWAP_MODE_CLAMP:
-			new_interval=interval;
-			if (new_interval < cfg->swap_param[0])
-				new_interval=cfg->swap_param[0];
-			if (new_interval > cfg->swap_param[1])
-				interval=cfg->swap_param[1];
-			break;
-		case GH_SWAP_MODE_FORCE:
-			new_interval=cfg->swap_param[0];
-			break;
-		case GH_SWAP_MODE_DISABLE:
-			new_interval=0;
-			break;
-		case GH_SWAP_MODE_ENABLE:
-			new_interval=interval;
-			if (new_interval < 1)
-				new_interval=1;
-			break;
-		case GH_SWAP_MODE_MIN:
-			new_interval=interval;
-			if (new_interval < cfg->swap_param[0])
-				new_interval=cfg->swap_param[0];
-			break;
-		case GH_SWAP_MODE_MAX:
-			new_interval=interval;
-			if (new_interval > cfg->swap_param[0])
-				new_interval=cfg->swap_param[0];
-			break;
-		default:
-			new_interval=interval;
+extern void glBufferDataARB(GLenum target, GLsizeiptrARB size, const void *data, GLenum usage)
+{
+	GH_uploads *up=uploads_current();
+	GH_gpu_memory *gm=gpu_mem_current();
+	if (up) {
+		upload_buffer(up, size, data);
 	}
+	if (gm) {
+		gpu_mem_buffer(gm, target, size);
+	}
+	if (!GH_glBufferDataARB) {
+		GH_GET_GL_PROC_OR_FAIL(glBufferDataARB, GH_MSG_WARNING, );
+	}
+	GH_glBufferDataARB(target, size, data, usage);
+}
 
-	GH_verbose(GH_MSG_DEBUG,"swap interval, absolute value %d -> %d\n", interval, new_interval);
-	return new_interval;
+extern void glBufferSubDataARB(GLenum target, GLintptrARB offset, GLsizeiptrARB size, const void *data)
+{
+	GH_uploads *up=uploads_current();
+	if (up) {
+		upload_buffer(up, size, data);
+	}
+	if (!GH_glBufferSubDataARB) {
+		GH_GET_GL_PROC_OR_FAIL(glBufferSubDataARB, GH_MSG_WARNING, );
+	}
+	GH_glBufferSubDataARB(target, offset, size, data);
 }
 
-static int GH_swap_interval_base(const volatile GH_config *cfg, int interval)
+extern void *glMapBufferARB(GLenum target, GLenum access)
 {
-	int sign_interval;
-	int abs_interval;
-	int new_interval;
+	GH_uploads *up=uploads_current();
+	void *ptr;
+	if (!GH_glMapBufferARB) {
+		GH_GET_GL_PROC_OR_FAIL(glMapBufferARB, GH_MSG_WARNING, NULL);
+	}
+	ptr=GH_glMapBufferARB(target, access);
+	if (up && ptr && access != GL_READ_ONLY) {
+		GLint size=0;
+		if (!GH_glGetBufferParameteriv) {
+			GH_GET_GL_PROC(glGetBufferParameteriv);
+		}
+		if (GH_glGetBufferParameteriv) {
+			GH_glGetBufferParameteriv(target, GL_BUFFER_SIZE, &size);
+		}
+		upload_map(up, (long long)size);
+	}
+	return ptr;
+}
 
-	if (cfg->swap_tear == GH_SWAP_TEAR_RAW) {
-		sign_interval=0;
-		abs_interval=interval; /* moght be negative */
-	} else 	if (interval < 0) {
-		sign_interval=-1;
-		abs_interval=-interval;
-	} else {
-		sign_interval=1;
-		abs_interval=interval;
+/* direct state access variants (GL 4.5 / ARB_direct_state_access) */
+
+extern void glTextureSubImage1D(GLuint texture, GLint level, GLint xoffset, GLsizei width, GLenum format, GLenum type, const void *pixels)
+{
+	GH_uploads *up=uploads_current();
+	if (up) {
+		upload_texture(up, format, type, width, 1, 1, pixels);
+	}
+	if (!GH_glTextureSubImage1D) {
+		GH_GET_GL_PROC_OR_FAIL(glTextureSubImage1D, GH_MSG_WARNING, );
 	}
+	GH_glTextureSubImage1D(texture, level, xoffset, width, format, type, pixels);
+}
 
-	abs_interval=GH_swap_interval_absolute(cfg, abs_interval);
-	if (abs_interval == GH_SWAP_DONT_SET) {
-		GH_verbose(GH_MSG_INFO,"swap interval %d setting ignored\n",
-					interval);
-		return GH_SWAP_DONT_SET;
+extern void glTextureSubImage2D(GLuint texture, GLint level, GLint xoffset, GLint yoffset, GLsizei width, GLsizei height, GLenum format, GLenum type, const void *pixels)
+{
+	GH_uploads *up=uploads_current();
+	if (up) {
+		upload_texture(up, format, type, width, height, 1, pixels);
+	}
+	if (!GH_glTextureSubImage2D) {
+		GH_GET_GL_PROC_OR_FAIL(glTextureSubImage2D, GH_MSG_WARNING, );
 	}
+	GH_glTextureSubImage2D(texture, level, xoffset, yoffset, width, height, format, type, pixels);
+}
 
-	/* set sign based on GH_SWAP_TEAR mode */
-	switch (cfg->swap_tear) {
-		case GH_SWAP_TEAR_KEEP:
-			new_interval=abs_interval * sign_interval;
-			break;
-		case GH_SWAP_TEAR_DISABLE:
-			new_interval=abs_interval;
-			break;
-		case GH_SWAP_TEAR_ENABLE:
-			new_interval=-abs_interval;
-			break;
-		case GH_SWAP_TEAR_INVERT:
-			new_interval=abs_interval * (-sign_interval);
-			break;
-		default:
-			new_interval=abs_interval;	
+extern void glTextureSubImage3D(GLuint texture, GLint level, GLint xoffset, GLint yoffset, GLint zoffset, GLsizei width, GLsizei height, GLsizei depth, GLenum format, GLenum type, const void *pixels)
+{
+	GH_uploads *up=uploads_current();
+	if (up) {
+		upload_texture(up, format, type, width, height, depth, pixels);
 	}
+	if (!GH_glTextureSubImage3D) {
+		GH_GET_GL_PROC_OR_FAIL(glTextureSubImage3D, GH_MSG_WARNING, );
+	}
+	GH_glTextureSubImage3D(texture, level, xoffset, yoffset, zoffset, width, height, depth, format, type, pixels);
+}
 
-	GH_verbose(GH_MSG_INFO,"swap interval %d -> %d\n", interval, new_interval);
-	return new_interval;
+extern void glCompressedTextureSubImage1D(GLuint texture, GLint level, GLint xoffset, GLsizei width, GLenum format, GLsizei imageSize, const void *data)
+{
+	GH_uploads *up=uploads_current();
+	if (up) {
+		upload_compressed(up, imageSize, data);
+	}
+	if (!GH_glCompressedTextureSubImage1D) {
+		GH_GET_GL_PROC_OR_FAIL(glCompressedTextureSubImage1D, GH_MSG_WARNING, );
+	}
+	GH_glCompressedTextureSubImage1D(texture, level, xoffset, width, format, imageSize, data);
 }
 
-static int GH_swap_interval(int interval)
+extern void glCompressedTextureSubImage2D(GLuint texture, GLint level, GLint xoffset, GLint yoffset, GLsizei width, GLsizei height, GLenum format, GLsizei imageSize, const void *data)
 {
-	static pthread_mutex_t mutex=PTHREAD_MUTEX_INITIALIZER;
-	static volatile GH_config cfg={GH_SWAP_MODES_COUNT, GH_SWAP_TEAR_KEEP, {0,1}};
+	GH_uploads *up=uploads_current();
+	if (up) {
+		upload_compressed(up, imageSize, data);
+	}
+	if (!GH_glCompressedTextureSubImage2D) {
+		GH_GET_GL_PROC_OR_FAIL(glCompressedTextureSubImage2D, GH_MSG_WARNING, );
+	}
+	GH_glCompressedTextureSubImage2D(texture, level, xoffset, yoffset, width, height, format, imageSize, data);
+}
 
-	pthread_mutex_lock(&mutex);
-	if (cfg.swap_mode >= GH_SWAP_MODES_COUNT) {
-		GH_swap_mode_from_str(&cfg, getenv("GH_SWAP_MODE"));
-		GH_swap_tear_from_str(&cfg, getenv("GH_SWAP_TEAR"));
+extern void glCompressedTextureSubImage3D(GLuint texture, GLint level, GLint xoffset, GLint yoffset, GLint zoffset, GLsizei width, GLsizei height, GLsizei depth, GLenum format, GLsizei imageSize, const void *data)
+{
+	GH_uploads *up=uploads_current();
+	if (up) {
+		upload_compressed(up, imageSize, data);
 	}
-	pthread_mutex_unlock(&mutex);
-	return GH_swap_interval_base(&cfg, interval);
+	if (!GH_glCompressedTextureSubImage3D) {
+		GH_GET_GL_PROC_OR_FAIL(glCompressedTextureSubImage3D, GH_MSG_WARNING, );
+	}
+	GH_glCompressedTextureSubImage3D(texture, level, xoffset, yoffset, zoffset, width, height, depth, format, imageSize, data);
 }
 
+extern void glNamedBufferData(GLuint buffer, GLsizeiptr size, const void *data, GLenum usage)
+{
+	GH_uploads *up=uploads_current();
+	if (up) {
+		upload_buffer(up, size, data);
+	}
+	if (!GH_glNamedBufferData) {
+		GH_GET_GL_PROC_OR_FAIL(glNamedBufferData, GH_MSG_WARNING, );
+	}
+	GH_glNamedBufferData(buffer, size, data, usage);
+}
 
-/***************************************************************************
- * INTERCEPTED FUNCTIONS: libdl/libc                                       *
- ***************************************************************************/
+extern void glNamedBufferSubData(GLuint buffer, GLintptr offset, GLsizeiptr size, const void *data)
+{
+	GH_uploads *up=uploads_current();
+	if (up) {
+		upload_buffer(up, size, data);
+	}
+	if (!GH_glNamedBufferSubData) {
+		GH_GET_GL_PROC_OR_FAIL(glNamedBufferSubData, GH_MSG_WARNING, );
+	}
+	GH_glNamedBufferSubData(buffer, offset, size, data);
+}
 
-/* intercept dlsym() itself */
-extern void *
-dlsym(void *handle, const char *name)
+extern void *glMapNamedBuffer(GLuint buffer, GLenum access)
 {
-	void *interceptor;
+	GH_uploads *up=uploads_current();
 	void *ptr;
-	/* special case: we cannot use GH_GET_PTR as it relies on
-	 * GH_dlsym() which we have to query using GH_dlsym_internal */
-	pthread_mutex_lock(&GH_fptr_mutex);
-	GH_dlsym_internal_dlsym();
-	pthread_mutex_unlock(&GH_fptr_mutex);
-	interceptor=GH_get_interceptor(name, GH_dlsym_next, "dlsym");
-	ptr=(interceptor)?interceptor:GH_dlsym(handle,name);
-	GH_verbose(GH_MSG_DEBUG_INTERCEPTION,"dlsym(%p, %s) = %p%s\n",handle,name,ptr,
-		interceptor?" [intercepted]":"");
+	if (!GH_glMapNamedBuffer) {
+		GH_GET_GL_PROC_OR_FAIL(glMapNamedBuffer, GH_MSG_WARNING, NULL);
+	}
+	ptr=GH_glMapNamedBuffer(buffer, access);
+	if (up && ptr && access != GL_READ_ONLY) {
+		GLint size=0;
+		if (!GH_glGetNamedBufferParameteriv) {
+			GH_GET_GL_PROC(glGetNamedBufferParameteriv);
+		}
+		if (GH_glGetNamedBufferParameteriv) {
+			GH_glGetNamedBufferParameteriv(buffer, GL_BUFFER_SIZE, &size);
+		}
+		upload_map(up, (long long)size);
+	}
 	return ptr;
 }
 
-#if (GH_DLSYM_METHOD != 2)
-/* Also intercept GNU specific dlvsym().
- * We can do this only if we are not using dlvsym to query dlsym... */
-extern void *
-dlvsym(void *handle, const char *name, const char *version)
+extern void *glMapNamedBufferRange(GLuint buffer, GLintptr offset, GLsizeiptr length, GLbitfield access)
 {
-	void *interceptor;
+	GH_uploads *up=uploads_current();
 	void *ptr;
-	pthread_mutex_lock(&GH_fptr_mutex);
-	GH_dlsym_internal_dlsym();
-	pthread_mutex_unlock(&GH_fptr_mutex);
-	GH_GET_PTR(dlvsym);
-	interceptor=GH_get_interceptor(name, GH_dlsym_next, "dlvsym");
-	ptr=(interceptor)?interceptor:GH_dlvsym(handle,name,version);
-	GH_verbose(GH_MSG_DEBUG_INTERCEPTION,"dlvsym(%p, %s, %s) = %p%s\n",handle,name,version,ptr,
-		interceptor?" [intercepted]":"");
+	if (!GH_glMapNamedBufferRange) {
+		GH_GET_GL_PROC_OR_FAIL(glMapNamedBufferRange, GH_MSG_WARNING, NULL);
+	}
+	ptr=GH_glMapNamedBufferRange(buffer, offset, length, access);
+	if (up && ptr) {
+		upload_map_range(up, (long long)length, access);
+	}
 	return ptr;
 }
-#endif
 
-/***************************************************************************
- * INTERCEPTED FUNCTIONS: glX                                              *
- ***************************************************************************/
+extern void glFlushMappedNamedBufferRange(GLuint buffer, GLintptr offset, GLsizeiptr length)
+{
+	GH_uploads *up=uploads_current();
+	if (up) {
+		upload_map(up, (long long)length);
+	}
+	if (!GH_glFlushMappedNamedBufferRange) {
+		GH_GET_GL_PROC_OR_FAIL(glFlushMappedNamedBufferRange, GH_MSG_WARNING, );
+	}
+	GH_glFlushMappedNamedBufferRange(buffer, offset, length);
+}
 
-/* Actually, our goal is to intercept glXSwapInterval[EXT|SGI]() etc. But
- * these are extension functions not required to be provided as external
- * symbols. However, some applications just likn them anyways, so we have
- * to handle the case were dlsym() or glXGetProcAddress[ARB]() is used to
- * query the function pointers, and have to intercept these as well.
- */
+extern void glTexStorage1D(GLenum target, GLsizei levels, GLenum internalformat, GLsizei width)
+{
+	GH_gpu_memory *gm=gpu_mem_current();
+	if (gm) {
+		gpu_mem_texture_storage(gm, target, levels, internalformat, width, 1, 1);
+	}
+	if (!GH_glTexStorage1D) {
+		GH_GET_GL_PROC_OR_FAIL(glTexStorage1D, GH_MSG_WARNING, );
+	}
+	GH_glTexStorage1D(target, levels, internalformat, width);
+}
 
-/* helper macro to handle both glxGetProcAddress and glXGetProcAddressARB */
-#define GH_GLXGETPROCADDRESS_GENERIC(procname) \
-extern GH_fptr procname(const GLubyte *name) \
-{ \
-	void *interceptor; \
-	GH_fptr ptr; \
-	GH_GET_PTR(procname); \
-	interceptor=GH_get_interceptor((const char *)name, \
-					(GH_resolve_func)GH_ ##procname, \
-					 #procname); \
-	ptr=(interceptor)?(GH_fptr)interceptor:GH_ ##procname((const char*)name); \
-	GH_verbose(GH_MSG_DEBUG_INTERCEPTION,#procname "(%s) = %p%s\n",(const char *)name, ptr, \
-		interceptor?" [intercepted]":""); \
-	return ptr; \
+extern void glTexStorage2D(GLenum target, GLsizei levels, GLenum internalformat, GLsizei width, GLsizei height)
+{
+	GH_gpu_memory *gm=gpu_mem_current();
+	if (gm) {
+		gpu_mem_texture_storage(gm, target, levels, internalformat, width, height, 1);
+	}
+	if (!GH_glTexStorage2D) {
+		GH_GET_GL_PROC_OR_FAIL(glTexStorage2D, GH_MSG_WARNING, );
+	}
+	GH_glTexStorage2D(target, levels, internalformat, width, height);
 }
 
-GH_GLXGETPROCADDRESS_GENERIC(glXGetProcAddress)
-GH_GLXGETPROCADDRESS_GENERIC(glXGetProcAddressARB)
+extern void glTexStorage3D(GLenum target, GLsizei levels, GLenum internalformat, GLsizei width, GLsizei height, GLsizei depth)
+{
+	GH_gpu_memory *gm=gpu_mem_current();
+	if (gm) {
+		gpu_mem_texture_storage(gm, target, levels, internalformat, width, height, depth);
+	}
+	if (!GH_glTexStorage3D) {
+		GH_GET_GL_PROC_OR_FAIL(glTexStorage3D, GH_MSG_WARNING, );
+	}
+	GH_glTexStorage3D(target, levels, internalformat, width, height, depth);
+}
 
-#ifdef GH_CONTEXT_TRACKING
+extern void glBufferStorage(GLenum target, GLsizeiptr size, const void *data, GLbitfield flags)
+{
+	GH_gpu_memory *gm=gpu_mem_current();
+	if (gm) {
+		gpu_mem_buffer(gm, target, size);
+	}
+	if (!GH_glBufferStorage) {
+		GH_GET_GL_PROC_OR_FAIL(glBufferStorage, GH_MSG_WARNING, );
+	}
+	GH_glBufferStorage(target, size, data, flags);
+}
 
-/* ---------- Context Creation ---------- */
+extern void glRenderbufferStorage(GLenum target, GLenum internalformat, GLsizei width, GLsizei height)
+{
+	GH_gpu_memory *gm=gpu_mem_current();
+	if (gm) {
+		gpu_mem_renderbuffer(gm, 0, internalformat, width, height);
+	}
+	if (!GH_glRenderbufferStorage) {
+		GH_GET_GL_PROC_OR_FAIL(glRenderbufferStorage, GH_MSG_WARNING, );
+	}
+	GH_glRenderbufferStorage(target, internalformat, width, height);
+}
 
-extern GLXContext glXCreateContext(Display *dpy, XVisualInfo *vis, GLXContext shareList, Bool direct )
+extern void glRenderbufferStorageMultisample(GLenum target, GLsizei samples, GLenum internalformat, GLsizei width, GLsizei height)
 {
-	GLXContext ctx;
+	GH_gpu_memory *gm=gpu_mem_current();
+	if (gm) {
+		gpu_mem_renderbuffer(gm, samples, internalformat, width, height);
+	}
+	if (!GH_glRenderbufferStorageMultisample) {
+		GH_GET_GL_PROC_OR_FAIL(glRenderbufferStorageMultisample, GH_MSG_WARNING, );
+	}
+	GH_glRenderbufferStorageMultisample(target, samples, internalformat, width, height);
+}
 
-	ctx = override_create_context(dpy, vis, NULL, shareList, direct, NULL);
-	if (ctx == NULL) {
-		GH_GET_PTR_GL(glXCreateContext);
-		ctx=GH_glXCreateContext(dpy, vis, shareList, direct);
+extern void glTexImage2DMultisample(GLenum target, GLsizei samples, GLenum internalformat, GLsizei width, GLsizei height, GLboolean fixedsamplelocations)
+{
+	GH_gpu_memory *gm=gpu_mem_current();
+	if (gm) {
+		gpu_mem_texture_multisample(gm, target, samples, internalformat, width, height, 1);
+	}
+	if (!GH_glTexImage2DMultisample) {
+		GH_GET_GL_PROC_OR_FAIL(glTexImage2DMultisample, GH_MSG_WARNING, );
+	}
+	GH_glTexImage2DMultisample(target, samples, internalformat, width, height, fixedsamplelocations);
+}
+
+extern void glTexImage3DMultisample(GLenum target, GLsizei samples, GLenum internalformat, GLsizei width, GLsizei height, GLsizei depth, GLboolean fixedsamplelocations)
+{
+	GH_gpu_memory *gm=gpu_mem_current();
+	if (gm) {
+		gpu_mem_texture_multisample(gm, target, samples, internalformat, width, height, depth);
+	}
+	if (!GH_glTexImage3DMultisample) {
+		GH_GET_GL_PROC_OR_FAIL(glTexImage3DMultisample, GH_MSG_WARNING, );
+	}
+	GH_glTexImage3DMultisample(target, samples, internalformat, width, height, depth, fixedsamplelocations);
+}
+
+extern void glTexStorage2DMultisample(GLenum target, GLsizei samples, GLenum internalformat, GLsizei width, GLsizei height, GLboolean fixedsamplelocations)
+{
+	GH_gpu_memory *gm=gpu_mem_current();
+	if (gm) {
+		gpu_mem_texture_multisample(gm, target, samples, internalformat, width, height, 1);
+	}
+	if (!GH_glTexStorage2DMultisample) {
+		GH_GET_GL_PROC_OR_FAIL(glTexStorage2DMultisample, GH_MSG_WARNING, );
+	}
+	GH_glTexStorage2DMultisample(target, samples, internalformat, width, height, fixedsamplelocations);
+}
+
+extern void glTexStorage3DMultisample(GLenum target, GLsizei samples, GLenum internalformat, GLsizei width, GLsizei height, GLsizei depth, GLboolean fixedsamplelocations)
+{
+	GH_gpu_memory *gm=gpu_mem_current();
+	if (gm) {
+		gpu_mem_texture_multisample(gm, target, samples, internalformat, width, height, depth);
+	}
+	if (!GH_glTexStorage3DMultisample) {
+		GH_GET_GL_PROC_OR_FAIL(glTexStorage3DMultisample, GH_MSG_WARNING, );
 	}
-	create_context(ctx);
-	return ctx;
+	GH_glTexStorage3DMultisample(target, samples, internalformat, width, height, depth, fixedsamplelocations);
 }
 
-extern GLXContext glXCreateNewContext( Display *dpy, GLXFBConfig config, int renderType, GLXContext shareList, Bool direct )
+extern void glGenerateMipmap(GLenum target)
 {
-	GLXContext ctx;
-
-	ctx = override_create_context(dpy, NULL, &config, shareList, direct, NULL);
-	if (ctx == NULL) {
-		GH_GET_PTR_GL(glXCreateNewContext);
-		ctx=GH_glXCreateNewContext(dpy, config, renderType, shareList, direct);
+	GH_gpu_memory *gm=gpu_mem_current();
+	if (gm) {
+		unsigned int face;
+		gpu_mem_generate_mipmap(gm, gpu_mem_bound(gpu_mem_texture_binding(target, &face)));
 	}
-	create_context(ctx);
-	return ctx;
+	if (!GH_glGenerateMipmap) {
+		GH_GET_GL_PROC_OR_FAIL(glGenerateMipmap, GH_MSG_WARNING, );
+	}
+	GH_glGenerateMipmap(target);
 }
 
-extern GLXContext glXCreateContextAttribsARB (Display * dpy, GLXFBConfig config, GLXContext shareList, Bool direct, const int *attr)
+extern void glGenerateMipmapEXT(GLenum target)
 {
-	GLXContext ctx;
-
-	ctx = override_create_context(dpy, NULL, &config, shareList, direct, attr);
-	if (ctx == NULL) {
-		GH_GET_PTR_GL(glXCreateContextAttribsARB);
-		ctx=GH_glXCreateContextAttribsARB(dpy, config, shareList, direct, attr);
+	GH_gpu_memory *gm=gpu_mem_current();
+	if (gm) {
+		unsigned int face;
+		gpu_mem_generate_mipmap(gm, gpu_mem_bound(gpu_mem_texture_binding(target, &face)));
 	}
-	create_context(ctx);
-	return ctx;
+	if (!GH_glGenerateMipmapEXT) {
+		GH_GET_GL_PROC_OR_FAIL(glGenerateMipmapEXT, GH_MSG_WARNING, );
+	}
+	GH_glGenerateMipmapEXT(target);
 }
 
-extern GLXContext glXImportContextEXT (Display *dpy, GLXContextID id)
+extern void glGenerateTextureMipmap(GLuint texture)
 {
-	GLXContext ctx;
+	GH_gpu_memory *gm=gpu_mem_current();
+	if (gm) {
+		gpu_mem_generate_mipmap(gm, texture);
+	}
+	if (!GH_glGenerateTextureMipmap) {
+		GH_GET_GL_PROC_OR_FAIL(glGenerateTextureMipmap, GH_MSG_WARNING, );
+	}
+	GH_glGenerateTextureMipmap(texture);
+}
 
-	GH_GET_PTR_GL(glXImportContextEXT);
-	ctx=GH_glXImportContextEXT(dpy, id);
-	create_context(ctx);
-	return ctx;
+extern void glDeleteTextures(GLsizei n, const GLuint *textures)
+{
+	GH_gpu_memory *gm=gpu_mem_current();
+	if (gm) {
+		gpu_mem_delete(gm, GH_GPU_MEM_TEXTURE, n, textures);
+	}
+	if (!GH_glDeleteTextures) {
+		GH_GET_GL_PROC_OR_FAIL(glDeleteTextures, GH_MSG_WARNING, );
+	}
+	GH_glDeleteTextures(n, textures);
 }
 
-extern GLXContext glXCreateContextWithConfigSGIX (Display *dpy, GLXFBConfigSGIX config, int renderType, GLXContext shareList, Bool direct)
+extern void glDeleteBuffers(GLsizei n, const GLuint *buffers)
 {
-	GLXContext ctx;
+	GH_gpu_memory *gm=gpu_mem_current();
+	if (gm) {
+		gpu_mem_delete(gm, GH_GPU_MEM_BUFFER, n, buffers);
+	}
+	if (!GH_glDeleteBuffers) {
+		GH_GET_GL_PROC_OR_FAIL(glDeleteBuffers, GH_MSG_WARNING, );
+	}
+	GH_glDeleteBuffers(n, buffers);
+}
 
-	/* TODO: override_create_context for this case */
-	GH_GET_PTR_GL(glXCreateContextWithConfigSGIX);
-	ctx=GH_glXCreateContextWithConfigSGIX(dpy, config, renderType, shareList, direct);
-	create_context(ctx);
-	return ctx;
+extern void glDeleteRenderbuffers(GLsizei n, const GLuint *renderbuffers)
+{
+	GH_gpu_memory *gm=gpu_mem_current();
+	if (gm) {
+		gpu_mem_delete(gm, GH_GPU_MEM_RENDERBUFFER, n, renderbuffers);
+	}
+	if (!GH_glDeleteRenderbuffers) {
+		GH_GET_GL_PROC_OR_FAIL(glDeleteRenderbuffers, GH_MSG_WARNING, );
+	}
+	GH_glDeleteRenderbuffers(n, renderbuffers);
 }
 
-/* ---------- Context Destruction ---------- */
+/* ---------- X11 Round Trips ---------- */
 
-extern void glXDestroyContext(Display *dpy, GLXContext ctx)
+/* the X11 call counters of the current context, if enabled */
+static GH_x11_calls *
+x11_calls_current(void)
 {
-	GH_GET_PTR_GL(glXDestroyContext);
-	GH_glXDestroyContext(dpy, ctx);
-	destroy_context(ctx);
+	gl_context_t *glc;
+
+	if (!x11_calls_active) {
+		/* the ctx_current key might not even exist yet */
+		return NULL;
+	}
+	glc=(gl_context_t*)pthread_getspecific(ctx_current);
+	return (glc && glc->frametimes.x11.enabled)?&glc->frametimes.x11:NULL;
 }
 
-extern void glXFreeContextEXT(Display *dpy, GLXContext ctx)
+static void
+x11_call_end(GH_x11_calls *xc, GH_x11_func func, uint64_t t0)
 {
-	GH_GET_PTR_GL(glXFreeContextEXT);
-	GH_glXFreeContextEXT(dpy, ctx);
-	destroy_context(ctx);
+	x11_call_record(xc, func, get_time_ns(CLOCK_MONOTONIC) - t0);
 }
 
-/* ---------- Current Context Tracking ---------- */
+/* Xlib calls can come before anything called dlsym(), so make sure
+ * we have the original one before resolving the next symbol */
+#define GH_GET_X11_PTR_OR_FAIL(func, fail_code) \
+	pthread_mutex_lock(&GH_fptr_mutex); \
+	GH_dlsym_internal_dlsym(); \
+	pthread_mutex_unlock(&GH_fptr_mutex); \
+	GH_GET_PTR(func); \
+	if (GH_ ##func == NULL) { \
+		GH_verbose(GH_MSG_ERROR, "%s not available!\n", #func); \
+		return fail_code; \
+	} \
+	(void)0
 
-extern Bool glXMakeCurrent(Display *dpy, GLXDrawable drawable, GLXContext ctx)
+extern int XSync(Display *dpy, Bool discard)
 {
-	Bool result;
+	GH_x11_calls *xc=x11_calls_current();
+	uint64_t t0=(xc)?get_time_ns(CLOCK_MONOTONIC):0;
+	int result;
+	if (!GH_XSync) {
+		GH_GET_X11_PTR_OR_FAIL(XSync, 0);
+	}
+	result=GH_XSync(dpy, discard);
+	if (t0) {
+		x11_call_end(xc, GH_X11_SYNC, t0);
+	}
+	return result;
+}
 
-	result=GH_glXMakeCurrent(dpy, drawable, ctx);
-	make_current(ctx, dpy, drawable, drawable);
+extern Status XGetWindowAttributes(Display *dpy, Window w, XWindowAttributes *attr)
+{
+	GH_x11_calls *xc=x11_calls_current();
+	uint64_t t0=(xc)?get_time_ns(CLOCK_MONOTONIC):0;
+	Status result;
+	if (!GH_XGetWindowAttributes) {
+		GH_GET_X11_PTR_OR_FAIL(XGetWindowAttributes, 0);
+	}
+	result=GH_XGetWindowAttributes(dpy, w, attr);
+	if (t0) {
+		x11_call_end(xc, GH_X11_GET_WINDOW_ATTRIBUTES, t0);
+	}
 	return result;
 }
 
-extern Bool glXMakeContextCurrent(Display *dpy, GLXDrawable draw, GLXDrawable read, GLXContext ctx)
+extern Bool XQueryPointer(Display *dpy, Window w, Window *root, Window *child,
+			  int *root_x, int *root_y, int *win_x, int *win_y, unsigned int *mask)
 {
+	GH_x11_calls *xc=x11_calls_current();
+	uint64_t t0=(xc)?get_time_ns(CLOCK_MONOTONIC):0;
 	Bool result;
+	if (!GH_XQueryPointer) {
+		GH_GET_X11_PTR_OR_FAIL(XQueryPointer, False);
+	}
+	result=GH_XQueryPointer(dpy, w, root, child, root_x, root_y, win_x, win_y, mask);
+	if (t0) {
+		x11_call_end(xc, GH_X11_QUERY_POINTER, t0);
+	}
+	return result;
+}
 
-	result=GH_glXMakeContextCurrent(dpy, draw, read, ctx);
-	make_current(ctx, dpy, draw, read);
+extern Status XGetGeometry(Display *dpy, Drawable d, Window *root, int *x, int *y,
+			   unsigned int *width, unsigned int *height, unsigned int *border, unsigned int *depth)
+{
+	GH_x11_calls *xc=x11_calls_current();
+	uint64_t t0=(xc)?get_time_ns(CLOCK_MONOTONIC):0;
+	Status result;
+	if (!GH_XGetGeometry) {
+		GH_GET_X11_PTR_OR_FAIL(XGetGeometry, 0);
+	}
+	result=GH_XGetGeometry(dpy, d, root, x, y, width, height, border, depth);
+	if (t0) {
+		x11_call_end(xc, GH_X11_GET_GEOMETRY, t0);
+	}
 	return result;
 }
 
-extern Bool glXMakeCurrentReadSGI(Display *dpy, GLXDrawable draw, GLXDrawable read, GLXContext ctx)
+extern Bool XTranslateCoordinates(Display *dpy, Window src, Window dst, int src_x, int src_y,
+				  int *dst_x, int *dst_y, Window *child)
 {
+	GH_x11_calls *xc=x11_calls_current();
+	uint64_t t0=(xc)?get_time_ns(CLOCK_MONOTONIC):0;
 	Bool result;
-
-	result=GH_glXMakeCurrentReadSGI(dpy, draw, read, ctx);
-	make_current(ctx, dpy, draw, read);
+	if (!GH_XTranslateCoordinates) {
+		GH_GET_X11_PTR_OR_FAIL(XTranslateCoordinates, False);
+	}
+	result=GH_XTranslateCoordinates(dpy, src, dst, src_x, src_y, dst_x, dst_y, child);
+	if (t0) {
+		x11_call_end(xc, GH_X11_TRANSLATE_COORDINATES, t0);
+	}
 	return result;
 }
 
-/* ---------- GL Debug Output ---------- */
-
-extern void glDebugMessageCallback(GLDEBUGPROC proc, const GLvoid *user_ptr)
+extern int XGetInputFocus(Display *dpy, Window *focus, int *revert_to)
 {
-	GH_GET_PTR_GL(glDebugMessageCallback);
-	if (GH_glDebugMessageCallback) {
-		gl_context_t *glc=(gl_context_t*)pthread_getspecific(ctx_current);
-		if (glc) {
-			glc->original_debug_callback = proc;
-			glc->original_debug_callback_user_ptr = user_ptr;
-
-			if (glc->flags & GH_GL_INTERCEPT_DEBUG) {
-				GH_verbose(GH_MSG_INFO, "injecting debug output [core]!\n");
-				proc = GH_debug_callback;
-				user_ptr = glc;
-			}
-		} else {
-			GH_verbose(GH_MSG_WARNING, "debug message callback without current context!\n");
-		}
-		GH_glDebugMessageCallback(proc, user_ptr);
+	GH_x11_calls *xc=x11_calls_current();
+	uint64_t t0=(xc)?get_time_ns(CLOCK_MONOTONIC):0;
+	int result;
+	if (!GH_XGetInputFocus) {
+		GH_GET_X11_PTR_OR_FAIL(XGetInputFocus, 0);
 	}
+	result=GH_XGetInputFocus(dpy, focus, revert_to);
+	if (t0) {
+		x11_call_end(xc, GH_X11_GET_INPUT_FOCUS, t0);
+	}
+	return result;
 }
 
-extern void glDebugMessageCallbackARB(GLDEBUGPROC proc, const GLvoid *user_ptr)
+extern Status XQueryTree(Display *dpy, Window w, Window *root, Window *parent,
+			 Window **children, unsigned int *nchildren)
 {
-	GH_GET_PTR_GL(glDebugMessageCallbackARB);
-	if (GH_glDebugMessageCallbackARB) {
-		gl_context_t *glc=(gl_context_t*)pthread_getspecific(ctx_current);
-		if (glc) {
-			glc->original_debug_callback = proc;
-			glc->original_debug_callback_user_ptr = user_ptr;
-
-			if (glc->flags & GH_GL_INTERCEPT_DEBUG) {
-				GH_verbose(GH_MSG_INFO, "injecting debug output [ARB]!\n");
-				proc = GH_debug_callback;
-				user_ptr = glc;
-			}
-		} else {
-			GH_verbose(GH_MSG_WARNING, "debug message callback without current context!\n");
-		}
-		GH_glDebugMessageCallbackARB(proc, user_ptr);
+	GH_x11_calls *xc=x11_calls_current();
+	uint64_t t0=(xc)?get_time_ns(CLOCK_MONOTONIC):0;
+	Status result;
+	if (!GH_XQueryTree) {
+		GH_GET_X11_PTR_OR_FAIL(XQueryTree, 0);
+	}
+	result=GH_XQueryTree(dpy, w, root, parent, children, nchildren);
+	if (t0) {
+		x11_call_end(xc, GH_X11_QUERY_TREE, t0);
 	}
+	return result;
 }
 
-extern void glDebugMessageCallbackKHR(GLDEBUGPROC proc, const GLvoid *user_ptr)
+extern Atom XInternAtom(Display *dpy, _Xconst char *name, Bool only_if_exists)
 {
-	GH_GET_PTR_GL(glDebugMessageCallbackKHR);
-	if (GH_glDebugMessageCallbackKHR) {
-		gl_context_t *glc=(gl_context_t*)pthread_getspecific(ctx_current);
-		if (glc) {
-			glc->original_debug_callback = proc;
-			glc->original_debug_callback_user_ptr = user_ptr;
-
-			if (glc->flags & GH_GL_INTERCEPT_DEBUG) {
-				GH_verbose(GH_MSG_INFO, "injecting debug output [KHR]!\n");
-				proc = GH_debug_callback;
-				user_ptr = glc;
-			}
-		} else {
-			GH_verbose(GH_MSG_WARNING, "debug message callback without current context!\n");
-		}
-		GH_glDebugMessageCallbackKHR(proc, user_ptr);
+	GH_x11_calls *xc=x11_calls_current();
+	uint64_t t0=(xc)?get_time_ns(CLOCK_MONOTONIC):0;
+	Atom result;
+	if (!GH_XInternAtom) {
+		GH_GET_X11_PTR_OR_FAIL(XInternAtom, None);
 	}
+	result=GH_XInternAtom(dpy, name, only_if_exists);
+	if (t0) {
+		x11_call_end(xc, GH_X11_INTERN_ATOM, t0);
+	}
+	return result;
 }
 
-extern void glDebugMessageCallbackAMD(GLDEBUGPROCAMD proc, GLvoid *user_ptr)
+extern void glXQueryDrawable(Display *dpy, GLXDrawable draw, int attribute, unsigned int *value)
 {
-	GH_GET_PTR_GL(glDebugMessageCallbackAMD);
-	if (GH_glDebugMessageCallbackAMD) {
-		gl_context_t *glc=(gl_context_t*)pthread_getspecific(ctx_current);
-		if (glc) {
-			glc->original_debug_callback_AMD = proc;
-			glc->original_debug_callback_AMD_user_ptr = user_ptr;
-
-			if (glc->flags & GH_GL_INTERCEPT_DEBUG) {
-				GH_verbose(GH_MSG_INFO, "injecting debug output [AMD]!\n");
-				proc = GH_debug_callback_AMD;
-				user_ptr = glc;
-			}
-		} else {
-			GH_verbose(GH_MSG_WARNING, "debug message callback without current context!\n");
-		}
-		GH_glDebugMessageCallbackAMD(proc, user_ptr);
+	GH_x11_calls *xc=x11_calls_current();
+	uint64_t t0=(xc)?get_time_ns(CLOCK_MONOTONIC):0;
+	if (!GH_glXQueryDrawable) {
+		GH_GET_GL_PROC_OR_FAIL(glXQueryDrawable, GH_MSG_ERROR, );
+	}
+	GH_glXQueryDrawable(dpy, draw, attribute, value);
+	if (t0) {
+		x11_call_end(xc, GH_X11_GLX_QUERY_DRAWABLE, t0);
 	}
 }
 
+/* ---------- Input Latency ---------- */
+
+#define GH_INPUT_EVENT_WRAPPER(type, name, fail_code, params, args, result_ok) \
+extern type name params \
+{ \
+	type result; \
+	if (!GH_ ##name) { \
+		GH_GET_X11_PTR_OR_FAIL(name, fail_code); \
+	} \
+	result=GH_ ##name args; \
+	if (input.active && (result_ok)) { \
+		input_event(ev); \
+	} \
+	return result; \
+}
+
+GH_INPUT_EVENT_WRAPPER(int, XNextEvent, 0,
+		(Display *dpy, XEvent *ev), (dpy, ev), 1)
+GH_INPUT_EVENT_WRAPPER(int, XWindowEvent, 0,
+		(Display *dpy, Window w, long mask, XEvent *ev), (dpy, w, mask, ev), 1)
+GH_INPUT_EVENT_WRAPPER(int, XMaskEvent, 0,
+		(Display *dpy, long mask, XEvent *ev), (dpy, mask, ev), 1)
+GH_INPUT_EVENT_WRAPPER(int, XIfEvent, 0,
+		(Display *dpy, XEvent *ev, Bool (*predicate)(Display*, XEvent*, XPointer), XPointer arg),
+		(dpy, ev, predicate, arg), 1)
+GH_INPUT_EVENT_WRAPPER(Bool, XCheckWindowEvent, False,
+		(Display *dpy, Window w, long mask, XEvent *ev), (dpy, w, mask, ev), result)
+GH_INPUT_EVENT_WRAPPER(Bool, XCheckMaskEvent, False,
+		(Display *dpy, long mask, XEvent *ev), (dpy, mask, ev), result)
+GH_INPUT_EVENT_WRAPPER(Bool, XCheckTypedEvent, False,
+		(Display *dpy, int type, XEvent *ev), (dpy, type, ev), result)
+GH_INPUT_EVENT_WRAPPER(Bool, XCheckTypedWindowEvent, False,
+		(Display *dpy, Window w, int type, XEvent *ev), (dpy, w, type, ev), result)
+GH_INPUT_EVENT_WRAPPER(Bool, XCheckIfEvent, False,
+		(Display *dpy, XEvent *ev, Bool (*predicate)(Display*, XEvent*, XPointer), XPointer arg),
+		(dpy, ev, predicate, arg), result)
+
 #endif /* GH_CONTEXT_TRACKING */
 
 /* ---------- Swap Interval---------- */
@@ -2575,6 +9782,13 @@ extern void glDebugMessageCallbackAMD(GLDEBUGPROCAMD proc, GLvoid *user_ptr)
 extern void glXSwapIntervalEXT(Display *dpy, GLXDrawable drawable,
 				int interval)
 {
+#ifdef GH_CONTEXT_TRACKING
+	uint64_t t0=recorder_begin();
+	if (t0) {
+		/* the call itself is quick, record the request of the app */
+		recorder_call(GH_RECORD_SWAP_INTERVAL, recorder_current_ctx_num(), t0, interval);
+	}
+#endif
 	interval=GH_swap_interval(interval);
 	if (interval == GH_SWAP_DONT_SET) {
 		/* ignore the call */
@@ -2586,6 +9800,12 @@ extern void glXSwapIntervalEXT(Display *dpy, GLXDrawable drawable,
 
 extern int glXSwapIntervalSGI(int interval)
 {
+#ifdef GH_CONTEXT_TRACKING
+	uint64_t t0=recorder_begin();
+	if (t0) {
+		recorder_call(GH_RECORD_SWAP_INTERVAL, recorder_current_ctx_num(), t0, interval);
+	}
+#endif
 	interval=GH_swap_interval(interval);
 	if (interval == GH_SWAP_DONT_SET) {
 		/* ignore the call */
@@ -2598,6 +9818,12 @@ extern int glXSwapIntervalSGI(int interval)
 extern int glXSwapIntervalMESA(unsigned int interval)
 {
 	int signed_interval;
+#ifdef GH_CONTEXT_TRACKING
+	uint64_t t0=recorder_begin();
+	if (t0) {
+		recorder_call(GH_RECORD_SWAP_INTERVAL, recorder_current_ctx_num(), t0, (int64_t)interval);
+	}
+#endif
 	if (interval > (unsigned)INT_MAX) {
 		signed_interval=INT_MAX;
 	} else {
@@ -2621,53 +9847,162 @@ extern int glXSwapIntervalMESA(unsigned int interval)
 /* ---------- Swap Buffers ---------- */
 
 #ifdef GH_SWAPBUFFERS_INTERCEPT
-extern void glXSwapBuffers(Display *dpy, GLXDrawable drawable)
+/* a buffer swap request of the application, either via
+ * glXSwapBuffers or glXSwapBuffersMscOML */
+typedef struct {
+	int oml;		/* use glXSwapBuffersMscOML */
+	int64_t target_msc;
+	int64_t divisor;
+	int64_t remainder;
+	int64_t sbc;		/* return value of glXSwapBuffersMscOML */
+#ifdef GH_CONTEXT_TRACKING
+	GH_flight_recorder *flight;	/* recorder of the current context, if any */
+#endif
+} GH_swap_request;
+
+static void
+swap_buffers_real(Display *dpy, GLXDrawable drawable, GH_swap_request *req)
+{
+#ifdef GH_CONTEXT_TRACKING
+	uint64_t t0=(GH_EVENTS_ENABLED(req->flight))?get_time_ns(CLOCK_REALTIME):0;
+#endif
+	if (req->oml) {
+		req->sbc=GH_glXSwapBuffersMscOML(dpy, drawable, req->target_msc, req->divisor, req->remainder);
+	} else {
+		GH_glXSwapBuffers(dpy, drawable);
+	}
+#ifdef GH_CONTEXT_TRACKING
+	if (t0) {
+		event_span(req->flight, (req->oml)?GH_EVENT_SWAP_OML:GH_EVENT_SWAP, t0, get_time_ns(CLOCK_REALTIME), 0);
+	}
+#endif
+}
+
+static void
+swap_buffers(Display *dpy, GLXDrawable drawable, GH_swap_request *req)
 {
 #ifdef GH_CONTEXT_TRACKING
 	gl_context_t *glc=(gl_context_t*)pthread_getspecific(ctx_current);
 
 	if (glc) {
+		int do_swap=1;
+		uint64_t now;
+		uint64_t t_record=recorder_begin();
+		/* the frame number as used by the frame timing measurements */
+		unsigned int frame=(glc->frametimes.mode > GH_FRAMETIME_NONE)?
+				glc->frametimes.frame:glc->profiler.frame;
+		req->flight=&glc->flight;
+		if (glc->jit_start.enabled) {
+			jit_start_arrive(&glc->jit_start, dpy, drawable);
+		}
 		frametimes_before_swap(&glc->frametimes);
+		if (glc->fps_limit.interval && !glc->fps_limit.after_swap) {
+			fps_limit_wait(&glc->fps_limit, &glc->flight);
+		}
 		if (glc->swapbuffer_omission.swapbuffers > 0) {
-			int do_swap;
 			if (glc->swapbuffer_omission.latency_mode > 0) {
-				latency_before_swap(&glc->latency);
+				latency_before_swap(&glc->latency, &glc->flight);
 			}
 			do_swap = swapbuffer_omission_do_swap(&glc->swapbuffer_omission);
 			if (do_swap) {
 				if (glc->swapbuffer_omission.latency_mode < 1) {
-					latency_before_swap(&glc->latency);
-					GH_glXSwapBuffers(dpy, drawable);
-					latency_after_swap(&glc->latency);
+					latency_before_swap(&glc->latency, &glc->flight);
+					swap_buffers_real(dpy, drawable, req);
+					latency_after_swap(&glc->latency, &glc->flight);
 				} else {
-					GH_glXSwapBuffers(dpy, drawable);
+					swap_buffers_real(dpy, drawable, req);
 				}
 			} else {
+				uint64_t t0=(GH_EVENTS_ENABLED(&glc->flight))?get_time_ns(CLOCK_REALTIME):0;
 				swapbuffer_omission_swap_skipped(&glc->swapbuffer_omission);
+				if (t0) {
+					event_span(&glc->flight, GH_EVENT_SWAP_OMITTED, t0, get_time_ns(CLOCK_REALTIME), 0);
+				}
+				if (req->oml) {
+					/* report the most recent swap as the one to wait for */
+					int64_t ust, msc;
+					GH_GET_GL_PROC(glXGetSyncValuesOML);
+					if (!GH_glXGetSyncValuesOML ||
+					    !GH_glXGetSyncValuesOML(dpy, drawable, &ust, &msc, &req->sbc)) {
+						req->sbc=0;
+					}
+				}
 			}
 			if (glc->swapbuffer_omission.latency_mode > 0) {
-				latency_after_swap(&glc->latency);
+				latency_after_swap(&glc->latency, &glc->flight);
 			}
 			swapbuffer_omission_swap_finished(&glc->swapbuffer_omission, do_swap);
 		} else {
-			latency_before_swap(&glc->latency);
-			GH_glXSwapBuffers(dpy, drawable);
-			latency_after_swap(&glc->latency);
+			latency_before_swap(&glc->latency, &glc->flight);
+			swap_buffers_real(dpy, drawable, req);
+			latency_after_swap(&glc->latency, &glc->flight);
+		}
+		if (do_swap) {
+			frametimes_present(&glc->frametimes, dpy, drawable);
 		}
+		glc->frametimes.current.latency_depth=glc->latency.depth;
 		frametimes_after_swap(&glc->frametimes);
+		now=get_time_ns(CLOCK_MONOTONIC);
+		stats_frame(&glc->stats, now, do_swap);
+		prom_update(now);
+		if (startup.enabled) {
+			startup_swap(now);
+		}
 		if (glc->swap_sleep_usecs) {
+			uint64_t t0=(GH_EVENTS_ENABLED(&glc->flight))?get_time_ns(CLOCK_REALTIME):0;
 			usleep(glc->swap_sleep_usecs);
+			if (t0) {
+				event_span(&glc->flight, GH_EVENT_SWAP_SLEEP, t0, get_time_ns(CLOCK_REALTIME), (long long)glc->swap_sleep_usecs);
+			}
+		}
+		if (glc->fps_limit.interval && glc->fps_limit.after_swap) {
+			fps_limit_wait(&glc->fps_limit, &glc->flight);
+		}
+		if (glc->jit_start.enabled) {
+			jit_start_wait(&glc->jit_start, &glc->fps_limit, do_swap, glc->frametimes.gpu_tail_valid,
+					glc->frametimes.gpu_tail, dpy, drawable, &glc->flight);
+		}
+		if (glc->flight.size) {
+			flight_frame_end(&glc->flight, get_time_ns(CLOCK_REALTIME));
+		}
+		profiler_frame_end(&glc->profiler, frame);
+		if (t_record) {
+			recorder_call(GH_RECORD_SWAP_BUFFERS, glc->num, t_record, (int64_t)frame);
 		}
 	} else {
 		GH_verbose(GH_MSG_WARNING,"SwapBuffers called without a context\n");
 		GH_GET_PTR_GL(glXSwapBuffers);
-		GH_glXSwapBuffers(dpy, drawable);
+		swap_buffers_real(dpy, drawable, req);
 	}
 #else /* GH_CONTEXT_TRACKING */
 	GH_GET_PTR_GL(glXSwapBuffers);
-	GH_glXSwapBuffers(dpy, drawable);
+	swap_buffers_real(dpy, drawable, req);
 #endif /* GH_CONTEXT_TRACKING */
 }
+
+extern void glXSwapBuffers(Display *dpy, GLXDrawable drawable)
+{
+	GH_swap_request req={ .oml = 0 };
+
+	swap_buffers(dpy, drawable, &req);
+}
+
+extern int64_t glXSwapBuffersMscOML(Display *dpy, GLXDrawable drawable, int64_t target_msc, int64_t divisor, int64_t remainder)
+{
+	GH_swap_request req={ .oml = 1, .target_msc = target_msc, .divisor = divisor, .remainder = remainder };
+
+#ifdef GH_CONTEXT_TRACKING
+	GH_GET_GL_PROC(glXSwapBuffersMscOML);
+#else
+	GH_GET_PTR_GL(glXSwapBuffersMscOML);
+#endif
+	if (!GH_glXSwapBuffersMscOML) {
+		GH_verbose(GH_MSG_ERROR,"glXSwapBuffersMscOML not available\n");
+		return 0;
+	}
+	swap_buffers(dpy, drawable, &req);
+	return req.sbc;
+}
 #endif /* GH_SWAPBUFFERS_INTERCEPT */
 
 /***************************************************************************
@@ -2682,6 +10017,41 @@ extern void glXSwapBuffers(Display *dpy, GLXDrawable drawable)
  * The interceptor functions will fall back to using GH_dlsym() if the
  * name resolution here did fail for some reason.
  */
+#ifdef GH_SWAPBUFFERS_INTERCEPT
+/* check if any of the features hooking into the buffer swaps is enabled */
+static int GH_swapbuffers_needed(void)
+{
+	const char *s;
+
+	if (get_envi("GH_SWAPBUFFERS", 0) ||
+	    get_envi("GH_MIN_SWAP_USECS", 0) ||
+	    get_envi("GH_FRAMETIME", 0) ||
+	    get_envi("GH_SWAP_SLEEP_USECS", 0) ||
+	    (strtod(get_envs("GH_FPS_LIMIT", "0"), NULL) > 0.0) ||
+	    get_envi("GH_JIT_START", 0) ||
+	    (get_envi("GH_LATENCY", GH_LATENCY_NOP) != GH_LATENCY_NOP) ||
+	    get_envi("GH_FLIGHT_RECORDER", 0) ||
+	    get_envi("GH_PROFILE_HZ", 0) ||
+	    get_envi("GH_STARTUP_REPORT", 0)) {
+		return 1;
+	}
+	s=getenv("GH_BENCHMARK");
+	if (s && s[0]) {
+		return 1;
+	}
+	s=getenv("GH_TRACE_FILE");
+	if (s && s[0]) {
+		return 1;
+	}
+	s=getenv("GH_PROM_FILE");
+	if (s && s[0]) {
+		return 1;
+	}
+	s=getenv("GH_RECORD_FILE");
+	return (s && s[0]);
+}
+#endif
+
 static void* GH_get_interceptor(const char *name, GH_resolve_func query,
 				const char *query_name )
 {
@@ -2699,6 +10069,16 @@ static void* GH_get_interceptor(const char *name, GH_resolve_func query,
 
 #ifdef GH_SWAPBUFFERS_INTERCEPT
 	static int do_swapbuffers=0;
+#endif
+#ifdef GH_CONTEXT_TRACKING
+	static int do_markers=0;
+	static int do_startup=0;
+	static int do_uploads=0;
+	static int do_gpumem=0;
+	static int do_stalls=0;
+	static int do_x11=0;
+	static int do_input=0;
+	static int do_record=0;
 #endif
 	static int do_dlsym = 0;
 #if (GH_DLSYM_METHOD != 2)
@@ -2708,10 +10088,17 @@ static void* GH_get_interceptor(const char *name, GH_resolve_func query,
 
 	if (!inited) {
 #ifdef GH_SWAPBUFFERS_INTERCEPT
-		do_swapbuffers =get_envi("GH_SWAPBUFFERS", 0) ||
-				get_envi("GH_FRAMETIME", 0) ||
-				get_envi("GH_SWAP_SLEEP_USECS", 0) ||
-				(get_envi("GH_LATENCY", GH_LATENCY_NOP) != GH_LATENCY_NOP);
+		do_swapbuffers =GH_swapbuffers_needed();
+#endif
+#ifdef GH_CONTEXT_TRACKING
+		do_markers = get_envi("GH_FRAMETIME_MARKERS", 0) || get_envi("GH_FRAMETIME_GPU_GROUPS", 0);
+		do_startup = get_envi("GH_STARTUP_REPORT", 0);
+		do_uploads = get_envi("GH_FRAMETIME_UPLOADS", 0);
+		do_gpumem = get_envi("GH_FRAMETIME_GPU_MEMORY", 0);
+		do_stalls = get_envi("GH_FRAMETIME_STALLS", 0);
+		do_x11 = get_envi("GH_FRAMETIME_X11", 0);
+		do_input = get_envi("GH_FRAMETIME_INPUT", 0);
+		do_record = (get_envs("GH_RECORD_FILE", NULL) != NULL);
 #endif
 		do_dlsym = get_envi("GH_HOOK_DLSYM_DYNAMICALLY", 0);
 #if (GH_DLSYM_METHOD != 2)
@@ -2719,6 +10106,11 @@ static void* GH_get_interceptor(const char *name, GH_resolve_func query,
 #endif
 		inited = 1;
 	}
+#ifdef GH_CONTEXT_TRACKING
+	if (do_startup) {
+		startup_lookup(query_name, name);
+	}
+#endif
 
 	if (do_dlsym) {
 		GH_INTERCEPT(dlsym);
@@ -2748,17 +10140,123 @@ static void* GH_get_interceptor(const char *name, GH_resolve_func query,
 	GH_INTERCEPT(glDebugMessageCallbackARB);
 	GH_INTERCEPT(glDebugMessageCallbackKHR);
 	GH_INTERCEPT(glDebugMessageCallbackAMD);
+	if (do_markers) {
+		GH_INTERCEPT(glPushDebugGroup);
+		GH_INTERCEPT(glPopDebugGroup);
+		GH_INTERCEPT(glPushGroupMarkerEXT);
+		GH_INTERCEPT(glPopGroupMarkerEXT);
+		GH_INTERCEPT(glInsertEventMarkerEXT);
+		GH_INTERCEPT(glDebugMessageInsert);
+		GH_INTERCEPT(glDebugMessageInsertARB);
+		GH_INTERCEPT(glStringMarkerGREMEDY);
+	}
+	if (do_record) {
+		GH_INTERCEPT(glClear);
+	}
+	if (do_startup) {
+		GH_INTERCEPT(glCompileShader);
+		GH_INTERCEPT(glCompileShaderARB);
+		GH_INTERCEPT(glLinkProgram);
+		GH_INTERCEPT(glLinkProgramARB);
+	}
+	if (do_uploads || do_gpumem) {
+		GH_INTERCEPT(glTexImage1D);
+		GH_INTERCEPT(glTexImage2D);
+		GH_INTERCEPT(glTexImage3D);
+		GH_INTERCEPT(glCompressedTexImage1D);
+		GH_INTERCEPT(glCompressedTexImage2D);
+		GH_INTERCEPT(glCompressedTexImage3D);
+		GH_INTERCEPT(glBufferData);
+		GH_INTERCEPT(glBufferDataARB);
+	}
+	if (do_uploads) {
+		GH_INTERCEPT(glTexSubImage1D);
+		GH_INTERCEPT(glTexSubImage2D);
+		GH_INTERCEPT(glTexSubImage3D);
+		GH_INTERCEPT(glCompressedTexSubImage1D);
+		GH_INTERCEPT(glCompressedTexSubImage2D);
+		GH_INTERCEPT(glCompressedTexSubImage3D);
+		GH_INTERCEPT(glBufferSubData);
+		GH_INTERCEPT(glFlushMappedBufferRange);
+		GH_INTERCEPT(glBufferSubDataARB);
+		GH_INTERCEPT(glMapBufferARB);
+		GH_INTERCEPT(glTextureSubImage1D);
+		GH_INTERCEPT(glTextureSubImage2D);
+		GH_INTERCEPT(glTextureSubImage3D);
+		GH_INTERCEPT(glCompressedTextureSubImage1D);
+		GH_INTERCEPT(glCompressedTextureSubImage2D);
+		GH_INTERCEPT(glCompressedTextureSubImage3D);
+		GH_INTERCEPT(glNamedBufferData);
+		GH_INTERCEPT(glNamedBufferSubData);
+		GH_INTERCEPT(glMapNamedBuffer);
+		GH_INTERCEPT(glMapNamedBufferRange);
+		GH_INTERCEPT(glFlushMappedNamedBufferRange);
+	}
+	if (do_uploads || do_stalls) {
+		GH_INTERCEPT(glMapBuffer);
+		GH_INTERCEPT(glMapBufferRange);
+	}
+	if (do_stalls) {
+		GH_INTERCEPT(glReadPixels);
+		GH_INTERCEPT(glGetTexImage);
+		GH_INTERCEPT(glGetBufferSubData);
+		GH_INTERCEPT(glGetQueryObjectiv);
+		GH_INTERCEPT(glGetQueryObjectuiv);
+		GH_INTERCEPT(glGetQueryObjecti64v);
+		GH_INTERCEPT(glGetQueryObjectui64v);
+		GH_INTERCEPT(glFinish);
+		GH_INTERCEPT(glClientWaitSync);
+	}
+	if (do_x11) {
+		GH_INTERCEPT(XSync);
+		GH_INTERCEPT(XGetWindowAttributes);
+		GH_INTERCEPT(XQueryPointer);
+		GH_INTERCEPT(XGetGeometry);
+		GH_INTERCEPT(XTranslateCoordinates);
+		GH_INTERCEPT(XGetInputFocus);
+		GH_INTERCEPT(XQueryTree);
+		GH_INTERCEPT(XInternAtom);
+		GH_INTERCEPT(glXQueryDrawable);
+	}
+	if (do_input) {
+		GH_INTERCEPT(XNextEvent);
+		GH_INTERCEPT(XWindowEvent);
+		GH_INTERCEPT(XMaskEvent);
+		GH_INTERCEPT(XIfEvent);
+		GH_INTERCEPT(XCheckWindowEvent);
+		GH_INTERCEPT(XCheckMaskEvent);
+		GH_INTERCEPT(XCheckTypedEvent);
+		GH_INTERCEPT(XCheckTypedWindowEvent);
+		GH_INTERCEPT(XCheckIfEvent);
+	}
+	if (do_gpumem) {
+		GH_INTERCEPT(glTexStorage1D);
+		GH_INTERCEPT(glTexStorage2D);
+		GH_INTERCEPT(glTexStorage3D);
+		GH_INTERCEPT(glBufferStorage);
+		GH_INTERCEPT(glRenderbufferStorage);
+		GH_INTERCEPT(glRenderbufferStorageMultisample);
+		GH_INTERCEPT(glTexImage2DMultisample);
+		GH_INTERCEPT(glTexImage3DMultisample);
+		GH_INTERCEPT(glTexStorage2DMultisample);
+		GH_INTERCEPT(glTexStorage3DMultisample);
+		GH_INTERCEPT(glGenerateMipmap);
+		GH_INTERCEPT(glGenerateMipmapEXT);
+		GH_INTERCEPT(glGenerateTextureMipmap);
+		GH_INTERCEPT(glDeleteTextures);
+		GH_INTERCEPT(glDeleteBuffers);
+		GH_INTERCEPT(glDeleteRenderbuffers);
+	}
 #endif
 #ifdef GH_SWAPBUFFERS_INTERCEPT
 	if (do_swapbuffers) {
 		if (do_swapbuffers < 0) {
-			do_swapbuffers =get_envi("GH_SWAPBUFFERS", 0) ||
-					get_envi("GH_FRAMETIME", 0) ||
-					get_envi("GH_SWAP_SLEEP_USECS", 0) ||
-					(get_envi("GH_LATENCY", GH_LATENCY_NOP) != GH_LATENCY_NOP);
+			do_swapbuffers =GH_swapbuffers_needed();
 		}
-		if (do_swapbuffers)
+		if (do_swapbuffers) {
 			GH_INTERCEPT(glXSwapBuffers);
+			GH_INTERCEPT(glXSwapBuffersMscOML);
+		}
 	}
 #endif
 	return NULL;
@@ -0,0 +1,360 @@
+/* Benchmark the pacing features of glx_hook against the simulated GPU of
+ * the stub libGL from "make tools":
+ *
+ *   LD_LIBRARY_PATH=./stub LD_PRELOAD=./glx_hook.so ./glx_hook_bench
+ *
+ * A synthetic application renders the same frames once per configuration,
+ * each in a new GL context with the GH_* settings of the configuration
+ * applied. A configuration is a comma separated list of NAME=value pairs
+ * given on the command line; without any, the combinations of the latency
+ * limiter and swap omission settings in bench_latency[] and
+ * bench_omission[] are run. For each configuration, the frames per second
+ * of the application and on the display, the number of frames queued after
+ * the buffer swap, the time from the start of a frame (where the
+ * application would sample the input) to its presentation on the display,
+ * the CPU time spent outside of the simulated CPU work, and how often the
+ * number of frames between two carried out buffer swaps changed (which
+ * shows if the swap omission interval is stable) are reported. With -x,
+ * the frames also make X11 round trips against the stub libX11. */
+
+#define _GNU_SOURCE
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <dlfcn.h>
+
+#include <GL/glx.h>
+
+#define BENCH_MAX_VARS 16
+
+typedef struct {
+	unsigned int frames;
+	unsigned int warmup;
+	uint64_t cpu;			/* CPU work per frame */
+	uint64_t cpu_jitter;
+	uint64_t cpu_step;		/* CPU work in the second half, 0 if unchanged */
+	unsigned int x11;		/* X11 round trips per frame */
+	uint64_t random;
+	/* the stub control interface */
+	void (*reset)(void);
+	unsigned int (*swaps)(uint64_t *present);
+	unsigned int (*queue_depth)(void);
+	unsigned long (*x11_round_trips)(void);
+	/* the variables set by the current configuration */
+	char *vars[BENCH_MAX_VARS];
+	unsigned int num_vars;
+} bench_state;
+
+typedef struct {
+	unsigned int frames;
+	unsigned int presented;
+	uint64_t time;
+	uint64_t cpu_time;		/* CPU time of the thread */
+	uint64_t work_time;		/* CPU time of the simulated work */
+	unsigned long long queue_depth;
+	unsigned int queue_depth_max;
+	unsigned long x11_round_trips;	/* round trips seen by the stub libX11 */
+	unsigned int run;		/* frames since the last carried out swap */
+	unsigned int last_run;
+	unsigned int run_changes;	/* changes of the number of frames per carried out swap */
+	uint64_t *latency;		/* input to present latency of each presented frame */
+} bench_result;
+
+/* the default configuration matrix */
+static const char *bench_latency[]={
+	"GH_LATENCY=-2",
+	"GH_LATENCY=-1",
+	"GH_LATENCY=0",
+	"GH_LATENCY=1,GH_LATENCY_MANUAL_WAIT=0",
+	"GH_LATENCY=1,GH_LATENCY_MANUAL_WAIT=1",
+	"GH_LATENCY=2,GH_LATENCY_MANUAL_WAIT=0",
+	"GH_LATENCY=2,GH_LATENCY_MANUAL_WAIT=1",
+	NULL
+};
+
+static const char *bench_omission[]={
+	"",
+	"GH_SWAPBUFFERS=2",
+	"GH_MIN_SWAP_USECS=15000,GH_SWAP_OMISSION_LATENCY=0",
+	"GH_MIN_SWAP_USECS=15000,GH_SWAP_OMISSION_LATENCY=1,GH_SWAP_OMISSION_FLUSH=0",
+	NULL
+};
+
+static uint64_t
+get_time(clockid_t clock)
+{
+	struct timespec ts;
+
+	clock_gettime(clock, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/* uniform in [0,range] */
+static uint64_t
+bench_random(bench_state *bs, uint64_t range)
+{
+	bs->random ^= bs->random >> 12;
+	bs->random ^= bs->random << 25;
+	bs->random ^= bs->random >> 27;
+	return (range)?((bs->random * 2685821657736338717ULL) >> 11) % (range + 1):0;
+}
+
+/* burn CPU time like an application would */
+static void
+bench_work(uint64_t ns)
+{
+	uint64_t end=get_time(CLOCK_THREAD_CPUTIME_ID) + ns;
+
+	while (get_time(CLOCK_THREAD_CPUTIME_ID) < end);
+}
+
+/* apply a configuration, undoing the previous one */
+static void
+bench_configure(bench_state *bs, const char *config)
+{
+	const char *c=config;
+	unsigned int i;
+
+	for (i=0; i<bs->num_vars; i++) {
+		unsetenv(bs->vars[i]);
+		free(bs->vars[i]);
+	}
+	bs->num_vars=0;
+	while (*c) {
+		size_t len=strcspn(c, ",");
+		char *var=strndup(c, len);
+		char *eq=(var)?strchr(var, '='):NULL;
+		if (eq && bs->num_vars < BENCH_MAX_VARS) {
+			*eq=0;
+			setenv(var, eq + 1, 1);
+			bs->vars[bs->num_vars++]=var;
+		} else {
+			free(var);
+		}
+		c += len;
+		if (*c) {
+			c++;
+		}
+	}
+}
+
+static int
+compare_u64(const void *a, const void *b)
+{
+	uint64_t x=*(const uint64_t*)a;
+	uint64_t y=*(const uint64_t*)b;
+
+	return (x > y) - (x < y);
+}
+
+/* the X11 round trips of a frame, alternating between the calls */
+static void
+bench_x11(const bench_state *bs)
+{
+	unsigned int i;
+
+	for (i=0; i<bs->x11; i++) {
+		if (i & 1) {
+			XWindowAttributes attr;
+			XGetWindowAttributes(NULL, 1, &attr);
+		} else {
+			XSync(NULL, False);
+		}
+	}
+}
+
+static void
+bench_run(bench_state *bs, const char *config, bench_result *res)
+{
+	GLXContext ctx;
+	unsigned int i,swaps;
+	uint64_t start=0,cpu_start=0,present;
+	unsigned long x11_start=0;
+
+	bench_configure(bs, config);
+	bs->random=0x9e3779b97f4a7c15ULL;
+	bs->reset();
+	ctx=glXCreateNewContext(NULL, NULL, GLX_RGBA_TYPE, NULL, True);
+	glXMakeCurrent(NULL, 1, ctx);
+	swaps=bs->swaps(NULL);
+	for (i=0; i<bs->warmup + bs->frames; i++) {
+		uint64_t t_input,work;
+		unsigned int s,depth;
+		if (i == bs->warmup) {
+			start=get_time(CLOCK_MONOTONIC);
+			cpu_start=get_time(CLOCK_THREAD_CPUTIME_ID);
+			if (bs->x11) {
+				x11_start=bs->x11_round_trips();
+			}
+		}
+		t_input=get_time(CLOCK_MONOTONIC);
+		work=(bs->cpu_step && i >= bs->warmup + bs->frames / 2)?bs->cpu_step:bs->cpu;
+		work=work - bs->cpu_jitter + bench_random(bs, 2 * bs->cpu_jitter);
+		bench_x11(bs);
+		bench_work(work);
+		glXSwapBuffers(NULL, 1);
+		s=bs->swaps(&present);
+		depth=bs->queue_depth();
+		if (i >= bs->warmup) {
+			res->frames++;
+			res->work_time += work;
+			res->queue_depth += depth;
+			if (depth > res->queue_depth_max) {
+				res->queue_depth_max=depth;
+			}
+			res->run++;
+			if (s != swaps) {
+				res->latency[res->presented++]=present - t_input;
+				if (res->last_run && res->run != res->last_run) {
+					res->run_changes++;
+				}
+				res->last_run=res->run;
+				res->run=0;
+			}
+		}
+		swaps=s;
+	}
+	res->time=get_time(CLOCK_MONOTONIC) - start;
+	res->cpu_time=get_time(CLOCK_THREAD_CPUTIME_ID) - cpu_start;
+	if (bs->x11) {
+		res->x11_round_trips=bs->x11_round_trips() - x11_start;
+	}
+	glXMakeCurrent(NULL, None, NULL);
+	glXDestroyContext(NULL, ctx);
+}
+
+static void
+bench_report(const bench_state *bs, const char *config, bench_result *res)
+{
+	double t=(double)res->time * 1.0E-9;
+	uint64_t overhead=(res->cpu_time > res->work_time)?(res->cpu_time - res->work_time):0;
+
+	printf("%-72s %7.2f %7.2f %5.2f %3u", (config[0])?config:"(default)",
+		(double)res->frames / t, (double)res->presented / t,
+		(double)res->queue_depth / (double)res->frames, res->queue_depth_max);
+	if (res->presented) {
+		uint64_t sum=0;
+		unsigned int i;
+		qsort(res->latency, res->presented, sizeof(*res->latency), compare_u64);
+		for (i=0; i<res->presented; i++) {
+			sum += res->latency[i];
+		}
+		printf(" %8.3f %8.3f %8.3f", (double)sum * 1.0E-6 / (double)res->presented,
+			(double)res->latency[(res->presented * 95U) / 100U] * 1.0E-6,
+			(double)res->latency[res->presented - 1] * 1.0E-6);
+	} else {
+		printf(" %8s %8s %8s", "-", "-", "-");
+	}
+	printf(" %6.1f %8u", 100.0 * (double)overhead / (double)res->time, res->run_changes);
+	if (bs->x11) {
+		printf(" %5.2f", (double)res->x11_round_trips / (double)res->frames);
+	}
+	printf("\n");
+	fflush(stdout);
+}
+
+static void
+usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-f frames] [-w frames] [-c usecs] [-j usecs] [-s usecs] [-x n] [config ...]\n"
+		"  -f frames  frames to measure per configuration (default: 300)\n"
+		"  -w frames  frames to run before measuring (default: 30)\n"
+		"  -c usecs   CPU time per frame (default: 8000)\n"
+		"  -j usecs   uniform jitter of the CPU time per frame (default: 0)\n"
+		"  -s usecs   CPU time per frame in the second half of the measured frames (default: unchanged)\n"
+		"  -x n       X11 round trips per frame, needs the stub libX11 (default: 0)\n"
+		"  config     comma separated NAME=value settings, e.g. GH_LATENCY=1,GH_LATENCY_MANUAL_WAIT=1\n"
+		"The GPU is configured via the GH_STUB_* environment variables.\n", name);
+}
+
+int main(int argc, char **argv)
+{
+	bench_state bs;
+	bench_result res;
+	int opt;
+
+	memset(&bs, 0, sizeof(bs));
+	bs.frames=300;
+	bs.warmup=30;
+	bs.cpu=8000000;
+	while ((opt=getopt(argc, argv, "f:w:c:j:s:x:")) != -1) {
+		switch (opt) {
+			case 'f':
+				bs.frames=(unsigned int)strtoul(optarg, NULL, 0);
+				break;
+			case 'w':
+				bs.warmup=(unsigned int)strtoul(optarg, NULL, 0);
+				break;
+			case 'c':
+				bs.cpu=strtoull(optarg, NULL, 0) * 1000ULL;
+				break;
+			case 'j':
+				bs.cpu_jitter=strtoull(optarg, NULL, 0) * 1000ULL;
+				break;
+			case 's':
+				bs.cpu_step=strtoull(optarg, NULL, 0) * 1000ULL;
+				break;
+			case 'x':
+				bs.x11=(unsigned int)strtoul(optarg, NULL, 0);
+				break;
+			default:
+				usage(argv[0]);
+				return 1;
+		}
+	}
+	if (bs.frames < 1) {
+		bs.frames=1;
+	}
+	if (bs.cpu_jitter > bs.cpu) {
+		bs.cpu_jitter=bs.cpu;
+	}
+	if (bs.cpu_step && bs.cpu_jitter > bs.cpu_step) {
+		bs.cpu_jitter=bs.cpu_step;
+	}
+	*(void**)&bs.reset=dlsym(RTLD_DEFAULT, "glx_hook_stub_reset");
+	*(void**)&bs.swaps=dlsym(RTLD_DEFAULT, "glx_hook_stub_swaps");
+	*(void**)&bs.queue_depth=dlsym(RTLD_DEFAULT, "glx_hook_stub_queue_depth");
+	if (!bs.reset || !bs.swaps || !bs.queue_depth) {
+		fprintf(stderr, "this must be run against the stub libGL\n");
+		return 2;
+	}
+	*(void**)&bs.x11_round_trips=dlsym(RTLD_DEFAULT, "glx_hook_stub_x11_round_trips");
+	if (bs.x11 && !bs.x11_round_trips) {
+		fprintf(stderr, "-x must be run against the stub libX11\n");
+		return 2;
+	}
+
+	printf("%-72s %7s %7s %5s %3s %8s %8s %8s %6s %8s%s\n", "configuration", "fps", "shown", "queue", "max",
+		"lat_avg", "lat_p95", "lat_max", "cpu%", "omit_chg", (bs.x11)?"   x11":"");
+	memset(&res, 0, sizeof(res));
+	if (!(res.latency=malloc(sizeof(*res.latency) * bs.frames))) {
+		fprintf(stderr, "out of memory\n");
+		return 2;
+	}
+	if (optind < argc) {
+		int i;
+		for (i=optind; i<argc; i++) {
+			memset(&res, 0, offsetof(bench_result, latency));
+			bench_run(&bs, argv[i], &res);
+			bench_report(&bs, argv[i], &res);
+		}
+	} else {
+		unsigned int i,j;
+		for (i=0; bench_latency[i]; i++) {
+			for (j=0; bench_omission[j]; j++) {
+				char config[256];
+				snprintf(config, sizeof(config), "%s%s%s", bench_latency[i],
+					(bench_omission[j][0])?",":"", bench_omission[j]);
+				memset(&res, 0, offsetof(bench_result, latency));
+				bench_run(&bs, config, &res);
+				bench_report(&bs, config, &res);
+			}
+		}
+	}
+	free(res.latency);
+	return 0;
+}
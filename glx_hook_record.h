@@ -0,0 +1,62 @@
+#ifndef GLX_HOOK_RECORD_H
+#define GLX_HOOK_RECORD_H
+
+#include <stdint.h>
+
+/* The binary call recording written with GH_RECORD_FILE and read by
+ * glx_hook_replay. All values are in the native byte order of the
+ * recording machine. The file starts with a GH_record_header, followed
+ * by GH_record entries, each of them followed by record.size bytes of
+ * payload and zero padding up to the next multiple of 8 bytes. All times
+ * are in nanoseconds of CLOCK_MONOTONIC since the start of the recording. */
+
+#define GH_RECORD_MAGIC		"GHREC\0\0\0"
+#define GH_RECORD_VERSION	1
+
+/* the padding after a payload of size bytes */
+#define GH_RECORD_PADDING(size)	((8 - ((size) & 7)) & 7)
+
+/* the context number if there is no context */
+#define GH_RECORD_NO_CONTEXT	0xffffffffU
+
+typedef enum {
+	/* payload: "NAME=value\0" of a GH_* environment variable */
+	GH_RECORD_CONFIG=0,
+	/* a glXCreate*Context* call, ctx is the new context */
+	GH_RECORD_CREATE_CONTEXT,
+	/* glXDestroyContext or glXFreeContextEXT */
+	GH_RECORD_DESTROY_CONTEXT,
+	/* a glXMake*Current* call, ctx is the new context */
+	GH_RECORD_MAKE_CURRENT,
+	/* glXSwapBuffers or glXSwapBuffersMscOML, arg[0] is the frame number */
+	GH_RECORD_SWAP_BUFFERS,
+	/* glXSwapInterval{EXT,SGI,MESA}, arg[0] is the interval requested by the app */
+	GH_RECORD_SWAP_INTERVAL,
+	/* the frametime results of a frame became available, this comes
+	 * GH_FRAMETIME_DELAY frames after the swap: arg[0] is the frame
+	 * number as in GH_RECORD_SWAP_BUFFERS, t0 the CPU frame time,
+	 * t1 the GPU time from the first glClear of the frame (or from the
+	 * previous swap if there was none) to the end of the frame, 0
+	 * without GPU timer queries, and arg[1] the GPU latency at the swap */
+	GH_RECORD_FRAME,
+	GH_RECORD_TYPES
+} GH_record_type;
+
+typedef struct {
+	char magic[8];
+	uint32_t version;
+	uint32_t pid;
+	uint64_t start;		/* CLOCK_REALTIME of the start of the recording */
+} GH_record_header;
+
+typedef struct {
+	uint32_t type;		/* GH_record_type */
+	uint32_t ctx;		/* context number, GH_RECORD_NO_CONTEXT if none */
+	uint32_t thread;	/* thread id of the caller */
+	uint32_t size;		/* bytes of payload following this record */
+	uint64_t t0;		/* the application called into glx_hook */
+	uint64_t t1;		/* glx_hook returned to the application */
+	int64_t arg[2];
+} GH_record;
+
+#endif
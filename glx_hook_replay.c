@@ -0,0 +1,372 @@
+/* Replay a glX call stream recorded with GH_RECORD_FILE.
+ *
+ * The recorded calls are issued again in the original order, keeping the
+ * time the application spent between two calls, while the time spent in
+ * the calls themselves is whatever glx_hook and the GL implementation take
+ * now. This is meant to be run against the stub libGL from "make tools",
+ * which executes the GPU time recorded for each frame on a simulated GPU:
+ *
+ *   LD_LIBRARY_PATH=./stub LD_PRELOAD=./glx_hook.so ./glx_hook_replay rec.bin
+ *
+ * so that the frame pacing of glx_hook can be compared between versions
+ * and settings without the original application, X server or GPU. The
+ * GH_* settings of the recording are applied unless they are already set
+ * in the environment, or -n is given. */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <errno.h>
+#include <unistd.h>
+#include <dlfcn.h>
+
+#include <GL/glx.h>
+#include <GL/glxext.h>
+
+#include "glx_hook_record.h"
+
+typedef struct {
+	GLXContext ctx;
+	uint64_t *gpu;			/* the GPU time per frame */
+	unsigned int frames;
+} replay_context;
+
+typedef struct {
+	char *data;
+	size_t size;
+	GH_record **rec;
+	size_t count;
+	replay_context *ctx;
+	unsigned int num_ctx;
+	GLXContext current;
+	uint64_t gpu_default;		/* GPU time for frames without one */
+	void (*frame_cost)(uint64_t ns);
+	PFNGLXSWAPINTERVALEXTPROC swap_interval;
+	/* results */
+	unsigned long calls;
+	unsigned long swaps;
+	uint64_t late;			/* total time a call started late */
+	uint64_t swap_time;		/* total time spent in the buffer swaps */
+} replay_state;
+
+static const char *record_type_name[GH_RECORD_TYPES]={
+	"config",
+	"create_context",
+	"destroy_context",
+	"make_current",
+	"swap_buffers",
+	"swap_interval",
+	"frame"
+};
+
+static uint64_t
+get_time(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void
+sleep_until(uint64_t t)
+{
+	struct timespec ts;
+
+	ts.tv_sec=(time_t)(t / 1000000000ULL);
+	ts.tv_nsec=(long)(t % 1000000000ULL);
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR);
+}
+
+static int
+load(replay_state *rs, const char *name)
+{
+	FILE *file=fopen(name, "rb");
+	const GH_record_header *hdr;
+	size_t pos,n;
+
+	if (!file) {
+		fprintf(stderr, "failed to open '%s'\n", name);
+		return -1;
+	}
+	for (;;) {
+		char *data=realloc(rs->data, rs->size + 65536);
+		if (!data) {
+			fclose(file);
+			fprintf(stderr, "out of memory\n");
+			return -1;
+		}
+		rs->data=data;
+		n=fread(rs->data + rs->size, 1, 65536, file);
+		rs->size += n;
+		if (n < 65536) {
+			break;
+		}
+	}
+	fclose(file);
+
+	hdr=(const GH_record_header*)rs->data;
+	if (rs->size < sizeof(*hdr) || memcmp(hdr->magic, GH_RECORD_MAGIC, sizeof(hdr->magic))) {
+		fprintf(stderr, "'%s' is not a glx_hook recording\n", name);
+		return -1;
+	}
+	if (hdr->version != GH_RECORD_VERSION) {
+		fprintf(stderr, "'%s': unsupported version %u\n", name, (unsigned)hdr->version);
+		return -1;
+	}
+
+	/* index the records */
+	for (pos=sizeof(*hdr); pos + sizeof(GH_record) <= rs->size; ) {
+		GH_record *rec=(GH_record*)(rs->data + pos);
+		size_t size=sizeof(*rec) + rec->size + GH_RECORD_PADDING(rec->size);
+		if (pos + size > rs->size) {
+			break;
+		}
+		if (!(rs->count & 1023)) {
+			GH_record **r=realloc(rs->rec, sizeof(*r) * (rs->count + 1024));
+			if (!r) {
+				fprintf(stderr, "out of memory\n");
+				return -1;
+			}
+			rs->rec=r;
+		}
+		rs->rec[rs->count++]=rec;
+		pos += size;
+	}
+	if (pos != rs->size) {
+		fprintf(stderr, "'%s': ignoring %lu trailing bytes\n", name, (unsigned long)(rs->size - pos));
+	}
+	printf("'%s': pid %u, %lu records\n", name, (unsigned)hdr->pid, (unsigned long)rs->count);
+	return 0;
+}
+
+static replay_context *
+get_context(replay_state *rs, uint32_t num)
+{
+	if (num == GH_RECORD_NO_CONTEXT) {
+		return NULL;
+	}
+	if (num >= rs->num_ctx) {
+		replay_context *c=realloc(rs->ctx, sizeof(*c) * (num + 1));
+		if (!c) {
+			return NULL;
+		}
+		memset(c + rs->num_ctx, 0, sizeof(*c) * (num + 1 - rs->num_ctx));
+		rs->ctx=c;
+		rs->num_ctx=num + 1;
+	}
+	return &rs->ctx[num];
+}
+
+/* apply the settings and collect the GPU times of the frames */
+static void
+prepare(replay_state *rs, int apply_config)
+{
+	size_t i;
+
+	for (i=0; i<rs->count; i++) {
+		const GH_record *rec=rs->rec[i];
+		replay_context *c;
+		if (rec->type == GH_RECORD_CONFIG && apply_config && rec->size) {
+			char *var=(char*)(rec + 1);
+			char *eq;
+			var[rec->size - 1]=0;
+			eq=strchr(var, '=');
+			if (eq && strncmp(var, "GH_RECORD_FILE=", 15)) {
+				*eq=0;
+				setenv(var, eq + 1, 0);
+				*eq='=';
+			}
+		} else if (rec->type == GH_RECORD_FRAME && rec->arg[0] >= 0 && (c=get_context(rs, rec->ctx))) {
+			unsigned int frame=(unsigned int)rec->arg[0];
+			if (frame >= c->frames) {
+				unsigned int frames=(frame + 1024) & ~1023U;
+				uint64_t *gpu=realloc(c->gpu, sizeof(*gpu) * frames);
+				if (!gpu) {
+					continue;
+				}
+				memset(gpu + c->frames, 0, sizeof(*gpu) * (frames - c->frames));
+				c->gpu=gpu;
+				c->frames=frames;
+			}
+			c->gpu[frame]=rec->t1;
+		}
+	}
+}
+
+static void
+call(replay_state *rs, const GH_record *rec)
+{
+	replay_context *c=get_context(rs, rec->ctx);
+	uint64_t t0;
+
+	switch (rec->type) {
+		case GH_RECORD_CREATE_CONTEXT:
+			if (c && !c->ctx) {
+				c->ctx=glXCreateNewContext(NULL, NULL, GLX_RGBA_TYPE, NULL, True);
+			}
+			break;
+		case GH_RECORD_DESTROY_CONTEXT:
+			if (c && c->ctx) {
+				glXDestroyContext(NULL, c->ctx);
+				if (rs->current == c->ctx) {
+					rs->current=NULL;
+				}
+				c->ctx=NULL;
+			}
+			break;
+		case GH_RECORD_MAKE_CURRENT:
+			rs->current=(c)?c->ctx:NULL;
+			glXMakeCurrent(NULL, (rs->current)?1:None, rs->current);
+			break;
+		case GH_RECORD_SWAP_INTERVAL:
+			if (!rs->swap_interval) {
+				rs->swap_interval=(PFNGLXSWAPINTERVALEXTPROC)
+					glXGetProcAddressARB((const GLubyte*)"glXSwapIntervalEXT");
+			}
+			if (rs->swap_interval) {
+				rs->swap_interval(NULL, 1, (int)rec->arg[0]);
+			}
+			break;
+		case GH_RECORD_SWAP_BUFFERS:
+			t0=get_time();
+			glXSwapBuffers(NULL, 1);
+			rs->swap_time += get_time() - t0;
+			rs->swaps++;
+			break;
+		default:
+			return;
+	}
+	rs->calls++;
+}
+
+/* the GPU work of the frame ending with the swap in rec */
+static void
+frame_start(replay_state *rs, const GH_record *rec)
+{
+	const replay_context *c=get_context(rs, rec->ctx);
+	uint64_t gpu=rs->gpu_default;
+
+	if (c && rec->arg[0] >= 0 && (uint64_t)rec->arg[0] < c->frames && c->gpu[rec->arg[0]]) {
+		gpu=c->gpu[rec->arg[0]];
+	}
+	if (rs->frame_cost && gpu) {
+		rs->frame_cost(gpu);
+		glFlush();
+	}
+}
+
+static void
+replay(replay_state *rs)
+{
+	const GH_record *prev=NULL;
+	uint64_t start=get_time();
+	uint64_t end=start;
+	size_t i;
+
+	for (i=0; i<rs->count; i++) {
+		const GH_record *rec=rs->rec[i];
+		uint64_t target,now;
+		if (rec->type == GH_RECORD_CONFIG || rec->type == GH_RECORD_FRAME || rec->type >= GH_RECORD_TYPES) {
+			continue;
+		}
+		if (rec->type == GH_RECORD_SWAP_BUFFERS) {
+			frame_start(rs, rec);
+		}
+		/* keep the time the application spent between the calls */
+		target=end + ((prev && rec->t0 > prev->t1)?(rec->t0 - prev->t1):0);
+		now=get_time();
+		if (now < target) {
+			sleep_until(target);
+		} else {
+			rs->late += now - target;
+		}
+		call(rs, rec);
+		end=get_time();
+		prev=rec;
+	}
+
+	printf("replayed %lu calls in %.3f s\n", rs->calls, (double)(end - start) * 1.0E-9);
+	if (rs->swaps) {
+		printf("%lu swaps: %.3f fps, avg swap time %.3f ms\n", rs->swaps,
+			(double)rs->swaps / ((double)(end - start) * 1.0E-9),
+			(double)rs->swap_time * 1.0E-6 / (double)rs->swaps);
+	}
+	if (rs->calls) {
+		printf("avg late start %.3f ms\n", (double)rs->late * 1.0E-6 / (double)rs->calls);
+	}
+}
+
+static void
+dump(const replay_state *rs)
+{
+	size_t i;
+
+	for (i=0; i<rs->count; i++) {
+		const GH_record *rec=rs->rec[i];
+		const char *name=(rec->type < GH_RECORD_TYPES)?record_type_name[rec->type]:"unknown";
+		if (rec->type == GH_RECORD_CONFIG) {
+			printf("%s\t%.*s\n", name, (int)rec->size, (const char*)(rec + 1));
+		} else {
+			printf("%s\t%d\t%u\t%llu\t%llu\t%lld\t%lld\n", name, (rec->ctx == GH_RECORD_NO_CONTEXT)?-1:(int)rec->ctx,
+				(unsigned)rec->thread, (unsigned long long)rec->t0, (unsigned long long)rec->t1,
+				(long long)rec->arg[0], (long long)rec->arg[1]);
+		}
+	}
+}
+
+static void
+usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-n] [-d] [-g usecs] file\n"
+		"  -n        do not apply the GH_* settings of the recording\n"
+		"  -d        dump the records instead of replaying them\n"
+		"  -g usecs  GPU time for frames without a recorded one\n", name);
+}
+
+int main(int argc, char **argv)
+{
+	replay_state rs;
+	int apply_config=1;
+	int do_dump=0;
+	int opt;
+
+	memset(&rs, 0, sizeof(rs));
+	while ((opt=getopt(argc, argv, "ndg:")) != -1) {
+		switch (opt) {
+			case 'n':
+				apply_config=0;
+				break;
+			case 'd':
+				do_dump=1;
+				break;
+			case 'g':
+				rs.gpu_default=strtoull(optarg, NULL, 0) * 1000ULL;
+				break;
+			default:
+				usage(argv[0]);
+				return 1;
+		}
+	}
+	if (optind + 1 != argc) {
+		usage(argv[0]);
+		return 1;
+	}
+	if (load(&rs, argv[optind])) {
+		return 2;
+	}
+	if (do_dump) {
+		dump(&rs);
+		return 0;
+	}
+	prepare(&rs, apply_config);
+	*(void**)&rs.frame_cost=dlsym(RTLD_DEFAULT, "glx_hook_stub_frame_cost");
+	if (!rs.frame_cost) {
+		fprintf(stderr, "not running against the stub libGL, the GPU times are not replayed\n");
+	}
+	replay(&rs);
+	return 0;
+}
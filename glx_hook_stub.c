@@ -0,0 +1,662 @@
+/* A stub libGL simulating a GPU, to evaluate the pacing features of
+ * glx_hook without a GPU or an X server, driven by glx_hook_replay or
+ * glx_hook_bench. Build it with "make tools" and put the directory
+ * containing it first into LD_LIBRARY_PATH.
+ *
+ * It models a single GPU executing the submitted work in order: the work
+ * of a frame is drawn from the GH_STUB_GPU_* cost distribution (and added
+ * to via glx_hook_stub_frame_cost()), and submitted at the next flush
+ * (glFlush, glFinish, glFenceSync, glQueryCounter or the buffer swap).
+ * GL_TIMESTAMP queries and fences complete at the time the GPU reaches
+ * them. A rendered frame is presented at the next vblank of a display
+ * refreshing at GH_STUB_REFRESH_HZ, honoring the swap interval, or the
+ * target MSC of glXSwapBuffersMscOML. There are GH_STUB_MAX_FRAMES back
+ * buffers: the buffer swap blocks while that many frames are not
+ * presented yet, and the GPU does not start a frame
+ * before its buffer is released by the presentation of the next one.
+ * The GL timeline is CLOCK_MONOTONIC. Display and drawables are never
+ * dereferenced. */
+
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+#include <errno.h>
+
+#include <GL/glx.h>
+#include <GL/glxext.h>
+#include <GL/glext.h>
+
+/* frames the GPU can queue at most */
+#define GH_STUB_FRAMES_MAX	16
+
+typedef struct {
+	pthread_mutex_t mutex;
+	int inited;
+	/* settings */
+	unsigned int max_frames;
+	uint64_t refresh;		/* the refresh period */
+	uint64_t cost;			/* GPU cost distribution of a frame */
+	uint64_t jitter;
+	uint64_t spike;
+	unsigned int spike_percent;
+	unsigned int seed;
+	/* state */
+	int interval;
+	uint64_t base;			/* the first vblank */
+	uint64_t random;
+	uint64_t busy_until;		/* the GPU is busy until then */
+	uint64_t pending;		/* work not submitted yet */
+	uint64_t gate;			/* the GPU can't start the frame before its buffer is free */
+	uint64_t present[GH_STUB_FRAMES_MAX];	/* presentation time of the recent frames */
+	unsigned int frame;
+	uint64_t *query;		/* the result of each query object */
+	GLuint num_queries;
+	GLuint max_queries;
+} GH_stub_gpu;
+
+typedef struct {
+	uint64_t time;			/* the GPU reaches the fence */
+} GH_stub_sync;
+
+typedef struct {
+	int dummy;
+} GH_stub_context;
+
+static GH_stub_gpu gpu={.mutex=PTHREAD_MUTEX_INITIALIZER};
+
+static uint64_t
+stub_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void
+stub_sleep_until(uint64_t t)
+{
+	struct timespec ts;
+
+	ts.tv_sec=(time_t)(t / 1000000000ULL);
+	ts.tv_nsec=(long)(t % 1000000000ULL);
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR);
+}
+
+static unsigned long
+stub_envul(const char *name, unsigned long def)
+{
+	const char *s=getenv(name);
+
+	return (s)?strtoul(s, NULL, 0):def;
+}
+
+/* xorshift64*, uniform in [0,1) */
+static double
+stub_random(void)
+{
+	gpu.random ^= gpu.random >> 12;
+	gpu.random ^= gpu.random << 25;
+	gpu.random ^= gpu.random >> 27;
+	return (double)((gpu.random * 2685821657736338717ULL) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/* the GPU cost of the next frame, called with the mutex held */
+static uint64_t
+stub_frame_cost(void)
+{
+	double cost=(double)gpu.cost;
+
+	if (gpu.jitter) {
+		/* normal distribution via Box-Muller */
+		double u=1.0 - stub_random();
+		double v=stub_random();
+		cost += (double)gpu.jitter * sqrt(-2.0 * log(u)) * cos(2.0 * M_PI * v);
+	}
+	if (gpu.spike_percent && stub_random() * 100.0 < (double)gpu.spike_percent) {
+		cost += (double)gpu.spike;
+	}
+	return (cost > 0.0)?(uint64_t)cost:0;
+}
+
+/* called with the mutex held */
+static void
+stub_reset(void)
+{
+	gpu.base=stub_now();
+	gpu.random=(uint64_t)gpu.seed * 0x9e3779b97f4a7c15ULL + 1;
+	gpu.busy_until=gpu.base;
+	gpu.frame=0;
+	gpu.gate=0;
+	memset(gpu.present, 0, sizeof(gpu.present));
+	gpu.pending=stub_frame_cost();
+}
+
+/* called with the mutex held */
+static void
+stub_init(void)
+{
+	if (!gpu.inited) {
+		unsigned long hz=stub_envul("GH_STUB_REFRESH_HZ", 60);
+		gpu.max_frames=(unsigned int)stub_envul("GH_STUB_MAX_FRAMES", 2);
+		if (gpu.max_frames < 1) {
+			gpu.max_frames=1;
+		} else if (gpu.max_frames >= GH_STUB_FRAMES_MAX) {
+			gpu.max_frames=GH_STUB_FRAMES_MAX - 1;
+		}
+		gpu.refresh=1000000000ULL / ((hz)?hz:60);
+		gpu.interval=(int)stub_envul("GH_STUB_SWAP_INTERVAL", 1);
+		gpu.cost=stub_envul("GH_STUB_GPU_USECS", 0) * 1000ULL;
+		gpu.jitter=stub_envul("GH_STUB_GPU_JITTER_USECS", 0) * 1000ULL;
+		gpu.spike=stub_envul("GH_STUB_GPU_SPIKE_USECS", 0) * 1000ULL;
+		gpu.spike_percent=(unsigned int)stub_envul("GH_STUB_GPU_SPIKE_PERCENT", 0);
+		gpu.seed=(unsigned int)stub_envul("GH_STUB_SEED", 1);
+		gpu.inited=1;
+		stub_reset();
+	}
+}
+
+/* submit the pending work, returns the time the GPU reaches the end of it,
+ * called with the mutex held */
+static uint64_t
+stub_submit_locked(void)
+{
+	uint64_t now=stub_now();
+
+	stub_init();
+	if (gpu.busy_until < now) {
+		gpu.busy_until=now;
+	}
+	if (gpu.pending && gpu.busy_until < gpu.gate) {
+		gpu.busy_until=gpu.gate;
+	}
+	gpu.busy_until += gpu.pending;
+	gpu.pending=0;
+	return gpu.busy_until;
+}
+
+static uint64_t
+stub_submit(void)
+{
+	uint64_t t;
+
+	pthread_mutex_lock(&gpu.mutex);
+	t=stub_submit_locked();
+	pthread_mutex_unlock(&gpu.mutex);
+	return t;
+}
+
+/* the number of frames not presented at time t, called with the mutex held */
+static unsigned int
+stub_queued(uint64_t t)
+{
+	unsigned int i,n=0;
+
+	for (i=0; i<GH_STUB_FRAMES_MAX && i<gpu.frame; i++) {
+		if (gpu.present[(gpu.frame - 1 - i) % GH_STUB_FRAMES_MAX] > t) {
+			n++;
+		}
+	}
+	return n;
+}
+
+/* ---------- control interface for glx_hook_replay and glx_hook_bench ---------- */
+
+/* add GPU work in ns to the current frame */
+extern void glx_hook_stub_frame_cost(uint64_t ns)
+{
+	pthread_mutex_lock(&gpu.mutex);
+	stub_init();
+	gpu.pending += ns;
+	pthread_mutex_unlock(&gpu.mutex);
+}
+
+/* wait for the GPU to become idle and restart the simulation */
+extern void glx_hook_stub_reset(void)
+{
+	uint64_t t;
+
+	pthread_mutex_lock(&gpu.mutex);
+	stub_init();
+	t=gpu.busy_until;
+	if (gpu.frame) {
+		uint64_t p=gpu.present[(gpu.frame - 1) % GH_STUB_FRAMES_MAX];
+		if (p > t) {
+			t=p;
+		}
+	}
+	pthread_mutex_unlock(&gpu.mutex);
+	stub_sleep_until(t);
+	pthread_mutex_lock(&gpu.mutex);
+	stub_reset();
+	pthread_mutex_unlock(&gpu.mutex);
+}
+
+/* the number of buffer swaps so far, and the time the last one is presented */
+extern unsigned int glx_hook_stub_swaps(uint64_t *present)
+{
+	unsigned int frame;
+
+	pthread_mutex_lock(&gpu.mutex);
+	frame=gpu.frame;
+	if (present) {
+		*present=(frame)?gpu.present[(frame - 1) % GH_STUB_FRAMES_MAX]:0;
+	}
+	pthread_mutex_unlock(&gpu.mutex);
+	return frame;
+}
+
+/* the number of frames swapped but not presented yet */
+extern unsigned int glx_hook_stub_queue_depth(void)
+{
+	unsigned int n;
+
+	pthread_mutex_lock(&gpu.mutex);
+	n=stub_queued(stub_now());
+	pthread_mutex_unlock(&gpu.mutex);
+	return n;
+}
+
+/* ---------- GLX ---------- */
+
+static GLXContext
+stub_create_context(void)
+{
+	return (GLXContext)calloc(1, sizeof(GH_stub_context));
+}
+
+extern GLXContext glXCreateContext(Display *dpy, XVisualInfo *vis, GLXContext shareList, Bool direct)
+{
+	(void)dpy; (void)vis; (void)shareList; (void)direct;
+	return stub_create_context();
+}
+
+extern GLXContext glXCreateNewContext(Display *dpy, GLXFBConfig config, int renderType, GLXContext shareList, Bool direct)
+{
+	(void)dpy; (void)config; (void)renderType; (void)shareList; (void)direct;
+	return stub_create_context();
+}
+
+extern GLXContext glXCreateContextAttribsARB(Display *dpy, GLXFBConfig config, GLXContext shareList, Bool direct, const int *attr)
+{
+	(void)dpy; (void)config; (void)shareList; (void)direct; (void)attr;
+	return stub_create_context();
+}
+
+extern void glXDestroyContext(Display *dpy, GLXContext ctx)
+{
+	(void)dpy;
+	free(ctx);
+}
+
+extern Bool glXMakeCurrent(Display *dpy, GLXDrawable drawable, GLXContext ctx)
+{
+	(void)dpy; (void)drawable; (void)ctx;
+	return True;
+}
+
+extern Bool glXMakeContextCurrent(Display *dpy, GLXDrawable draw, GLXDrawable read, GLXContext ctx)
+{
+	(void)dpy; (void)draw; (void)read; (void)ctx;
+	return True;
+}
+
+/* swap the buffers, oml selects the presentation via the GLX_OML_sync_control
+ * parameters instead of the swap interval, returns the swap buffer count */
+static int64_t
+stub_swap(int oml, int64_t target_msc, int64_t divisor, int64_t remainder)
+{
+	uint64_t t,wait=0;
+	int64_t sbc;
+
+	pthread_mutex_lock(&gpu.mutex);
+	t=stub_submit_locked();
+	if (oml) {
+		/* the first vblank after the frame is rendered, but not
+		 * before target_msc, then the next one with the remainder */
+		int64_t msc=(int64_t)((t - gpu.base + gpu.refresh - 1) / gpu.refresh);
+		if (msc < target_msc) {
+			msc=target_msc;
+		} else if (divisor > 0) {
+			msc += ((remainder - msc % divisor) % divisor + divisor) % divisor;
+		}
+		t=gpu.base + (uint64_t)msc * gpu.refresh;
+	} else if (gpu.interval > 0) {
+		/* present at the first vblank after the frame is rendered,
+		 * and interval vblanks after the previous one at the earliest */
+		uint64_t prev=(gpu.frame)?gpu.present[(gpu.frame - 1) % GH_STUB_FRAMES_MAX]:0;
+		if (prev && t < prev + (uint64_t)gpu.interval * gpu.refresh) {
+			t=prev + (uint64_t)gpu.interval * gpu.refresh;
+		}
+		t=gpu.base + ((t - gpu.base + gpu.refresh - 1) / gpu.refresh) * gpu.refresh;
+	}
+	gpu.present[gpu.frame % GH_STUB_FRAMES_MAX]=t;
+	gpu.frame++;
+	/* block while too many frames are not presented */
+	if (gpu.frame > gpu.max_frames) {
+		wait=gpu.present[(gpu.frame - gpu.max_frames - 1) % GH_STUB_FRAMES_MAX];
+	}
+	/* the next frame renders into the buffer freed by presenting
+	 * the frame max_frames before it */
+	if (gpu.frame >= gpu.max_frames) {
+		gpu.gate=gpu.present[(gpu.frame - gpu.max_frames) % GH_STUB_FRAMES_MAX];
+	}
+	/* the work of the next frame */
+	gpu.pending += stub_frame_cost();
+	sbc=(int64_t)gpu.frame;
+	pthread_mutex_unlock(&gpu.mutex);
+	if (wait > stub_now()) {
+		stub_sleep_until(wait);
+	}
+	return sbc;
+}
+
+extern void glXSwapBuffers(Display *dpy, GLXDrawable drawable)
+{
+	(void)dpy; (void)drawable;
+	stub_swap(0, 0, 0, 0);
+}
+
+extern int64_t glXSwapBuffersMscOML(Display *dpy, GLXDrawable drawable, int64_t target_msc, int64_t divisor, int64_t remainder)
+{
+	(void)dpy; (void)drawable;
+	if (target_msc < 0 || divisor < 0 || remainder < 0 || (divisor > 0 && remainder >= divisor)) {
+		return -1;
+	}
+	return stub_swap(1, target_msc, divisor, remainder);
+}
+
+extern Bool glXGetSyncValuesOML(Display *dpy, GLXDrawable drawable, int64_t *ust, int64_t *msc, int64_t *sbc)
+{
+	uint64_t now=stub_now();
+
+	(void)dpy; (void)drawable;
+	pthread_mutex_lock(&gpu.mutex);
+	stub_init();
+	/* the UST is the time of the most recent vblank */
+	*msc=(int64_t)((now - gpu.base) / gpu.refresh);
+	*ust=(int64_t)((gpu.base + (uint64_t)*msc * gpu.refresh) / 1000ULL);
+	*sbc=(int64_t)(gpu.frame - stub_queued(now));
+	pthread_mutex_unlock(&gpu.mutex);
+	return True;
+}
+
+static void
+stub_swap_interval(int interval)
+{
+	pthread_mutex_lock(&gpu.mutex);
+	stub_init();
+	gpu.interval=interval;
+	pthread_mutex_unlock(&gpu.mutex);
+}
+
+extern void glXSwapIntervalEXT(Display *dpy, GLXDrawable drawable, int interval)
+{
+	(void)dpy; (void)drawable;
+	stub_swap_interval(interval);
+}
+
+extern int glXSwapIntervalSGI(int interval)
+{
+	stub_swap_interval(interval);
+	return 0;
+}
+
+extern int glXSwapIntervalMESA(unsigned int interval)
+{
+	stub_swap_interval((int)interval);
+	return 0;
+}
+
+/* ---------- GL ---------- */
+
+extern void glFlush(void)
+{
+	stub_submit();
+}
+
+extern void glFinish(void)
+{
+	stub_sleep_until(stub_submit());
+}
+
+extern GLenum glGetError(void)
+{
+	return GL_NO_ERROR;
+}
+
+extern const GLubyte *glGetString(GLenum name)
+{
+	switch (name) {
+		case GL_VENDOR:
+			return (const GLubyte*)"glx_hook";
+		case GL_RENDERER:
+			return (const GLubyte*)"glx_hook stub";
+		case GL_VERSION:
+			return (const GLubyte*)"4.6 glx_hook stub";
+		default:
+			return (const GLubyte*)"";
+	}
+}
+
+extern const GLubyte *glGetStringi(GLenum name, GLuint index)
+{
+	(void)name; (void)index;
+	return NULL;
+}
+
+extern void glGetIntegerv(GLenum pname, GLint *data)
+{
+	(void)pname;
+	*data=0;
+}
+
+extern void glGetInteger64v(GLenum pname, GLint64 *data)
+{
+	*data=(pname == GL_TIMESTAMP)?(GLint64)stub_now():0;
+}
+
+extern void glGenQueries(GLsizei n, GLuint *ids)
+{
+	GLsizei i;
+
+	pthread_mutex_lock(&gpu.mutex);
+	for (i=0; i<n; i++) {
+		if (gpu.num_queries + 1 >= gpu.max_queries) {
+			GLuint size=(gpu.max_queries)?(2 * gpu.max_queries):256;
+			uint64_t *q=realloc(gpu.query, sizeof(*q) * size);
+			if (!q) {
+				ids[i]=0;
+				continue;
+			}
+			gpu.query=q;
+			gpu.max_queries=size;
+		}
+		ids[i]=++gpu.num_queries;
+		gpu.query[ids[i]]=0;
+	}
+	pthread_mutex_unlock(&gpu.mutex);
+}
+
+extern void glDeleteQueries(GLsizei n, const GLuint *ids)
+{
+	/* query objects are never reused */
+	(void)n; (void)ids;
+}
+
+extern void glQueryCounter(GLuint id, GLenum target)
+{
+	uint64_t t=stub_submit();
+
+	(void)target;
+	pthread_mutex_lock(&gpu.mutex);
+	if (id && id <= gpu.num_queries) {
+		gpu.query[id]=t;
+	}
+	pthread_mutex_unlock(&gpu.mutex);
+}
+
+/* get the result of a query, returns 0 if not available and not waiting */
+static int
+stub_query_result(GLuint id, GLenum pname, uint64_t *value)
+{
+	uint64_t t=0;
+
+	pthread_mutex_lock(&gpu.mutex);
+	if (id && id <= gpu.num_queries) {
+		t=gpu.query[id];
+	}
+	pthread_mutex_unlock(&gpu.mutex);
+	switch (pname) {
+		case GL_QUERY_RESULT_AVAILABLE:
+			*value=(t <= stub_now());
+			return 1;
+		case GL_QUERY_RESULT_NO_WAIT:
+			if (t > stub_now()) {
+				return 0;
+			}
+			*value=t;
+			return 1;
+		default:
+			stub_sleep_until(t);
+			*value=t;
+			return 1;
+	}
+}
+
+extern void glGetQueryObjectui64v(GLuint id, GLenum pname, GLuint64 *params)
+{
+	uint64_t value;
+
+	if (stub_query_result(id, pname, &value)) {
+		*params=(GLuint64)value;
+	}
+}
+
+extern void glGetQueryObjecti64v(GLuint id, GLenum pname, GLint64 *params)
+{
+	uint64_t value;
+
+	if (stub_query_result(id, pname, &value)) {
+		*params=(GLint64)value;
+	}
+}
+
+extern void glGetQueryObjectuiv(GLuint id, GLenum pname, GLuint *params)
+{
+	uint64_t value;
+
+	if (stub_query_result(id, pname, &value)) {
+		*params=(GLuint)value;
+	}
+}
+
+extern void glGetQueryObjectiv(GLuint id, GLenum pname, GLint *params)
+{
+	uint64_t value;
+
+	if (stub_query_result(id, pname, &value)) {
+		*params=(GLint)value;
+	}
+}
+
+extern GLsync glFenceSync(GLenum condition, GLbitfield flags)
+{
+	GH_stub_sync *sync=malloc(sizeof(*sync));
+
+	(void)condition; (void)flags;
+	if (sync) {
+		sync->time=stub_submit();
+	}
+	return (GLsync)sync;
+}
+
+extern void glDeleteSync(GLsync sync)
+{
+	free(sync);
+}
+
+extern GLenum glClientWaitSync(GLsync sync, GLbitfield flags, GLuint64 timeout)
+{
+	const GH_stub_sync *s=(const GH_stub_sync*)sync;
+	uint64_t now=stub_now();
+
+	(void)flags;
+	if (!s) {
+		return GL_WAIT_FAILED;
+	}
+	if (s->time <= now) {
+		return GL_ALREADY_SIGNALED;
+	}
+	if (!timeout) {
+		return GL_TIMEOUT_EXPIRED;
+	}
+	if (s->time - now <= timeout) {
+		stub_sleep_until(s->time);
+		return GL_CONDITION_SATISFIED;
+	}
+	stub_sleep_until(now + timeout);
+	return GL_TIMEOUT_EXPIRED;
+}
+
+/* ---------- GetProcAddress ---------- */
+
+#define GH_STUB_PROC(name) {#name, (__GLXextFuncPtr)name}
+
+static const struct {
+	const char *name;
+	__GLXextFuncPtr proc;
+} stub_procs[]={
+	GH_STUB_PROC(glXCreateContext),
+	GH_STUB_PROC(glXCreateNewContext),
+	GH_STUB_PROC(glXCreateContextAttribsARB),
+	GH_STUB_PROC(glXDestroyContext),
+	GH_STUB_PROC(glXMakeCurrent),
+	GH_STUB_PROC(glXMakeContextCurrent),
+	GH_STUB_PROC(glXSwapBuffers),
+	GH_STUB_PROC(glXSwapBuffersMscOML),
+	GH_STUB_PROC(glXGetSyncValuesOML),
+	GH_STUB_PROC(glXSwapIntervalEXT),
+	GH_STUB_PROC(glXSwapIntervalSGI),
+	GH_STUB_PROC(glXSwapIntervalMESA),
+	GH_STUB_PROC(glFlush),
+	GH_STUB_PROC(glFinish),
+	GH_STUB_PROC(glGetError),
+	GH_STUB_PROC(glGetString),
+	GH_STUB_PROC(glGetStringi),
+	GH_STUB_PROC(glGetIntegerv),
+	GH_STUB_PROC(glGetInteger64v),
+	GH_STUB_PROC(glGenQueries),
+	GH_STUB_PROC(glDeleteQueries),
+	GH_STUB_PROC(glQueryCounter),
+	GH_STUB_PROC(glGetQueryObjectui64v),
+	GH_STUB_PROC(glGetQueryObjecti64v),
+	GH_STUB_PROC(glGetQueryObjectuiv),
+	GH_STUB_PROC(glGetQueryObjectiv),
+	GH_STUB_PROC(glFenceSync),
+	GH_STUB_PROC(glDeleteSync),
+	GH_STUB_PROC(glClientWaitSync),
+	{NULL, NULL}
+};
+
+extern __GLXextFuncPtr glXGetProcAddressARB(const GLubyte *name)
+{
+	unsigned int i;
+
+	for (i=0; stub_procs[i].name; i++) {
+		if (!strcmp(stub_procs[i].name, (const char*)name)) {
+			return stub_procs[i].proc;
+		}
+	}
+	return NULL;
+}
+
+extern void (*glXGetProcAddress(const GLubyte *name))(void)
+{
+	return glXGetProcAddressARB(name);
+}
@@ -0,0 +1,78 @@
+/* A minimal stub libX11 to evaluate the X11 round trip profiling of
+ * glx_hook (GH_FRAMETIME_X11) without an X server, driven by
+ * glx_hook_bench. It is built with "make tools" next to the stub libGL.
+ *
+ * Only XSync and XGetWindowAttributes are provided. Each call simulates a
+ * round trip to the X server taking GH_STUB_X11_USECS microseconds, and
+ * is counted, so that the round trips glx_hook reports can be checked
+ * against glx_hook_stub_x11_round_trips(). Display and windows are never
+ * dereferenced. */
+
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <errno.h>
+
+#include <X11/Xlib.h>
+
+typedef struct {
+	pthread_once_t once;
+	uint64_t delay;			/* the duration of a round trip */
+	unsigned long round_trips;	/* the round trips so far */
+} GH_stub_x11;
+
+static GH_stub_x11 x11={.once=PTHREAD_ONCE_INIT};
+
+static void
+stub_x11_init(void)
+{
+	const char *s=getenv("GH_STUB_X11_USECS");
+
+	x11.delay=((s)?strtoull(s, NULL, 0):100ULL) * 1000ULL;
+}
+
+/* wait for the reply of the simulated X server */
+static void
+stub_x11_round_trip(void)
+{
+	struct timespec ts;
+
+	pthread_once(&x11.once, stub_x11_init);
+	__atomic_add_fetch(&x11.round_trips, 1, __ATOMIC_RELAXED);
+	if (x11.delay) {
+		ts.tv_sec=(time_t)(x11.delay / 1000000000ULL);
+		ts.tv_nsec=(long)(x11.delay % 1000000000ULL);
+		while (nanosleep(&ts, &ts) == -1 && errno == EINTR);
+	}
+}
+
+/* ---------- control interface for glx_hook_bench ---------- */
+
+/* the number of round trips so far */
+extern unsigned long glx_hook_stub_x11_round_trips(void)
+{
+	return __atomic_load_n(&x11.round_trips, __ATOMIC_RELAXED);
+}
+
+/* ---------- Xlib ---------- */
+
+extern int XSync(Display *dpy, Bool discard)
+{
+	(void)dpy; (void)discard;
+	stub_x11_round_trip();
+	return 1;
+}
+
+extern Status XGetWindowAttributes(Display *dpy, Window w, XWindowAttributes *attr)
+{
+	(void)dpy; (void)w;
+	stub_x11_round_trip();
+	memset(attr, 0, sizeof(*attr));
+	attr->width=1;
+	attr->height=1;
+	attr->map_state=IsViewable;
+	return 1;
+}